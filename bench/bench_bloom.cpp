@@ -0,0 +1,54 @@
+// bench_bloom.cpp
+//
+// Probe throughput of the blocked bloom filter used for import dedup.
+// Usage: bench_bloom [n=10000000] [probes=20000000]
+//
+// Fills a filter sized for n random keys, then times probes for present
+// keys and for absent ones, and reports the measured false positive rate.
+#include <chrono>
+#include <filesystem>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "bloom.h"
+
+using Clock = std::chrono::steady_clock;
+
+int main(int argc, char** argv) {
+    const size_t n = argc > 1 ? std::stoull(argv[1]) : 10000000;
+    const size_t probes = argc > 2 ? std::stoull(argv[2]) : 20000000;
+
+    const std::string path = "bench_bloom_tmp.bloom";
+    BlockedBloom f = BlockedBloom::Create(path, n);
+    std::mt19937_64 rng(1);
+    std::vector<uint64_t> keys(n);
+    for (uint64_t& k : keys) {
+        k = rng();
+        f.Add(k);
+    }
+    std::cout << "keys: " << n << ", filter: " << (n * BlockedBloom::kBitsPerKey / 8) / (1 << 20) << " MB\n";
+
+    std::vector<uint64_t> absent(probes);
+    for (uint64_t& k : absent) k = rng();
+
+    volatile size_t sink = 0;
+    auto t0 = Clock::now();
+    size_t hits = 0;
+    for (size_t i = 0; i < probes; ++i) hits += f.MayContain(keys[i % n]);
+    double s = std::chrono::duration<double>(Clock::now() - t0).count();
+    sink = sink + hits;
+    std::cout << "present: " << probes / s / 1e6 << " M probes/s (" << s * 1e9 / probes << " ns/probe)\n";
+
+    t0 = Clock::now();
+    size_t fp = 0;
+    for (uint64_t k : absent) fp += f.MayContain(k);
+    s = std::chrono::duration<double>(Clock::now() - t0).count();
+    sink = sink + fp;
+    std::cout << "absent:  " << probes / s / 1e6 << " M probes/s (" << s * 1e9 / probes
+              << " ns/probe), false positives " << static_cast<double>(fp) / probes * 100 << "%\n";
+
+    std::filesystem::remove(path);
+    return 0;
+}
@@ -0,0 +1,107 @@
+// bench_hnsw.cpp
+//
+// HNSW recall and throughput against exact brute force on synthetic data.
+// Usage: bench_hnsw [n=1000000] [dim=512] [queries=1000] [f32|f16]
+//
+// Vectors are drawn from a mixture of 256 gaussians so the data has the
+// cluster structure real embeddings have. The store is written to a
+// temporary file and read back through mmap, exactly as imgdb does.
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+#include <unistd.h>
+
+#include "distance.h"
+#include "embed.h"
+#include "hnsw.h"
+
+using Clock = std::chrono::steady_clock;
+
+static double secs_since(Clock::time_point t0) {
+    return std::chrono::duration<double>(Clock::now() - t0).count();
+}
+
+int main(int argc, char** argv) {
+    const size_t n = argc > 1 ? std::stoull(argv[1]) : 1'000'000ULL;
+    const uint32_t dim = argc > 2 ? static_cast<uint32_t>(std::stoul(argv[2])) : 512;
+    const size_t nq = argc > 3 ? std::stoull(argv[3]) : 1000;
+    const EmbedDType dtype = (argc > 4 && std::string(argv[4]) == "f16") ? EmbedDType::F16 : EmbedDType::F32;
+    const int k = 10;
+
+    std::cout << "n=" << n << " dim=" << dim << " queries=" << nq
+              << " dtype=" << (dtype == EmbedDType::F16 ? "f16" : "f32")
+              << " simd=" << (simd_distance_available() ? "avx2" : "scalar") << "\n";
+
+    const std::string path = (std::filesystem::temp_directory_path() /
+                              ("bench_hnsw." + std::to_string(::getpid()) + ".bin")).string();
+
+    std::mt19937_64 rng(1);
+    std::normal_distribution<float> gauss(0.f, 1.f);
+    const size_t n_centers = 256;
+    std::vector<float> centers(n_centers * dim);
+    for (auto& x : centers) x = gauss(rng) * 4.f;
+
+    auto sample = [&](std::vector<float>& v) {
+        const float* c = &centers[(rng() % n_centers) * dim];
+        for (uint32_t d = 0; d < dim; ++d) v[d] = c[d] + gauss(rng);
+    };
+
+    auto t0 = Clock::now();
+    {
+        EmbeddingStore w = EmbeddingStore::Create(path, dim, dtype);
+        std::vector<float> v(dim);
+        for (size_t i = 0; i < n; ++i) {
+            sample(v);
+            w.Append(static_cast<uint32_t>(i), v.data());
+        }
+    }
+    EmbeddingStore store = EmbeddingStore::Open(path);
+    std::cout << "store: wrote and mapped " << n << " rows in " << secs_since(t0) << " s\n";
+
+    t0 = Clock::now();
+    Hnsw index(&store);
+    for (size_t i = 0; i < n; ++i) index.Add(static_cast<uint32_t>(i));
+    const double build_s = secs_since(t0);
+    std::cout << "hnsw: built in " << build_s << " s (" << n / build_s << " inserts/s)\n";
+
+    std::vector<std::vector<float>> queries(nq, std::vector<float>(dim));
+    for (auto& q : queries) sample(q);
+
+    // Exact top-k with the same SIMD kernel.
+    std::vector<std::vector<uint32_t>> truth(nq);
+    t0 = Clock::now();
+    for (size_t qi = 0; qi < nq; ++qi) {
+        std::vector<std::pair<float, uint32_t>> all(n);
+        for (size_t i = 0; i < n; ++i) all[i] = {store.Distance(queries[qi].data(), i), static_cast<uint32_t>(i)};
+        std::partial_sort(all.begin(), all.begin() + k, all.end());
+        for (int j = 0; j < k; ++j) truth[qi].push_back(all[j].second);
+    }
+    const double brute_s = secs_since(t0);
+    std::cout << "brute force: " << nq / brute_s << " QPS\n\n";
+
+    std::cout << "ef\trecall@10\tQPS\tspeedup\n";
+    for (int ef : {10, 16, 32, 64, 128, 256}) {
+        size_t found = 0;
+        t0 = Clock::now();
+        std::vector<std::vector<Hnsw::Hit>> results(nq);
+        for (size_t qi = 0; qi < nq; ++qi) results[qi] = index.Search(queries[qi].data(), k, ef);
+        const double s = secs_since(t0);
+
+        for (size_t qi = 0; qi < nq; ++qi) {
+            for (const auto& hit : results[qi]) {
+                found += std::count(truth[qi].begin(), truth[qi].end(), hit.second);
+            }
+        }
+        std::cout << ef << "\t" << static_cast<double>(found) / (nq * k) << "\t\t"
+                  << nq / s << "\t" << (nq / s) / (nq / brute_s) << "x\n";
+    }
+
+    std::remove(path.c_str());
+    std::remove((path + ".ords").c_str());
+    return 0;
+}
@@ -0,0 +1,158 @@
+// bench_import.cpp
+//
+// The file work of an import (read and hash, blob write, decode and
+// thumbnail, thumbnail write), done for a batch of images two ways: one
+// thread per import with blocking I/O, and coroutines on a few IoExecutor
+// threads with every import in flight. The catalog steps are left out;
+// they run one at a time either way.
+// Usage: bench_import [files=200] [threads=4] [in_flight=256] [side=800]
+//
+// Source images are generated as JPEGs under bench_import_tmp/. Reads hit
+// the page cache after the first round, so this measures scheduling cost
+// and thread count more than disk waits; on cold or networked storage the
+// threads mode also pays a blocked thread per outstanding read.
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "coro.h"
+#include "image.h"
+#include "sha256.h"
+#include "stb_image_write.h"
+
+using Clock = std::chrono::steady_clock;
+
+namespace {
+
+std::string hash_of(const std::string& bytes) {
+    Sha256Ctx ctx;
+    sha256_init(ctx);
+    sha256_update(ctx, reinterpret_cast<const uint8_t*>(bytes.data()), bytes.size());
+    uint8_t digest[32];
+    sha256_final(ctx, digest);
+    return sha256_hex(digest);
+}
+
+bool write_file(const std::string& path, const std::string& bytes) {
+    const std::string tmp = path + ".tmp";
+    {
+        std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+        if (!out.write(bytes.data(), static_cast<std::streamsize>(bytes.size()))) return false;
+    }
+    std::error_code ec;
+    std::filesystem::rename(tmp, path, ec);
+    return !ec;
+}
+
+bool import_blocking(const std::string& src, const std::string& out_dir) {
+    std::ifstream in(src, std::ios::binary);
+    const std::string bytes((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    const std::string hash = hash_of(bytes);
+    if (!write_file(out_dir + "/" + hash, bytes)) return false;
+    std::string png;
+    ImgDims dims;
+    ImgSignature sig;
+    if (!thumbnail_256_from_memory(bytes, &png, &dims, &sig)) return false;
+    return write_file(out_dir + "/" + hash + "_256.png", png);
+}
+
+Task<bool> import_coro(IoExecutor& io, const std::string& src, const std::string& out_dir) {
+    std::string bytes;
+    if (!co_await ReadFile(io, src, &bytes)) co_return false;
+    const std::string hash = hash_of(bytes);
+    if (!co_await WriteFileAtomic(io, out_dir + "/" + hash, bytes)) co_return false;
+    std::string png;
+    ImgDims dims;
+    ImgSignature sig;
+    if (!thumbnail_256_from_memory(bytes, &png, &dims, &sig)) co_return false;
+    co_return co_await WriteFileAtomic(io, out_dir + "/" + hash + "_256.png", png);
+}
+
+Task<void> lane(IoExecutor& io, const std::vector<std::string>& files, std::atomic<size_t>& next,
+                std::atomic<size_t>& ok, std::string out_dir) {
+    for (size_t i; (i = next.fetch_add(1)) < files.size();) {
+        if (co_await import_coro(io, files[i], out_dir)) ok.fetch_add(1);
+    }
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    namespace fs = std::filesystem;
+    const size_t n = argc > 1 ? std::stoull(argv[1]) : 200;
+    const int threads = argc > 2 ? std::stoi(argv[2]) : 4;
+    const size_t in_flight = argc > 3 ? std::stoull(argv[3]) : 256;
+    const int side = argc > 4 ? std::stoi(argv[4]) : 800;
+
+    const std::string root = "bench_import_tmp";
+    fs::remove_all(root);
+    fs::create_directories(root + "/src");
+    std::vector<std::string> files;
+    std::vector<unsigned char> pixels(static_cast<size_t>(side) * side * 3 / 4 * 3);
+    for (size_t f = 0; f < n; ++f) {
+        const int w = side, h = side * 3 / 4;
+        for (int y = 0; y < h; ++y) {
+            for (int x = 0; x < w; ++x) {
+                unsigned char* p = &pixels[(static_cast<size_t>(y) * w + x) * 3];
+                p[0] = static_cast<unsigned char>(x + f * 7);
+                p[1] = static_cast<unsigned char>(y * 2 + f);
+                p[2] = static_cast<unsigned char>((x ^ y) + f * 13);
+            }
+        }
+        files.push_back(root + "/src/" + std::to_string(f) + ".jpg");
+        stbi_write_jpg(files.back().c_str(), w, h, 3, pixels.data(), 90);
+    }
+
+    for (int round = 0; round < 2; ++round) {
+        // One thread per import.
+        fs::remove_all(root + "/t");
+        fs::create_directories(root + "/t");
+        std::atomic<size_t> ok{0};
+        auto start = Clock::now();
+        {
+            std::vector<std::thread> workers;
+            workers.reserve(files.size());
+            for (const std::string& f : files) {
+                workers.emplace_back([&, f] {
+                    if (import_blocking(f, root + "/t")) ok.fetch_add(1);
+                });
+            }
+            for (std::thread& w : workers) w.join();
+        }
+        const double t_threads = std::chrono::duration<double>(Clock::now() - start).count();
+        const size_t ok_threads = ok.load();
+
+        // Coroutines.
+        fs::remove_all(root + "/c");
+        fs::create_directories(root + "/c");
+        ok = 0;
+        bool uring;
+        start = Clock::now();
+        {
+            IoExecutor io(threads);
+            uring = io.uses_io_uring();
+            std::atomic<size_t> next{0};
+            const size_t lanes = std::min(in_flight, files.size());
+            for (size_t i = 0; i < lanes; ++i) io.Spawn(lane(io, files, next, ok, root + "/c"));
+            io.Wait();
+        }
+        const double t_coro = std::chrono::duration<double>(Clock::now() - start).count();
+
+        std::cout << (round == 0 ? "cold run" : "warm run") << ": " << n << " images " << side << "x" << side * 3 / 4
+                  << "\n"
+                  << "  thread per import: " << files.size() << " threads, " << t_threads << " s, "
+                  << static_cast<uint64_t>(ok_threads / t_threads) << " imports/s\n"
+                  << "  coroutines:        " << threads << " threads + " << (uring ? "io_uring" : "blocking I/O pool")
+                  << ", " << std::min(in_flight, files.size()) << " in flight, " << t_coro << " s, "
+                  << static_cast<uint64_t>(ok.load() / t_coro) << " imports/s\n";
+    }
+    fs::remove_all(root);
+    return 0;
+}
@@ -0,0 +1,71 @@
+// bench_mih.cpp
+//
+// Near-duplicate lookup over a synthetic set of 64-bit hashes.
+// Usage: bench_mih [n_hashes=10000000] [n_queries=1000]
+//
+// Half of the queries are perturbed copies of stored hashes (true
+// near-duplicates), half are random. Reports build time and mean query time
+// for multi-index hashing against a popcount linear scan.
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "mih.h"
+
+using Clock = std::chrono::steady_clock;
+
+static double ms_since(Clock::time_point t0) {
+    return std::chrono::duration<double, std::milli>(Clock::now() - t0).count();
+}
+
+int main(int argc, char** argv) {
+    const size_t n = argc > 1 ? std::stoull(argv[1]) : 10'000'000ULL;
+    const size_t nq = argc > 2 ? std::stoull(argv[2]) : 1000;
+
+    std::mt19937_64 rng(42);
+    std::vector<uint64_t> hashes(n);
+    for (auto& h : hashes) h = rng();
+
+    std::vector<uint64_t> queries(nq);
+    for (size_t i = 0; i < nq; ++i) {
+        if (i % 2 == 0) {
+            uint64_t h = hashes[rng() % n];
+            for (int b = 0; b < 4; ++b) h ^= 1ULL << (rng() % 64);
+            queries[i] = h;
+        } else {
+            queries[i] = rng();
+        }
+    }
+
+    auto t0 = Clock::now();
+    MultiIndexHash index(hashes);
+    std::cout << "build: " << n << " hashes in " << ms_since(t0) << " ms\n";
+
+    // Linear scan is slow at 10M; sample a few queries for the baseline.
+    const size_t n_linear = std::min<size_t>(nq, 20);
+
+    std::cout << "radius  mih_ms/query  linear_ms/query  avg_hits\n";
+    for (int radius : {0, 4, 8, 12, 16}) {
+        size_t hits = 0;
+        t0 = Clock::now();
+        for (uint64_t q : queries) hits += index.Query(q, radius).size();
+        const double mih_ms = ms_since(t0) / nq;
+
+        t0 = Clock::now();
+        for (size_t i = 0; i < n_linear; ++i) {
+            if (index.LinearScan(queries[i], radius) != index.Query(queries[i], radius)) {
+                std::cerr << "mismatch at radius " << radius << "\n";
+                return 1;
+            }
+        }
+        const double lin_ms = ms_since(t0) / n_linear;
+
+        std::cout << radius << "\t" << mih_ms << "\t" << lin_ms << "\t"
+                  << static_cast<double>(hits) / nq << "\n";
+    }
+    return 0;
+}
@@ -0,0 +1,54 @@
+// bench_roaring.cpp
+//
+// Boolean tag queries over roaring posting lists.
+// Usage: bench_roaring [n=10000000] [reps=50]
+//
+// Builds four tags over n image ordinals with densities 50%, 10%, 1% and
+// 0.01%, then times And/Or/AndNot between them and a universe complement.
+#include <chrono>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "roaring.h"
+
+using Clock = std::chrono::steady_clock;
+
+int main(int argc, char** argv) {
+    const uint32_t n = argc > 1 ? static_cast<uint32_t>(std::stoul(argv[1])) : 10'000'000u;
+    const int reps = argc > 2 ? std::stoi(argv[2]) : 50;
+
+    const double density[] = {0.5, 0.1, 0.01, 0.0001};
+    const char* names[] = {"50%", "10%", "1%", "0.01%"};
+    std::vector<RoaringBitmap> tags(4);
+    std::mt19937_64 rng(1);
+    for (int t = 0; t < 4; ++t) {
+        const uint64_t threshold = static_cast<uint64_t>(density[t] * static_cast<double>(UINT64_MAX));
+        for (uint32_t i = 0; i < n; ++i) {
+            if (rng() < threshold) tags[t].Add(i);
+        }
+        std::cout << "tag " << names[t] << ": " << tags[t].Cardinality() << " images, "
+                  << tags[t].SizeInBytes() / 1024 << " KB\n";
+    }
+
+    volatile uint64_t sink = 0;
+    auto time_op = [&](const std::string& label, auto op) {
+        const auto t0 = Clock::now();
+        for (int r = 0; r < reps; ++r) sink = sink + op().Cardinality();
+        const double us = std::chrono::duration<double, std::micro>(Clock::now() - t0).count() / reps;
+        std::cout << label << ": " << us << " us\n";
+    };
+
+    for (int a = 0; a < 4; ++a) {
+        for (int b = a + 1; b < 4; ++b) {
+            const std::string pair = std::string(names[a]) + " , " + names[b];
+            time_op("AND    " + pair, [&] { return RoaringBitmap::And(tags[a], tags[b]); });
+            time_op("OR     " + pair, [&] { return RoaringBitmap::Or(tags[a], tags[b]); });
+            time_op("ANDNOT " + pair, [&] { return RoaringBitmap::AndNot(tags[a], tags[b]); });
+        }
+    }
+    const RoaringBitmap universe = RoaringBitmap::Range(0, n);
+    time_op("NOT 10%", [&] { return RoaringBitmap::AndNot(universe, tags[1]); });
+    return 0;
+}
@@ -0,0 +1,142 @@
+// bench_server.cpp
+//
+// Load generator for the HTTP server: keep-alive connections each send
+// `pipeline` requests back to back, read the responses, and repeat.
+// Usage: bench_server [connections=32] [pipeline=1] [seconds=5] [port=0] [path=/]
+//
+// With port 0 it starts an in-process server whose handler returns a
+// small fixed body, which measures the event loop and worker hand-off;
+// otherwise it targets 127.0.0.1:port (e.g. `imgdb -cmd serve`). Reports
+// throughput and p50/p99/max latency per request.
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "http.h"
+
+using Clock = std::chrono::steady_clock;
+
+namespace {
+
+int connect_to(uint16_t port) {
+    const int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    const int one = 1;
+    ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof one);
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    ::inet_pton(AF_INET, "127.0.0.1", &addr.sin_addr);
+    if (::connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof addr) != 0) {
+        ::close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// Reads one response from `fd` (buffered in `in`); false on EOF or a
+// malformed response.
+bool read_response(int fd, std::string& in) {
+    for (;;) {
+        const size_t end = in.find("\r\n\r\n");
+        if (end != std::string::npos) {
+            size_t length = 0;
+            const size_t cl = in.find("Content-Length: ");
+            if (cl != std::string::npos && cl < end) length = std::stoull(in.substr(cl + 16));
+            if (in.size() >= end + 4 + length) {
+                in.erase(0, end + 4 + length);
+                return true;
+            }
+        }
+        char buf[64 << 10];
+        const ssize_t n = ::recv(fd, buf, sizeof buf, 0);
+        if (n <= 0) return false;
+        in.append(buf, static_cast<size_t>(n));
+    }
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    const int connections = argc > 1 ? std::stoi(argv[1]) : 32;
+    const int pipeline = argc > 2 ? std::stoi(argv[2]) : 1;
+    const double seconds = argc > 3 ? std::stod(argv[3]) : 5;
+    uint16_t port = argc > 4 ? static_cast<uint16_t>(std::stoul(argv[4])) : 0;
+    const std::string path = argc > 5 ? argv[5] : "/";
+
+    std::optional<HttpServer> server;
+    std::thread loop;
+    if (port == 0) {
+        HttpServerOptions opts;
+        opts.port = 0;
+        server.emplace(HttpServer::Listen(opts, [](const HttpRequest&) { return HttpResponse::Text(200, "ok\n"); }));
+        port = server->port();
+        loop = std::thread([&] { server->Run(); });
+    }
+
+    const std::string request = "GET " + path + " HTTP/1.1\r\nHost: bench\r\n\r\n";
+    std::string batch;
+    for (int i = 0; i < pipeline; ++i) batch += request;
+
+    std::atomic<bool> failed{false};
+    std::vector<std::vector<double>> latencies(connections);
+    const auto start = Clock::now();
+    const auto deadline = start + std::chrono::duration<double>(seconds);
+    std::vector<std::thread> clients;
+    for (int c = 0; c < connections; ++c) {
+        clients.emplace_back([&, c] {
+            const int fd = connect_to(port);
+            if (fd < 0) {
+                failed = true;
+                return;
+            }
+            std::string in;
+            while (Clock::now() < deadline && !failed) {
+                const auto sent = Clock::now();
+                if (::send(fd, batch.data(), batch.size(), MSG_NOSIGNAL) != static_cast<ssize_t>(batch.size())) {
+                    failed = true;
+                    break;
+                }
+                for (int i = 0; i < pipeline; ++i) {
+                    if (!read_response(fd, in)) {
+                        failed = true;
+                        break;
+                    }
+                    latencies[c].push_back(std::chrono::duration<double, std::micro>(Clock::now() - sent).count());
+                }
+            }
+            ::close(fd);
+        });
+    }
+    for (std::thread& t : clients) t.join();
+    const double elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+    if (server) {
+        server->Stop();
+        loop.join();
+    }
+    if (failed) {
+        std::cerr << "a connection failed\n";
+        return 1;
+    }
+
+    std::vector<double> all;
+    for (const auto& l : latencies) all.insert(all.end(), l.begin(), l.end());
+    if (all.empty()) return 1;
+    std::sort(all.begin(), all.end());
+    auto pct = [&](double p) { return all[std::min(all.size() - 1, static_cast<size_t>(p * all.size()))]; };
+    std::cout << connections << " connections x " << pipeline << " pipelined, " << path << ": " << all.size()
+              << " requests in " << elapsed << " s (" << static_cast<uint64_t>(all.size() / elapsed) << " req/s)\n"
+              << "latency us: p50 " << pct(0.50) << "  p99 " << pct(0.99) << "  max " << all.back() << "\n";
+    return 0;
+}
@@ -0,0 +1,123 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <unordered_map>
+
+#include "cache.h"
+#include "db.h"
+#include "diskcache.h"
+#include "http.h"
+
+// HTTP routes of `imgdb -cmd serve` over one open ImageDB:
+//
+//   POST   /images               body: image bytes -> 201 {"image_id": ...},
+//                                409 if the content is already stored
+//   POST   /images?async=1       body: image bytes -> 202 {"job_id": ...},
+//                                429 with Retry-After while the queue is full
+//   GET    /jobs/<id>            {"job_id", "state": queued|running|done|
+//                                duplicate|failed, "image_id"}
+//   GET    /images/<id>          catalog record as JSON
+//   DELETE /images/<id>          204
+//   GET    /images/<id>/blob     original bytes
+//   GET    /images/<id>/thumbnail
+//   GET    /img/<id>?w=&h=&fit=cover|contain&fmt=jpg|png
+//                                rendition resized on demand
+//   GET    /query?q=<sql>        RunQuery output (POST /query: sql as body)
+//   GET    /stats                cache, import queue and task pool counters as JSON
+//
+// Thumbnails are served from a TinyLfuCache of their encoded bytes; a hit
+// touches neither the DB nor the filesystem.
+// Renditions are resized from the 256px thumbnail when it has enough
+// pixels, else from the blob, and kept in a DiskCache under
+// db_root/variants keyed by blob sha256 and parameters, so images with the
+// same content share them. Concurrent requests for the same rendition
+// wait for one render instead of each doing it.
+// Uploads are written to db_root/tmp as they arrive and hashed in the
+// same pass (see Admit). An async upload takes its queue slot as soon as
+// its headers arrive, and a full queue answers 429 before the body is
+// read; one importer thread runs the rest of ImportFile (decode,
+// thumbnail, catalog) for queued jobs in order. The queue is bounded, so a
+// burst of uploads is pushed back to the clients instead of piling up on
+// disk or in memory. Job states are kept in memory for the
+// last kJobHistory finished jobs.
+// Blobs and thumbnails are sent straight from their files and honour a
+// single-range Range header. Handlers call into the shared ImageDB
+// directly: lookups and queries read its published snapshot without
+// waiting, and imports and deletes queue on its commit lock.
+struct ApiOptions {
+    size_t thumb_cache_bytes = 256 << 20;
+    uint64_t variant_cache_bytes = uint64_t{1} << 30;
+    size_t import_queue = 64;          // async imports waiting at once
+};
+
+class ImageApi {
+public:
+    static constexpr size_t kJobHistory = 4096;
+
+    // Throws std::runtime_error if the variants directory is unusable.
+    ImageApi(ImageDB& db, const ApiOptions& opts);
+    // Finishes the queued imports first.
+    ~ImageApi();
+    ImageApi(const ImageApi&) = delete;
+    ImageApi& operator=(const ImageApi&) = delete;
+
+    HttpResponse Handle(const HttpRequest& req);
+    // HttpServer::HeadHandler for these routes: turns an async upload away
+    // with 429 while the queue is full, before its body is read, and has
+    // the body of an accepted one streamed to its staging file.
+    std::optional<HttpResponse> Admit(const HttpRequest& req, std::shared_ptr<HttpBodySink>* sink);
+
+private:
+    enum class JobState { Queued, Running, Done, Duplicate, Failed };
+    struct ImportJob {
+        std::string id;
+        std::string staged;   // upload file under db_root/tmp
+        std::string sha256;
+    };
+    struct JobStatus {
+        JobState state = JobState::Queued;
+        std::string image_id;
+    };
+
+    class Upload;
+
+    // A new upload to POST /images, holding a queue slot if it is async;
+    // null with the response to send (429, 500) if it cannot be taken.
+    std::shared_ptr<Upload> StartUpload(const HttpRequest& req, HttpResponse* refused);
+    HttpResponse Import(const HttpRequest& req);
+    HttpResponse ImportAsync(Upload& up, const std::string& sha256);
+    HttpResponse Job(const std::string& id);
+    void RunImports();
+    HttpResponse Query(const HttpRequest& req);
+    HttpResponse Image(const HttpRequest& req, const std::string& id, const std::string& part);
+    HttpResponse Thumbnail(const HttpRequest& req, const std::string& id);
+    HttpResponse Resized(const HttpRequest& req, const std::string& id);
+    HttpResponse Stats() const;
+
+    ImageDB& db_;
+    TinyLfuCache thumbs_;
+    DiskCache variants_;
+    std::mutex flights_mu_;
+    std::unordered_map<std::string, std::shared_future<TinyLfuCache::Value>> flights_;   // renders in progress
+    std::atomic<uint64_t> coalesced_{0};
+    std::atomic<uint64_t> uploads_{0};
+
+    const size_t queue_cap_;
+    mutable std::mutex jobs_mu_;
+    std::condition_variable jobs_cv_;
+    std::deque<ImportJob> queue_;
+    size_t reserved_ = 0;                  // slots held by uploads being staged
+    std::unordered_map<std::string, JobStatus> jobs_;
+    std::deque<std::string> finished_;     // oldest first
+    uint64_t next_job_ = 0;
+    bool stopping_ = false;
+    std::thread importer_;                 // last: started once the rest exists
+};
@@ -0,0 +1,132 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// Fixed-size page cache over one file. Pages are pinned while in use and
+// evicted by the clock algorithm; dirty pages are written back on eviction
+// or Flush().
+class BufferPool {
+public:
+    static constexpr size_t kPageSize = 4096;
+
+    BufferPool(int fd, size_t frames, uint32_t page_count);
+
+    // Pins page `id`, reading it on a miss. nullptr on I/O errors or when
+    // every frame is pinned.
+    unsigned char* Pin(uint32_t id);
+    // Pins a zeroed page appended to the file; its id goes to `*id`.
+    unsigned char* PinNew(uint32_t* id);
+    void Unpin(uint32_t id, bool dirty);
+
+    bool Flush();
+
+    uint32_t page_count() const { return page_count_; }
+    uint64_t hits() const { return hits_; }
+    uint64_t misses() const { return misses_; }
+
+private:
+    struct Frame {
+        uint32_t page = UINT32_MAX;
+        int pins = 0;
+        bool dirty = false;
+        bool ref = false;
+    };
+
+    Frame* Victim();
+    bool WriteBack(Frame& f);
+    unsigned char* Data(const Frame& f) { return &bytes_[static_cast<size_t>(&f - frames_.data()) * kPageSize]; }
+
+    int fd_;
+    uint32_t page_count_;
+    std::vector<Frame> frames_;
+    std::vector<unsigned char> bytes_;
+    std::unordered_map<uint32_t, size_t> table_;   // page id -> frame
+    size_t hand_ = 0;
+    uint64_t hits_ = 0, misses_ = 0;
+};
+
+// On-disk B+tree of (u64 key, u32 ordinal) entries, used as a secondary
+// index from a numeric catalog field to image ordinals. Entries are unique
+// as pairs, so equal keys are fine.
+//
+// File layout, 4 KB pages:
+//   page 0     [magic "IMGBT001"][root u32][height u32][pages u32][dirty u32]
+//              [entries u64][synced rows u64]
+//   leaf       [1 u16][count u16][next leaf u32] then count x (key u64, ordinal u32)
+//   internal   [0 u16][count u16][pad u32][child0 u32] then count x
+//              (key u64, ordinal u32, child u32); child i+1 holds entries >= key i
+//
+// Inserts update pages through the buffer pool and set the dirty flag
+// first; Flush() writes the pages, syncs, then clears it. A tree found
+// dirty (a crash mid-update) does not open and is rebuilt by BulkLoad.
+//
+// Updates happen in place, so readers and an update exclude each other
+// with flock(2): OpenReadOnly() holds a shared lock for as long as the
+// tree is open, and the first Insert() after a Flush() takes an exclusive
+// one, which Flush() drops. Neither side waits for the other.
+class BTree {
+public:
+    using Entry = std::pair<uint64_t, uint32_t>;   // (key, ordinal)
+
+    static constexpr size_t kLeafCap = (BufferPool::kPageSize - 8) / 12;
+    static constexpr size_t kInnerCap = (BufferPool::kPageSize - 12) / 16;
+    static constexpr size_t kPoolFrames = 256;
+
+    // nullopt when the file is missing, not a tree, or dirty.
+    static std::optional<BTree> Open(const std::string& path);
+    // Open() for queries, which hold no lock: also nullopt while an update
+    // is in progress. Insert() fails.
+    static std::optional<BTree> OpenReadOnly(const std::string& path);
+
+    // Writes a tree holding `entries` (sorted ascending, unique) bottom-up:
+    // leaves are packed to kBulkFill, then each internal level is built
+    // over the one below. Goes through a temp file and rename.
+    static bool BulkLoad(const std::string& path, const std::vector<Entry>& entries, uint64_t synced_rows);
+    static constexpr double kBulkFill = 0.9;   // leaves keep room for in-order inserts
+
+    ~BTree();
+    BTree(BTree&& o) noexcept;
+    BTree& operator=(BTree&& o) noexcept;
+    BTree(const BTree&) = delete;
+    BTree& operator=(const BTree&) = delete;
+
+    // Adds (key, ordinal); false while a reader has the tree open, and
+    // (with a message) on I/O errors. An entry already present is left
+    // alone.
+    bool Insert(uint64_t key, uint32_t ordinal);
+    // Catalog rows the tree reflects, kept for the caller's catch-up.
+    void set_synced_rows(uint64_t rows) { synced_rows_ = rows; }
+    bool Flush();
+
+    // Ordinals with lo <= key <= hi, in key order. `pages`, if given,
+    // receives how many pages the search touched: height + leaves scanned.
+    std::vector<uint32_t> Range(uint64_t lo, uint64_t hi, size_t* pages = nullptr) const;
+
+    // Rough entry count in [lo, hi] from the separators on the way down;
+    // touches at most height() pages.
+    uint64_t Estimate(uint64_t lo, uint64_t hi) const;
+
+    uint64_t size() const { return entries_; }
+    uint32_t height() const { return height_; }
+    uint32_t page_count() const { return pool_.page_count(); }
+    uint64_t synced_rows() const { return synced_rows_; }
+
+private:
+    BTree(int fd, uint32_t pages);
+    static std::optional<BTree> Open(const std::string& path, bool writable);
+    bool WriteMeta(bool dirty);
+    bool InsertInto(uint32_t page, uint32_t depth, const Entry& e, bool* inserted, Entry* up_key, uint32_t* up_page);
+
+    std::string path_;
+    int fd_ = -1;
+    uint32_t root_ = 0, height_ = 0;
+    uint64_t entries_ = 0, synced_rows_ = 0;
+    bool dirty_ = false;
+    bool writable_ = true;
+    mutable BufferPool pool_;
+};
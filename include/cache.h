@@ -0,0 +1,50 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+// In-memory cache of byte strings under a total byte budget, split over
+// lock-striped shards. Each shard runs W-TinyLFU: new entries enter a
+// small LRU window (1% of the bytes); the window's victims are admitted to
+// the main segmented LRU (probation, then protected on a second hit) only
+// if a count-min sketch says they are requested more often than the main
+// victim they would displace. A one-off scan therefore cannot flush the
+// popular entries.
+class TinyLfuCache {
+public:
+    using Value = std::shared_ptr<const std::string>;
+
+    struct Stats {
+        uint64_t hits = 0;
+        uint64_t misses = 0;
+        uint64_t evictions = 0;    // entries dropped to make room
+        uint64_t rejections = 0;   // candidates the admission policy turned away
+        uint64_t entries = 0;
+        uint64_t bytes = 0;
+    };
+
+    explicit TinyLfuCache(size_t budget_bytes, size_t shards = 16);
+    ~TinyLfuCache();
+    TinyLfuCache(const TinyLfuCache&) = delete;
+    TinyLfuCache& operator=(const TinyLfuCache&) = delete;
+
+    // nullptr on a miss. Every lookup counts towards the key's frequency.
+    Value Get(const std::string& key);
+    // Inserts or replaces. Values larger than an eighth of a shard's
+    // budget are not cached.
+    void Put(const std::string& key, Value value);
+    void Erase(const std::string& key);
+
+    Stats stats() const;
+    size_t budget() const { return budget_; }
+
+private:
+    struct Shard;
+
+    Shard& shard_of(uint64_t h) const;
+
+    size_t budget_;
+    std::vector<std::unique_ptr<Shard>> shards_;
+};
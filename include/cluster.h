@@ -0,0 +1,86 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <optional>
+#include <string>
+#include <vector>
+
+// Which stored per-image vector a cluster model groups images by.
+enum class ClusterFeature : uint32_t {
+    PHash = 0,       // 64 pHash bits as 0/1 floats: squared L2 = hamming distance
+    Color = 1,       // colour histogram scaled to sum to 1
+    Embedding = 2,   // embedding store rows (or PQ reconstructions)
+};
+
+const char* cluster_feature_name(ClusterFeature f);
+bool parse_cluster_feature(const std::string& name, ClusterFeature* out);
+
+// Feature vectors for the catalog-derived features (64 floats each).
+void phash_vector(uint64_t phash, float* out);
+void color_vector(const uint16_t* hist, float* out);
+
+// k centroids plus how many points each has absorbed. Training runs
+// mini-batch k-means; afterwards Update() folds single new points in with
+// the same 1/count step, so imports never trigger a recompute.
+//
+// File layout: [magic "IMGKM001"][feature u32][dim u32][k u32][pad u32]
+//              [counts: k x u64][centroids: k x dim f32]
+class ClusterModel {
+public:
+    static ClusterModel Train(ClusterFeature feature, const float* data, size_t n, uint32_t dim,
+                              int k, size_t batch, int iters, uint64_t seed = 1);
+
+    // Nearest centroid to `v`.
+    uint32_t Assign(const float* v) const;
+
+    // Assigns `v` and moves that centroid towards it. When the model was
+    // loaded from disk the centroid row and its count are written back in
+    // place; no other part of the file changes.
+    uint32_t Update(const float* v);
+
+    // Writes the whole model (temp file + rename). Loaded models then
+    // persist Update() against this path.
+    bool Save(const std::string& path);
+    static std::optional<ClusterModel> Load(const std::string& path);
+
+    ClusterFeature feature() const { return feature_; }
+    uint32_t dim() const { return dim_; }
+    int k() const { return static_cast<int>(counts_.size()); }
+    uint64_t count(uint32_t c) const { return counts_[c]; }
+    const float* centroid(uint32_t c) const { return &centroids_[static_cast<size_t>(c) * dim_]; }
+
+private:
+    ClusterFeature feature_ = ClusterFeature::PHash;
+    uint32_t dim_ = 0;
+    std::vector<uint64_t> counts_;
+    std::vector<float> centroids_;
+    std::string path_;
+    std::fstream file_;
+};
+
+// Cluster id of every clustered image, next to the catalog:
+//   <dir>/clusters.assign  n x u32 cluster ids
+//   <dir>/clusters.ords    n x u32 image ordinals; written last, so its
+//                          entry count is the commit point for a row.
+class ClusterAssignments {
+public:
+    // Opens (creating empty files if needed). Throws std::runtime_error.
+    static ClusterAssignments Open(const std::string& dir);
+
+    // Replaces both files with the given rows (temp files + rename).
+    static bool Rewrite(const std::string& dir, const std::vector<uint32_t>& ords,
+                        const std::vector<uint32_t>& clusters);
+
+    bool Append(uint32_t ordinal, uint32_t cluster);
+
+    size_t size() const { return ords_.size(); }
+    uint32_t ordinal(size_t row) const { return ords_[row]; }
+    uint32_t cluster(size_t row) const { return clusters_[row]; }
+
+private:
+    std::string dir_;
+    std::vector<uint32_t> clusters_;
+    std::vector<uint32_t> ords_;
+    std::fstream assign_out_, ords_out_;
+};
@@ -0,0 +1,95 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Quantized HSV colour histogram: 12 hues x {low,high saturation} x
+// {low,high value} = 48 chromatic bins, plus 16 gray levels for pixels with
+// too little saturation to have a meaningful hue.
+constexpr int kColorBins = 64;
+
+// Histograms are normalized so the bins sum to this value; it fits int16,
+// which lets the SIMD kernel sum with a signed multiply-add.
+constexpr uint16_t kHistTotal = 32767;
+
+struct DominantColor {
+    uint8_t r = 0, g = 0, b = 0;
+    uint8_t share = 0;   // fraction of pixels in this colour's bin, 0-255
+};
+
+struct ColorFeatures {
+    uint16_t hist[kColorBins] = {};
+    DominantColor dominant[3];
+};
+
+// Bin of one RGB pixel.
+int color_bin(uint8_t r, uint8_t g, uint8_t b);
+
+// Histogram and top-3 dominant colours (mean RGB of the three fullest bins)
+// of interleaved 8-bit pixels. Meant for the already-resized thumbnail.
+bool color_features(const unsigned char* pixels, int w, int h, int channels, ColorFeatures* out);
+
+// Query histogram with all mass in the bin of a single colour.
+void single_color_hist(uint8_t r, uint8_t g, uint8_t b, uint16_t out[kColorBins]);
+
+// Indicator histogram over every chromatic bin whose hue centre lies in
+// [lo, hi] degrees (wrapping when lo > hi). Intersecting an image's
+// histogram with it yields the image's mass inside that hue range.
+void hue_range_mask(float lo_deg, float hi_deg, uint16_t out[kColorBins]);
+
+// sum_i min(a[i], b[i]); kHistTotal means identical histograms.
+uint32_t hist_intersection(const uint16_t* a, const uint16_t* b);
+
+// hist_intersection of `query` against `n` rows stored back to back.
+// AVX2 path: 16 bins per min/madd, four per row.
+void hist_intersection_batch(const uint16_t* query, const uint16_t* rows, size_t n, uint32_t* out);
+
+// Columnar colour sidecar next to the catalog:
+//   <dir>/color.hist  n x 128 bytes (the histograms)
+//   <dir>/color.dom   n x 12 bytes  (three DominantColor)
+//   <dir>/color.ords  image ordinal of row i as u32; written last, so its
+//                     entry count is the commit point for a row.
+// Scoring queries only read color.hist.
+//
+// The files are memory-mapped read-only, so opening costs the same at any
+// size; appends go through the file descriptors and become visible to
+// readers after Refresh().
+class ColorStore {
+public:
+    // Opens (creating empty column files if needed). Throws std::runtime_error.
+    static ColorStore Open(const std::string& dir);
+    // Opens for queries, which hold no lock: creates nothing (missing
+    // files read as no rows) and Append() fails.
+    static ColorStore OpenReadOnly(const std::string& dir);
+
+    ~ColorStore();
+    ColorStore(ColorStore&& o) noexcept;
+    ColorStore& operator=(ColorStore&& o) noexcept;
+    ColorStore(const ColorStore&) = delete;
+    ColorStore& operator=(const ColorStore&) = delete;
+
+    bool Append(uint32_t ordinal, const ColorFeatures& f);
+    // Makes appended rows visible.
+    bool Refresh();
+
+    size_t size() const { return count_; }
+    uint32_t ordinal(size_t row) const { return ords_[row]; }
+    const uint16_t* hist(size_t row) const { return &hist_[row * kColorBins]; }
+    const uint16_t* hists() const { return hist_; }
+    const DominantColor* dominant(size_t row) const { return &dom_[row * 3]; }
+
+private:
+    ColorStore() = default;
+    static ColorStore Open(const std::string& dir, bool writable);
+    bool Map();
+    void Unmap();
+
+    std::string dir_;
+    int fd_[3] = {-1, -1, -1};   // hist, dom, ords
+    size_t rows_ = 0;            // appended
+    size_t count_ = 0;           // mapped
+    const uint16_t* hist_ = nullptr;
+    const DominantColor* dom_ = nullptr;
+    const uint32_t* ords_ = nullptr;
+};
@@ -0,0 +1,93 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "meta.h"
+
+// Numeric catalog fields projected into their own arrays.
+enum class NumColumn : uint8_t { Width = 0, Height = 1, Bytes = 2, CreatedAt = 3 };
+constexpr int kNumColumns = 4;
+
+// Closed range predicate lo <= column <= hi.
+struct ColumnRange {
+    NumColumn column;
+    uint64_t lo, hi;
+};
+
+struct ScanStats {
+    size_t blocks = 0;    // blocks in the store
+    size_t skipped = 0;   // ruled out by a zone map
+    size_t whole = 0;     // zone maps prove every row matches
+};
+
+// Columnar projection of the catalog for filtered scans, row i being the
+// i-th catalog record. On disk, next to the catalog:
+//   <dir>/columns.width, columns.height       n x u32
+//   <dir>/columns.bytes, columns.created_at   n x u64
+//   <dir>/columns.zones  [magic "IMGCOL01"][u64 catalog bytes covered]
+//                        then per kBlockRows-row block and column a
+//                        (min u64, max u64) zone map
+//   <dir>/columns.ords   n x u32 image ordinals; written last, so its
+//                        entry count is the commit point for a row.
+//
+// Value files are memory-mapped read-only; appends go through the file
+// descriptors and become visible to scans after Refresh(). A torn append
+// can only widen a zone map, which never changes a scan's result.
+class ColumnStore {
+public:
+    static constexpr size_t kBlockRows = 65536;
+
+    // Opens (creating empty files if needed). Throws std::runtime_error.
+    static ColumnStore Open(const std::string& dir);
+
+    ~ColumnStore();
+    ColumnStore(ColumnStore&& o) noexcept;
+    ColumnStore& operator=(ColumnStore&& o) noexcept;
+    ColumnStore(const ColumnStore&) = delete;
+    ColumnStore& operator=(const ColumnStore&) = delete;
+
+    bool Append(const ImageMeta& m) { return Append(&m, 1); }
+    // Appends `n` records with one write per file.
+    bool Append(const ImageMeta* records, size_t n);
+    // Records how many bytes of the catalog file the rows reflect, so a
+    // later open can project only what was appended since.
+    bool SetCatalogBytes(uint64_t bytes);
+    // Makes appended rows visible to scans.
+    bool Refresh();
+
+    size_t size() const { return ords_.size(); }
+    uint64_t catalog_bytes() const { return catalog_bytes_; }
+    uint32_t ordinal(size_t row) const { return ords_[row]; }
+    uint64_t value(NumColumn c, size_t row) const;
+    const uint32_t* width() const { return static_cast<const uint32_t*>(data_[0]); }
+    const uint32_t* height() const { return static_cast<const uint32_t*>(data_[1]); }
+    const uint64_t* bytes() const { return static_cast<const uint64_t*>(data_[2]); }
+    const uint64_t* created_at() const { return static_cast<const uint64_t*>(data_[3]); }
+
+    // Rows (ascending) satisfying every range. Blocks a zone map rules out
+    // are skipped; the rest are compared 8 (u32) or 4 (u64) rows per AVX2
+    // instruction into a row bitmask per block.
+    std::vector<uint32_t> Select(const std::vector<ColumnRange>& ranges, ScanStats* stats = nullptr) const;
+    uint64_t Count(const std::vector<ColumnRange>& ranges, ScanStats* stats = nullptr) const;
+
+private:
+    ColumnStore() = default;
+    bool Map();
+    void Unmap();
+    template <typename Sink>
+    void Scan(const std::vector<ColumnRange>& ranges, ScanStats* stats, Sink&& sink) const;
+
+    std::string dir_;
+    int fd_[kNumColumns] = {-1, -1, -1, -1};
+    int zones_fd_ = -1;
+    const void* data_[kNumColumns] = {};
+    size_t map_len_[kNumColumns] = {};
+    size_t count_ = 0;                 // rows visible to scans
+    uint64_t catalog_bytes_ = 0;
+    std::vector<uint64_t> zones_;      // block * kNumColumns * 2 + column * 2 + {0: min, 1: max}
+    std::vector<uint32_t> ords_;
+    std::fstream ords_out_;
+};
@@ -0,0 +1,273 @@
+#pragma once
+#include <coroutine>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <future>
+#include <memory>
+#include <optional>
+#include <string>
+#include <type_traits>
+#include <utility>
+
+// Coroutines for I/O-bound pipelines (the batch import): a Task type and
+// an executor whose file reads and writes suspend the coroutine instead
+// of blocking a thread, so a few threads keep hundreds of operations in
+// flight.
+//
+//   Task<bool> Copy(IoExecutor& io, std::string from, std::string to) {
+//       std::string bytes;
+//       if (!co_await ReadFile(io, from, &bytes)) co_return false;
+//       co_return co_await WriteFileAtomic(io, to, bytes);
+//   }
+//   IoExecutor io(2);
+//   bool ok = io.Run(Copy(io, "a", "b"));
+
+// Lazily started coroutine producing a T. Awaiting it starts it, and the
+// awaiter resumes when it finishes (symmetric transfer: no thread hop, no
+// stack growth). Exceptions propagate to the awaiter.
+template <typename T = void>
+class Task;
+
+namespace coro_detail {
+
+template <typename T>
+struct Promise;
+
+struct PromiseBase {
+    std::coroutine_handle<> continuation;
+    std::exception_ptr error;
+
+    std::suspend_always initial_suspend() noexcept { return {}; }
+
+    struct FinalAwaiter {
+        bool await_ready() noexcept { return false; }
+        template <typename P>
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<P> h) noexcept {
+            const std::coroutine_handle<> next = h.promise().continuation;
+            return next ? next : std::noop_coroutine();
+        }
+        void await_resume() noexcept {}
+    };
+    FinalAwaiter final_suspend() noexcept { return {}; }
+    void unhandled_exception() { error = std::current_exception(); }
+};
+
+template <typename T>
+struct Promise : PromiseBase {
+    std::optional<T> value;
+    Task<T> get_return_object();
+    void return_value(T v) { value.emplace(std::move(v)); }
+    T result() {
+        if (error) std::rethrow_exception(error);
+        return std::move(*value);
+    }
+};
+
+template <>
+struct Promise<void> : PromiseBase {
+    Task<void> get_return_object();
+    void return_void() {}
+    void result() {
+        if (error) std::rethrow_exception(error);
+    }
+};
+
+} // namespace coro_detail
+
+template <typename T>
+class Task {
+public:
+    using promise_type = coro_detail::Promise<T>;
+    using Handle = std::coroutine_handle<promise_type>;
+
+    Task() = default;
+    explicit Task(Handle h) : h_(h) {}
+    Task(Task&& o) noexcept : h_(std::exchange(o.h_, {})) {}
+    Task& operator=(Task&& o) noexcept {
+        if (this != &o) {
+            if (h_) h_.destroy();
+            h_ = std::exchange(o.h_, {});
+        }
+        return *this;
+    }
+    Task(const Task&) = delete;
+    Task& operator=(const Task&) = delete;
+    ~Task() {
+        if (h_) h_.destroy();
+    }
+
+    bool await_ready() const noexcept { return false; }
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiter) noexcept {
+        h_.promise().continuation = awaiter;
+        return h_;
+    }
+    T await_resume() { return h_.promise().result(); }
+
+private:
+    Handle h_;
+};
+
+namespace coro_detail {
+
+template <typename T>
+Task<T> Promise<T>::get_return_object() {
+    return Task<T>(std::coroutine_handle<Promise<T>>::from_promise(*this));
+}
+
+inline Task<void> Promise<void>::get_return_object() {
+    return Task<void>(std::coroutine_handle<Promise<void>>::from_promise(*this));
+}
+
+// Fire-and-forget coroutine frame: starts at once and frees itself.
+struct Detached {
+    struct promise_type {
+        Detached get_return_object() { return {}; }
+        std::suspend_never initial_suspend() noexcept { return {}; }
+        std::suspend_never final_suspend() noexcept { return {}; }
+        void return_void() {}
+        void unhandled_exception() { std::terminate(); }
+    };
+};
+
+} // namespace coro_detail
+
+// Runs coroutines on a small pool of worker threads. File I/O goes through
+// io_uring, where one reaper thread turns completions back into resumed
+// coroutines. Where the kernel refuses io_uring (old kernels, seccomp),
+// each operation is instead run by a pool of blocking I/O threads, which
+// keeps the same interface at the cost of a thread per operation in
+// flight (up to the pool size).
+class IoExecutor {
+public:
+    // One read or write; lives in the awaiting coroutine's frame.
+    struct IoOp {
+        enum Kind : uint8_t { kRead, kWrite } kind;
+        int fd;
+        void* buf;
+        size_t len;
+        uint64_t offset;
+        int64_t result = 0;
+        std::coroutine_handle<> waiter;
+    };
+
+    // Result of Read/Write: bytes transferred, or -errno.
+    struct IoAwaiter {
+        IoExecutor& ex;
+        IoOp op;
+        bool await_ready() const noexcept { return false; }
+        void await_suspend(std::coroutine_handle<> h) {
+            op.waiter = h;
+            ex.Submit(&op);
+        }
+        int64_t await_resume() const noexcept { return op.result; }
+    };
+
+    struct ScheduleAwaiter {
+        IoExecutor& ex;
+        bool await_ready() const noexcept { return false; }
+        void await_suspend(std::coroutine_handle<> h) { ex.Post(h); }
+        void await_resume() const noexcept {}
+    };
+
+    // threads = 0: one per hardware thread. Throws std::runtime_error if
+    // no thread can be started.
+    explicit IoExecutor(int threads = 0, unsigned queue_depth = 256, bool use_io_uring = true);
+    // Waits for every spawned task, then stops the threads.
+    ~IoExecutor();
+    IoExecutor(const IoExecutor&) = delete;
+    IoExecutor& operator=(const IoExecutor&) = delete;
+
+    // Starts `task` on a worker; nobody awaits it.
+    void Spawn(Task<void> task);
+    // Runs `task` on the workers and blocks the calling thread (which must
+    // not be a worker) until it finishes.
+    template <typename T>
+    T Run(Task<T> task);
+    // Blocks until every spawned task has finished.
+    void Wait();
+
+    // co_await io.Schedule(): continue on a worker thread.
+    ScheduleAwaiter Schedule() { return ScheduleAwaiter{*this}; }
+    // Resumes `h` on a worker thread.
+    void Post(std::coroutine_handle<> h);
+
+    // pread/pwrite without blocking a worker. offset UINT64_MAX uses and
+    // advances the file position (for O_APPEND writes).
+    IoAwaiter Read(int fd, void* buf, size_t len, uint64_t offset) {
+        return IoAwaiter{*this, IoOp{IoOp::kRead, fd, buf, len, offset, 0, {}}};
+    }
+    IoAwaiter Write(int fd, const void* buf, size_t len, uint64_t offset) {
+        return IoAwaiter{*this, IoOp{IoOp::kWrite, fd, const_cast<void*>(buf), len, offset, 0, {}}};
+    }
+
+    bool uses_io_uring() const;
+    int threads() const;
+
+private:
+    struct State;
+
+    void Submit(IoOp* op);
+    static coro_detail::Detached Drive(IoExecutor* ex, Task<void> task);
+
+    std::unique_ptr<State> s_;
+};
+
+template <typename T>
+T IoExecutor::Run(Task<T> task) {
+    std::promise<T> done;
+    std::future<T> result = done.get_future();
+    auto wrap = [](Task<T> t, std::promise<T>* p) -> Task<void> {
+        try {
+            if constexpr (std::is_void_v<T>) {
+                co_await std::move(t);
+                p->set_value();
+            } else {
+                p->set_value(co_await std::move(t));
+            }
+        } catch (...) {
+            p->set_exception(std::current_exception());
+        }
+    };
+    Spawn(wrap(std::move(task), &done));
+    return result.get();
+}
+
+// Whole-file helpers built on Read/Write. false (with a message) on
+// errors.
+Task<bool> ReadFile(IoExecutor& io, std::string path, std::string* out);
+// Writes a temp file next to `path` and renames it into place, creating
+// the parent directory if needed.
+Task<bool> WriteFileAtomic(IoExecutor& io, std::string path, const std::string& bytes);
+
+// One thread that runs blocking calls one at a time in submission order,
+// for code that must not run concurrently (ImageDB). `co_await
+// serial.Call(io, fn)` runs fn there and resumes on io's workers, so the
+// waiting coroutine holds no thread.
+class SerialWorker {
+public:
+    SerialWorker();
+    ~SerialWorker();
+    SerialWorker(const SerialWorker&) = delete;
+    SerialWorker& operator=(const SerialWorker&) = delete;
+
+    // Rethrows what fn threw.
+    struct CallAwaiter {
+        SerialWorker& worker;
+        IoExecutor& io;
+        std::function<void()> fn;
+        std::exception_ptr error;
+        std::coroutine_handle<> waiter;
+        bool await_ready() const noexcept { return false; }
+        void await_suspend(std::coroutine_handle<> h);
+        void await_resume() const {
+            if (error) std::rethrow_exception(error);
+        }
+    };
+    CallAwaiter Call(IoExecutor& io, std::function<void()> fn) { return CallAwaiter{*this, io, std::move(fn), {}, {}}; }
+
+private:
+    struct State;
+    std::unique_ptr<State> s_;
+};
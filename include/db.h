@@ -1,10 +1,231 @@
+#pragma once
 #include<string>
+#include<vector>
+#include<meta.h>
+#include<embed.h>
+#include<color.h>
+#include<image.h>
+#include<cluster.h>
+#include<tags.h>
+#include<ordinals.h>
+#include<columns.h>
+#include<btree.h>
+#include<lsm.h>
+#include<bloom.h>
+#include<refs.h>
+#include<query.h>
+#include<taskpool.h>
+#include<snapshot.h>
+#include<memory>
+#include<functional>
+#include<iosfwd>
 
+struct SimilarHit {
+    std::string image_id;
+    int distance;   // hamming distance between perceptual hashes
+};
+
+struct KnnHit {
+    std::string image_id;
+    float distance;   // squared L2 distance between embeddings
+};
+
+struct ColorHit {
+    std::string image_id;
+    float score;              // histogram intersection, 0..1
+    DominantColor dominant[3];
+};
+
+struct ImportResult {
+    std::string image_id;
+    bool duplicate = false;
+};
+
+struct KnnOptions {
+    int ef = 64;          // HNSW search beam width (higher = better recall, slower)
+    bool use_pq = false;  // search PQ codes even when float vectors exist
+    int rerank = 0;       // PQ only: re-rank this many candidates with float vectors
+};
+
+// An opened ImageDB may be shared across threads, and copies of the
+// handle share its state. Lookups, LoadCatalog, tag searches and queries
+// read the published CatalogSnapshot without taking a lock. Everything
+// that writes, and every accessor that may bring an on-disk index up to
+// date, runs under one commit lock; each commit then publishes a new
+// snapshot. Several processes may open the same DB: the commit lock also
+// takes a writer lease on the root (see lease.h), so their writes take
+// turns, and a reader notices another process's commit from the shared
+// header and catches up, reading only the appended records when that is
+// all that changed.
 class ImageDB {
 public:
-    static ImageDB Open(const std::string& db_path);
+    // `workers` sizes the DB's task pool (0: one per CPU).
+    static ImageDB Open(const std::string& db_path, int workers = 0);
     bool Init();
-    bool ImportFile(const std::string& file);
+    // `result`, if given, receives the new image id, or duplicate = true
+    // when an image with the same content is already stored. A caller that
+    // hashed the bytes while writing `file` passes the hex digest as
+    // `sha256` to skip reading it again.
+    bool ImportFile(const std::string& file, ImportResult* result = nullptr, const std::string& sha256 = "");
+
+    // ImportFile's catalog steps, for callers that move the bytes
+    // themselves. ClaimImport checks `sha256` against the store and, for
+    // new content, takes a blob reference and allocates the image id
+    // (false with duplicate = true otherwise). The caller then writes the
+    // blob and thumbnail and fills in m.image_id, sha256, width, height
+    // and bytes (and mime, if it has the bytes; otherwise it is read from
+    // the blob's signature); CommitImport assigns the ordinal and records
+    // `m` in every catalog index. `sig` is null when no thumbnail could be made.
+    // CommitImport returns false only when it recorded nothing, and throws
+    // only once it has. A claim that fails before its record commits,
+    // exceptions included, must be given up with
+    // AbandonImport, which drops its blob reference, and the blob and
+    // thumbnail unless something else references the blob.
+    bool ClaimImport(const std::string& sha256, ImportResult* claim);
+    bool CommitImport(ImageMeta& m, const ImgSignature* sig);
+    bool AbandonImport(const std::string& sha256, const std::string& image_id);
+
+    // Imports many files with up to `in_flight` of them in progress at
+    // once. File reads and blob and thumbnail writes are coroutine I/O
+    // (see coro.h), hashing and thumbnail decoding run on Pool(), and the
+    // catalog steps run one at a time on a thread of their own. Repeats of
+    // the same content within the batch count as duplicates. Returns the
+    // number imported.
+    size_t ImportFiles(const std::vector<std::string>& files, size_t in_flight = 256);
+
+    // The work-stealing pool that CPU-heavy work on this DB runs on
+    // (import hashing and decoding, query scans, resize renders), started
+    // on first use. Copies of the handle share it.
+    WorkStealingPool& Pool() const;
+
+    // The current catalog snapshot, pinned: an epoch pin and one atomic
+    // load once published. Versions replaced by later commits are freed
+    // once no handle pins them. The first call reads the catalog from
+    // disk. Throws std::runtime_error if it cannot be read.
+    PinnedSnapshot Snapshot() const;
+
+    // All live catalog records in import order, from the snapshot.
+    // Throws std::runtime_error if the catalog cannot be read.
+    std::vector<ImageMeta> LoadCatalog() const;
+
+    // Catalog records keyed by ordinal, where edits and deletes go. The
+    // catalog file stays the import log: records appended to it since the
+    // store last synced are added first (all of them, as one run, on first
+    // use). Kept open across commits and reopened once another process
+    // commits, so the caller holds the commit lock while using it. Throws
+    // std::runtime_error.
+    LsmStore& Records() const;
+
+    // One record by image id, from the snapshot.
+    std::optional<ImageMeta> GetImage(const std::string& image_id) const;
+
+    // Replaces the record with the same ordinal. Identity and content
+    // fields (image_id, sha256, ordinal) must not change, nor may the ones
+    // the projection holds (width, height, bytes, created_unix).
+    bool UpdateImage(const ImageMeta& m);
+
+    // B+tree from created_at or bytes (the only columns with one) to
+    // ordinals, covering a prefix of `projection`. Each import inserts its
+    // row unless a query has the tree open (see BTree::OpenReadOnly); a
+    // missing or dirty tree, one ahead of the projection, or one trailing
+    // it by more than max(4096, an eighth of its rows) is bulk-loaded
+    // anew and renamed over the old. Throws std::runtime_error.
+    BTree RangeIndex(NumColumn column, const ColumnStore& projection) const;
+
+    // Rebuilds both range trees bottom-up from the projection.
+    bool BuildRangeIndexes() const;
+
+    // Bloom filter over every catalog sha256, consulted before the blob
+    // store when deduplicating imports. Rebuilt from the catalog when
+    // missing, behind the catalog, or full. Throws std::runtime_error.
+    BlockedBloom Digests() const;
+
+    // Deletes an image: records its ordinal in catalog/deleted.ords (which
+    // every read path filters on), tombstones its record, drops its tags
+    // and releases its reference on the blob. The blob and thumbnail stay
+    // until CollectGarbage().
+    bool Delete(const std::string& image_id);
+
+    // Ordinals of deleted images, from the snapshot.
+    RoaringBitmap Deleted() const;
+
+    // Unlinks blobs no image references and the thumbnails of deleted
+    // images, then compacts the reference log. Only the compaction takes
+    // the writer lease, so imports through any handle or process may run
+    // meanwhile: a blob is moved aside before it is unlinked and put back
+    // if an import referenced it again in between.
+    bool CollectGarbage();
+
+    // Where the original bytes of a blob and the thumbnail of an image live.
+    std::string BlobPath(const std::string& sha256) const;
+    std::string ThumbnailPath(const std::string& image_id) const;
+
+    // Compacts the record store into one run, rebuilds the digest filter
+    // at twice the catalog size, and brings the projection and range
+    // trees up to date.
+    bool Checkpoint();
+
+    // Catalog entries whose pHash is within `radius` bits of `file`'s,
+    // closest first, ties in import order. Uses the snapshot's multi-index
+    // hash, which imports keep up to date.
+    std::vector<SimilarHit> FindSimilar(const std::string& file, int radius) const;
+
+    // Imports embeddings from a text file, one "image_id v0 v1 ... v{d-1}"
+    // line per image. The first import fixes the store's dimension and
+    // dtype; new rows are added to the HNSW index, which is then saved.
+    // Once PQ is trained, new rows are also encoded into the PQ store.
+    bool ImportEmbeddings(const std::string& file, EmbedDType dtype);
+
+    // Trains an M-subspace product quantizer over a sample of the float
+    // embeddings and encodes every row. With `drop_float` the float store
+    // and HNSW index are deleted and the DB runs on PQ codes alone.
+    bool TrainPq(int m, size_t sample_size, bool drop_float);
+
+    // k nearest images by embedding, closest first. Uses HNSW over float
+    // vectors when they exist, otherwise (or with use_pq) a PQ scan.
+    std::vector<KnnHit> NearestByVector(const std::vector<float>& q, int k, const KnnOptions& opts) const;
+    std::vector<KnnHit> NearestByEmbedding(const std::string& image_id, int k, const KnnOptions& opts) const;
+
+    // Images ranked by histogram intersection with `query` (kColorBins
+    // bins summing to kHistTotal, or a hue_range_mask), best first. Only
+    // images scoring at least `min_score` are returned.
+    std::vector<ColorHit> SearchColor(const uint16_t* query, size_t k, float min_score) const;
+
+    // Clusters every image that has `feature` with mini-batch k-means
+    // (`iters` batches of `batch` rows) and rewrites all assignments.
+    // Afterwards imports of that feature join their nearest cluster and
+    // nudge its centroid instead of retraining.
+    bool TrainClusters(ClusterFeature feature, int k, size_t batch, int iters);
+
+    // Member count of each cluster, indexed by cluster id. Throws
+    // std::runtime_error if no cluster model has been trained.
+    std::vector<size_t> ClusterSizes(ClusterFeature* feature = nullptr) const;
+
+    // Image ids in `cluster`, in assignment order, skipping `offset` and
+    // returning at most `limit`.
+    std::vector<std::string> ClusterMembers(uint32_t cluster, size_t offset, size_t limit) const;
+
+    // Adds and removes tags on an image. Tags are kept in a TagStore keyed
+    // by the image's ordinal.
+    bool TagImage(const std::string& image_id, const std::vector<std::string>& add,
+                  const std::vector<std::string>& remove);
+
+    // Every tag with its image count.
+    std::vector<std::pair<std::string, uint64_t>> ListTags() const;
+
+    // Image ids matching a boolean tag query (see TagStore::Query), in
+    // import order, skipping `offset` and returning at most `limit`.
+    // `total` receives the full match count; `at` is as for RunQuery.
+    // Throws std::invalid_argument on a malformed query.
+    std::vector<std::string> FindByTags(const std::string& expr, size_t offset, size_t limit,
+                                        uint64_t* total = nullptr, const CatalogSnapshot* at = nullptr) const;
+
+    // Runs a SELECT over the snapshot's columns and tags (grammar in
+    // query.h) and writes the rows, or for EXPLAIN the chosen plan, to
+    // `out`. `at` runs it against a pinned snapshot instead of the latest,
+    // so a series of queries sees one commit point. Throws
+    // std::invalid_argument on a malformed query.
+    void RunQuery(const std::string& sql, std::ostream& out, const CatalogSnapshot* at = nullptr) const;
 
     std::string db_root;
     std::string manifest_path;
@@ -13,5 +234,62 @@ public:
     std::string catalog_meta_path;
     std::string blobs_dir;
     std::string thumbs_dir;
+    std::string embeddings_path;
+    std::string hnsw_path;
+    std::string pq_path;
+    std::string clusters_path;
     bool is_initialized;
+
+private:
+    struct Shared;
+    std::shared_ptr<Shared> shared_;
+
+    // LoadCatalog and Deleted as the files hold them.
+    std::vector<ImageMeta> ScanCatalog() const;
+    RoaringBitmap ReadDeleted() const;
+    // Image id <-> ordinal map. Every secondary index keys rows by
+    // ordinal. Loaded once and then only reads what other processes
+    // appended; the caller holds the commit lock while using it.
+    OrdinalMap& Ordinals() const;
+    // The cluster model imports fold new images into, or nullptr when none
+    // is trained, and its assignment column in `*assignments`. Loaded once
+    // and kept across commits until TrainClusters replaces them or another
+    // process commits; the caller holds the commit lock while using them.
+    ClusterModel* Clusters(ClusterAssignments** assignments) const;
+    // Reference count of every blob, seeded from the catalog on first use.
+    // Kept open, so counts are read from the log's new lines only; the
+    // caller holds the commit lock while using it. Throws
+    // std::runtime_error.
+    BlobRefs& Refs() const;
+    // Columnar projection of the numeric catalog fields, first brought up
+    // to date with any records appended to the catalog since it was last
+    // synced (all of them on first use). Kept open across commits and
+    // reopened once another process commits, so the caller holds the
+    // commit lock for as long as it uses the reference.
+    const ColumnStore& Columns() const;
+    // The projection as queries read it: opened without the commit lock
+    // and shared until the files grow past it by more than the slack the
+    // range trees get.
+    std::shared_ptr<const ColumnStore> ProjectionView() const;
+    // Reads a snapshot from disk; caller holds the commit lock.
+    CatalogSnapshot::Ptr ReadSnapshot(uint64_t seq = 0) const;
+    // Replaces the published snapshot with fn(current), or with one read
+    // from disk if fn is empty, and retires the old one. Nothing is
+    // published before the first Snapshot() call. `append` when the commit
+    // only appended plain records to the catalog, which other processes
+    // can then pick up from its tail. Caller holds the commit lock.
+    void Publish(const std::function<CatalogSnapshot::Ptr(const CatalogSnapshot&)>& fn,
+                 bool append = false) const;
+    // Loads the first snapshot, or brings the published one up to what
+    // other processes have committed, and returns it. Caller holds
+    // Shared::catchup_mu, and the commit lock when `locked`; without it only
+    // appended records are read, and nullptr means the rest needs the lock.
+    const CatalogSnapshot* CatchUp(bool locked) const;
+
+    // Brings a DB written before ordinals existed up to date: numbers the
+    // catalog in record order and converts image_id-keyed sidecars to
+    // ordinal columns. Cheap (a few stat calls) once done.
+    void MigrateToOrdinals() const;
+
+    BlockedBloom BuildDigests() const;
 };
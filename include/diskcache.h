@@ -0,0 +1,51 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <string>
+
+// Derived files (e.g. resized renditions) kept under a directory with a
+// total byte budget. Keys are file names: letters, digits, '.', '_' and
+// '-' only. Layout: <dir>/<first two chars of key>/<key>.
+//
+// Inserts are written to a temp file and renamed into place, then least
+// recently used files are unlinked until the total fits the budget. The
+// index is rebuilt on Open from the files present, ordered by mtime; a
+// hit refreshes the file's mtime so recency survives a restart. An
+// evicted file stays readable through descriptors that are already open.
+class DiskCache {
+public:
+    struct Stats {
+        uint64_t hits = 0;
+        uint64_t misses = 0;
+        uint64_t evictions = 0;
+        uint64_t entries = 0;
+        uint64_t bytes = 0;
+    };
+
+    // Creates `dir` if needed and indexes what is already there. Throws
+    // std::runtime_error.
+    static DiskCache Open(const std::string& dir, uint64_t budget_bytes);
+
+    ~DiskCache();
+    DiskCache(DiskCache&& o) noexcept;
+    DiskCache& operator=(DiskCache&& o) noexcept;
+    DiskCache(const DiskCache&) = delete;
+    DiskCache& operator=(const DiskCache&) = delete;
+
+    // Path of the cached file, or "" on a miss.
+    std::string Lookup(const std::string& key);
+    // false (with a message) on I/O errors or an invalid key. Files larger
+    // than the budget are not stored.
+    bool Insert(const std::string& key, const std::string& bytes);
+    void Erase(const std::string& key);
+
+    Stats stats() const;
+    uint64_t budget() const;
+
+private:
+    struct State;
+
+    DiskCache() = default;
+
+    std::unique_ptr<State> s_;
+};
@@ -0,0 +1,24 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+// Vector distance kernels. Each entry point dispatches once, at first use, to
+// an AVX2/FMA(/F16C) implementation when the CPU has it and to a portable
+// scalar loop otherwise, so the binary does not need -mavx2.
+
+// Squared euclidean distance between two float32 vectors.
+float l2sq_f32(const float* a, const float* b, size_t n);
+
+// Squared euclidean distance between a float32 query and a float16 row.
+float l2sq_f16(const float* q, const uint16_t* row, size_t n);
+
+// Inner product of two float32 vectors.
+float dot_f32(const float* a, const float* b, size_t n);
+
+// IEEE 754 binary16 <-> binary32 conversion (round-to-nearest-even).
+uint16_t float_to_half(float f);
+float half_to_float(uint16_t h);
+void halves_to_floats(const uint16_t* in, float* out, size_t n);
+
+// True when the SIMD paths above are in use; reported by benchmarks.
+bool simd_distance_available();
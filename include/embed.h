@@ -0,0 +1,72 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+enum class EmbedDType : uint32_t { F32 = 0, F16 = 1 };
+
+// Column store of fixed-dimension embedding vectors, one row per image.
+//
+// On disk (`<path>`):
+//   [64-byte header][row 0][row 1]...
+// Every row is padded to a multiple of 64 bytes, so with the page-aligned
+// mmap base each row starts on its own cache line and SIMD loads never split
+// one. The image ordinal of row i is entry i of the u32 column `<path>.ords`.
+//
+// The data file is memory-mapped read-only; appends go through the file
+// descriptor and become visible to Row() after Refresh().
+class EmbeddingStore {
+public:
+    static constexpr size_t kAlign = 64;
+
+    // Creates an empty store. Throws std::runtime_error if `path` exists.
+    static EmbeddingStore Create(const std::string& path, uint32_t dim, EmbedDType dtype);
+    // Opens an existing store. Throws std::runtime_error on a bad header.
+    static EmbeddingStore Open(const std::string& path);
+    // Open() for queries, which hold no lock: Append() fails.
+    static EmbeddingStore OpenReadOnly(const std::string& path);
+
+    ~EmbeddingStore();
+    EmbeddingStore(EmbeddingStore&& o) noexcept;
+    EmbeddingStore& operator=(EmbeddingStore&& o) noexcept;
+    EmbeddingStore(const EmbeddingStore&) = delete;
+    EmbeddingStore& operator=(const EmbeddingStore&) = delete;
+
+    // Appends one vector of dim() floats (converted to the store dtype).
+    bool Append(uint32_t ordinal, const float* v);
+    // Makes appended rows visible to Row()/Distance().
+    bool Refresh();
+
+    uint32_t dim() const { return dim_; }
+    EmbedDType dtype() const { return dtype_; }
+    size_t size() const { return count_; }
+    size_t row_bytes() const { return row_bytes_; }
+    uint32_t ordinal(size_t row) const { return ords_[row]; }
+
+    const void* Row(size_t row) const { return data_ + row * row_bytes_; }
+    // Copies row `row` into `out` as float32.
+    void Decode(size_t row, float* out) const;
+    // Squared L2 distance between a float32 query and row `row`.
+    float Distance(const float* q, size_t row) const;
+
+private:
+    EmbeddingStore() = default;
+    static EmbeddingStore Open(const std::string& path, int flags);
+    bool Map();
+    void Unmap();
+
+    std::string path_;
+    int fd_ = -1;
+    uint32_t dim_ = 0;
+    EmbedDType dtype_ = EmbedDType::F32;
+    size_t row_bytes_ = 0;
+    size_t count_ = 0;
+
+    const unsigned char* map_ = nullptr;
+    size_t map_len_ = 0;
+    const unsigned char* data_ = nullptr;
+    std::vector<uint32_t> ords_;
+    std::fstream ords_out_;
+};
@@ -0,0 +1,94 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+// Epoch-based reclamation for objects that readers reach through an atomic
+// pointer. A reader pins the current epoch before loading the pointer and
+// unpins when done; a writer swaps the pointer and retires the old object,
+// which is freed once every pin taken before the swap is gone. Pinning is
+// a load and a CAS on one of kSlots padded slots, so readers never wait
+// for writers or for each other.
+//
+//   EpochDomain::Guard g = domain.Pin();
+//   const T* p = head.load();            // valid until g is released
+//   ...
+//   const T* old = head.exchange(next);  // writer
+//   domain.Retire(old);
+//   domain.Collect();
+//
+// A guard held for a long time keeps everything retired after it was
+// taken; readers should pin for the length of an operation.
+class EpochDomain {
+public:
+    // Pins taken at once; Pin() yields until a slot is free beyond that.
+    static constexpr size_t kSlots = 256;
+
+    class Guard {
+    public:
+        Guard() = default;
+        Guard(Guard&& o) noexcept
+            : domain_(std::exchange(o.domain_, nullptr)), slot_(o.slot_), epoch_(o.epoch_) {}
+        Guard& operator=(Guard&& o) noexcept;
+        Guard(const Guard&) = delete;
+        Guard& operator=(const Guard&) = delete;
+        ~Guard() { Release(); }
+
+        // Unpins early; the guard is then empty.
+        void Release();
+        explicit operator bool() const { return domain_ != nullptr; }
+        uint64_t epoch() const { return epoch_; }
+
+    private:
+        friend class EpochDomain;
+        Guard(EpochDomain* domain, size_t slot, uint64_t epoch) : domain_(domain), slot_(slot), epoch_(epoch) {}
+
+        EpochDomain* domain_ = nullptr;
+        size_t slot_ = 0;
+        uint64_t epoch_ = 0;
+    };
+
+    EpochDomain();
+    // Frees everything still retired. No guard may outlive the domain.
+    ~EpochDomain();
+    EpochDomain(const EpochDomain&) = delete;
+    EpochDomain& operator=(const EpochDomain&) = delete;
+
+    Guard Pin();
+
+    // Runs `free` once no guard taken before this call remains. Advances
+    // the epoch.
+    void Retire(std::function<void()> free);
+    template <typename T>
+    void Retire(const T* p) {
+        Retire([p] { delete p; });
+    }
+
+    // Runs every retired free that no live guard can still need; returns
+    // how many ran.
+    size_t Collect();
+
+    uint64_t epoch() const { return epoch_.load(); }
+    size_t pending() const;
+    size_t pinned() const;
+
+private:
+    static constexpr uint64_t kFree = UINT64_MAX;
+    struct alignas(64) Slot {
+        std::atomic<uint64_t> epoch{kFree};
+    };
+    struct Retired {
+        uint64_t epoch;
+        std::function<void()> free;
+    };
+
+    std::atomic<uint64_t> epoch_{0};
+    std::unique_ptr<Slot[]> slots_;
+    mutable std::mutex retired_mu_;
+    std::vector<Retired> retired_;
+};
@@ -0,0 +1,67 @@
+#pragma once
+#include <cstdint>
+#include <optional>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+class EmbeddingStore;
+
+// Hierarchical navigable small world graph (Malkov & Yashunin) over the rows
+// of an EmbeddingStore, using squared L2 distance.
+//
+// Node ids are store row numbers and must be added in row order. Vectors are
+// never copied: the graph only holds links and reads rows through the store's
+// mmap. Level-0 links live in one flat array (node * (M0 + 1) words, count
+// first) so the hot layer is a single allocation.
+//
+// Search is safe to run from many threads at once; Add is not.
+class Hnsw {
+public:
+    struct Params {
+        int M = 16;                // links per node on upper layers (2M on layer 0)
+        int ef_construction = 200; // beam width while inserting
+        uint64_t seed = 100;
+    };
+
+    using Hit = std::pair<float, uint32_t>;   // (distance, row)
+
+    explicit Hnsw(const EmbeddingStore* store);
+    Hnsw(const EmbeddingStore* store, Params p);
+
+    // Inserts store row `row`; rows must arrive as 0, 1, 2, ...
+    void Add(uint32_t row);
+
+    // k nearest rows to `q` (dim() floats), closest first.
+    std::vector<Hit> Search(const float* q, int k, int ef) const;
+
+    size_t size() const { return levels_.size(); }
+
+    bool Save(const std::string& path) const;
+    // Returns nullopt if the file is missing, corrupt, or built for a store
+    // with a different dimension.
+    static std::optional<Hnsw> Load(const std::string& path, const EmbeddingStore* store);
+
+private:
+    int RandomLevel();
+    uint32_t* Links(uint32_t node, int level);
+    const uint32_t* Links(uint32_t node, int level) const;
+    int MaxLinks(int level) const { return level == 0 ? 2 * p_.M : p_.M; }
+
+    uint32_t GreedyDescend(const float* q, int from, int stop) const;
+    std::vector<Hit> SearchLayer(const float* q, uint32_t entry, int ef, int level) const;
+    std::vector<uint32_t> SelectNeighbors(std::vector<Hit> candidates, int m) const;
+    void Connect(uint32_t from, uint32_t to, int level);
+
+    const EmbeddingStore* store_;
+    Params p_;
+    std::mt19937_64 rng_;
+    double level_mult_;
+
+    int max_level_ = -1;
+    uint32_t entry_ = 0;
+    std::vector<uint8_t> levels_;
+    std::vector<uint32_t> level0_;
+    std::vector<std::vector<uint32_t>> upper_;
+};
@@ -0,0 +1,136 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+// Minimal HTTP/1.1: requests with a Content-Length body (no chunked
+// uploads), persistent connections and pipelining.
+
+// Takes a request body piece by piece as it arrives, in place of
+// HttpRequest::body (see HttpServer::HeadHandler). Written on the
+// server's event thread, so it should store the bytes and little else.
+class HttpBodySink {
+public:
+    virtual ~HttpBodySink() = default;
+    // The next piece of the body. false aborts the request: the client
+    // gets a 500 and the connection is closed.
+    virtual bool Write(std::string_view piece) = 0;
+};
+
+struct HttpRequest {
+    std::string method;
+    std::string target;    // as sent, e.g. "/query?q=SELECT%20..."
+    std::string path;      // target up to '?'
+    std::string query;     // after '?', still percent-encoded
+    std::vector<std::pair<std::string, std::string>> headers;   // names lower-cased
+    std::string body;
+    std::shared_ptr<HttpBodySink> body_sink;   // holds the whole body instead, if set
+    bool keep_alive = true;
+
+    // Value of the first header called `name` (lower case), or nullptr.
+    const std::string* header(std::string_view name) const;
+    // Decoded value of query parameter `name`.
+    std::optional<std::string> param(std::string_view name) const;
+};
+
+// Bytes [offset, offset + length) of an open file, sent with sendfile.
+// The descriptor is closed with the last reference.
+struct HttpFile {
+    int fd = -1;
+    uint64_t offset = 0;
+    uint64_t length = 0;
+
+    HttpFile(int fd, uint64_t offset, uint64_t length) : fd(fd), offset(offset), length(length) {}
+    ~HttpFile();
+    HttpFile(const HttpFile&) = delete;
+    HttpFile& operator=(const HttpFile&) = delete;
+};
+
+struct HttpResponse {
+    int status = 200;
+    std::string content_type = "text/plain";
+    std::vector<std::pair<std::string, std::string>> headers;
+    std::string body;
+    // When set, the body instead of `body`: bytes shared with a cache, or
+    // a file range.
+    std::shared_ptr<const std::string> shared_body;
+    std::shared_ptr<HttpFile> file;
+
+    static HttpResponse Text(int status, std::string body);
+    // The file at `path` (404 if it cannot be opened), or the single byte
+    // range the request's Range header asks for: 206 with Content-Range,
+    // or 416 if it lies past the end. Other Range forms get the whole file.
+    static HttpResponse File(const HttpRequest& req, const std::string& path, std::string content_type);
+};
+
+// Resolves a Range header value against a `size`-byte body. Returns 1
+// with the inclusive range in `first`/`last`, 0 if the header should be
+// ignored (malformed or several ranges), or -1 if it cannot be satisfied.
+int parse_http_range(std::string_view value, uint64_t size, uint64_t* first, uint64_t* last);
+
+// Decodes %XX escapes and '+' (as a space).
+std::string url_decode(std::string_view s);
+const char* http_reason(int status);
+
+// Parses the request at the front of `buf`. Returns 0 with `consumed` set
+// once `buf` holds a whole request, -1 while more bytes are needed, or the
+// error status (400, 413, 431, 501) of a request that cannot be served.
+int parse_http_request(std::string_view buf, size_t max_body, HttpRequest* req, size_t* consumed);
+// The same for the head alone: 0 once `buf` holds it, with `head_bytes`
+// (through the blank line) and the body's `content_length` set.
+int parse_http_head(std::string_view buf, size_t max_body, HttpRequest* req, size_t* head_bytes,
+                    uint64_t* content_length);
+
+// Status line, headers (Content-Length, and Connection: close unless
+// `keep_alive`) and body; only the head when the body is shared or a file.
+std::string serialize_http_response(const HttpResponse& r, bool keep_alive);
+
+struct HttpServerOptions {
+    std::string host = "127.0.0.1";
+    uint16_t port = 8080;              // 0 picks a free port
+    int workers = 0;                   // 0: one per hardware thread
+    size_t max_body = 64 << 20;
+};
+
+// One epoll thread (the caller of Run) accepts connections, reads and
+// parses requests and writes responses; a pool of workers runs the
+// handler. A connection may pipeline requests: they are handled in
+// parallel and answered in the order they arrived. File bodies go from
+// the page cache to the socket with sendfile, never through user space.
+class HttpServer {
+public:
+    using Handler = std::function<HttpResponse(const HttpRequest&)>;
+    // Sees each request on the event thread once its head has arrived,
+    // before any of the body is read. It may answer at once: the response
+    // goes out in turn while the body is read past and dropped, never
+    // buffered. Or it may set `*sink`: the body is written there as it
+    // arrives, and the request reaches the Handler with body_sink set once
+    // all of it has. nullopt and no sink leave the request to the Handler
+    // as usual.
+    using HeadHandler =
+        std::function<std::optional<HttpResponse>(const HttpRequest& req, std::shared_ptr<HttpBodySink>* sink)>;
+
+    // Binds and listens. Throws std::runtime_error.
+    static HttpServer Listen(const HttpServerOptions& opts, Handler handler, HeadHandler head = nullptr);
+
+    ~HttpServer();
+    HttpServer(HttpServer&&) noexcept;
+    HttpServer& operator=(HttpServer&&) noexcept;
+
+    uint16_t port() const;
+    // Serves until Stop() (callable from any thread, or a signal handler).
+    void Run();
+    void Stop();
+
+private:
+    struct State;
+    explicit HttpServer(std::unique_ptr<State> s);
+
+    std::unique_ptr<State> s_;
+};
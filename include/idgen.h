@@ -0,0 +1,47 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <string>
+
+// 128-bit, time-ordered image ids in ULID layout: 48-bit unix milliseconds
+// followed by 80 random bits, written as 26 Crockford base32 characters so
+// byte order equals issue order.
+//
+// Ids issued within one millisecond (or while the clock is behind) keep the
+// previous timestamp and increment the random part, so one generator never
+// repeats or goes backwards. Across restarts the generator resumes above a
+// high-water mark persisted in <path>: each write reserves kLeaseMs ahead,
+// so the file is touched at most once per lease rather than once per id.
+// Keep one generator open for as long as ids are issued: each Open starts
+// at the mark, up to kLeaseMs ahead of the clock. Generators sharing a
+// file never lower its mark.
+class IdGenerator {
+public:
+    static constexpr size_t kLen = 26;
+    static constexpr uint64_t kLeaseMs = 10000;
+
+    // Opens (creating the mark file if needed). Throws std::runtime_error.
+    static IdGenerator Open(const std::string& path);
+
+    // Writes the next id plus a NUL into `out`. Returns false (with a
+    // message) when the high-water mark cannot be persisted.
+    bool Next(char (&out)[kLen + 1]);
+    // Same, with an explicit clock reading; exposed for tests.
+    bool Next(uint64_t now_ms, char (&out)[kLen + 1]);
+
+    // Millisecond timestamp encoded in an id, or 0 when malformed.
+    static uint64_t Timestamp(const char* id);
+
+private:
+    bool Reserve(uint64_t ms);
+
+    std::string path_;
+    std::fstream file_;
+    uint64_t reserved_ = 0;   // persisted: every issued timestamp is below it
+    uint64_t floor_ = 0;      // mark found at Open
+    uint64_t last_ms_ = 0;
+    uint64_t rand_hi_ = 0;    // top 16 of the 80 random bits
+    uint64_t rand_lo_ = 0;
+    uint64_t rng_[2] = {0, 0};
+};
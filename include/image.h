@@ -1,4 +1,8 @@
+#pragma once
 #include<string>
+#include<string_view>
+#include<cstdint>
+#include<color.h>
 
 struct ImgDims {
     int width;
@@ -6,6 +10,52 @@ struct ImgDims {
     int channels;
 };
 
+// Features computed from the thumbnail pixels: perceptual hashes (see
+// phash.h) and the colour histogram (see color.h).
+struct ImgSignature {
+    uint64_t dhash = 0;
+    uint64_t phash = 0;
+    ColorFeatures color;
+};
+
 bool read_dims(const std::string& filepath, ImgDims* out);
 
-bool make_thumbnail_256(const std::string& src_path, const std::string& dst_path);
+// MIME type of an encoded image from its leading bytes (the first 12 are
+// enough), or "application/octet-stream" when no known signature matches.
+std::string image_mime(std::string_view head);
+
+// Writes a thumbnail whose longest side is 256px. When `sig` is non-null the
+// features are computed from the resized pixels before they are freed.
+bool make_thumbnail_256(const std::string& src_path, const std::string& dst_path,
+                        ImgSignature* sig = nullptr);
+
+// make_thumbnail_256 for an image already in memory: fills `dims` from the
+// decoded image and returns the encoded thumbnail in `png` instead of
+// writing it.
+bool thumbnail_256_from_memory(const std::string& bytes, std::string* png, ImgDims* dims,
+                               ImgSignature* sig = nullptr);
+
+// Computes the same signature make_thumbnail_256 would, without writing a file.
+bool compute_signature(const std::string& src_path, ImgSignature* sig);
+
+enum class ResizeFit {
+    Contain,   // scale to fit inside the box, keeping the aspect ratio
+    Cover,     // scale to fill the box, then crop the overflow (centred)
+};
+
+// A requested rendition. A zero side leaves that dimension unconstrained
+// (then Cover behaves like Contain).
+struct ResizeSpec {
+    int width = 0;
+    int height = 0;
+    ResizeFit fit = ResizeFit::Contain;
+    bool png = false;   // JPEG otherwise
+};
+
+// Factor a src_w x src_h image is scaled by to render `spec`.
+double resize_scale(int src_w, int src_h, const ResizeSpec& spec);
+
+// Decodes `src_path`, scales it as `spec` asks and encodes the result into
+// `out`. The box is in output pixels, so any source with the original's
+// aspect ratio (the original or a downscaled level of it) will do.
+bool render_resized(const std::string& src_path, const ResizeSpec& spec, std::string* out);
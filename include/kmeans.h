@@ -0,0 +1,25 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// k-means over row-major float vectors (n x dim), squared L2 distance.
+
+// Lloyd iterations from k-means++ seeds. Returns k * dim centroids. If n < k
+// the surplus centroids duplicate existing rows. Empty clusters are re-seeded
+// from the point farthest from its centroid.
+std::vector<float> kmeans_train(const float* data, size_t n, uint32_t dim, int k,
+                                int iters, uint64_t seed);
+
+// Mini-batch k-means (Sculley 2010): each iteration assigns `batch` random
+// rows and moves their centroids with a per-centroid 1/count learning rate,
+// so cost is independent of n. Seeds with k-means++ over one batch.
+// `counts` (optional) receives how many points each centroid has absorbed,
+// which is what incremental updates continue from.
+std::vector<float> minibatch_kmeans(const float* data, size_t n, uint32_t dim, int k,
+                                    size_t batch, int iters, uint64_t seed,
+                                    std::vector<uint64_t>* counts = nullptr);
+
+// Index of the centroid nearest to `v`; writes the distance if `dist` is set.
+int nearest_centroid(const float* centroids, int k, uint32_t dim, const float* v,
+                     float* dist = nullptr);
@@ -0,0 +1,73 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+// Lets several processes open one DB root: one of them writes at a time,
+// the others keep reading.
+//
+//   <root>/LOCK   flock()ed by the process holding the writer lease
+//   <root>/HEAD   64 bytes mapped MAP_SHARED by every process: the
+//                 committed length of catalog/meta.ndjson, a sequence
+//                 number bumped by every commit, and a generation bumped by
+//                 commits that did more than append to the catalog
+//
+// A reader polls seq() -- one load from the shared page -- to learn that
+// another process committed. If only the catalog grew it reads the bytes
+// between the length it has seen and the committed one; a new generation
+// means it has to read everything again.
+//
+// The header is a seqlock: Commit() makes seq odd while it writes, and
+// Read() retries until it gets an even, unchanged seq, so a length is never
+// paired with another commit's number. A writer that dies mid-Commit leaves
+// seq odd; the next Acquire() repairs it.
+//
+// flock() locks belong to the open file, not the thread: threads of one
+// process must serialise among themselves (ImageDB's commit lock does).
+class WriterLease {
+public:
+    struct State {
+        uint64_t seq = 0;
+        uint64_t catalog_bytes = 0;
+        uint64_t generation = 0;
+    };
+
+    // Opens <root>/LOCK and <root>/HEAD, creating them if needed. Throws
+    // std::runtime_error.
+    static WriterLease Open(const std::string& db_root);
+
+    ~WriterLease();
+    WriterLease(WriterLease&& o) noexcept;
+    WriterLease& operator=(WriterLease&& o) noexcept;
+    WriterLease(const WriterLease&) = delete;
+    WriterLease& operator=(const WriterLease&) = delete;
+
+    // Blocks until this process holds the lease. Returns false (with a
+    // message) if the lock cannot be taken.
+    bool Acquire();
+    void Release();
+    bool held() const { return held_; }
+
+    // Consistent header contents; needs no lease.
+    State Read() const;
+    // Read() that gives up instead of waiting out a Commit() in progress,
+    // or one a crash left open for the next Acquire() to close.
+    bool TryRead(State* out) const;
+    // Sequence number alone, for a cheap "anything new?" check.
+    uint64_t seq() const;
+    // Lease holder only: records a commit that left the catalog
+    // `catalog_bytes` long. `rewrote` when it changed more than the tail.
+    State Commit(uint64_t catalog_bytes, bool rewrote);
+
+    // Pid recorded by the current holder, or 0.
+    uint64_t writer_pid() const;
+
+private:
+    struct Header;
+
+    WriterLease() = default;
+
+    int lock_fd_ = -1;
+    Header* head_ = nullptr;
+    bool held_ = false;
+};
@@ -0,0 +1,83 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+// Log-structured map from u32 keys (image ordinals) to byte strings, for
+// catalog records that change after import.
+//
+// Writes go to a log and an in-memory skiplist (the memtable). A full
+// memtable is written out as an immutable sorted run; a background thread
+// merges runs of similar size (size-tiered compaction), keeping the newest
+// version of each key. Deletes are tombstones until a merge reaches the
+// oldest run. A lookup checks the memtable, then each run newest first,
+// skipping runs by key range and bloom filter; a run that may hold the key
+// costs one block read, so lookups average close to one disk read.
+//
+// On disk, in `dir`:
+//   MANIFEST   text: "IMGLSM01", catalog bytes, next run number, then the
+//              live runs newest first; replaced atomically
+//   log        (key u32, length u32 or kTombstone, bytes) per unflushed write,
+//              and per SetCatalogBytes() since the last flush (key UINT32_MAX)
+//   run-N.sst  sorted (key, length, bytes) records in ~kBlockBytes blocks,
+//              then the block index, the bloom filter, and a footer
+class LsmStore {
+public:
+    static constexpr size_t kMemtableBytes = 4u << 20;
+    static constexpr size_t kBlockBytes = 4096;
+    static constexpr size_t kTierRuns = 4;        // runs merged at once
+    static constexpr double kTierRatio = 3.0;     // max/min size within a tier
+    static constexpr int kBloomBitsPerKey = 10;   // ~1% false positives
+    static constexpr uint32_t kTombstone = UINT32_MAX;
+
+    // Opens (creating if needed), replays the log and starts the compaction
+    // thread. Throws std::runtime_error.
+    static LsmStore Open(const std::string& dir);
+
+    ~LsmStore();
+    LsmStore(LsmStore&& o) noexcept;
+    LsmStore& operator=(LsmStore&& o) noexcept;
+    LsmStore(const LsmStore&) = delete;
+    LsmStore& operator=(const LsmStore&) = delete;
+
+    // Keys are below UINT32_MAX. false (with a message) on I/O errors.
+    bool Put(uint32_t key, std::string_view value);
+    bool Delete(uint32_t key);
+
+    std::optional<std::string> Get(uint32_t key) const;
+    // Live entries in key order.
+    void Scan(const std::function<void(uint32_t key, std::string_view value)>& fn) const;
+
+    // Writes every (key, value) pair, sorted by key and unique, as one run
+    // below everything else. Meant for filling an empty store.
+    bool Ingest(const std::vector<std::pair<uint32_t, std::string>>& sorted);
+
+    // Writes the memtable out as a run.
+    bool Flush();
+    // Flushes and merges every run into one, dropping tombstones.
+    bool CompactAll();
+    // Blocks until the compaction thread is idle.
+    void WaitForCompaction();
+
+    // Bytes of the catalog the store reflects, for catch-up by the caller.
+    // Set through the log like a write; the manifest takes it on flush.
+    uint64_t catalog_bytes() const;
+    bool SetCatalogBytes(uint64_t bytes);
+
+    size_t run_count() const;
+    uint64_t disk_reads() const;   // blocks read by Get since Open
+
+private:
+    struct Memtable;
+    struct Run;
+    struct State;
+
+    LsmStore() = default;
+    std::unique_ptr<State> s_;
+};
@@ -1,9 +1,27 @@
+#pragma once
 #include<string>
+#include<cstdint>
+#include<vector>
 
 struct ImageMeta {
     std::string image_id, sha256, mime;
     uint32_t width, height;
     uint64_t bytes, created_unix;
+    uint64_t dhash = 0, phash = 0;   // perceptual hashes, 0 when unavailable
+    uint32_t ordinal = 0;            // dense internal id, see OrdinalMap
 };
 
-std::string meta_to_json(const ImageMeta& m);
\ No newline at end of file
+std::string meta_to_json(const ImageMeta& m);
+bool meta_from_json(const std::string& json, ImageMeta* out);
+
+// Reads every record of a catalog file. Records may span several lines.
+// Records written before ordinals existed get their row index. With an
+// `offset`, reading starts at that byte (a record boundary) and the first
+// record read counts as row `first_row`.
+// Returns false (with a message on stderr) if the file cannot be parsed.
+bool load_catalog(const std::string& path, std::vector<ImageMeta>* out, uint64_t offset = 0,
+                  uint32_t first_row = 0);
+// The records in bytes [offset, end) of a catalog file, read through a
+// read-only mapping: a committed tail another process may be appending
+// past. Records must carry their ordinals.
+bool map_catalog(const std::string& path, uint64_t offset, uint64_t end, std::vector<ImageMeta>* out);
@@ -0,0 +1,45 @@
+#pragma once
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Multi-index hashing over 64-bit perceptual hashes (Norouzi et al.).
+//
+// Each hash is split into four 16-bit substrings, and each substring position
+// gets its own table mapping substring value -> ids. Two hashes within hamming
+// distance r must agree to within floor(r/4) bits on at least one substring
+// (pigeonhole), so a query only probes the substring neighbourhoods of that
+// radius and verifies candidates with a popcount.
+//
+// Tables are stored CSR-style: 65537 offsets plus, per table, the ids and a
+// copy of their full hashes in bucket order. The copy costs 32 bytes/entry but
+// lets verification stream through a bucket instead of chasing a cache miss
+// per candidate, which is where a probe spends its time.
+class MultiIndexHash {
+public:
+    static constexpr int kChunks = 4;
+    static constexpr int kChunkBits = 16;
+
+    // Builds the index over `hashes`; entry i is reported as id i.
+    explicit MultiIndexHash(std::vector<uint64_t> hashes);
+
+    // Ids of all entries within `radius` bits of `q`, ascending.
+    std::vector<uint32_t> Query(uint64_t q, int radius) const;
+
+    // Reference popcount scan over every entry; same result as Query().
+    std::vector<uint32_t> LinearScan(uint64_t q, int radius) const;
+
+    uint64_t hash(uint32_t id) const { return hashes_[id]; }
+    size_t size() const { return hashes_.size(); }
+
+private:
+    static uint16_t chunk(uint64_t h, int t) {
+        return static_cast<uint16_t>(h >> (t * kChunkBits));
+    }
+
+    std::vector<uint64_t> hashes_;
+    std::array<std::vector<uint32_t>, kChunks> offsets_;
+    std::array<std::vector<uint32_t>, kChunks> ids_;
+    std::array<std::vector<uint64_t>, kChunks> bucket_hashes_;
+};
@@ -0,0 +1,66 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Dense uint32 ordinal per image, assigned in import order. Secondary
+// indexes (tags, colour, clusters, embeddings) key rows by ordinal instead
+// of by the 27-byte image_id string.
+//
+// On disk: <dir>/ordinals.ids holds the image_id of ordinal i on line i.
+// In memory the ids are packed back to back (ordinal -> id) and the reverse
+// direction is an open-addressing table of ordinals probed by id hash, so
+// both directions together cost about (id length + 20) bytes per image
+// against ~100 for a std::unordered_map<std::string, uint32_t>.
+class OrdinalMap {
+public:
+    static constexpr uint32_t kNone = UINT32_MAX;
+
+    // Opens (creating an empty file if needed). Throws std::runtime_error.
+    static OrdinalMap Open(const std::string& dir);
+
+    // Allocates the next ordinal for `image_id` and persists it. Returns
+    // kNone (with a message) on I/O errors or a duplicate id.
+    uint32_t Append(const std::string& image_id);
+
+    // Takes in the ids appended to the file since this map read it, e.g.
+    // by another process. Throws std::runtime_error.
+    void Refresh();
+    // Bytes of the file the map reflects.
+    uint64_t file_bytes() const { return file_bytes_; }
+
+    // Ordinal of `image_id`, or kNone.
+    uint32_t Find(std::string_view image_id) const;
+
+    std::string_view image_id(uint32_t ordinal) const {
+        return std::string_view(chars_).substr(offsets_[ordinal], offsets_[ordinal + 1] - offsets_[ordinal]);
+    }
+    size_t size() const { return offsets_.size() - 1; }
+
+    size_t SizeInBytes() const;
+
+private:
+    void Insert(uint32_t ordinal);
+    void Grow();
+
+    std::string dir_;
+    std::string chars_;
+    std::vector<uint64_t> offsets_{0};
+    std::vector<uint32_t> slots_;   // ordinal + 1; 0 marks an empty slot
+    uint64_t file_bytes_ = 0;
+    std::ofstream out_;
+};
+
+// Ordinal column sidecar of a row store: one native-endian u32 per row.
+// Reads every complete entry; a missing file reads as empty.
+std::vector<uint32_t> read_ordinal_column(const std::string& path);
+// Replaces the file with `ords`.
+bool write_ordinal_column(const std::string& path, const std::vector<uint32_t>& ords);
+// Writes `ord` as entry `row` (positioned, so a torn earlier append is
+// overwritten). Opens `out` on first use.
+bool put_ordinal(std::fstream& out, const std::string& path, size_t row, uint32_t ord);
+// Same for `n` consecutive entries starting at `row`.
+bool put_ordinals(std::fstream& out, const std::string& path, size_t row, const uint32_t* ords, size_t n);
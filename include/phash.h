@@ -0,0 +1,28 @@
+#pragma once
+#include <cstdint>
+#include <string>
+
+// Side length of the grayscale reduction both hashes are computed from.
+constexpr int kHashSide = 32;
+
+// Reduces interleaved 8-bit pixels (1-4 channels) to a kHashSide x kHashSide
+// luma square. `pixels` is expected to be the already-resized thumbnail so the
+// extra work is proportional to the thumbnail, not the original.
+bool gray_reduce(const unsigned char* pixels, int w, int h, int channels,
+                 float out[kHashSide * kHashSide]);
+
+// Difference hash: 9x8 reduction of `gray`, one bit per horizontal gradient.
+uint64_t dhash64(const float gray[kHashSide * kHashSide]);
+
+// DCT hash: 2D DCT-II of `gray`, one bit per low-frequency 8x8 coefficient
+// compared against the median of those coefficients (DC excluded).
+uint64_t phash64(const float gray[kHashSide * kHashSide]);
+
+inline int hamming64(uint64_t a, uint64_t b) {
+    return __builtin_popcountll(a ^ b);
+}
+
+// 16-character lowercase hex, the form stored in the catalog.
+std::string hash64_to_hex(uint64_t h);
+// Returns false if `hex` is not 1-16 hex digits.
+bool hex_to_hash64(const std::string& hex, uint64_t* out);
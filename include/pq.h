@@ -0,0 +1,79 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Product quantizer (Jégou et al.): a dim-dimensional vector is cut into M
+// contiguous subvectors and each is replaced by the index of its nearest of
+// 256 sub-centroids, so a vector costs M bytes instead of 4 * dim.
+//
+// Distances are computed asymmetrically (ADC): the query stays in float32,
+// a per-query M x 256 table of sub-distances is built once, and each code's
+// distance is the sum of M table lookups.
+class ProductQuantizer {
+public:
+    static constexpr int kCentroids = 256;
+
+    ProductQuantizer() = default;
+
+    // Trains M codebooks with k-means over `n` sample rows (n x dim).
+    // Throws std::invalid_argument unless dim % m == 0.
+    static ProductQuantizer Train(const float* sample, size_t n, uint32_t dim, int m,
+                                  int iters = 20, uint64_t seed = 1);
+
+    void Encode(const float* v, uint8_t* code) const;
+    void Decode(const uint8_t* code, float* out) const;
+
+    // Fills `lut` (m() * 256 floats) with squared distances from each query
+    // subvector to each sub-centroid.
+    void ComputeTable(const float* q, float* lut) const;
+
+    // ADC distances for `n` codes stored back to back (n x m() bytes).
+    // Uses AVX2 gathers, eight subspaces per instruction, when available.
+    void ScanCodes(const float* lut, const uint8_t* codes, size_t n, float* out) const;
+
+    uint32_t dim() const { return dim_; }
+    int m() const { return m_; }
+    int dsub() const { return m_ ? static_cast<int>(dim_) / m_ : 0; }
+    const std::vector<float>& centroids() const { return centroids_; }
+
+    void Write(std::ostream& out) const;
+    bool Read(std::istream& in);
+
+private:
+    uint32_t dim_ = 0;
+    int m_ = 0;
+    std::vector<float> centroids_;   // m x 256 x dsub
+};
+
+// PQ codes for every embedding row, plus the codebook, in one file:
+//   [header][codebook][codes: count x M bytes]
+// with image ordinals in `<path>.ords`, like EmbeddingStore. Loaded fully into
+// memory: at 64 bytes/vector, 50M images fit in ~3.2 GB.
+class PqStore {
+public:
+    static PqStore Create(const std::string& path, ProductQuantizer pq);
+    static PqStore Open(const std::string& path);
+
+    bool Append(uint32_t ordinal, const float* v);
+
+    // Exhaustive ADC scan; the `k` closest rows as (distance, row), closest first.
+    std::vector<std::pair<float, uint32_t>> Search(const float* q, size_t k) const;
+
+    const ProductQuantizer& quantizer() const { return pq_; }
+    size_t size() const { return ords_.size(); }
+    uint32_t ordinal(size_t row) const { return ords_[row]; }
+    const uint8_t* code(size_t row) const { return &codes_[row * pq_.m()]; }
+
+private:
+    std::string path_;
+    ProductQuantizer pq_;
+    std::vector<uint8_t> codes_;
+    std::vector<uint32_t> ords_;
+    std::streamoff codes_offset_ = 0;
+    std::fstream file_;
+    std::fstream ords_out_;
+};
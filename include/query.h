@@ -0,0 +1,230 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <iosfwd>
+#include <iterator>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "btree.h"
+#include "columns.h"
+#include "meta.h"
+#include "ordinals.h"
+#include "tags.h"
+
+class WorkStealingPool;
+
+// SQL-like SELECT over the catalog:
+//
+//   [EXPLAIN] SELECT * | COUNT(*) | col[, col...] FROM images
+//     [WHERE expr] [ORDER BY col [ASC|DESC]] [LIMIT n [OFFSET m]]
+//
+// expr combines `col op literal` (op: = != <> < <= > >=),
+// `col BETWEEN a AND b` and `tags MATCH '<tag query>'` with AND, OR, NOT
+// and parentheses. Keywords and column names are case-insensitive; strings
+// are single-quoted with '' for a quote.
+enum class SqlColumn : uint8_t {
+    ImageId, Sha256, Mime, Width, Height, Bytes, CreatedAt, Ordinal, Cluster,
+};
+
+const char* sql_column_name(SqlColumn c);
+bool sql_column_is_string(SqlColumn c);
+
+struct SqlExpr {
+    enum Kind : uint8_t { And, Or, Not, Compare, Match };
+    enum Op : uint8_t { Eq, Ne, Lt, Le, Gt, Ge, Between };
+
+    Kind kind = Compare;
+    Op op = Eq;
+    SqlColumn column = SqlColumn::ImageId;
+    uint64_t lo = 0, hi = 0;      // numeric literal(s); Between is [lo, hi]
+    std::string text;             // string literal, or the tag query of Match
+    std::unique_ptr<SqlExpr> left, right;   // right is unset for Not
+};
+
+struct SqlQuery {
+    bool explain = false;
+    bool count = false;                  // SELECT COUNT(*)
+    std::vector<SqlColumn> select;       // columns to print, in order
+    std::unique_ptr<SqlExpr> where;
+    bool ordered = false;
+    SqlColumn order_by = SqlColumn::Ordinal;
+    bool descending = false;
+    size_t limit = SIZE_MAX, offset = 0;
+};
+
+// Throws std::invalid_argument with the offending token on syntax errors.
+SqlQuery parse_sql(const std::string& sql);
+
+// Whether `c` appears anywhere in the query.
+bool sql_query_uses(const SqlQuery& q, SqlColumn c);
+
+// Textual form of an expression, as EXPLAIN prints it.
+std::string sql_expr_string(const SqlExpr& e);
+
+// One column of CatalogColumns. Copies share storage: each copy sees its
+// own prefix of it, and push_back() on the copy that reaches the end of
+// what is written so far fills the next free slot in place, so a column
+// that only grows costs amortized O(1) per row however many copies
+// (snapshot versions) hold it. Growing past the capacity, pushing from a
+// copy that is no longer the longest, and set() on storage another copy
+// holds reallocate instead. One thread writes; copies made before a
+// push_back never see its row.
+template <typename T>
+class SharedColumn {
+public:
+    size_t size() const { return size_; }
+    bool empty() const { return size_ == 0; }
+    const T* data() const { return store_ ? store_->data.get() : nullptr; }
+    const T& operator[](size_t i) const { return store_->data[i]; }
+    const T* begin() const { return data(); }
+    const T* end() const { return data() + size_; }
+
+    void reserve(size_t n) {
+        if (!store_ || n > store_->cap) Reallocate(n);
+    }
+    void push_back(const T& v) {
+        size_t at = size_;
+        if (!store_ || size_ == store_->cap || !store_->used.compare_exchange_strong(at, size_ + 1)) {
+            Reallocate(std::max<size_t>(16, 2 * (size_ + 1)));
+            store_->used.store(size_ + 1);
+        }
+        store_->data[size_++] = v;
+    }
+    void assign(size_t n, const T& v) {
+        *this = SharedColumn();
+        reserve(n);
+        std::fill_n(store_->data.get(), n, v);
+        store_->used.store(size_ = n);
+    }
+    template <typename It>
+    void assign(It first, It last) {
+        *this = SharedColumn();
+        for (reserve(static_cast<size_t>(std::distance(first, last))); first != last; ++first) push_back(*first);
+    }
+    void set(size_t i, const T& v) {
+        if (store_.use_count() > 1) Reallocate(store_->cap);
+        store_->data[i] = v;
+    }
+
+private:
+    struct Store {
+        std::unique_ptr<T[]> data;
+        size_t cap = 0;
+        std::atomic<size_t> used{0};   // slots some copy has written
+    };
+
+    // Private storage of at least `cap` slots holding this copy's rows.
+    void Reallocate(size_t cap) {
+        auto s = std::make_shared<Store>();
+        s->cap = std::max(cap, size_);
+        s->data = std::make_unique<T[]>(s->cap);
+        if (size_) std::copy_n(store_->data.get(), size_, s->data.get());
+        s->used.store(size_);
+        store_ = std::move(s);
+    }
+
+    std::shared_ptr<Store> store_;
+    size_t size_ = 0;
+};
+
+// The catalog decoded into one array per column, row i holding the i-th
+// record (rows ascend by ordinal). mime is dictionary-coded, so filters on
+// it compare small integers instead of strings. Built from the columnar
+// projection instead, the string columns stay empty and image ids come
+// from the ordinal map. Copies share the arrays (see SharedColumn), so a
+// copy plus Append() is how a new version is made.
+struct CatalogColumns {
+    static constexpr uint32_t kNoCluster = UINT32_MAX;
+
+    SharedColumn<std::string> image_id, sha256;
+    SharedColumn<uint16_t> mime;
+    std::vector<std::string> mime_dict;
+    SharedColumn<uint32_t> width, height, ordinal;
+    SharedColumn<uint64_t> bytes, created_at;
+    SharedColumn<uint32_t> cluster;   // kNoCluster when unassigned
+    SharedColumn<uint32_t> row_of;    // ordinal -> row, or OrdinalMap::kNone
+
+    static CatalogColumns Build(const std::vector<ImageMeta>& records);
+    static CatalogColumns FromProjection(const ColumnStore& store);
+
+    // Adds `m` as the last row; its ordinal must be past every row's.
+    void Append(const ImageMeta& m, uint32_t cluster_id = kNoCluster);
+    // Rewrites the row of m.ordinal, which must exist, in place.
+    void Set(const ImageMeta& m);
+
+    // Sets the cluster column from (ordinal, cluster) pairs.
+    void SetClusters(const std::vector<uint32_t>& ordinals, const std::vector<uint32_t>& clusters);
+
+    size_t size() const { return ordinal.size(); }
+    // Row of `o`, or OrdinalMap::kNone.
+    uint32_t row(uint32_t o) const { return o < row_of.size() ? row_of[o] : OrdinalMap::kNone; }
+
+private:
+    uint16_t MimeCode(const std::string& mime);
+};
+
+// Indexes the planner may use instead of a full scan; null means absent.
+//
+// The on-disk ones may be at another commit than the columns: the
+// planner maps their rows to the columns' rows by ordinal, dropping
+// ordinals the columns lack, and checks rows past an index's last
+// ordinal against the term itself. A projection or range tree that trails
+// the columns therefore only costs a scan of the rows it is missing.
+struct QueryIndexes {
+    const OrdinalMap* ordinals = nullptr;   // image_id = '...', and ids when the columns lack them
+    // image_id = '...' through another id index (e.g. a snapshot's);
+    // returns OrdinalMap::kNone for unknown ids. Preferred over ordinals.
+    std::function<uint32_t(std::string_view)> find_id;
+    const TagStore* tags = nullptr;         // tags MATCH '...'
+    const ColumnStore* columns = nullptr;   // numeric ranges, via zone maps
+    const BTree* created_at = nullptr;      // selective created_at ranges
+    const BTree* bytes = nullptr;           // selective bytes ranges
+    const RoaringBitmap* deleted = nullptr; // ordinals left out of every result
+    WorkStealingPool* pool = nullptr;       // filters large scans' batches in parallel
+};
+
+struct QueryResult {
+    std::vector<uint32_t> rows;   // catalog rows in output order
+    uint64_t count = 0;           // COUNT(*) value
+};
+
+// Plans and runs queries. The plan takes the top-level AND terms an index
+// can answer (image_id equality through the ordinal map, tag matches
+// through the posting lists, a selective created_at or bytes range through
+// its B+tree, other numeric ranges through the projection's zone maps),
+// intersects their row sets, and filters the candidates with the
+// remaining terms a column at a time over batches of kBatch rows. ORDER BY with LIMIT keeps only the top rows; without ORDER
+// BY the scan stops as soon as LIMIT rows qualify. Scans that must see
+// every candidate spread their batches over `indexes.pool`, if given.
+class QueryEngine {
+public:
+    static constexpr size_t kBatch = 1024;
+    // Smallest scan spread over the pool, and the rows each task takes.
+    static constexpr size_t kParallelRows = 64 * kBatch;
+
+    QueryEngine(const CatalogColumns& cols, const QueryIndexes& indexes) : cols_(cols), idx_(indexes) {}
+
+    QueryResult Run(const SqlQuery& q) const;
+
+    // The chosen plan, one operator per line, innermost last.
+    std::string Explain(const SqlQuery& q) const;
+
+    // Tab-separated rows under a "# col..." header, then "# N rows"; the
+    // bare number for COUNT(*).
+    void Write(const SqlQuery& q, const QueryResult& r, std::ostream& out) const;
+
+private:
+    struct Plan;
+    Plan MakePlan(const SqlQuery& q) const;
+    size_t Filter(const Plan& plan, const SqlExpr& e, uint32_t* sel, size_t n) const;
+    std::string_view StringValue(SqlColumn c, uint32_t row) const;
+
+    const CatalogColumns& cols_;
+    QueryIndexes idx_;
+};
@@ -0,0 +1,47 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+
+// Reference counts of content-addressed blobs, as an append-only log:
+//   <dir>/refs.log   "+<sha256>" and "-<sha256>" lines, and "=<sha256> <n>"
+//                    snapshot lines written by Compact()
+// Appends take a shared flock and Compact() an exclusive one, so a log
+// replaced by Compact() is never appended to after the fact.
+//
+// Count() answers from counts kept in memory: each call reads only the
+// lines appended since the last (by this object or anyone else), and a
+// log that Compact() replaced is replayed once. Keep one object open for
+// that to pay off; it is not safe to share between threads.
+class BlobRefs {
+public:
+    // Throws std::runtime_error if `dir` is not writable.
+    static BlobRefs Open(const std::string& dir);
+
+    bool exists() const;   // false until the first write
+    bool Increment(const std::string& sha256) { return Append('+', sha256); }
+    bool Decrement(const std::string& sha256) { return Append('-', sha256); }
+
+    // Net counts replayed from byte `from` of the log (0: everything);
+    // `end`, if given, receives where the replay stopped, for a later
+    // call to pick up changes since.
+    std::unordered_map<std::string, int64_t> Counts(uint64_t from = 0, uint64_t* end = nullptr) const;
+    int64_t Count(const std::string& sha256) const;
+
+    // Replaces the log with one snapshot line per blob whose count is
+    // positive (temp file + rename). With `seed`, those counts are written
+    // instead of the replayed ones.
+    bool Compact(const std::unordered_map<std::string, int64_t>* seed = nullptr);
+
+private:
+    BlobRefs() = default;
+    bool Append(char op, const std::string& sha256);
+    // Brings counts_ up to the log's current end.
+    void CatchUp() const;
+
+    std::string path_;
+    // What Count() answers from: the net counts of the log with inode
+    // `ino_` up to byte `end_`.
+    mutable std::unordered_map<std::string, int64_t> counts_;
+    mutable uint64_t ino_ = 0, end_ = 0;
+};
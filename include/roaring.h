@@ -0,0 +1,67 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <iosfwd>
+#include <vector>
+
+// Compressed set of uint32 (Chambi, Lemire et al., "Roaring bitmaps").
+//
+// Values are split by their high 16 bits into containers of up to 65536
+// values. A container holding at most kArrayMax values is a sorted uint16
+// array; a denser one is a 1024-word bitmap. Either way a container never
+// costs more than 8 KB, and sparse sets stay at about 2 bytes per value.
+//
+// Bitmap/bitmap AND, OR and ANDNOT run 256 bits per AVX2 instruction when
+// the CPU has it; mixed containers probe the bitmap per array value. Their
+// results may keep a bitmap container below kArrayMax values rather than
+// pay to extract it; Add/Remove and operator== treat both forms alike.
+class RoaringBitmap {
+public:
+    static constexpr uint32_t kArrayMax = 4096;
+    static constexpr uint32_t kWords = 1024;
+
+    // All values in [lo, hi).
+    static RoaringBitmap Range(uint32_t lo, uint32_t hi);
+
+    void Add(uint32_t v);
+    void Remove(uint32_t v);
+    bool Contains(uint32_t v) const;
+
+    uint64_t Cardinality() const;
+    bool empty() const { return keys_.empty(); }
+
+    static RoaringBitmap And(const RoaringBitmap& a, const RoaringBitmap& b);
+    static RoaringBitmap Or(const RoaringBitmap& a, const RoaringBitmap& b);
+    static RoaringBitmap AndNot(const RoaringBitmap& a, const RoaringBitmap& b);
+
+    // Values in ascending order, skipping `offset` and stopping at `limit`.
+    std::vector<uint32_t> ToVector(size_t offset = 0, size_t limit = SIZE_MAX) const;
+
+    // Heap bytes held by the containers.
+    size_t SizeInBytes() const;
+
+    // [u32 containers] then per container [u16 key][u16 type][u32 card][payload]
+    void Write(std::ostream& out) const;
+    bool Read(std::istream& in);
+
+    bool operator==(const RoaringBitmap& o) const;
+
+private:
+    struct Container {
+        uint32_t card = 0;
+        std::vector<uint16_t> array;   // sorted; used while bits is empty
+        std::vector<uint64_t> bits;    // kWords words, always once card > kArrayMax
+
+        bool is_bitmap() const { return !bits.empty(); }
+        bool Contains(uint16_t lo) const;
+        void ToBitmap();
+        void Normalize();   // bitmap -> array when it shrinks to kArrayMax
+    };
+
+    static Container AndC(const Container& a, const Container& b);
+    static Container OrC(const Container& a, const Container& b);
+    static Container AndNotC(const Container& a, const Container& b);
+
+    std::vector<uint16_t> keys_;
+    std::vector<Container> containers_;
+};
@@ -1,6 +1,25 @@
 #pragma once
+#include <array>
+#include <cstddef>
+#include <cstdint>
 #include <string>
 
+// Incremental hashing, for bytes that arrive in pieces:
+//   Sha256Ctx ctx; sha256_init(ctx);
+//   sha256_update(ctx, p, n); ...   (any split gives the same digest)
+//   uint8_t dig[32]; sha256_final(ctx, dig); sha256_hex(dig);
+struct Sha256Ctx {
+    std::array<uint32_t, 8> h;
+    std::array<uint8_t, 64>  data;   // partial block
+    uint64_t bitlen;                 // bits in completed blocks
+    uint32_t datalen;                // bytes in `data`
+};
+
+void sha256_init(Sha256Ctx& ctx);
+void sha256_update(Sha256Ctx& ctx, const uint8_t* data, size_t len);
+void sha256_final(Sha256Ctx& ctx, uint8_t out[32]);
+std::string sha256_hex(const uint8_t digest[32]);
+
 // Computes the SHA-256 hash of the file at `filepath`.
 // Returns a 64-character lowercase hex string.
 // Throws std::runtime_error on failure.
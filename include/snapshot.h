@@ -0,0 +1,141 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "epoch.h"
+#include "meta.h"
+#include "mih.h"
+#include "query.h"
+#include "roaring.h"
+#include "tags.h"
+
+// Immutable in-memory view of the catalog that readers share without
+// locks. A writer never changes a published snapshot: With*() return a
+// new one that shares every part the change left alone (records in
+// kChunkRows-ordinal chunks, the id index, the query columns, the pHash
+// index, the deleted set, the tag store), so an import costs one chunk
+// copy plus appends to the id index, columns and pHash index.
+// Each snapshot carries the sequence number of the commit it reflects.
+//
+//   PinnedSnapshot s = db.Snapshot();
+//   if (std::optional<uint32_t> o = s->Find(id)) use(*s->Get(*o));
+class CatalogSnapshot {
+public:
+    using Ptr = std::unique_ptr<const CatalogSnapshot>;
+    static constexpr size_t kChunkRows = 256;
+
+    // From every live record plus the deleted ordinals, tags and cluster
+    // assignments (parallel vectors) as they are on disk.
+    static Ptr Build(std::vector<ImageMeta> records, RoaringBitmap deleted, TagStore tags,
+                     const std::vector<uint32_t>& cluster_ords, const std::vector<uint32_t>& clusters,
+                     uint64_t seq = 0);
+
+    // Record with m.ordinal added or replaced; `cluster` sets its cluster
+    // assignment unless it is CatalogColumns::kNoCluster.
+    Ptr WithRecord(const ImageMeta& m, uint32_t cluster = CatalogColumns::kNoCluster) const;
+    // Several records as one new version, e.g. those appended to the
+    // catalog by another process.
+    Ptr WithRecords(const std::vector<ImageMeta>& records, uint32_t cluster = CatalogColumns::kNoCluster) const;
+    // `ordinal` deleted: its record is dropped and `tags` (the store with
+    // its tags removed) replaces the tag store.
+    Ptr WithDeleted(uint32_t ordinal, TagStore tags) const;
+    Ptr WithTags(TagStore tags) const;
+
+    // Live record of `ordinal`, if any.
+    const ImageMeta* Get(uint32_t ordinal) const;
+    // Ordinal of a live image.
+    std::optional<uint32_t> Find(std::string_view image_id) const;
+    // Every live record, ascending by ordinal (import order).
+    std::vector<ImageMeta> Live() const;
+
+    // The records as query columns with their clusters. Rows of images
+    // deleted since the snapshot was read from disk stay, so queries skip
+    // deleted() ordinals.
+    const CatalogColumns& Columns() const { return *columns_; }
+
+    // Live records whose pHash is within `radius` bits of `phash`, as
+    // (ordinal, distance) ascending by ordinal. Records without a pHash
+    // never match.
+    std::vector<std::pair<uint32_t, int>> Similar(uint64_t phash, int radius) const;
+
+    const RoaringBitmap& deleted() const { return *deleted_; }
+    const TagStore& tags() const { return *tags_; }
+    // One past the highest ordinal ever recorded.
+    uint32_t ordinal_end() const { return end_; }
+    size_t size() const { return live_; }
+    // Commit sequence number: bumped by every With*() call; a rebuild
+    // passes on its own.
+    uint64_t seq() const { return seq_; }
+
+private:
+    struct Chunk {
+        std::vector<ImageMeta> rows;     // kChunkRows slots; empty image_id: no live record
+        std::vector<uint32_t> cluster;   // kNoCluster when unassigned
+    };
+    using IdMap = std::unordered_map<std::string, uint32_t>;
+    struct PhashIndex {
+        MultiIndexHash mih;
+        std::vector<uint32_t> ordinals;   // of mih's entries
+    };
+
+    CatalogSnapshot() = default;
+    std::unique_ptr<CatalogSnapshot> Copy() const;
+    // Mutable copy of the chunk holding `ordinal`, created if missing.
+    Chunk& Own(uint32_t ordinal);
+    void Index(const std::string& image_id, uint32_t ordinal);
+    // Columns rebuilt from the chunks.
+    void BuildColumns();
+    // pHash index rebuilt from the chunks, with an empty tail.
+    void BuildPhash();
+
+    std::vector<std::shared_ptr<const Chunk>> chunks_;
+    // Id index: maps shared across versions, oldest and largest first.
+    // Index() adds a one-id map and merges the last two while the newer is
+    // no smaller, so sizes at least halve along the list: a lookup probes
+    // O(log n) maps and an id is copied O(log n) times over its life.
+    // Ids of deleted images stay; Find() checks the record.
+    std::vector<std::shared_ptr<const IdMap>> ids_;
+    std::shared_ptr<const CatalogColumns> columns_;
+    // pHash index: a MultiIndexHash as of its last build, plus a tail of
+    // the (ordinal, pHash) of records added or re-hashed since, which
+    // queries scan. Rebuilt once the tail outgrows max(4096, an eighth of
+    // the index). Entries of deleted or since re-hashed records stay until
+    // then; Similar() checks them against the record.
+    std::shared_ptr<const PhashIndex> phash_;
+    SharedColumn<uint32_t> phash_tail_ords_;
+    SharedColumn<uint64_t> phash_tail_;
+    std::shared_ptr<const RoaringBitmap> deleted_;
+    std::shared_ptr<const TagStore> tags_;
+    uint32_t end_ = 0;
+    size_t live_ = 0;
+    uint64_t seq_ = 0;
+};
+
+// A CatalogSnapshot kept alive by an epoch pin (see epoch.h): the version
+// it points at, and every version retired after it was pinned, stay
+// allocated until the handle is dropped. Readers see one commit point for
+// as long as they hold it while writers go on publishing; hold it for an
+// export or a batch of queries, not indefinitely. Must not outlive the
+// ImageDB it came from.
+class PinnedSnapshot {
+public:
+    PinnedSnapshot() = default;
+    PinnedSnapshot(EpochDomain::Guard guard, const CatalogSnapshot* snap) : guard_(std::move(guard)), snap_(snap) {}
+
+    const CatalogSnapshot* get() const { return snap_; }
+    const CatalogSnapshot& operator*() const { return *snap_; }
+    const CatalogSnapshot* operator->() const { return snap_; }
+    explicit operator bool() const { return snap_ != nullptr; }
+    uint64_t seq() const { return snap_->seq(); }
+
+private:
+    EpochDomain::Guard guard_;
+    const CatalogSnapshot* snap_ = nullptr;
+};
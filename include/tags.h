@@ -0,0 +1,64 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "roaring.h"
+
+// Tag dictionary plus one roaring posting list per tag, keyed by image
+// ordinal, next to the catalog:
+//   <dir>/tags.dict      name of tag id i on line i
+//   <dir>/tags.postings  [magic][u32 tags] then each tag's RoaringBitmap
+//   <dir>/tags.log       (u32 ordinal, u32 tag id | kRemoveBit) records not
+//                        yet folded into tags.postings
+// Tagging appends one 8-byte log record; Open() replays the log, and once it
+// grows past kCompactAfter records the postings are rewritten and the log
+// truncated. Replay is idempotent, so a crash mid-compaction is harmless.
+class TagStore {
+public:
+    static constexpr uint32_t kRemoveBit = 0x80000000u;
+    static constexpr size_t kCompactAfter = 1 << 16;
+
+    // Opens (creating empty files if needed). Throws std::runtime_error.
+    static TagStore Open(const std::string& dir);
+
+    // Tag names are 1-64 characters of [A-Za-z0-9_:.-] other than the
+    // words AND/OR/NOT, so queries never need quoting. Both return false
+    // (with a message) on invalid names or I/O errors.
+    bool Add(uint32_t ordinal, const std::string& tag);
+    bool Remove(uint32_t ordinal, const std::string& tag);
+
+    // Folds the log into tags.postings (temp file + rename).
+    bool Compact();
+
+    // Ordinals matching a boolean tag expression such as
+    //   "cat AND (outdoor OR garden) AND NOT blurry"
+    // AND/OR/NOT may also be written &, |, !; juxtaposition means AND and
+    // NOT binds tightest. A leading NOT complements against [0, universe).
+    // Unknown tags match nothing. Throws std::invalid_argument on syntax
+    // errors.
+    RoaringBitmap Query(const std::string& expr, uint32_t universe) const;
+
+    size_t size() const { return names_.size(); }
+    const std::string& name(size_t tag) const { return names_[tag]; }
+    const RoaringBitmap& postings(size_t tag) const { return postings_[tag]; }
+
+    // Posting list of `tag`, or nullptr if it was never used.
+    const RoaringBitmap* Find(const std::string& tag) const;
+
+private:
+    bool Log(uint32_t ordinal, uint32_t tag_word);
+    bool TagId(const std::string& tag, bool create, uint32_t* id);
+    void Apply(uint32_t ordinal, uint32_t tag_word);
+
+    std::string dir_;
+    std::vector<std::string> names_;
+    std::unordered_map<std::string, uint32_t> ids_;
+    std::vector<RoaringBitmap> postings_;
+    size_t log_records_ = 0;
+    std::ofstream dict_out_;
+    std::ofstream log_out_;
+};
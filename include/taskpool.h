@@ -0,0 +1,83 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <vector>
+
+// The process's CPU-bound work (import hashing and thumbnail decode, query
+// and similarity scans, resize renders) runs on one pool sized to the
+// machine instead of on threads each subsystem starts for itself.
+//
+// Every worker owns a Chase-Lev deque per priority: it pushes and pops its
+// own end without locks, and idle workers steal from the other end,
+// trying workers on their own NUMA node before remote ones. Work submitted
+// from outside the pool goes through a shared queue per priority. A
+// worker always takes the highest priority it can find anywhere before
+// looking at lower ones, so a background scan never delays a query.
+//
+//   WorkStealingPool pool;
+//   pool.ParallelFor(n, 4096, [&](size_t begin, size_t end) { ... });
+enum class TaskPriority : uint8_t { High, Normal, Low };
+
+class WorkStealingPool {
+public:
+    static constexpr int kPriorities = 3;
+
+    struct WorkerStats {
+        int node = 0;            // NUMA node the worker is pinned to
+        size_t queued = 0;       // tasks in its deques right now
+        uint64_t executed = 0;
+        uint64_t stolen = 0;     // tasks it took from other workers
+        uint64_t stolen_from = 0; // its tasks other workers took
+        uint64_t parked = 0;     // times it went to sleep for lack of work
+    };
+
+    struct Stats {
+        std::vector<WorkerStats> workers;
+        size_t injected_queued = 0;   // submitted from outside, not yet taken
+        int nodes = 1;
+    };
+
+    // workers = 0: one per CPU this process may run on. Workers are spread
+    // over the NUMA nodes in proportion to their CPUs and pinned to their
+    // node's CPUs (where /sys/devices/system/node describes the topology).
+    // Throws std::runtime_error if no thread can be started.
+    explicit WorkStealingPool(int workers = 0);
+    // Runs everything already submitted, then stops the workers.
+    ~WorkStealingPool();
+    WorkStealingPool(const WorkStealingPool&) = delete;
+    WorkStealingPool& operator=(const WorkStealingPool&) = delete;
+
+    // Queues `fn` and returns. A worker submitting puts it on its own
+    // deque, where it is likely to run next while its data is still in
+    // cache. Exceptions are reported on stderr.
+    void Submit(std::function<void()> fn, TaskPriority priority = TaskPriority::Normal);
+
+    // Runs fn(begin, end) over [0, n) in chunks of at most `grain`, on the
+    // workers and the calling thread, and returns when every chunk is
+    // done. The caller working too means a worker may call it without
+    // deadlocking the pool. The first exception is rethrown.
+    void ParallelFor(size_t n, size_t grain, const std::function<void(size_t, size_t)>& fn,
+                     TaskPriority priority = TaskPriority::Normal);
+
+    // Runs `fn` on a worker and blocks until it returns (inline when the
+    // caller is one of this pool's workers), rethrowing its exception.
+    // Bounds the CPU-heavy work of many blocked callers to the pool size.
+    void Run(const std::function<void()>& fn, TaskPriority priority = TaskPriority::Normal);
+
+    int workers() const;
+    // True on one of this pool's worker threads.
+    bool on_worker() const;
+    Stats stats() const;
+
+private:
+    struct Worker;
+    struct State;
+
+    std::unique_ptr<State> s_;
+};
+
+// The CPUs of each NUMA node this process may run on, node order; one
+// entry holding every allowed CPU when the kernel exposes no topology.
+std::vector<std::vector<int>> numa_cpus();
@@ -0,0 +1,446 @@
+#include "api.h"
+
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <sstream>
+#include <stdexcept>
+
+#include <image.h>
+#include <meta.h>
+#include <sha256.h>
+
+namespace {
+
+constexpr int kMaxSide = 4096;       // largest rendition side served
+constexpr int kThumbnailSide = 256;  // longest side of the stored thumbnail
+constexpr const char* kThumbnailMime = "image/png";  // as make_thumbnail_256 encodes it
+
+HttpResponse not_found() { return HttpResponse::Text(404, "Not Found\n"); }
+HttpResponse bad_method() { return HttpResponse::Text(405, "Method Not Allowed\n"); }
+
+// Parses /img query parameters; "" on success, else the error.
+std::string parse_resize(const HttpRequest& req, ResizeSpec* spec) {
+    auto side = [&](const char* name, int* out) -> bool {
+        const std::optional<std::string> v = req.param(name);
+        if (!v) return true;
+        if (v->empty() || v->size() > 5 || v->find_first_not_of("0123456789") != std::string::npos) return false;
+        *out = std::stoi(*v);
+        return *out >= 1 && *out <= kMaxSide;
+    };
+    if (!side("w", &spec->width) || !side("h", &spec->height)) {
+        return "w and h must be integers in 1.." + std::to_string(kMaxSide);
+    }
+    if (spec->width == 0 && spec->height == 0) return "w or h is needed";
+    const std::string fit = req.param("fit").value_or("contain");
+    if (fit != "contain" && fit != "cover") return "fit must be cover or contain";
+    spec->fit = fit == "cover" ? ResizeFit::Cover : ResizeFit::Contain;
+    const std::string fmt = req.param("fmt").value_or("jpg");
+    if (fmt != "jpg" && fmt != "png") return "fmt must be jpg or png";
+    spec->png = fmt == "png";
+    return "";
+}
+
+const char* state_name(int state) {
+    static const char* const kNames[] = {"queued", "running", "done", "duplicate", "failed"};
+    return kNames[state];
+}
+
+} // namespace
+
+ImageApi::ImageApi(ImageDB& db, const ApiOptions& opts)
+    : db_(db),
+      thumbs_(opts.thumb_cache_bytes),
+      variants_(DiskCache::Open(db.db_root + "/variants", opts.variant_cache_bytes)),
+      queue_cap_(std::max<size_t>(1, opts.import_queue)),
+      importer_([this] { RunImports(); }) {}
+
+ImageApi::~ImageApi() {
+    {
+        std::lock_guard<std::mutex> lock(jobs_mu_);
+        stopping_ = true;
+    }
+    jobs_cv_.notify_all();
+    importer_.join();
+}
+
+HttpResponse ImageApi::Handle(const HttpRequest& req) {
+    const std::string& path = req.path;
+    if (path == "/images") return req.method == "POST" ? Import(req) : bad_method();
+    if (path == "/query") return req.method == "GET" || req.method == "POST" ? Query(req) : bad_method();
+    if (path == "/stats") return req.method == "GET" ? Stats() : bad_method();
+    if (path.compare(0, 6, "/jobs/") == 0 && path.size() > 6) {
+        return req.method == "GET" ? Job(path.substr(6)) : bad_method();
+    }
+
+    if (path.compare(0, 5, "/img/") == 0 && path.size() > 5 && path.find('/', 5) == std::string::npos) {
+        return req.method == "GET" ? Resized(req, path.substr(5)) : bad_method();
+    }
+
+    const std::string prefix = "/images/";
+    if (path.compare(0, prefix.size(), prefix) != 0) return not_found();
+    const std::string rest = path.substr(prefix.size());
+    const size_t slash = rest.find('/');
+    const std::string id = rest.substr(0, slash);
+    const std::string part = slash == std::string::npos ? "" : rest.substr(slash + 1);
+    if (id.empty()) return not_found();
+    return Image(req, id, part);
+}
+
+// An upload to POST /images being written to its staging file as it
+// arrives, hashed in the same pass so ImportFile need not read the file
+// back for its digest. Holds an import queue slot while an async one is
+// staged. The file goes with the object unless a job took it over.
+class ImageApi::Upload : public HttpBodySink {
+public:
+    Upload(ImageApi& api, std::string path, bool async)
+        : path(std::move(path)), async(async), api_(api), out_(this->path, std::ios::binary | std::ios::trunc) {
+        sha256_init(ctx_);
+    }
+    ~Upload() override {
+        if (async && !queued) {
+            std::lock_guard<std::mutex> lock(api_.jobs_mu_);
+            --api_.reserved_;
+        }
+        out_.close();
+        std::error_code ec;
+        if (!queued) std::filesystem::remove(path, ec);
+    }
+
+    bool Write(std::string_view piece) override {
+        sha256_update(ctx_, reinterpret_cast<const uint8_t*>(piece.data()), piece.size());
+        bytes += piece.size();
+        return static_cast<bool>(out_.write(piece.data(), static_cast<std::streamsize>(piece.size())));
+    }
+    // Flushes the file; false if any write failed.
+    bool Finish(std::string* sha256) {
+        uint8_t digest[32];
+        sha256_final(ctx_, digest);
+        *sha256 = sha256_hex(digest);
+        return static_cast<bool>(out_.flush());
+    }
+
+    bool opened() const { return out_.is_open(); }
+
+    const std::string path;
+    const bool async;
+    uint64_t bytes = 0;
+    bool queued = false;   // set under jobs_mu_ once a job owns the file and slot
+
+private:
+    ImageApi& api_;
+    std::ofstream out_;
+    Sha256Ctx ctx_;
+};
+
+std::shared_ptr<ImageApi::Upload> ImageApi::StartUpload(const HttpRequest& req, HttpResponse* refused) {
+    const std::string param = req.param("async").value_or("");
+    const bool async = param == "1" || param == "true";
+    // Take a slot before writing anything, so a full queue costs the
+    // client one round trip and us no disk.
+    if (async) {
+        std::lock_guard<std::mutex> lock(jobs_mu_);
+        if (queue_.size() + reserved_ >= queue_cap_) {
+            *refused = HttpResponse::Text(429, "import queue full\n");
+            refused->headers.emplace_back("Retry-After", "1");
+            return nullptr;
+        }
+        ++reserved_;
+    }
+    // ImportFile reads from a path: stage the body under the DB root.
+    const std::string dir = db_.db_root + "/tmp";
+    std::error_code ec;
+    std::filesystem::create_directories(dir, ec);
+    auto up = std::make_shared<Upload>(*this, dir + "/upload-" + std::to_string(uploads_.fetch_add(1)), async);
+    if (!up->opened()) {
+        *refused = HttpResponse::Text(500, "cannot stage upload\n");
+        return nullptr;
+    }
+    return up;
+}
+
+std::optional<HttpResponse> ImageApi::Admit(const HttpRequest& req, std::shared_ptr<HttpBodySink>* sink) {
+    if (req.path != "/images" || req.method != "POST") return std::nullopt;
+    HttpResponse refused;
+    std::shared_ptr<Upload> up = StartUpload(req, &refused);
+    if (!up) return refused;
+    *sink = std::move(up);
+    return std::nullopt;
+}
+
+HttpResponse ImageApi::Import(const HttpRequest& req) {
+    // Served by HttpServer, the body has already streamed into the upload
+    // Admit started; a request handed over whole is staged here.
+    std::shared_ptr<Upload> up = std::dynamic_pointer_cast<Upload>(req.body_sink);
+    if (!up) {
+        HttpResponse refused;
+        if (!(up = StartUpload(req, &refused))) return refused;
+        up->Write(req.body);
+    }
+    if (up->bytes == 0) return HttpResponse::Text(400, "empty body\n");
+    std::string sha256;
+    if (!up->Finish(&sha256)) return HttpResponse::Text(500, "cannot stage upload\n");
+    if (up->async) return ImportAsync(*up, sha256);
+
+    ImportResult result;
+    const bool ok = db_.ImportFile(up->path, &result, sha256);
+    if (result.duplicate) return HttpResponse::Text(409, "already present\n");
+    if (!ok) return HttpResponse::Text(400, "cannot import image\n");
+
+    HttpResponse r;
+    r.status = 201;
+    r.content_type = "application/json";
+    r.headers.emplace_back("Location", "/images/" + result.image_id);
+    r.body = "{\"image_id\":\"" + result.image_id + "\"}\n";
+    return r;
+}
+
+HttpResponse ImageApi::ImportAsync(Upload& up, const std::string& sha256) {
+    ImportJob job;
+    job.staged = up.path;
+    job.sha256 = sha256;
+
+    // The upload's slot and file pass to the job.
+    std::unique_lock<std::mutex> lock(jobs_mu_);
+    --reserved_;
+    up.queued = true;
+    job.id = std::to_string(++next_job_);
+    jobs_[job.id] = JobStatus{};
+    HttpResponse r;
+    r.status = 202;
+    r.content_type = "application/json";
+    r.headers.emplace_back("Location", "/jobs/" + job.id);
+    r.body = "{\"job_id\":\"" + job.id + "\",\"sha256\":\"" + job.sha256 + "\"}\n";
+    queue_.push_back(std::move(job));
+    lock.unlock();
+    jobs_cv_.notify_one();
+    return r;
+}
+
+void ImageApi::RunImports() {
+    std::unique_lock<std::mutex> lock(jobs_mu_);
+    for (;;) {
+        jobs_cv_.wait(lock, [this] { return stopping_ || !queue_.empty(); });
+        if (queue_.empty()) return;   // stopping, and nothing left to do
+        ImportJob job = std::move(queue_.front());
+        queue_.pop_front();
+        jobs_[job.id].state = JobState::Running;
+        lock.unlock();
+
+        ImportResult result;
+        const bool ok = db_.ImportFile(job.staged, &result, job.sha256);
+        std::error_code ec;
+        std::filesystem::remove(job.staged, ec);
+
+        lock.lock();
+        JobStatus& st = jobs_[job.id];
+        st.state = result.duplicate ? JobState::Duplicate : ok ? JobState::Done : JobState::Failed;
+        st.image_id = result.image_id;
+        finished_.push_back(job.id);
+        while (finished_.size() > kJobHistory) {
+            jobs_.erase(finished_.front());
+            finished_.pop_front();
+        }
+    }
+}
+
+HttpResponse ImageApi::Job(const std::string& id) {
+    JobStatus st;
+    {
+        std::lock_guard<std::mutex> lock(jobs_mu_);
+        const auto found = jobs_.find(id);
+        if (found == jobs_.end()) return not_found();
+        st = found->second;
+    }
+    HttpResponse r;
+    r.content_type = "application/json";
+    r.body = "{\"job_id\":\"" + id + "\",\"state\":\"" + state_name(static_cast<int>(st.state)) + "\"";
+    if (!st.image_id.empty()) r.body += ",\"image_id\":\"" + st.image_id + "\"";
+    r.body += "}\n";
+    return r;
+}
+
+HttpResponse ImageApi::Query(const HttpRequest& req) {
+    std::string sql = req.body;
+    if (req.method == "GET") {
+        const std::optional<std::string> q = req.param("q");
+        if (!q) return HttpResponse::Text(400, "missing q parameter\n");
+        sql = *q;
+    }
+    std::ostringstream out;
+    try {
+        db_.RunQuery(sql, out);
+    } catch (const std::invalid_argument& e) {
+        return HttpResponse::Text(400, std::string(e.what()) + "\n");
+    }
+    return HttpResponse::Text(200, out.str());
+}
+
+HttpResponse ImageApi::Image(const HttpRequest& req, const std::string& id, const std::string& part) {
+    if (part.empty() && req.method == "DELETE") {
+        if (!db_.Delete(id)) return not_found();
+        thumbs_.Erase(id);
+        return HttpResponse::Text(204, "");
+    }
+    if (req.method != "GET") return bad_method();
+    if (part == "thumbnail" && !req.header("range")) return Thumbnail(req, id);
+
+    const std::optional<ImageMeta> m = db_.GetImage(id);
+    if (!m) return not_found();
+
+    if (part.empty()) {
+        HttpResponse r;
+        r.content_type = "application/json";
+        r.body = meta_to_json(*m) + "\n";
+        return r;
+    }
+    if (part == "blob") return HttpResponse::File(req, db_.BlobPath(m->sha256), m->mime);
+    if (part == "thumbnail") return HttpResponse::File(req, db_.ThumbnailPath(m->image_id), kThumbnailMime);
+    return not_found();
+}
+
+HttpResponse ImageApi::Thumbnail(const HttpRequest& req, const std::string& id) {
+    TinyLfuCache::Value bytes = thumbs_.Get(id);
+    if (!bytes) {
+        if (!db_.Snapshot()->Find(id)) return not_found();
+        const std::string path = db_.ThumbnailPath(id);
+        std::ifstream in(path, std::ios::binary);
+        if (!in) return HttpResponse::File(req, path, kThumbnailMime);
+        bytes = std::make_shared<const std::string>(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+        // A Delete may have erased the entry since the lookup above. It
+        // publishes before erasing, so either the image is gone from the
+        // snapshot by now or its Erase still comes after this Put.
+        thumbs_.Put(id, bytes);
+        if (!db_.Snapshot()->Find(id)) {
+            thumbs_.Erase(id);
+            return not_found();
+        }
+    }
+    HttpResponse r;
+    r.content_type = kThumbnailMime;
+    r.headers.emplace_back("Accept-Ranges", "bytes");
+    r.shared_body = std::move(bytes);
+    return r;
+}
+
+HttpResponse ImageApi::Resized(const HttpRequest& req, const std::string& id) {
+    ResizeSpec spec;
+    const std::string err = parse_resize(req, &spec);
+    if (!err.empty()) return HttpResponse::Text(400, err + "\n");
+
+    const std::optional<ImageMeta> m = db_.GetImage(id);
+    if (!m) return not_found();
+
+    const char* mime = spec.png ? "image/png" : "image/jpeg";
+    const std::string key = m->sha256 + "_" + std::to_string(spec.width) + "x" + std::to_string(spec.height) +
+                            (spec.fit == ResizeFit::Cover ? "_cover." : "_contain.") + (spec.png ? "png" : "jpg");
+    auto cached = [&]() -> std::optional<HttpResponse> {
+        const std::string path = variants_.Lookup(key);
+        if (path.empty()) return std::nullopt;
+        HttpResponse r = HttpResponse::File(req, path, mime);
+        if (r.status == 404) return std::nullopt;   // evicted since the lookup
+        return r;
+    };
+    if (std::optional<HttpResponse> r = cached()) return std::move(*r);
+
+    // One render per key at a time; later arrivals wait for its bytes.
+    std::promise<TinyLfuCache::Value> promise;
+    std::shared_future<TinyLfuCache::Value> flight;
+    bool leader = false;
+    {
+        std::lock_guard<std::mutex> lock(flights_mu_);
+        auto it = flights_.find(key);
+        if (it == flights_.end()) {
+            it = flights_.emplace(key, promise.get_future().share()).first;
+            leader = true;
+        }
+        flight = it->second;
+    }
+    TinyLfuCache::Value bytes;
+    if (!leader) {
+        coalesced_.fetch_add(1);
+        bytes = flight.get();
+    } else {
+        // Waiters block on the promise and later requests on the flight:
+        // both are settled however the render ends, an exception included.
+        const auto land = [&] {
+            std::lock_guard<std::mutex> lock(flights_mu_);
+            flights_.erase(key);
+        };
+        std::optional<HttpResponse> r;
+        try {
+            // A render that finished between our lookup and taking the flight.
+            r = cached();
+            if (!r) {
+                // The thumbnail is a downscaled copy of a large original; use it
+                // when the rendition needs no more pixels than it has.
+                std::string src = db_.BlobPath(m->sha256);
+                const int longest = static_cast<int>(std::max(m->width, m->height));
+                if (longest > kThumbnailSide && resize_scale(m->width, m->height, spec) <= static_cast<double>(kThumbnailSide) / longest &&
+                    std::filesystem::exists(db_.ThumbnailPath(m->image_id))) {
+                    src = db_.ThumbnailPath(m->image_id);
+                }
+                // Decode and resample on the DB's pool, which bounds how many
+                // renders compete for the CPUs however many requests wait.
+                std::string out;
+                bool rendered = false;
+                db_.Pool().Run([&] { rendered = render_resized(src, spec, &out); }, TaskPriority::High);
+                if (rendered) {
+                    bytes = std::make_shared<const std::string>(std::move(out));
+                    variants_.Insert(key, *bytes);
+                }
+            }
+        } catch (...) {
+            promise.set_exception(std::current_exception());
+            land();
+            throw;
+        }
+        promise.set_value(bytes);
+        land();
+        if (r) return std::move(*r);
+    }
+    if (!bytes) {
+        // The leader found the file cached, or could not render: look again.
+        if (std::optional<HttpResponse> r = cached()) return std::move(*r);
+        return HttpResponse::Text(500, "cannot render image\n");
+    }
+
+    HttpResponse r;
+    r.content_type = mime;
+    r.shared_body = std::move(bytes);
+    return r;
+}
+
+HttpResponse ImageApi::Stats() const {
+    const TinyLfuCache::Stats st = thumbs_.stats();
+    const DiskCache::Stats vt = variants_.stats();
+    const WorkStealingPool::Stats ps = db_.Pool().stats();
+    size_t queued, jobs;
+    {
+        std::lock_guard<std::mutex> lock(jobs_mu_);
+        queued = queue_.size() + reserved_;
+        jobs = jobs_.size();
+    }
+    HttpResponse r;
+    r.content_type = "application/json";
+    r.body = "{\"thumb_cache\":{\"hits\":" + std::to_string(st.hits) + ",\"misses\":" + std::to_string(st.misses) +
+             ",\"evictions\":" + std::to_string(st.evictions) + ",\"rejections\":" + std::to_string(st.rejections) +
+             ",\"entries\":" + std::to_string(st.entries) + ",\"bytes\":" + std::to_string(st.bytes) +
+             ",\"budget\":" + std::to_string(thumbs_.budget()) + "}" +
+             ",\"variant_cache\":{\"hits\":" + std::to_string(vt.hits) + ",\"misses\":" + std::to_string(vt.misses) +
+             ",\"evictions\":" + std::to_string(vt.evictions) + ",\"entries\":" + std::to_string(vt.entries) +
+             ",\"bytes\":" + std::to_string(vt.bytes) + ",\"budget\":" + std::to_string(variants_.budget()) +
+             ",\"coalesced\":" + std::to_string(coalesced_.load()) + "}" +
+             ",\"imports\":{\"queued\":" + std::to_string(queued) + ",\"capacity\":" + std::to_string(queue_cap_) +
+             ",\"jobs\":" + std::to_string(jobs) + "}" +
+             ",\"pool\":{\"nodes\":" + std::to_string(ps.nodes) + ",\"injected\":" + std::to_string(ps.injected_queued) +
+             ",\"workers\":[";
+    for (size_t i = 0; i < ps.workers.size(); ++i) {
+        const WorkStealingPool::WorkerStats& w = ps.workers[i];
+        r.body += std::string(i ? "," : "") + "{\"node\":" + std::to_string(w.node) + ",\"queued\":" + std::to_string(w.queued) +
+                  ",\"executed\":" + std::to_string(w.executed) + ",\"stolen\":" + std::to_string(w.stolen) +
+                  ",\"stolen_from\":" + std::to_string(w.stolen_from) + ",\"parked\":" + std::to_string(w.parked) + "}";
+    }
+    r.body += "]}}\n";
+    return r;
+}
@@ -0,0 +1,173 @@
+#include "bloom.h"
+
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <stdexcept>
+#include <utility>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define IMGDB_X86 1
+#include <immintrin.h>
+#endif
+
+struct BlockedBloom::Header {
+    char magic[8];
+    uint64_t blocks;
+    uint64_t count;
+    uint64_t capacity;
+    uint64_t catalog_bytes;
+    char pad[24];
+};
+
+namespace {
+
+constexpr char kMagic[8] = {'I', 'M', 'G', 'B', 'L', 'M', '0', '1'};
+
+// Odd multipliers; word i takes bit (key32 * kSalt[i]) >> 26.
+constexpr uint32_t kSalt[BlockedBloom::kProbes] = {0x47b6137bU, 0x44974d91U, 0x8824ad5bU, 0xa2b7289dU,
+                                                   0x705495c7U, 0x2df1424bU, 0x9efc4947U, 0x5c6bfb31U};
+
+bool probe_scalar(const uint64_t* w, uint32_t k) {
+    for (int i = 0; i < BlockedBloom::kProbes; ++i) {
+        if (!(w[i] >> ((k * kSalt[i]) >> 26) & 1)) return false;
+    }
+    return true;
+}
+
+#ifdef IMGDB_X86
+// The eight bit indexes come from one 32-bit multiply and shift, widened
+// to 64-bit lanes for the variable shifts; testc checks (~block & mask) == 0.
+__attribute__((target("avx2")))
+bool probe_avx2(const uint64_t* w, uint32_t k) {
+    const __m256i salt = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(kSalt));
+    const __m256i bits = _mm256_srli_epi32(_mm256_mullo_epi32(_mm256_set1_epi32(static_cast<int>(k)), salt), 26);
+    const __m256i one = _mm256_set1_epi64x(1);
+    const __m256i lo = _mm256_sllv_epi64(one, _mm256_cvtepu32_epi64(_mm256_castsi256_si128(bits)));
+    const __m256i hi = _mm256_sllv_epi64(one, _mm256_cvtepu32_epi64(_mm256_extracti128_si256(bits, 1)));
+    const __m256i w0 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(w));
+    const __m256i w1 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(w + 4));
+    return _mm256_testc_si256(w0, lo) & _mm256_testc_si256(w1, hi);
+}
+#endif
+
+using ProbeFn = bool (*)(const uint64_t*, uint32_t);
+
+ProbeFn pick_probe() {
+#ifdef IMGDB_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) return probe_avx2;
+#endif
+    return probe_scalar;
+}
+
+} // namespace
+
+BlockedBloom BlockedBloom::Create(const std::string& path, uint64_t capacity) {
+    static_assert(sizeof(Header) == kBlockBytes, "header fills one block");
+    const uint64_t blocks = std::max<uint64_t>(1, (capacity * kBitsPerKey + kBlockBytes * 8 - 1) / (kBlockBytes * 8));
+    const std::string tmp = path + ".tmp";
+    const int fd = ::open(tmp.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) throw std::runtime_error("BlockedBloom: cannot create " + tmp);
+    Header h{};
+    std::memcpy(h.magic, kMagic, sizeof kMagic);
+    h.blocks = blocks;
+    h.capacity = capacity;
+    const bool ok = ::ftruncate(fd, static_cast<off_t>((blocks + 1) * kBlockBytes)) == 0 &&
+                    ::pwrite(fd, &h, sizeof h, 0) == static_cast<ssize_t>(sizeof h);
+    ::close(fd);
+    std::error_code ec;
+    if (ok) std::filesystem::rename(tmp, path, ec);
+    if (!ok || ec) throw std::runtime_error("BlockedBloom: cannot write " + path);
+    std::optional<BlockedBloom> f = Open(path);
+    if (!f) throw std::runtime_error("BlockedBloom: cannot map " + path);
+    return std::move(*f);
+}
+
+std::optional<BlockedBloom> BlockedBloom::Open(const std::string& path) {
+    const int fd = ::open(path.c_str(), O_RDWR);
+    if (fd < 0) return std::nullopt;
+    struct stat st;
+    Header h{};
+    if (::fstat(fd, &st) != 0 || ::pread(fd, &h, sizeof h, 0) != static_cast<ssize_t>(sizeof h) ||
+        std::memcmp(h.magic, kMagic, sizeof kMagic) != 0 ||
+        static_cast<uint64_t>(st.st_size) != (h.blocks + 1) * kBlockBytes || h.blocks == 0) {
+        ::close(fd);
+        return std::nullopt;
+    }
+    void* map = ::mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (map == MAP_FAILED) return std::nullopt;
+    BlockedBloom f;
+    f.map_ = map;
+    f.len_ = static_cast<size_t>(st.st_size);
+    f.blocks_ = h.blocks;
+    return std::optional<BlockedBloom>(std::move(f));
+}
+
+uint64_t BlockedBloom::KeyOfSha256(const std::string& hex) {
+    uint64_t key = 0;
+    for (size_t i = 0; i < 16 && i < hex.size(); ++i) {
+        const char c = hex[i];
+        uint64_t d = 0;
+        if (c >= '0' && c <= '9') d = static_cast<uint64_t>(c - '0');
+        else if (c >= 'a' && c <= 'f') d = static_cast<uint64_t>(c - 'a' + 10);
+        else if (c >= 'A' && c <= 'F') d = static_cast<uint64_t>(c - 'A' + 10);
+        key = key << 4 | d;
+    }
+    return key;
+}
+
+BlockedBloom::~BlockedBloom() {
+    if (map_) ::munmap(map_, len_);
+}
+
+BlockedBloom::BlockedBloom(BlockedBloom&& o) noexcept
+    : map_(std::exchange(o.map_, nullptr)), len_(o.len_), blocks_(o.blocks_) {}
+
+BlockedBloom& BlockedBloom::operator=(BlockedBloom&& o) noexcept {
+    if (this != &o) {
+        if (map_) ::munmap(map_, len_);
+        map_ = std::exchange(o.map_, nullptr);
+        len_ = o.len_;
+        blocks_ = o.blocks_;
+    }
+    return *this;
+}
+
+// High half picks the block (multiply-shift instead of a modulo).
+uint64_t* BlockedBloom::block(uint64_t key) const {
+    const uint64_t b = ((key >> 32) * blocks_) >> 32;
+    return static_cast<uint64_t*>(map_) + (b + 1) * (kBlockBytes / 8);
+}
+
+void BlockedBloom::Add(uint64_t key) {
+    uint64_t* w = block(key);
+    const uint32_t k = static_cast<uint32_t>(key);
+    for (int i = 0; i < kProbes; ++i) w[i] |= uint64_t{1} << ((k * kSalt[i]) >> 26);
+    ++header()->count;
+}
+
+bool BlockedBloom::MayContain(uint64_t key) const {
+    static const ProbeFn probe = pick_probe();
+    return probe(block(key), static_cast<uint32_t>(key));
+}
+
+bool BlockedBloom::Sync() {
+    if (::msync(map_, len_, MS_SYNC) != 0) {
+        std::cerr << "BlockedBloom: msync failed\n";
+        return false;
+    }
+    return true;
+}
+
+uint64_t BlockedBloom::count() const { return header()->count; }
+uint64_t BlockedBloom::capacity() const { return header()->capacity; }
+uint64_t BlockedBloom::catalog_bytes() const { return header()->catalog_bytes; }
+void BlockedBloom::set_catalog_bytes(uint64_t bytes) { header()->catalog_bytes = bytes; }
@@ -0,0 +1,532 @@
+#include "btree.h"
+
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+
+#include <fcntl.h>
+#include <sys/file.h>
+#include <unistd.h>
+
+namespace {
+
+constexpr char kMagic[8] = {'I', 'M', 'G', 'B', 'T', '0', '0', '1'};
+constexpr size_t kPage = BufferPool::kPageSize;
+
+struct Meta {
+    char magic[8];
+    uint32_t root;
+    uint32_t height;
+    uint32_t pages;
+    uint32_t dirty;
+    uint64_t entries;
+    uint64_t synced_rows;
+};
+
+template <typename T>
+T get(const unsigned char* p, size_t off) {
+    T v;
+    std::memcpy(&v, p + off, sizeof v);
+    return v;
+}
+
+template <typename T>
+void put(unsigned char* p, size_t off, T v) {
+    std::memcpy(p + off, &v, sizeof v);
+}
+
+// ---- node accessors (layout in btree.h) ----
+
+bool is_leaf(const unsigned char* p) { return get<uint16_t>(p, 0) == 1; }
+size_t count(const unsigned char* p) { return get<uint16_t>(p, 2); }
+void set_header(unsigned char* p, bool leaf, size_t n) {
+    put<uint16_t>(p, 0, leaf ? 1 : 0);
+    put<uint16_t>(p, 2, static_cast<uint16_t>(n));
+}
+uint32_t next_leaf(const unsigned char* p) { return get<uint32_t>(p, 4); }
+
+BTree::Entry leaf_entry(const unsigned char* p, size_t i) {
+    return {get<uint64_t>(p, 8 + 12 * i), get<uint32_t>(p, 16 + 12 * i)};
+}
+void set_leaf_entry(unsigned char* p, size_t i, const BTree::Entry& e) {
+    put(p, 8 + 12 * i, e.first);
+    put(p, 16 + 12 * i, e.second);
+}
+
+uint32_t child(const unsigned char* p, size_t i) {
+    return i == 0 ? get<uint32_t>(p, 8) : get<uint32_t>(p, 12 + 16 * (i - 1) + 12);
+}
+BTree::Entry separator(const unsigned char* p, size_t i) {
+    return {get<uint64_t>(p, 12 + 16 * i), get<uint32_t>(p, 20 + 16 * i)};
+}
+void set_inner(unsigned char* p, uint32_t child0, const std::vector<BTree::Entry>& seps,
+               const std::vector<uint32_t>& kids, size_t from, size_t n) {
+    set_header(p, false, n);
+    put<uint32_t>(p, 4, 0);
+    put(p, 8, child0);
+    for (size_t i = 0; i < n; ++i) {
+        put(p, 12 + 16 * i, seps[from + i].first);
+        put(p, 20 + 16 * i, seps[from + i].second);
+        put(p, 24 + 16 * i, kids[from + i]);
+    }
+}
+
+// First leaf slot whose entry is >= e.
+size_t leaf_lower_bound(const unsigned char* p, const BTree::Entry& e) {
+    size_t lo = 0, hi = count(p);
+    while (lo < hi) {
+        const size_t mid = (lo + hi) / 2;
+        if (leaf_entry(p, mid) < e) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo;
+}
+
+// Child to descend into for e: the number of separators <= e.
+size_t child_index(const unsigned char* p, const BTree::Entry& e) {
+    size_t lo = 0, hi = count(p);
+    while (lo < hi) {
+        const size_t mid = (lo + hi) / 2;
+        if (!(e < separator(p, mid))) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo;
+}
+
+bool write_page(int fd, uint32_t id, const unsigned char* p) {
+    return ::pwrite(fd, p, kPage, static_cast<off_t>(id) * kPage) == static_cast<ssize_t>(kPage);
+}
+
+} // namespace
+
+// ---- BufferPool ----
+
+BufferPool::BufferPool(int fd, size_t frames, uint32_t page_count)
+    : fd_(fd), page_count_(page_count), frames_(frames), bytes_(frames * kPageSize) {}
+
+BufferPool::Frame* BufferPool::Victim() {
+    // Two sweeps: the first clears reference bits, the second finds a frame.
+    for (size_t step = 0; step < 2 * frames_.size(); ++step) {
+        Frame& f = frames_[hand_];
+        hand_ = (hand_ + 1) % frames_.size();
+        if (f.pins > 0) continue;
+        if (f.ref) {
+            f.ref = false;
+            continue;
+        }
+        if (f.page != UINT32_MAX) {
+            if (f.dirty && !WriteBack(f)) return nullptr;
+            table_.erase(f.page);
+            f.page = UINT32_MAX;
+        }
+        return &f;
+    }
+    std::cerr << "BufferPool: every frame is pinned\n";
+    return nullptr;
+}
+
+bool BufferPool::WriteBack(Frame& f) {
+    if (!write_page(fd_, f.page, Data(f))) {
+        std::cerr << "BufferPool: cannot write page " << f.page << "\n";
+        return false;
+    }
+    f.dirty = false;
+    return true;
+}
+
+unsigned char* BufferPool::Pin(uint32_t id) {
+    const auto it = table_.find(id);
+    if (it != table_.end()) {
+        Frame& f = frames_[it->second];
+        ++f.pins;
+        f.ref = true;
+        ++hits_;
+        return Data(f);
+    }
+    Frame* f = Victim();
+    if (!f) return nullptr;
+    if (::pread(fd_, Data(*f), kPageSize, static_cast<off_t>(id) * kPageSize) != static_cast<ssize_t>(kPageSize)) {
+        std::cerr << "BufferPool: cannot read page " << id << "\n";
+        return nullptr;
+    }
+    ++misses_;
+    *f = Frame{id, 1, false, true};
+    table_[id] = static_cast<size_t>(f - frames_.data());
+    return Data(*f);
+}
+
+unsigned char* BufferPool::PinNew(uint32_t* id) {
+    Frame* f = Victim();
+    if (!f) return nullptr;
+    *id = page_count_++;
+    std::memset(Data(*f), 0, kPageSize);
+    *f = Frame{*id, 1, true, true};
+    table_[*id] = static_cast<size_t>(f - frames_.data());
+    return Data(*f);
+}
+
+void BufferPool::Unpin(uint32_t id, bool dirty) {
+    Frame& f = frames_[table_.at(id)];
+    --f.pins;
+    f.dirty = f.dirty || dirty;
+}
+
+bool BufferPool::Flush() {
+    for (Frame& f : frames_) {
+        if (f.page != UINT32_MAX && f.dirty && !WriteBack(f)) return false;
+    }
+    return true;
+}
+
+// ---- BTree ----
+
+BTree::BTree(int fd, uint32_t pages) : fd_(fd), pool_(fd, kPoolFrames, pages) {}
+
+BTree::BTree(BTree&& o) noexcept
+    : path_(std::move(o.path_)), fd_(std::exchange(o.fd_, -1)), root_(o.root_), height_(o.height_),
+      entries_(o.entries_), synced_rows_(o.synced_rows_), dirty_(std::exchange(o.dirty_, false)),
+      writable_(o.writable_), pool_(std::move(o.pool_)) {}
+
+BTree& BTree::operator=(BTree&& o) noexcept {
+    if (this != &o) {
+        if (fd_ >= 0) {
+            if (dirty_) Flush();
+            ::close(fd_);
+        }
+        path_ = std::move(o.path_);
+        fd_ = std::exchange(o.fd_, -1);
+        root_ = o.root_;
+        height_ = o.height_;
+        entries_ = o.entries_;
+        synced_rows_ = o.synced_rows_;
+        dirty_ = std::exchange(o.dirty_, false);
+        writable_ = o.writable_;
+        pool_ = std::move(o.pool_);
+    }
+    return *this;
+}
+
+BTree::~BTree() {
+    if (fd_ < 0) return;
+    if (dirty_) Flush();
+    ::close(fd_);
+}
+
+std::optional<BTree> BTree::Open(const std::string& path) {
+    return Open(path, true);
+}
+
+std::optional<BTree> BTree::OpenReadOnly(const std::string& path) {
+    return Open(path, false);
+}
+
+std::optional<BTree> BTree::Open(const std::string& path, bool writable) {
+    const int fd = ::open(path.c_str(), writable ? O_RDWR : O_RDONLY);
+    if (fd < 0) return std::nullopt;
+    Meta m{};
+    // A reader's lock is taken before the header is read, so no update
+    // starts after it.
+    if ((!writable && ::flock(fd, LOCK_SH | LOCK_NB) != 0) ||
+        ::pread(fd, &m, sizeof m, 0) != static_cast<ssize_t>(sizeof m) ||
+        std::memcmp(m.magic, kMagic, sizeof kMagic) != 0 || m.dirty != 0 || m.root == 0 || m.root >= m.pages) {
+        ::close(fd);
+        return std::nullopt;
+    }
+    BTree t(fd, m.pages);
+    t.path_ = path;
+    t.writable_ = writable;
+    t.root_ = m.root;
+    t.height_ = m.height;
+    t.entries_ = m.entries;
+    t.synced_rows_ = m.synced_rows;
+    return std::optional<BTree>(std::move(t));
+}
+
+bool BTree::WriteMeta(bool dirty) {
+    Meta m{};
+    std::memcpy(m.magic, kMagic, sizeof kMagic);
+    m.root = root_;
+    m.height = height_;
+    m.pages = pool_.page_count();
+    m.dirty = dirty ? 1 : 0;
+    m.entries = entries_;
+    m.synced_rows = synced_rows_;
+    if (::pwrite(fd_, &m, sizeof m, 0) != static_cast<ssize_t>(sizeof m)) {
+        std::cerr << "BTree: cannot write header of " << path_ << "\n";
+        return false;
+    }
+    return true;
+}
+
+bool BTree::Insert(uint64_t key, uint32_t ordinal) {
+    if (!dirty_) {
+        // A reader's flock would be converted, and then dropped, by ours.
+        if (!writable_ || ::flock(fd_, LOCK_EX | LOCK_NB) != 0) return false;
+        if (!WriteMeta(true)) {
+            ::flock(fd_, LOCK_UN);
+            return false;
+        }
+        dirty_ = true;
+    }
+    bool inserted = false;
+    Entry up_key;
+    uint32_t up_page = 0;
+    if (!InsertInto(root_, 0, {key, ordinal}, &inserted, &up_key, &up_page)) return false;
+    if (up_page != 0) {
+        // The root split: grow the tree by one level.
+        uint32_t id;
+        unsigned char* p = pool_.PinNew(&id);
+        if (!p) return false;
+        set_inner(p, root_, {up_key}, {up_page}, 0, 1);
+        pool_.Unpin(id, true);
+        root_ = id;
+        ++height_;
+    }
+    if (inserted) ++entries_;
+    return true;
+}
+
+bool BTree::InsertInto(uint32_t page, uint32_t depth, const Entry& e, bool* inserted, Entry* up_key,
+                       uint32_t* up_page) {
+    unsigned char* p = pool_.Pin(page);
+    if (!p) return false;
+
+    if (is_leaf(p)) {
+        const size_t n = count(p);
+        const size_t pos = leaf_lower_bound(p, e);
+        if (pos < n && leaf_entry(p, pos) == e) {
+            pool_.Unpin(page, false);
+            return true;
+        }
+        *inserted = true;
+        if (n < kLeafCap) {
+            std::memmove(p + 8 + 12 * (pos + 1), p + 8 + 12 * pos, 12 * (n - pos));
+            set_leaf_entry(p, pos, e);
+            set_header(p, true, n + 1);
+            pool_.Unpin(page, true);
+            return true;
+        }
+
+        std::vector<Entry> all(n + 1);
+        for (size_t i = 0, j = 0; i <= n; ++i) all[i] = i == pos ? e : leaf_entry(p, j++);
+        // Appending past the last leaf (time-ordered keys) leaves the left
+        // page full instead of half empty.
+        const size_t keep = pos == n && next_leaf(p) == 0 ? n : (n + 1) / 2;
+        uint32_t right_id;
+        unsigned char* r = pool_.PinNew(&right_id);
+        if (!r) {
+            pool_.Unpin(page, false);
+            return false;
+        }
+        set_header(r, true, n + 1 - keep);
+        put(r, 4, next_leaf(p));
+        for (size_t i = keep; i <= n; ++i) set_leaf_entry(r, i - keep, all[i]);
+        set_header(p, true, keep);
+        put(p, 4, right_id);
+        for (size_t i = 0; i < keep; ++i) set_leaf_entry(p, i, all[i]);
+        pool_.Unpin(right_id, true);
+        pool_.Unpin(page, true);
+        *up_key = all[keep];
+        *up_page = right_id;
+        return true;
+    }
+
+    const size_t idx = child_index(p, e);
+    const uint32_t down = child(p, idx);
+    pool_.Unpin(page, false);
+
+    Entry key;
+    uint32_t split = 0;
+    if (!InsertInto(down, depth + 1, e, inserted, &key, &split)) return false;
+    if (split == 0) return true;
+
+    // Put (key, split) right after child idx.
+    p = pool_.Pin(page);
+    if (!p) return false;
+    const size_t n = count(p);
+    std::vector<Entry> seps(n + 1);
+    std::vector<uint32_t> kids(n + 1);   // kids[i] is the child right of seps[i]
+    for (size_t i = 0, j = 0; i <= n; ++i) {
+        if (i == idx) {
+            seps[i] = key;
+            kids[i] = split;
+        } else {
+            seps[i] = separator(p, j);
+            kids[i] = child(p, j + 1);
+            ++j;
+        }
+    }
+    const uint32_t child0 = child(p, 0);
+    if (n < kInnerCap) {
+        set_inner(p, child0, seps, kids, 0, n + 1);
+        pool_.Unpin(page, true);
+        return true;
+    }
+
+    // Split: the middle separator moves up, its child starts the right node.
+    const size_t mid = (n + 1) / 2;
+    uint32_t right_id;
+    unsigned char* r = pool_.PinNew(&right_id);
+    if (!r) {
+        pool_.Unpin(page, false);
+        return false;
+    }
+    set_inner(r, kids[mid], seps, kids, mid + 1, n - mid);
+    set_inner(p, child0, seps, kids, 0, mid);
+    pool_.Unpin(right_id, true);
+    pool_.Unpin(page, true);
+    *up_key = seps[mid];
+    *up_page = right_id;
+    return true;
+}
+
+bool BTree::Flush() {
+    if (!dirty_) return true;
+    // Pages reach the disk before the header says they are consistent.
+    if (!pool_.Flush() || ::fdatasync(fd_) != 0 || !WriteMeta(false)) return false;
+    dirty_ = false;
+    ::flock(fd_, LOCK_UN);
+    return true;
+}
+
+std::vector<uint32_t> BTree::Range(uint64_t lo, uint64_t hi, size_t* pages) const {
+    std::vector<uint32_t> out;
+    size_t touched = 0;
+    if (lo > hi) {
+        if (pages) *pages = 0;
+        return out;
+    }
+    const Entry from{lo, 0};
+    uint32_t page = root_;
+    for (;;) {
+        const unsigned char* p = pool_.Pin(page);
+        ++touched;
+        if (!p) return out;
+        if (is_leaf(p)) {
+            pool_.Unpin(page, false);
+            break;
+        }
+        const uint32_t down = child(p, child_index(p, from));
+        pool_.Unpin(page, false);
+        page = down;
+    }
+
+    bool first = true;
+    while (page != 0) {
+        const unsigned char* p = pool_.Pin(page);
+        if (!first) ++touched;
+        if (!p) break;
+        const size_t n = count(p);
+        size_t i = first ? leaf_lower_bound(p, from) : 0;
+        for (; i < n; ++i) {
+            const Entry e = leaf_entry(p, i);
+            if (e.first > hi) break;
+            out.push_back(e.second);
+        }
+        const uint32_t next = i < n ? 0 : next_leaf(p);
+        pool_.Unpin(page, false);
+        page = next;
+        first = false;
+    }
+    if (pages) *pages = touched;
+    return out;
+}
+
+uint64_t BTree::Estimate(uint64_t lo, uint64_t hi) const {
+    if (lo > hi) return 0;
+    // Follow the path lo and hi share, narrowing the share of entries by
+    // each node's fan-out, and scale by the children they span where they
+    // part. Reaching a leaf together, count it exactly.
+    double share = static_cast<double>(entries_);
+    uint32_t page = root_;
+    for (;;) {
+        const unsigned char* p = pool_.Pin(page);
+        if (!p) return entries_;
+        if (is_leaf(p)) {
+            uint64_t n = 0;
+            for (size_t i = leaf_lower_bound(p, {lo, 0}); i < count(p) && leaf_entry(p, i).first <= hi; ++i) ++n;
+            pool_.Unpin(page, false);
+            return n;
+        }
+        const size_t first = child_index(p, {lo, 0});
+        const size_t last = child_index(p, {hi, UINT32_MAX});
+        const size_t fanout = count(p) + 1;
+        const uint32_t down = child(p, first);
+        pool_.Unpin(page, false);
+        if (first != last) return static_cast<uint64_t>(share * static_cast<double>(last - first + 1) / fanout);
+        share /= static_cast<double>(fanout);
+        page = down;
+    }
+}
+
+bool BTree::BulkLoad(const std::string& path, const std::vector<Entry>& entries, uint64_t synced_rows) {
+    const std::string tmp = path + ".tmp";
+    const int fd = ::open(tmp.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        std::cerr << "BTree: cannot create " << tmp << "\n";
+        return false;
+    }
+    std::vector<unsigned char> page(kPage);
+    uint32_t next_page = 1;
+    bool ok = true;
+
+    // Leaves, left to right, each linked to the next.
+    const size_t per_leaf = std::max<size_t>(1, static_cast<size_t>(kLeafCap * kBulkFill));
+    std::vector<Entry> firsts;
+    std::vector<uint32_t> ids;
+    size_t i = 0;
+    do {
+        const size_t n = std::min(per_leaf, entries.size() - i);
+        std::fill(page.begin(), page.end(), 0);
+        set_header(page.data(), true, n);
+        put<uint32_t>(page.data(), 4, i + n < entries.size() ? next_page + 1 : 0);
+        for (size_t j = 0; j < n; ++j) set_leaf_entry(page.data(), j, entries[i + j]);
+        firsts.push_back(n ? entries[i] : Entry{});
+        ids.push_back(next_page);
+        ok = ok && write_page(fd, next_page++, page.data());
+        i += n;
+    } while (i < entries.size());
+
+    // Internal levels until a single root remains.
+    uint32_t height = 1;
+    const size_t fanout = std::max<size_t>(2, static_cast<size_t>(kInnerCap * kBulkFill) + 1);
+    while (ids.size() > 1) {
+        std::vector<Entry> up_firsts;
+        std::vector<uint32_t> up_ids;
+        for (size_t k = 0; k < ids.size(); k += fanout) {
+            const size_t n = std::min(fanout, ids.size() - k);
+            std::fill(page.begin(), page.end(), 0);
+            set_inner(page.data(), ids[k], firsts, ids, k + 1, n - 1);
+            up_firsts.push_back(firsts[k]);
+            up_ids.push_back(next_page);
+            ok = ok && write_page(fd, next_page++, page.data());
+        }
+        firsts = std::move(up_firsts);
+        ids = std::move(up_ids);
+        ++height;
+    }
+
+    Meta m{};
+    std::memcpy(m.magic, kMagic, sizeof kMagic);
+    m.root = ids[0];
+    m.height = height;
+    m.pages = next_page;
+    m.entries = entries.size();
+    m.synced_rows = synced_rows;
+    std::fill(page.begin(), page.end(), 0);
+    std::memcpy(page.data(), &m, sizeof m);
+    ok = ok && write_page(fd, 0, page.data()) && ::fdatasync(fd) == 0;
+    ::close(fd);
+    if (!ok) {
+        std::cerr << "BTree: cannot write " << tmp << "\n";
+        return false;
+    }
+    std::error_code ec;
+    std::filesystem::rename(tmp, path, ec);
+    if (ec) {
+        std::cerr << "BTree: cannot publish " << path << ": " << ec.message() << "\n";
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,199 @@
+#include "cache.h"
+
+#include <algorithm>
+#include <functional>
+#include <list>
+#include <mutex>
+#include <unordered_map>
+
+namespace {
+
+constexpr size_t kEntryOverhead = 96;   // list node, map slot, control block
+
+uint64_t mix64(uint64_t x) {
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33;
+    x *= 0xc4ceb9fe1a85ec53ULL;
+    x ^= x >> 33;
+    return x;
+}
+
+// Count-min sketch of 4 rows of saturating 4-bit counts (kept a byte
+// each). After `sample` increments every count is halved, so old
+// popularity fades.
+class FrequencySketch {
+public:
+    explicit FrequencySketch(size_t width) : mask_(width - 1), sample_(10 * width), counts_(4 * width) {}
+
+    void Increment(uint64_t h) {
+        for (size_t row = 0; row < 4; ++row) {
+            uint8_t& c = counts_[Index(h, row)];
+            if (c < 15) ++c;
+        }
+        if (++additions_ >= sample_) {
+            for (uint8_t& c : counts_) c >>= 1;
+            additions_ /= 2;
+        }
+    }
+
+    uint8_t Estimate(uint64_t h) const {
+        uint8_t e = 15;
+        for (size_t row = 0; row < 4; ++row) e = std::min(e, counts_[Index(h, row)]);
+        return e;
+    }
+
+private:
+    size_t Index(uint64_t h, size_t row) const {
+        return row * (mask_ + 1) + (mix64(h + row * 0x9e3779b97f4a7c15ULL) & mask_);
+    }
+
+    size_t mask_;
+    size_t sample_;
+    size_t additions_ = 0;
+    std::vector<uint8_t> counts_;
+};
+
+size_t pow2_at_least(size_t n) {
+    size_t p = 1;
+    while (p < n) p <<= 1;
+    return p;
+}
+
+} // namespace
+
+struct TinyLfuCache::Shard {
+    enum Segment : uint8_t { kWindow, kProbation, kProtected };
+
+    struct Entry {
+        std::string key;
+        Value value;
+        uint64_t hash;
+        size_t charge;
+        Segment seg;
+    };
+    using List = std::list<Entry>;
+
+    Shard(size_t budget)
+        : window_cap(std::max<size_t>(budget / 100, 1)),
+          main_cap(budget - std::min(budget, window_cap)),
+          protected_cap(main_cap / 10 * 8),
+          max_charge(budget / 8),
+          sketch(pow2_at_least(std::max<size_t>(256, budget / 4096))) {}
+
+    List& list(Segment s) { return s == kWindow ? window : s == kProbation ? probation : protected_; }
+    size_t& bytes(Segment s) { return s == kWindow ? window_bytes : s == kProbation ? probation_bytes : protected_bytes; }
+
+    void Move(List::iterator it, Segment to) {
+        bytes(it->seg) -= it->charge;
+        bytes(to) += it->charge;
+        list(to).splice(list(to).begin(), list(it->seg), it);
+        it->seg = to;
+    }
+
+    void Drop(List::iterator it) {
+        bytes(it->seg) -= it->charge;
+        index.erase(it->key);
+        list(it->seg).erase(it);
+    }
+
+    // The main segment's next victim: probation's LRU end, or protected's
+    // once probation is empty.
+    List::iterator Victim() { return probation.empty() ? std::prev(protected_.end()) : std::prev(probation.end()); }
+
+    // Moves the window's LRU entry into the main segment if it is more
+    // popular than whatever it would push out.
+    void Admit() {
+        const List::iterator cand = std::prev(window.end());
+        const uint8_t freq = sketch.Estimate(cand->hash);
+        while (probation_bytes + protected_bytes + cand->charge > main_cap) {
+            const List::iterator victim = Victim();
+            if (freq <= sketch.Estimate(victim->hash)) {
+                Drop(cand);
+                ++rejections;
+                return;
+            }
+            Drop(victim);
+            ++evictions;
+        }
+        Move(cand, kProbation);
+    }
+
+    const size_t window_cap, main_cap, protected_cap, max_charge;
+    FrequencySketch sketch;
+    List window, probation, protected_;
+    size_t window_bytes = 0, probation_bytes = 0, protected_bytes = 0;
+    std::unordered_map<std::string, List::iterator> index;
+    uint64_t hits = 0, misses = 0, evictions = 0, rejections = 0;
+    mutable std::mutex mu;
+};
+
+TinyLfuCache::TinyLfuCache(size_t budget_bytes, size_t shards) : budget_(budget_bytes) {
+    shards = std::max<size_t>(1, shards);
+    for (size_t i = 0; i < shards; ++i) shards_.push_back(std::make_unique<Shard>(budget_bytes / shards));
+}
+
+TinyLfuCache::~TinyLfuCache() = default;
+
+TinyLfuCache::Shard& TinyLfuCache::shard_of(uint64_t h) const {
+    return *shards_[mix64(h) % shards_.size()];
+}
+
+TinyLfuCache::Value TinyLfuCache::Get(const std::string& key) {
+    const uint64_t h = std::hash<std::string>()(key);
+    Shard& s = shard_of(h);
+    std::lock_guard<std::mutex> lock(s.mu);
+    s.sketch.Increment(h);
+    const auto found = s.index.find(key);
+    if (found == s.index.end()) {
+        ++s.misses;
+        return nullptr;
+    }
+    ++s.hits;
+    const Shard::List::iterator it = found->second;
+    if (it->seg == Shard::kProbation) {
+        s.Move(it, Shard::kProtected);
+        while (s.protected_bytes > s.protected_cap) s.Move(std::prev(s.protected_.end()), Shard::kProbation);
+    } else {
+        s.list(it->seg).splice(s.list(it->seg).begin(), s.list(it->seg), it);
+    }
+    return it->value;
+}
+
+void TinyLfuCache::Put(const std::string& key, Value value) {
+    if (!value) return;
+    const uint64_t h = std::hash<std::string>()(key);
+    Shard& s = shard_of(h);
+    const size_t charge = value->size() + key.size() + kEntryOverhead;
+    std::lock_guard<std::mutex> lock(s.mu);
+    const auto found = s.index.find(key);
+    if (found != s.index.end()) s.Drop(found->second);
+    if (charge > s.max_charge) return;
+
+    s.window.push_front(Shard::Entry{key, std::move(value), h, charge, Shard::kWindow});
+    s.window_bytes += charge;
+    s.index.emplace(key, s.window.begin());
+    while (s.window_bytes > s.window_cap) s.Admit();
+}
+
+void TinyLfuCache::Erase(const std::string& key) {
+    const uint64_t h = std::hash<std::string>()(key);
+    Shard& s = shard_of(h);
+    std::lock_guard<std::mutex> lock(s.mu);
+    const auto found = s.index.find(key);
+    if (found != s.index.end()) s.Drop(found->second);
+}
+
+TinyLfuCache::Stats TinyLfuCache::stats() const {
+    Stats st;
+    for (const auto& s : shards_) {
+        std::lock_guard<std::mutex> lock(s->mu);
+        st.hits += s->hits;
+        st.misses += s->misses;
+        st.evictions += s->evictions;
+        st.rejections += s->rejections;
+        st.entries += s->index.size();
+        st.bytes += s->window_bytes + s->probation_bytes + s->protected_bytes;
+    }
+    return st;
+}
@@ -0,0 +1,186 @@
+#include "cluster.h"
+#include "color.h"
+#include "kmeans.h"
+#include "ordinals.h"
+
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <stdexcept>
+
+namespace {
+
+constexpr char kMagic[8] = {'I', 'M', 'G', 'K', 'M', '0', '0', '1'};
+constexpr std::streamoff kHeaderBytes = sizeof kMagic + 4 * sizeof(uint32_t);
+
+} // namespace
+
+const char* cluster_feature_name(ClusterFeature f) {
+    switch (f) {
+    case ClusterFeature::PHash: return "phash";
+    case ClusterFeature::Color: return "color";
+    case ClusterFeature::Embedding: return "embed";
+    }
+    return "?";
+}
+
+bool parse_cluster_feature(const std::string& name, ClusterFeature* out) {
+    for (ClusterFeature f : {ClusterFeature::PHash, ClusterFeature::Color, ClusterFeature::Embedding}) {
+        if (name == cluster_feature_name(f)) {
+            *out = f;
+            return true;
+        }
+    }
+    return false;
+}
+
+void phash_vector(uint64_t phash, float* out) {
+    for (int i = 0; i < 64; ++i) out[i] = static_cast<float>((phash >> i) & 1);
+}
+
+void color_vector(const uint16_t* hist, float* out) {
+    for (int i = 0; i < kColorBins; ++i) out[i] = static_cast<float>(hist[i]) / kHistTotal;
+}
+
+ClusterModel ClusterModel::Train(ClusterFeature feature, const float* data, size_t n, uint32_t dim,
+                                 int k, size_t batch, int iters, uint64_t seed) {
+    if (k <= 0 || dim == 0) throw std::invalid_argument("ClusterModel: k and dim must be positive");
+    ClusterModel m;
+    m.feature_ = feature;
+    m.dim_ = dim;
+    m.centroids_ = minibatch_kmeans(data, n, dim, k, batch, iters, seed, &m.counts_);
+    return m;
+}
+
+uint32_t ClusterModel::Assign(const float* v) const {
+    return static_cast<uint32_t>(nearest_centroid(centroids_.data(), k(), dim_, v));
+}
+
+uint32_t ClusterModel::Update(const float* v) {
+    const uint32_t c = Assign(v);
+    float* row = &centroids_[static_cast<size_t>(c) * dim_];
+    const float eta = 1.f / static_cast<float>(++counts_[c]);
+    for (uint32_t d = 0; d < dim_; ++d) row[d] += eta * (v[d] - row[d]);
+
+    if (path_.empty()) return c;
+    if (!file_.is_open()) file_.open(path_, std::ios::binary | std::ios::in | std::ios::out);
+    file_.seekp(kHeaderBytes + static_cast<std::streamoff>(c * sizeof(uint64_t)));
+    file_.write(reinterpret_cast<const char*>(&counts_[c]), sizeof(uint64_t));
+    file_.seekp(kHeaderBytes + static_cast<std::streamoff>(counts_.size() * sizeof(uint64_t) +
+                                                           static_cast<size_t>(c) * dim_ * sizeof(float)));
+    file_.write(reinterpret_cast<const char*>(row), static_cast<std::streamsize>(dim_ * sizeof(float)));
+    // A lost update only leaves the centroid slightly staler.
+    if (!file_.flush()) std::cerr << "ClusterModel: cannot update " << path_ << "\n";
+    return c;
+}
+
+bool ClusterModel::Save(const std::string& path) {
+    const std::string tmp = path + ".tmp";
+    {
+        std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+        const uint32_t header[4] = {static_cast<uint32_t>(feature_), dim_, static_cast<uint32_t>(k()), 0};
+        out.write(kMagic, sizeof kMagic);
+        out.write(reinterpret_cast<const char*>(header), sizeof header);
+        out.write(reinterpret_cast<const char*>(counts_.data()),
+                  static_cast<std::streamsize>(counts_.size() * sizeof(uint64_t)));
+        out.write(reinterpret_cast<const char*>(centroids_.data()),
+                  static_cast<std::streamsize>(centroids_.size() * sizeof(float)));
+        if (!out.flush()) {
+            std::cerr << "ClusterModel: cannot write " << tmp << "\n";
+            return false;
+        }
+    }
+    std::error_code ec;
+    std::filesystem::rename(tmp, path, ec);
+    if (ec) {
+        std::cerr << "ClusterModel: cannot publish " << path << ": " << ec.message() << "\n";
+        return false;
+    }
+    file_.close();
+    path_ = path;
+    return true;
+}
+
+std::optional<ClusterModel> ClusterModel::Load(const std::string& path) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in) return std::nullopt;
+
+    char magic[8];
+    uint32_t header[4];
+    if (!in.read(magic, sizeof magic) || std::memcmp(magic, kMagic, sizeof kMagic) != 0 ||
+        !in.read(reinterpret_cast<char*>(header), sizeof header) || header[0] > 2 || header[1] == 0 ||
+        header[2] == 0) {
+        return std::nullopt;
+    }
+    ClusterModel m;
+    m.feature_ = static_cast<ClusterFeature>(header[0]);
+    m.dim_ = header[1];
+    m.counts_.resize(header[2]);
+    m.centroids_.resize(static_cast<size_t>(header[2]) * m.dim_);
+    if (!in.read(reinterpret_cast<char*>(m.counts_.data()),
+                 static_cast<std::streamsize>(m.counts_.size() * sizeof(uint64_t))) ||
+        !in.read(reinterpret_cast<char*>(m.centroids_.data()),
+                 static_cast<std::streamsize>(m.centroids_.size() * sizeof(float)))) {
+        return std::nullopt;
+    }
+    m.path_ = path;
+    return m;
+}
+
+ClusterAssignments ClusterAssignments::Open(const std::string& dir) {
+    namespace fs = std::filesystem;
+    ClusterAssignments a;
+    a.dir_ = dir;
+    const std::string assign_path = dir + "/clusters.assign";
+    const std::string ords_path = dir + "/clusters.ords";
+
+    for (const auto& p : {assign_path, ords_path}) {
+        if (!fs::exists(p)) std::ofstream(p, std::ios::binary);
+    }
+
+    a.ords_ = read_ordinal_column(ords_path);
+    a.clusters_.resize(a.ords_.size());
+    std::ifstream assign(assign_path, std::ios::binary);
+    if (!assign.read(reinterpret_cast<char*>(a.clusters_.data()),
+                     static_cast<std::streamsize>(a.clusters_.size() * sizeof(uint32_t)))) {
+        throw std::runtime_error("ClusterAssignments: clusters.assign shorter than " + ords_path);
+    }
+    return a;
+}
+
+bool ClusterAssignments::Rewrite(const std::string& dir, const std::vector<uint32_t>& ords,
+                                 const std::vector<uint32_t>& clusters) {
+    namespace fs = std::filesystem;
+    const std::string assign_path = dir + "/clusters.assign";
+    const std::string ords_path = dir + "/clusters.ords";
+    if (!write_ordinal_column(assign_path + ".tmp", clusters) || !write_ordinal_column(ords_path + ".tmp", ords)) {
+        return false;
+    }
+    // Column first: a crash in between leaves the old ordinal column, which
+    // only commits a prefix of the new one.
+    std::error_code ec;
+    fs::rename(assign_path + ".tmp", assign_path, ec);
+    if (!ec) fs::rename(ords_path + ".tmp", ords_path, ec);
+    if (ec) {
+        std::cerr << "ClusterAssignments: cannot publish in " << dir << ": " << ec.message() << "\n";
+        return false;
+    }
+    return true;
+}
+
+bool ClusterAssignments::Append(uint32_t ordinal, uint32_t cluster) {
+    const size_t n = ords_.size();
+    if (!assign_out_.is_open()) assign_out_.open(dir_ + "/clusters.assign", std::ios::binary | std::ios::in | std::ios::out);
+
+    assign_out_.seekp(static_cast<std::streamoff>(n * sizeof(uint32_t)));
+    assign_out_.write(reinterpret_cast<const char*>(&cluster), sizeof cluster);
+    if (!assign_out_.flush()) {
+        std::cerr << "ClusterAssignments: column write failed in " << dir_ << "\n";
+        return false;
+    }
+    if (!put_ordinal(ords_out_, dir_ + "/clusters.ords", n, ordinal)) return false;
+
+    clusters_.push_back(cluster);
+    ords_.push_back(ordinal);
+    return true;
+}
@@ -0,0 +1,291 @@
+#include "color.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <array>
+#include <cmath>
+#include <iostream>
+#include <stdexcept>
+#include <utility>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define IMGDB_X86 1
+#include <immintrin.h>
+#endif
+
+static_assert(sizeof(DominantColor) == 4, "DominantColor is stored raw in color.dom");
+
+namespace {
+
+constexpr int kHues = 12;
+constexpr int kGrayBase = kHues * 4;
+
+// Scales raw counts so the bins sum to exactly kHistTotal (largest-remainder
+// rounding), keeping intersection scores comparable across images.
+void normalize(const std::array<uint32_t, kColorBins>& counts, uint16_t out[kColorBins]) {
+    uint64_t total = 0;
+    for (uint32_t c : counts) total += c;
+    if (total == 0) {
+        std::fill(out, out + kColorBins, 0);
+        return;
+    }
+    std::array<std::pair<uint64_t, int>, kColorBins> rem;
+    uint32_t assigned = 0;
+    for (int i = 0; i < kColorBins; ++i) {
+        const uint64_t scaled = static_cast<uint64_t>(counts[i]) * kHistTotal;
+        out[i] = static_cast<uint16_t>(scaled / total);
+        assigned += out[i];
+        rem[i] = {scaled % total, i};
+    }
+    std::sort(rem.begin(), rem.end(), [](const auto& a, const auto& b) { return a.first > b.first; });
+    for (int i = 0; assigned < kHistTotal; ++i, ++assigned) ++out[rem[i].second];
+}
+
+uint32_t intersection_scalar(const uint16_t* a, const uint16_t* b) {
+    uint32_t s = 0;
+    for (int i = 0; i < kColorBins; ++i) s += std::min(a[i], b[i]);
+    return s;
+}
+
+void batch_scalar(const uint16_t* q, const uint16_t* rows, size_t n, uint32_t* out) {
+    for (size_t r = 0; r < n; ++r) out[r] = intersection_scalar(q, rows + r * kColorBins);
+}
+
+#ifdef IMGDB_X86
+// A row is four 256-bit vectors. min_epu16 takes the per-bin minimum and
+// madd_epi16 against ones folds pairs into int32 lanes (safe: every bin is
+// <= kHistTotal < 2^15), so a row costs 4 loads, 4 mins and 4 madds.
+__attribute__((target("avx2")))
+void batch_avx2(const uint16_t* q, const uint16_t* rows, size_t n, uint32_t* out) {
+    const __m256i q0 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(q));
+    const __m256i q1 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(q + 16));
+    const __m256i q2 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(q + 32));
+    const __m256i q3 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(q + 48));
+    const __m256i ones = _mm256_set1_epi16(1);
+    for (size_t r = 0; r < n; ++r) {
+        const auto* p = reinterpret_cast<const __m256i*>(rows + r * kColorBins);
+        __m256i s = _mm256_madd_epi16(_mm256_min_epu16(_mm256_loadu_si256(p + 0), q0), ones);
+        s = _mm256_add_epi32(s, _mm256_madd_epi16(_mm256_min_epu16(_mm256_loadu_si256(p + 1), q1), ones));
+        s = _mm256_add_epi32(s, _mm256_madd_epi16(_mm256_min_epu16(_mm256_loadu_si256(p + 2), q2), ones));
+        s = _mm256_add_epi32(s, _mm256_madd_epi16(_mm256_min_epu16(_mm256_loadu_si256(p + 3), q3), ones));
+        __m128i x = _mm_add_epi32(_mm256_castsi256_si128(s), _mm256_extracti128_si256(s, 1));
+        x = _mm_add_epi32(x, _mm_shuffle_epi32(x, _MM_SHUFFLE(1, 0, 3, 2)));
+        x = _mm_add_epi32(x, _mm_shuffle_epi32(x, _MM_SHUFFLE(2, 3, 0, 1)));
+        out[r] = static_cast<uint32_t>(_mm_cvtsi128_si32(x));
+    }
+}
+#endif
+
+using BatchFn = void (*)(const uint16_t*, const uint16_t*, size_t, uint32_t*);
+
+BatchFn pick_batch() {
+#ifdef IMGDB_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) return batch_avx2;
+#endif
+    return batch_scalar;
+}
+
+} // namespace
+
+int color_bin(uint8_t r, uint8_t g, uint8_t b) {
+    const int mx = std::max({r, g, b});
+    const int mn = std::min({r, g, b});
+    const float v = mx / 255.f;
+    const float s = mx == 0 ? 0.f : static_cast<float>(mx - mn) / mx;
+
+    // Near-black and unsaturated pixels have no stable hue.
+    if (s < 0.2f || v < 0.15f) return kGrayBase + std::min(15, mx / 16);
+
+    float h;
+    const float d = static_cast<float>(mx - mn);
+    if (mx == r) h = 60.f * std::fmod((g - b) / d + 6.f, 6.f);
+    else if (mx == g) h = 60.f * ((b - r) / d + 2.f);
+    else h = 60.f * ((r - g) / d + 4.f);
+
+    const int hue = std::min(kHues - 1, static_cast<int>(h / (360.f / kHues)));
+    return hue * 4 + (s >= 0.6f ? 2 : 0) + (v >= 0.6f ? 1 : 0);
+}
+
+bool color_features(const unsigned char* pixels, int w, int h, int channels, ColorFeatures* out) {
+    if (!pixels || w <= 0 || h <= 0 || channels < 1 || channels > 4) return false;
+
+    std::array<uint32_t, kColorBins> counts{};
+    std::array<std::array<uint64_t, 3>, kColorBins> sums{};
+    const size_t n = static_cast<size_t>(w) * h;
+    for (size_t i = 0; i < n; ++i) {
+        const unsigned char* p = pixels + i * channels;
+        const uint8_t r = p[0];
+        const uint8_t g = channels >= 3 ? p[1] : p[0];
+        const uint8_t b = channels >= 3 ? p[2] : p[0];
+        const int bin = color_bin(r, g, b);
+        ++counts[bin];
+        sums[bin][0] += r;
+        sums[bin][1] += g;
+        sums[bin][2] += b;
+    }
+    normalize(counts, out->hist);
+
+    std::array<int, kColorBins> order;
+    for (int i = 0; i < kColorBins; ++i) order[i] = i;
+    std::partial_sort(order.begin(), order.begin() + 3, order.end(),
+                      [&](int a, int b) { return counts[a] > counts[b]; });
+    for (int k = 0; k < 3; ++k) {
+        const int bin = order[k];
+        DominantColor& d = out->dominant[k];
+        if (counts[bin] == 0) {
+            d = DominantColor{};
+            continue;
+        }
+        d.r = static_cast<uint8_t>(sums[bin][0] / counts[bin]);
+        d.g = static_cast<uint8_t>(sums[bin][1] / counts[bin]);
+        d.b = static_cast<uint8_t>(sums[bin][2] / counts[bin]);
+        d.share = static_cast<uint8_t>(std::min<uint64_t>(255, counts[bin] * 255 / n));
+    }
+    return true;
+}
+
+void single_color_hist(uint8_t r, uint8_t g, uint8_t b, uint16_t out[kColorBins]) {
+    std::fill(out, out + kColorBins, 0);
+    out[color_bin(r, g, b)] = kHistTotal;
+}
+
+void hue_range_mask(float lo, float hi, uint16_t out[kColorBins]) {
+    std::fill(out, out + kColorBins, 0);
+    const float width = 360.f / kHues;
+    for (int hue = 0; hue < kHues; ++hue) {
+        const float centre = (hue + 0.5f) * width;
+        const bool in = lo <= hi ? (centre >= lo && centre <= hi) : (centre >= lo || centre <= hi);
+        if (!in) continue;
+        for (int k = 0; k < 4; ++k) out[hue * 4 + k] = kHistTotal;
+    }
+}
+
+uint32_t hist_intersection(const uint16_t* a, const uint16_t* b) {
+    uint32_t out;
+    hist_intersection_batch(a, b, 1, &out);
+    return out;
+}
+
+void hist_intersection_batch(const uint16_t* query, const uint16_t* rows, size_t n, uint32_t* out) {
+    static const BatchFn fn = pick_batch();
+    fn(query, rows, n, out);
+}
+
+namespace {
+
+constexpr const char* kColorFiles[3] = {"/color.hist", "/color.dom", "/color.ords"};
+constexpr size_t kColorRowBytes[3] = {kColorBins * sizeof(uint16_t), 3 * sizeof(DominantColor), sizeof(uint32_t)};
+
+bool pwrite_all(int fd, const void* p, size_t len, off_t off) {
+    return ::pwrite(fd, p, len, off) == static_cast<ssize_t>(len);
+}
+
+} // namespace
+
+ColorStore ColorStore::Open(const std::string& dir) { return Open(dir, true); }
+
+ColorStore ColorStore::OpenReadOnly(const std::string& dir) { return Open(dir, false); }
+
+ColorStore ColorStore::Open(const std::string& dir, bool writable) {
+    ColorStore s;
+    s.dir_ = dir;
+    struct stat st[3];
+    for (int f = 0; f < 3; ++f) {
+        const std::string path = dir + kColorFiles[f];
+        s.fd_[f] = ::open(path.c_str(), writable ? O_RDWR | O_CREAT | O_CLOEXEC : O_RDONLY | O_CLOEXEC, 0644);
+        if (s.fd_[f] < 0 && !writable && errno == ENOENT) return s;
+        if (s.fd_[f] < 0 || ::fstat(s.fd_[f], &st[f]) != 0) {
+            throw std::runtime_error("ColorStore: cannot open " + path);
+        }
+    }
+    // A torn ordinal is not a row; value rows past the last ordinal are
+    // overwritten by the next append.
+    s.rows_ = static_cast<size_t>(st[2].st_size) / kColorRowBytes[2];
+    for (int f = 0; f < 2; ++f) {
+        if (static_cast<size_t>(st[f].st_size) < s.rows_ * kColorRowBytes[f]) {
+            throw std::runtime_error("ColorStore: column files shorter than " + dir + kColorFiles[2]);
+        }
+    }
+    if (!s.Refresh()) throw std::runtime_error("ColorStore: mmap failed in " + dir);
+    return s;
+}
+
+ColorStore::~ColorStore() {
+    Unmap();
+    for (int fd : fd_) {
+        if (fd >= 0) ::close(fd);
+    }
+}
+
+ColorStore::ColorStore(ColorStore&& o) noexcept { *this = std::move(o); }
+
+ColorStore& ColorStore::operator=(ColorStore&& o) noexcept {
+    if (this == &o) return *this;
+    Unmap();
+    for (int f = 0; f < 3; ++f) {
+        if (fd_[f] >= 0) ::close(fd_[f]);
+        fd_[f] = std::exchange(o.fd_[f], -1);
+    }
+    dir_ = std::move(o.dir_);
+    rows_ = std::exchange(o.rows_, 0);
+    count_ = std::exchange(o.count_, 0);
+    hist_ = std::exchange(o.hist_, nullptr);
+    dom_ = std::exchange(o.dom_, nullptr);
+    ords_ = std::exchange(o.ords_, nullptr);
+    return *this;
+}
+
+bool ColorStore::Map() {
+    Unmap();
+    if (count_ == 0) return true;
+    const void* maps[3];
+    for (int f = 0; f < 3; ++f) {
+        void* p = ::mmap(nullptr, count_ * kColorRowBytes[f], PROT_READ, MAP_SHARED, fd_[f], 0);
+        if (p == MAP_FAILED) {
+            for (int g = 0; g < f; ++g) ::munmap(const_cast<void*>(maps[g]), count_ * kColorRowBytes[g]);
+            return false;
+        }
+        maps[f] = p;
+    }
+    hist_ = static_cast<const uint16_t*>(maps[0]);
+    dom_ = static_cast<const DominantColor*>(maps[1]);
+    ords_ = static_cast<const uint32_t*>(maps[2]);
+    return true;
+}
+
+void ColorStore::Unmap() {
+    const void* maps[3] = {hist_, dom_, ords_};
+    for (int f = 0; f < 3; ++f) {
+        if (maps[f]) ::munmap(const_cast<void*>(maps[f]), count_ * kColorRowBytes[f]);
+    }
+    hist_ = nullptr;
+    dom_ = nullptr;
+    ords_ = nullptr;
+}
+
+bool ColorStore::Refresh() {
+    Unmap();
+    count_ = rows_;
+    return Map();
+}
+
+bool ColorStore::Append(uint32_t ordinal, const ColorFeatures& f) {
+    // Positioned writes overwrite anything an interrupted append left past
+    // the committed row count; the ordinal goes last.
+    const size_t n = rows_;
+    const void* row[3] = {f.hist, f.dominant, &ordinal};
+    for (int c = 0; c < 3; ++c) {
+        if (!pwrite_all(fd_[c], row[c], kColorRowBytes[c], static_cast<off_t>(n * kColorRowBytes[c]))) {
+            std::cerr << "ColorStore: column write failed in " << dir_ << "\n";
+            return false;
+        }
+    }
+    rows_ = n + 1;
+    return true;
+}
@@ -0,0 +1,377 @@
+#include "columns.h"
+#include "ordinals.h"
+
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <stdexcept>
+#include <utility>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define IMGDB_X86 1
+#include <immintrin.h>
+#endif
+
+namespace {
+
+constexpr char kMagic[8] = {'I', 'M', 'G', 'C', 'O', 'L', '0', '1'};
+constexpr off_t kZonesHeader = sizeof kMagic + sizeof(uint64_t);
+constexpr size_t kZoneBytes = kNumColumns * 2 * sizeof(uint64_t);   // one block
+constexpr const char* kNames[kNumColumns] = {"width", "height", "bytes", "created_at"};
+constexpr size_t kElem[kNumColumns] = {4, 4, 8, 8};
+
+// ---- range kernels ----
+// Each sets bit i of mask[i / 64] when lo <= col[i] <= lo + span (one
+// unsigned compare of col[i] - lo), or ANDs into the mask unless `first`.
+
+void range_u32_scalar(const uint32_t* col, size_t n, uint32_t lo, uint32_t span, uint64_t* mask, bool first) {
+    for (size_t w = 0; w * 64 < n; ++w) {
+        const size_t end = std::min<size_t>(64, n - w * 64);
+        uint64_t bits = 0;
+        for (size_t i = 0; i < end; ++i) bits |= static_cast<uint64_t>(col[w * 64 + i] - lo <= span) << i;
+        mask[w] = first ? bits : mask[w] & bits;
+    }
+}
+
+void range_u64_scalar(const uint64_t* col, size_t n, uint64_t lo, uint64_t span, uint64_t* mask, bool first) {
+    for (size_t w = 0; w * 64 < n; ++w) {
+        const size_t end = std::min<size_t>(64, n - w * 64);
+        uint64_t bits = 0;
+        for (size_t i = 0; i < end; ++i) bits |= static_cast<uint64_t>(col[w * 64 + i] - lo <= span) << i;
+        mask[w] = first ? bits : mask[w] & bits;
+    }
+}
+
+#ifdef IMGDB_X86
+// d <= span is min_epu32(d, span) == d; a mask word is 8 vectors of 8 rows.
+__attribute__((target("avx2")))
+void range_u32_avx2(const uint32_t* col, size_t n, uint32_t lo, uint32_t span, uint64_t* mask, bool first) {
+    const __m256i vlo = _mm256_set1_epi32(static_cast<int>(lo));
+    const __m256i vspan = _mm256_set1_epi32(static_cast<int>(span));
+    const size_t full = n / 64;
+    for (size_t w = 0; w < full; ++w) {
+        const uint32_t* p = col + w * 64;
+        uint64_t bits = 0;
+        for (int j = 0; j < 8; ++j) {
+            const __m256i d = _mm256_sub_epi32(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + j * 8)), vlo);
+            const __m256i le = _mm256_cmpeq_epi32(_mm256_min_epu32(d, vspan), d);
+            bits |= static_cast<uint64_t>(static_cast<uint32_t>(_mm256_movemask_ps(_mm256_castsi256_ps(le)))) << (j * 8);
+        }
+        mask[w] = first ? bits : mask[w] & bits;
+    }
+    if (full * 64 < n) range_u32_scalar(col + full * 64, n - full * 64, lo, span, mask + full, first);
+}
+
+// AVX2 has no unsigned 64-bit compare: flip the sign bits and use the
+// signed one. A mask word is 16 vectors of 4 rows.
+__attribute__((target("avx2")))
+void range_u64_avx2(const uint64_t* col, size_t n, uint64_t lo, uint64_t span, uint64_t* mask, bool first) {
+    const __m256i sign = _mm256_set1_epi64x(INT64_MIN);
+    const __m256i vlo = _mm256_set1_epi64x(static_cast<long long>(lo));
+    const __m256i vspan = _mm256_xor_si256(_mm256_set1_epi64x(static_cast<long long>(span)), sign);
+    const size_t full = n / 64;
+    for (size_t w = 0; w < full; ++w) {
+        const uint64_t* p = col + w * 64;
+        uint64_t out = 0;
+        for (int j = 0; j < 16; ++j) {
+            const __m256i d = _mm256_sub_epi64(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + j * 4)), vlo);
+            const __m256i gt = _mm256_cmpgt_epi64(_mm256_xor_si256(d, sign), vspan);
+            out |= static_cast<uint64_t>(~_mm256_movemask_pd(_mm256_castsi256_pd(gt)) & 0xF) << (j * 4);
+        }
+        mask[w] = first ? out : mask[w] & out;
+    }
+    if (full * 64 < n) range_u64_scalar(col + full * 64, n - full * 64, lo, span, mask + full, first);
+}
+#endif
+
+using RangeU32Fn = void (*)(const uint32_t*, size_t, uint32_t, uint32_t, uint64_t*, bool);
+using RangeU64Fn = void (*)(const uint64_t*, size_t, uint64_t, uint64_t, uint64_t*, bool);
+
+bool cpu_has_avx2() {
+#ifdef IMGDB_X86
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2");
+#else
+    return false;
+#endif
+}
+
+RangeU32Fn pick_u32() {
+#ifdef IMGDB_X86
+    if (cpu_has_avx2()) return range_u32_avx2;
+#endif
+    return range_u32_scalar;
+}
+
+RangeU64Fn pick_u64() {
+#ifdef IMGDB_X86
+    if (cpu_has_avx2()) return range_u64_avx2;
+#endif
+    return range_u64_scalar;
+}
+
+bool pwrite_all(int fd, const void* p, size_t len, off_t off) {
+    return ::pwrite(fd, p, len, off) == static_cast<ssize_t>(len);
+}
+
+} // namespace
+
+ColumnStore ColumnStore::Open(const std::string& dir) {
+    ColumnStore s;
+    s.dir_ = dir;
+    for (int c = 0; c < kNumColumns; ++c) {
+        const std::string path = dir + "/columns." + kNames[c];
+        s.fd_[c] = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+        if (s.fd_[c] < 0) throw std::runtime_error("ColumnStore: cannot open " + path);
+    }
+    const std::string zones_path = dir + "/columns.zones";
+    s.zones_fd_ = ::open(zones_path.c_str(), O_RDWR | O_CREAT, 0644);
+    if (s.zones_fd_ < 0) throw std::runtime_error("ColumnStore: cannot open " + zones_path);
+
+    char header[kZonesHeader];
+    const ssize_t got = ::pread(s.zones_fd_, header, sizeof header, 0);
+    if (got == 0) {
+        std::memset(header, 0, sizeof header);
+        std::memcpy(header, kMagic, sizeof kMagic);
+        if (!pwrite_all(s.zones_fd_, header, sizeof header, 0)) {
+            throw std::runtime_error("ColumnStore: cannot write " + zones_path);
+        }
+    } else if (got != static_cast<ssize_t>(sizeof header) || std::memcmp(header, kMagic, sizeof kMagic) != 0) {
+        throw std::runtime_error("ColumnStore: bad header in " + zones_path);
+    }
+    std::memcpy(&s.catalog_bytes_, header + sizeof kMagic, sizeof s.catalog_bytes_);
+
+    const std::string ords_path = dir + "/columns.ords";
+    if (!std::filesystem::exists(ords_path)) std::ofstream(ords_path, std::ios::binary);
+    s.ords_ = read_ordinal_column(ords_path);
+    s.count_ = s.ords_.size();
+
+    const size_t blocks = (s.count_ + kBlockRows - 1) / kBlockRows;
+    s.zones_.resize(blocks * kNumColumns * 2);
+    if (::pread(s.zones_fd_, s.zones_.data(), blocks * kZoneBytes, kZonesHeader) !=
+        static_cast<ssize_t>(blocks * kZoneBytes)) {
+        throw std::runtime_error("ColumnStore: zone maps shorter than " + ords_path);
+    }
+    for (int c = 0; c < kNumColumns; ++c) {
+        struct stat st{};
+        if (::fstat(s.fd_[c], &st) != 0 || static_cast<size_t>(st.st_size) < s.count_ * kElem[c]) {
+            throw std::runtime_error("ColumnStore: columns." + std::string(kNames[c]) + " shorter than " + ords_path);
+        }
+    }
+    if (!s.Map()) throw std::runtime_error("ColumnStore: mmap failed in " + dir);
+    return s;
+}
+
+ColumnStore::~ColumnStore() {
+    Unmap();
+    for (int fd : fd_) {
+        if (fd >= 0) ::close(fd);
+    }
+    if (zones_fd_ >= 0) ::close(zones_fd_);
+}
+
+ColumnStore::ColumnStore(ColumnStore&& o) noexcept { *this = std::move(o); }
+
+ColumnStore& ColumnStore::operator=(ColumnStore&& o) noexcept {
+    if (this == &o) return *this;
+    Unmap();
+    for (int c = 0; c < kNumColumns; ++c) {
+        if (fd_[c] >= 0) ::close(fd_[c]);
+        fd_[c] = std::exchange(o.fd_[c], -1);
+        data_[c] = std::exchange(o.data_[c], nullptr);
+        map_len_[c] = std::exchange(o.map_len_[c], 0);
+    }
+    if (zones_fd_ >= 0) ::close(zones_fd_);
+    zones_fd_ = std::exchange(o.zones_fd_, -1);
+    dir_ = std::move(o.dir_);
+    count_ = std::exchange(o.count_, 0);
+    catalog_bytes_ = o.catalog_bytes_;
+    zones_ = std::move(o.zones_);
+    ords_ = std::move(o.ords_);
+    ords_out_ = std::move(o.ords_out_);
+    return *this;
+}
+
+bool ColumnStore::Map() {
+    Unmap();
+    for (int c = 0; c < kNumColumns; ++c) {
+        map_len_[c] = count_ * kElem[c];
+        if (map_len_[c] == 0) continue;
+        void* p = ::mmap(nullptr, map_len_[c], PROT_READ, MAP_SHARED, fd_[c], 0);
+        if (p == MAP_FAILED) {
+            map_len_[c] = 0;
+            Unmap();
+            return false;
+        }
+        ::madvise(p, map_len_[c], MADV_SEQUENTIAL);
+        data_[c] = p;
+    }
+    return true;
+}
+
+void ColumnStore::Unmap() {
+    for (int c = 0; c < kNumColumns; ++c) {
+        if (data_[c]) ::munmap(const_cast<void*>(data_[c]), map_len_[c]);
+        data_[c] = nullptr;
+        map_len_[c] = 0;
+    }
+}
+
+bool ColumnStore::Append(const ImageMeta* records, size_t count) {
+    if (count == 0) return true;
+    const size_t n = ords_.size();
+    std::vector<uint32_t> dims[2], ords(count);
+    std::vector<uint64_t> wide[2];
+    for (auto* col : {&dims[0], &dims[1]}) col->resize(count);
+    for (auto* col : {&wide[0], &wide[1]}) col->resize(count);
+
+    const size_t last_block = (n + count - 1) / kBlockRows;
+    if (zones_.size() < (last_block + 1) * kNumColumns * 2) zones_.resize((last_block + 1) * kNumColumns * 2);
+    for (size_t i = 0; i < count; ++i) {
+        const ImageMeta& m = records[i];
+        dims[0][i] = m.width;
+        dims[1][i] = m.height;
+        wide[0][i] = m.bytes;
+        wide[1][i] = m.created_unix;
+        ords[i] = m.ordinal;
+
+        const uint64_t v[kNumColumns] = {m.width, m.height, m.bytes, m.created_unix};
+        const bool fresh = (n + i) % kBlockRows == 0;
+        uint64_t* z = &zones_[(n + i) / kBlockRows * kNumColumns * 2];
+        for (int c = 0; c < kNumColumns; ++c) {
+            z[2 * c] = fresh ? v[c] : std::min(z[2 * c], v[c]);
+            z[2 * c + 1] = fresh ? v[c] : std::max(z[2 * c + 1], v[c]);
+        }
+    }
+
+    // Values, then the zone maps, then the ordinals (commit point).
+    const size_t first_block = n / kBlockRows;
+    bool ok = true;
+    for (int c = 0; c < kNumColumns; ++c) {
+        const void* p = c < 2 ? static_cast<const void*>(dims[c].data()) : static_cast<const void*>(wide[c - 2].data());
+        ok &= pwrite_all(fd_[c], p, count * kElem[c], static_cast<off_t>(n * kElem[c]));
+    }
+    ok = ok && pwrite_all(zones_fd_, &zones_[first_block * kNumColumns * 2], (last_block - first_block + 1) * kZoneBytes,
+                          kZonesHeader + static_cast<off_t>(first_block * kZoneBytes));
+    if (!ok) {
+        std::cerr << "ColumnStore: column write failed in " << dir_ << "\n";
+        return false;
+    }
+    if (!put_ordinals(ords_out_, dir_ + "/columns.ords", n, ords.data(), count)) return false;
+    ords_.insert(ords_.end(), ords.begin(), ords.end());
+    return true;
+}
+
+bool ColumnStore::SetCatalogBytes(uint64_t bytes) {
+    if (!pwrite_all(zones_fd_, &bytes, sizeof bytes, sizeof kMagic)) {
+        std::cerr << "ColumnStore: header update failed in " << dir_ << "\n";
+        return false;
+    }
+    catalog_bytes_ = bytes;
+    return true;
+}
+
+bool ColumnStore::Refresh() {
+    count_ = ords_.size();
+    return Map();
+}
+
+uint64_t ColumnStore::value(NumColumn c, size_t row) const {
+    switch (c) {
+    case NumColumn::Width: return width()[row];
+    case NumColumn::Height: return height()[row];
+    case NumColumn::Bytes: return bytes()[row];
+    case NumColumn::CreatedAt: return created_at()[row];
+    }
+    return 0;
+}
+
+template <typename Sink>
+void ColumnStore::Scan(const std::vector<ColumnRange>& ranges, ScanStats* stats, Sink&& sink) const {
+    static const RangeU32Fn range_u32 = pick_u32();
+    static const RangeU64Fn range_u64 = pick_u64();
+
+    ScanStats st;
+    st.blocks = (count_ + kBlockRows - 1) / kBlockRows;
+    std::vector<uint64_t> mask(kBlockRows / 64);
+    std::vector<const ColumnRange*> pending;
+    for (size_t b = 0; b < st.blocks; ++b) {
+        const size_t base = b * kBlockRows;
+        const size_t rows = std::min(kBlockRows, count_ - base);
+        const uint64_t* z = &zones_[b * kNumColumns * 2];
+
+        // Zone maps either rule the block out, prove a range for all of its
+        // rows, or leave the range to the kernels.
+        bool skip = false;
+        pending.clear();
+        for (const ColumnRange& r : ranges) {
+            const int c = static_cast<int>(r.column);
+            if (r.lo > r.hi || z[2 * c + 1] < r.lo || z[2 * c] > r.hi) {
+                skip = true;
+                break;
+            }
+            if (r.lo > z[2 * c] || z[2 * c + 1] > r.hi) pending.push_back(&r);
+        }
+        if (skip) {
+            ++st.skipped;
+            continue;
+        }
+        if (pending.empty()) {
+            ++st.whole;
+            sink.Whole(base, rows);
+            continue;
+        }
+
+        bool first = true;
+        for (const ColumnRange* r : pending) {
+            const int c = static_cast<int>(r->column);
+            if (kElem[c] == 4) {
+                // The zone check above guarantees lo fits in 32 bits.
+                const uint64_t hi = std::min<uint64_t>(r->hi, UINT32_MAX);
+                range_u32(static_cast<const uint32_t*>(data_[c]) + base, rows, static_cast<uint32_t>(r->lo),
+                          static_cast<uint32_t>(hi - r->lo), mask.data(), first);
+            } else {
+                range_u64(static_cast<const uint64_t*>(data_[c]) + base, rows, r->lo, r->hi - r->lo, mask.data(), first);
+            }
+            first = false;
+        }
+        sink.Mask(base, mask.data(), (rows + 63) / 64);
+    }
+    if (stats) *stats = st;
+}
+
+std::vector<uint32_t> ColumnStore::Select(const std::vector<ColumnRange>& ranges, ScanStats* stats) const {
+    struct {
+        std::vector<uint32_t> rows;
+        void Whole(size_t base, size_t n) {
+            for (size_t i = 0; i < n; ++i) rows.push_back(static_cast<uint32_t>(base + i));
+        }
+        void Mask(size_t base, const uint64_t* mask, size_t words) {
+            for (size_t w = 0; w < words; ++w) {
+                for (uint64_t bits = mask[w]; bits; bits &= bits - 1) {
+                    rows.push_back(static_cast<uint32_t>(base + w * 64 + static_cast<size_t>(__builtin_ctzll(bits))));
+                }
+            }
+        }
+    } sink;
+    Scan(ranges, stats, sink);
+    return std::move(sink.rows);
+}
+
+uint64_t ColumnStore::Count(const std::vector<ColumnRange>& ranges, ScanStats* stats) const {
+    struct {
+        uint64_t n = 0;
+        void Whole(size_t, size_t rows) { n += rows; }
+        void Mask(size_t, const uint64_t* mask, size_t words) {
+            for (size_t w = 0; w < words; ++w) n += static_cast<uint64_t>(__builtin_popcountll(mask[w]));
+        }
+    } sink;
+    Scan(ranges, stats, sink);
+    return sink.n;
+}
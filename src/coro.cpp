@@ -0,0 +1,447 @@
+#include "coro.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <filesystem>
+#include <iostream>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace {
+
+constexpr uint64_t kStopTag = 0;          // user_data of the reaper's stop NOP
+constexpr size_t kMaxOpBytes = 1u << 30;  // sqe lengths are 32 bits
+
+template <typename T>
+T load_acquire(T* p) {
+    return std::atomic_ref<T>(*p).load(std::memory_order_acquire);
+}
+
+template <typename T>
+void store_release(T* p, T v) {
+    std::atomic_ref<T>(*p).store(v, std::memory_order_release);
+}
+
+int uring_enter(int fd, unsigned submit, unsigned wait, unsigned flags) {
+    for (;;) {
+        const long r = ::syscall(__NR_io_uring_enter, fd, submit, wait, flags, nullptr, 0);
+        if (r >= 0 || errno != EINTR) return static_cast<int>(r);
+    }
+}
+
+// The submission and completion rings of one io_uring instance, mapped
+// from the kernel. Submissions are made under the executor's lock; only
+// the reaper thread consumes completions.
+struct Ring {
+    int fd = -1;
+    unsigned sq_entries = 0, cq_entries = 0;
+    unsigned *sq_head = nullptr, *sq_tail = nullptr, *sq_array = nullptr;
+    unsigned sq_mask = 0;
+    io_uring_sqe* sqes = nullptr;
+    unsigned *cq_head = nullptr, *cq_tail = nullptr;
+    unsigned cq_mask = 0;
+    io_uring_cqe* cqes = nullptr;
+
+    void* sq_map = MAP_FAILED;
+    void* cq_map = MAP_FAILED;
+    void* sqe_map = MAP_FAILED;
+    size_t sq_len = 0, cq_len = 0, sqe_len = 0;
+
+    ~Ring() {
+        if (sqe_map != MAP_FAILED) ::munmap(sqe_map, sqe_len);
+        if (cq_map != MAP_FAILED && cq_map != sq_map) ::munmap(cq_map, cq_len);
+        if (sq_map != MAP_FAILED) ::munmap(sq_map, sq_len);
+        if (fd >= 0) ::close(fd);
+    }
+
+    // false if the kernel lacks io_uring or the positional-less reads and
+    // writes used here (IORING_FEAT_RW_CUR_POS, Linux 5.6).
+    bool Setup(unsigned depth) {
+        io_uring_params p;
+        std::memset(&p, 0, sizeof(p));
+        fd = static_cast<int>(::syscall(__NR_io_uring_setup, depth, &p));
+        if (fd < 0 || !(p.features & IORING_FEAT_RW_CUR_POS)) return false;
+
+        sq_len = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+        cq_len = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+        const bool single = p.features & IORING_FEAT_SINGLE_MMAP;
+        if (single) sq_len = cq_len = std::max(sq_len, cq_len);
+        sq_map = ::mmap(nullptr, sq_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+        if (sq_map == MAP_FAILED) return false;
+        cq_map = single ? sq_map
+                        : ::mmap(nullptr, cq_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd,
+                                 IORING_OFF_CQ_RING);
+        if (cq_map == MAP_FAILED) return false;
+        sqe_len = p.sq_entries * sizeof(io_uring_sqe);
+        sqe_map = ::mmap(nullptr, sqe_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+        if (sqe_map == MAP_FAILED) return false;
+
+        char* sq = static_cast<char*>(sq_map);
+        char* cq = static_cast<char*>(cq_map);
+        sq_entries = p.sq_entries;
+        cq_entries = p.cq_entries;
+        sq_head = reinterpret_cast<unsigned*>(sq + p.sq_off.head);
+        sq_tail = reinterpret_cast<unsigned*>(sq + p.sq_off.tail);
+        sq_mask = *reinterpret_cast<unsigned*>(sq + p.sq_off.ring_mask);
+        sq_array = reinterpret_cast<unsigned*>(sq + p.sq_off.array);
+        sqes = static_cast<io_uring_sqe*>(sqe_map);
+        cq_head = reinterpret_cast<unsigned*>(cq + p.cq_off.head);
+        cq_tail = reinterpret_cast<unsigned*>(cq + p.cq_off.tail);
+        cq_mask = *reinterpret_cast<unsigned*>(cq + p.cq_off.ring_mask);
+        cqes = reinterpret_cast<io_uring_cqe*>(cq + p.cq_off.cqes);
+        return true;
+    }
+
+    // Queues one entry and hands everything queued to the kernel. The SQ
+    // never fills: each call submits what it queued.
+    void Push(uint8_t opcode, int op_fd, void* buf, size_t len, uint64_t offset, uint64_t user_data) {
+        const unsigned tail = *sq_tail;
+        const unsigned idx = tail & sq_mask;
+        io_uring_sqe& e = sqes[idx];
+        std::memset(&e, 0, sizeof(e));
+        e.opcode = opcode;
+        e.fd = op_fd;
+        e.addr = reinterpret_cast<uint64_t>(buf);
+        e.len = static_cast<uint32_t>(std::min(len, kMaxOpBytes));
+        e.off = offset;
+        e.user_data = user_data;
+        sq_array[idx] = idx;
+        store_release(sq_tail, tail + 1);
+        const unsigned pending = tail + 1 - load_acquire(sq_head);
+        if (uring_enter(fd, pending, 0, 0) < 0) {
+            std::cerr << "io_uring_enter: " << std::strerror(errno) << "\n";
+        }
+    }
+};
+
+void run_blocking(IoExecutor::IoOp* op) {
+    const size_t len = std::min(op->len, kMaxOpBytes);
+    ssize_t n;
+    if (op->kind == IoExecutor::IoOp::kRead) {
+        n = op->offset == UINT64_MAX ? ::read(op->fd, op->buf, len)
+                                     : ::pread(op->fd, op->buf, len, static_cast<off_t>(op->offset));
+    } else {
+        n = op->offset == UINT64_MAX ? ::write(op->fd, op->buf, len)
+                                     : ::pwrite(op->fd, op->buf, len, static_cast<off_t>(op->offset));
+    }
+    op->result = n < 0 ? -errno : n;
+}
+
+} // namespace
+
+struct IoExecutor::State {
+    // Coroutines ready to run.
+    std::mutex mu;
+    std::condition_variable cv;
+    std::deque<std::coroutine_handle<>> ready;
+    bool stopping = false;
+    std::vector<std::thread> workers;
+
+    // Spawned tasks not yet finished.
+    std::mutex live_mu;
+    std::condition_variable live_cv;
+    size_t live = 0;
+
+    // io_uring. Ops beyond the CQ size wait in `backlog` so completions
+    // never overflow.
+    Ring ring;
+    bool uring = false;
+    std::mutex sq_mu;
+    size_t inflight = 0;
+    std::deque<IoOp*> backlog;
+    std::thread reaper;
+
+    // Fallback: blocking I/O threads.
+    std::mutex io_mu;
+    std::condition_variable io_cv;
+    std::deque<IoOp*> io_queue;
+    bool io_stopping = false;
+    std::vector<std::thread> io_threads;
+};
+
+IoExecutor::IoExecutor(int threads, unsigned queue_depth, bool use_io_uring) : s_(std::make_unique<State>()) {
+    State& s = *s_;
+    if (threads <= 0) threads = static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+
+    s.uring = use_io_uring && s.ring.Setup(std::max(8u, queue_depth));
+    if (s.uring) {
+        s.reaper = std::thread([this] {
+            State& st = *s_;
+            Ring& r = st.ring;
+            for (bool stop = false; !stop;) {
+                if (uring_enter(r.fd, 0, 1, IORING_ENTER_GETEVENTS) < 0 && errno != EAGAIN && errno != EBUSY) {
+                    std::cerr << "io_uring_enter: " << std::strerror(errno) << "\n";
+                }
+                std::vector<std::pair<IoOp*, int>> done;
+                unsigned head = *r.cq_head;
+                const unsigned tail = load_acquire(r.cq_tail);
+                for (; head != tail; ++head) {
+                    const io_uring_cqe& c = r.cqes[head & r.cq_mask];
+                    if (c.user_data == kStopTag) {
+                        stop = true;
+                        continue;
+                    }
+                    done.emplace_back(reinterpret_cast<IoOp*>(c.user_data), c.res);
+                }
+                store_release(r.cq_head, head);
+                {
+                    // Every op was pushed under sq_mu; taking it before
+                    // touching the ops orders this thread after the
+                    // submitter without relying on the ring's barriers.
+                    std::lock_guard<std::mutex> lock(st.sq_mu);
+                    for (auto& [op, res] : done) op->result = res;
+                    st.inflight -= done.size();
+                    while (!st.backlog.empty() && st.inflight < r.cq_entries) {
+                        IoOp* op = st.backlog.front();
+                        st.backlog.pop_front();
+                        ++st.inflight;
+                        r.Push(op->kind == IoOp::kRead ? IORING_OP_READ : IORING_OP_WRITE, op->fd, op->buf, op->len,
+                               op->offset, reinterpret_cast<uint64_t>(op));
+                    }
+                }
+                // The op lives in the waiter's frame: read it before the
+                // waiter can run.
+                for (auto& d : done) Post(d.first->waiter);
+            }
+        });
+    } else {
+        const int io_threads = std::max(4, 4 * threads);
+        for (int i = 0; i < io_threads; ++i) {
+            s.io_threads.emplace_back([this] {
+                State& st = *s_;
+                for (;;) {
+                    IoOp* op;
+                    {
+                        std::unique_lock<std::mutex> lock(st.io_mu);
+                        st.io_cv.wait(lock, [&] { return st.io_stopping || !st.io_queue.empty(); });
+                        if (st.io_queue.empty()) return;
+                        op = st.io_queue.front();
+                        st.io_queue.pop_front();
+                    }
+                    run_blocking(op);
+                    Post(op->waiter);
+                }
+            });
+        }
+    }
+
+    for (int i = 0; i < threads; ++i) {
+        s.workers.emplace_back([this] {
+            State& st = *s_;
+            for (;;) {
+                std::coroutine_handle<> h;
+                {
+                    std::unique_lock<std::mutex> lock(st.mu);
+                    st.cv.wait(lock, [&] { return st.stopping || !st.ready.empty(); });
+                    if (st.ready.empty()) return;
+                    h = st.ready.front();
+                    st.ready.pop_front();
+                }
+                h.resume();
+            }
+        });
+    }
+}
+
+IoExecutor::~IoExecutor() {
+    State& s = *s_;
+    Wait();
+    if (s.uring) {
+        {
+            std::lock_guard<std::mutex> lock(s.sq_mu);
+            s.ring.Push(IORING_OP_NOP, -1, nullptr, 0, 0, kStopTag);
+        }
+        s.reaper.join();
+    } else {
+        {
+            std::lock_guard<std::mutex> lock(s.io_mu);
+            s.io_stopping = true;
+        }
+        s.io_cv.notify_all();
+        for (std::thread& t : s.io_threads) t.join();
+    }
+    {
+        std::lock_guard<std::mutex> lock(s.mu);
+        s.stopping = true;
+    }
+    s.cv.notify_all();
+    for (std::thread& t : s.workers) t.join();
+}
+
+coro_detail::Detached IoExecutor::Drive(IoExecutor* ex, Task<void> task) {
+    co_await ex->Schedule();
+    try {
+        co_await std::move(task);
+    } catch (const std::exception& e) {
+        std::cerr << "IoExecutor: task failed: " << e.what() << "\n";
+    }
+    State& s = *ex->s_;
+    std::lock_guard<std::mutex> lock(s.live_mu);
+    if (--s.live == 0) s.live_cv.notify_all();
+}
+
+void IoExecutor::Spawn(Task<void> task) {
+    {
+        std::lock_guard<std::mutex> lock(s_->live_mu);
+        ++s_->live;
+    }
+    Drive(this, std::move(task));
+}
+
+void IoExecutor::Wait() {
+    std::unique_lock<std::mutex> lock(s_->live_mu);
+    s_->live_cv.wait(lock, [this] { return s_->live == 0; });
+}
+
+void IoExecutor::Post(std::coroutine_handle<> h) {
+    {
+        std::lock_guard<std::mutex> lock(s_->mu);
+        s_->ready.push_back(h);
+    }
+    s_->cv.notify_one();
+}
+
+void IoExecutor::Submit(IoOp* op) {
+    State& s = *s_;
+    if (!s.uring) {
+        {
+            std::lock_guard<std::mutex> lock(s.io_mu);
+            s.io_queue.push_back(op);
+        }
+        s.io_cv.notify_one();
+        return;
+    }
+    std::lock_guard<std::mutex> lock(s.sq_mu);
+    if (s.inflight >= s.ring.cq_entries) {
+        s.backlog.push_back(op);
+        return;
+    }
+    ++s.inflight;
+    s.ring.Push(op->kind == IoOp::kRead ? IORING_OP_READ : IORING_OP_WRITE, op->fd, op->buf, op->len, op->offset,
+                reinterpret_cast<uint64_t>(op));
+}
+
+bool IoExecutor::uses_io_uring() const { return s_->uring; }
+
+int IoExecutor::threads() const { return static_cast<int>(s_->workers.size()); }
+
+Task<bool> ReadFile(IoExecutor& io, std::string path, std::string* out) {
+    // open and fstat are metadata calls that rarely block for long; only
+    // the data transfer goes through the executor.
+    const int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    struct stat st;
+    if (fd < 0 || ::fstat(fd, &st) != 0) {
+        std::cerr << "ReadFile: cannot open " << path << ": " << std::strerror(errno) << "\n";
+        if (fd >= 0) ::close(fd);
+        co_return false;
+    }
+    out->resize(static_cast<size_t>(st.st_size));
+    size_t done = 0;
+    while (done < out->size()) {
+        const int64_t n = co_await io.Read(fd, out->data() + done, out->size() - done, done);
+        if (n < 0) {
+            std::cerr << "ReadFile: " << path << ": " << std::strerror(static_cast<int>(-n)) << "\n";
+            ::close(fd);
+            co_return false;
+        }
+        if (n == 0) break;   // shrank since the fstat
+        done += static_cast<size_t>(n);
+    }
+    out->resize(done);
+    ::close(fd);
+    co_return true;
+}
+
+Task<bool> WriteFileAtomic(IoExecutor& io, std::string path, const std::string& bytes) {
+    static std::atomic<uint64_t> counter{0};
+    const std::filesystem::path dst(path);
+    std::error_code ec;
+    if (dst.has_parent_path()) std::filesystem::create_directories(dst.parent_path(), ec);
+    const std::string tmp = path + ".tmp." + std::to_string(::getpid()) + "." + std::to_string(counter.fetch_add(1));
+    const int fd = ::open(tmp.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        std::cerr << "WriteFileAtomic: cannot create " << tmp << ": " << std::strerror(errno) << "\n";
+        co_return false;
+    }
+    size_t done = 0;
+    while (done < bytes.size()) {
+        const int64_t n = co_await io.Write(fd, bytes.data() + done, bytes.size() - done, done);
+        if (n <= 0) {
+            std::cerr << "WriteFileAtomic: " << tmp << ": " << std::strerror(n < 0 ? static_cast<int>(-n) : EIO) << "\n";
+            ::close(fd);
+            ::unlink(tmp.c_str());
+            co_return false;
+        }
+        done += static_cast<size_t>(n);
+    }
+    ::close(fd);
+    if (::rename(tmp.c_str(), path.c_str()) != 0) {
+        std::cerr << "WriteFileAtomic: cannot rename to " << path << ": " << std::strerror(errno) << "\n";
+        ::unlink(tmp.c_str());
+        co_return false;
+    }
+    co_return true;
+}
+
+struct SerialWorker::State {
+    std::mutex mu;
+    std::condition_variable cv;
+    std::deque<CallAwaiter*> calls;
+    bool stopping = false;
+    std::thread thread;
+};
+
+SerialWorker::SerialWorker() : s_(std::make_unique<State>()) {
+    s_->thread = std::thread([this] {
+        State& s = *s_;
+        for (;;) {
+            CallAwaiter* call;
+            {
+                std::unique_lock<std::mutex> lock(s.mu);
+                s.cv.wait(lock, [&] { return s.stopping || !s.calls.empty(); });
+                if (s.calls.empty()) return;
+                call = s.calls.front();
+                s.calls.pop_front();
+            }
+            try {
+                call->fn();
+            } catch (...) {
+                call->error = std::current_exception();
+            }
+            call->io.Post(call->waiter);
+        }
+    });
+}
+
+SerialWorker::~SerialWorker() {
+    {
+        std::lock_guard<std::mutex> lock(s_->mu);
+        s_->stopping = true;
+    }
+    s_->cv.notify_all();
+    s_->thread.join();
+}
+
+void SerialWorker::CallAwaiter::await_suspend(std::coroutine_handle<> h) {
+    waiter = h;
+    State& s = *worker.s_;
+    {
+        std::lock_guard<std::mutex> lock(s.mu);
+        s.calls.push_back(this);
+    }
+    s.cv.notify_one();
+}
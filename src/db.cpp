@@ -6,8 +6,24 @@
 #include <fstream>
 #include <iostream>
 #include <image.h>
-#include <sstream> 
+#include <phash.h>
+#include <sstream>
+#include <optional>
+#include <chrono>
 #include <fsutil.h>
+#include <ordinals.h>
+#include <idgen.h>
+#include <hnsw.h>
+#include <pq.h>
+#include <random>
+#include <cmath>
+#include <algorithm>
+#include <functional>
+#include <atomic>
+#include <unordered_set>
+#include <coro.h>
+#include <lease.h>
+#include <mutex>
 
 #ifdef _WIN32
   #include <process.h>
@@ -16,32 +32,150 @@
   #include <unistd.h>
 #endif
 
-std::string generate_id() {
-  using namespace std::chrono;
+struct ImageDB::Shared {
+    int workers = 0;
+    std::once_flag pool_started;
+    std::unique_ptr<WorkStealingPool> pool;
+    // Held by every write and by the accessors that catch an index up on
+    // disk, through lock()/unlock() below. Recursive because those call
+    // each other (ImportFile -> ClaimImport -> Refs -> LoadCatalog ->
+    // Snapshot).
+    std::recursive_mutex commit_mu;
+    // The published snapshot; replaced ones are retired to `epochs`.
+    EpochDomain epochs;
+    std::atomic<const CatalogSnapshot*> head{nullptr};
 
-  static std::atomic<uint64_t> counter{0};
+    // Cross-process writer lease and shared header (see lease.h). The
+    // outermost lock() takes the lease; the matching unlock() tells other
+    // processes what was committed meanwhile and drops it.
+    WriterLease lease;
+    std::string catalog_meta_path;
+    int depth = 0;                            // lock() nesting
+    bool committed = false, rewrote = false;  // since the outermost lock()
+    // Header state `head` reflects. seen_seq is also read by Snapshot()
+    // without the lock.
+    WriterLease::State seen;
+    std::atomic<uint64_t> seen_seq{0};
+    // Guards `seen` and catching `head` up to it, which readers do without
+    // the commit lock when only the catalog's tail is new. Taken after
+    // commit_mu, never before.
+    std::mutex catchup_mu;
 
-  auto now = system_clock::now();
-  auto now_s = time_point_cast<seconds>(now);
-  std::time_t t = system_clock::to_time_t(now_s);
+    // Writer-side copies of on-disk indexes, kept across commits instead
+    // of reopened by each. Valid while the header's seq is `cached_seq`,
+    // i.e. no other process committed since this one last did; the
+    // outermost lock() drops them otherwise.
+    uint64_t cached_seq = UINT64_MAX;
+    std::optional<OrdinalMap> ordinals;   // checked against the file's size instead
+    std::optional<IdGenerator> ids;       // for the handle's life: each Open jumps to the mark
+    std::optional<BlobRefs> refs;         // follows the log itself
+    std::optional<LsmStore> records;
+    bool clusters_loaded = false;         // cluster_model is what the file holds
+    std::optional<ClusterModel> cluster_model;
+    std::optional<ClusterAssignments> assignments;
+    std::optional<ColumnStore> projection;
+    std::optional<BTree> trees[2];        // created_at, bytes range indexes
 
-  // Format timestamp as YYYYMMDD-HHMMSS
-  std::tm tm{};
-#ifdef _WIN32
-  localtime_s(&tm, &t);
-#else
-  localtime_r(&t, &tm);
-#endif
+    // A projection opened for queries, shared by them until it trails the
+    // one on disk by too much (see index_slack). Not the writer's: that
+    // one is appended to and remapped under the commit lock.
+    std::mutex view_mu;
+    std::shared_ptr<const ColumnStore> view;
+
+    explicit Shared(WriterLease l) : lease(std::move(l)) {}
+    ~Shared() { delete head.load(); }
+
+    // BasicLockable, for std::lock_guard<Shared>: the commit lock.
+    void lock();
+    void unlock();
+
+    // Makes `next` the published snapshot and retires the old one.
+    void Install(CatalogSnapshot::Ptr next);
+    // Committed length of the catalog file as it is now.
+    uint64_t CatalogBytes() const;
+};
 
-  std::ostringstream oss;
-  oss << std::put_time(&tm, "%Y%m%d-%H%M%S")
-      << "-" << getpid()
-      << "-" << std::setw(6) << std::setfill('0') << counter++;
+void ImageDB::Shared::lock() {
+    commit_mu.lock();
+    if (depth++ > 0) return;
+    if (!lease.Acquire()) {
+        depth = 0;
+        commit_mu.unlock();
+        throw std::runtime_error("ImageDB: cannot take the writer lease");
+    }
+    // A writer that died between appending and committing: publish its
+    // rows now, or readers would never look past the old length.
+    const WriterLease::State st = lease.Read();
+    const uint64_t size = CatalogBytes();
+    if (size != st.catalog_bytes) lease.Commit(size, size < st.catalog_bytes);
+    if (lease.seq() != cached_seq) {
+        records.reset();
+        clusters_loaded = false;
+        cluster_model.reset();
+        assignments.reset();
+        projection.reset();
+        trees[0].reset();
+        trees[1].reset();
+    }
+}
 
-  return oss.str();
+void ImageDB::Shared::unlock() {
+    if (--depth == 0) {
+        if (committed) {
+            // Publish() caught up with other processes before applying
+            // this one's commits, so `head` reflects the new header.
+            const std::lock_guard<std::mutex> seen_lock(catchup_mu);
+            seen = lease.Commit(CatalogBytes(), rewrote);
+            seen_seq.store(seen.seq);
+            committed = rewrote = false;
+        }
+        cached_seq = lease.seq();
+        // A merge left running would rewrite the store's manifest under
+        // the next holder.
+        if (records) records->WaitForCompaction();
+        lease.Release();
+    }
+    commit_mu.unlock();
 }
 
-ImageDB ImageDB::Open(const std::string& db_path) {
+void ImageDB::Shared::Install(CatalogSnapshot::Ptr next) {
+    // Swapped before it is retired: a reader pinned after the retire
+    // cannot load the old pointer.
+    const CatalogSnapshot* cur = head.exchange(next.release());
+    if (!cur) return;
+    epochs.Retire(cur);
+    epochs.Collect();
+}
+
+uint64_t ImageDB::Shared::CatalogBytes() const {
+    std::error_code ec;
+    const uint64_t size = std::filesystem::file_size(catalog_meta_path, ec);
+    return ec ? 0 : size;
+}
+
+namespace {
+
+// Rows an on-disk index covering `rows` may trail the catalog by before it
+// is rebuilt or reopened: queries check the rows past it directly, so this
+// bounds that scan to an eighth of the index (and at least 4096 rows) while
+// keeping rebuilds O(1) amortized per import.
+uint64_t index_slack(uint64_t rows) {
+    return std::max<uint64_t>(4096, rows / 8);
+}
+
+// Adds the projection's rows past the ones `tree` reflects. False while a
+// query has the tree open, or on I/O errors.
+bool insert_range_rows(BTree& tree, NumColumn column, const ColumnStore& projection) {
+    for (size_t row = tree.synced_rows(); row < projection.size(); ++row) {
+        if (!tree.Insert(projection.value(column, row), projection.ordinal(row))) return false;
+    }
+    tree.set_synced_rows(projection.size());
+    return tree.Flush();
+}
+
+} // namespace
+
+ImageDB ImageDB::Open(const std::string& db_path, int workers) {
     namespace fs = std::filesystem;
 
     if(db_path.empty()) {
@@ -67,6 +201,8 @@ ImageDB ImageDB::Open(const std::string& db_path) {
     fs::path abs = fs::weakly_canonical(root);
 
     ImageDB db = ImageDB();
+    db.shared_ = std::make_shared<Shared>(WriterLease::Open(abs.string()));
+    db.shared_->workers = workers;
     db.db_root = abs.string();
     db.manifest_path      = (abs / "MANIFEST").string();
     db.wal_path           = (abs / "WAL.current").string();
@@ -74,6 +210,11 @@ ImageDB ImageDB::Open(const std::string& db_path) {
     db.catalog_meta_path  = (abs / "catalog" / "meta.ndjson").string();
     db.blobs_dir          = (abs / "blobs").string();
     db.thumbs_dir         = (abs / "thumbs").string();
+    db.embeddings_path    = (abs / "catalog" / "embeddings.bin").string();
+    db.hnsw_path          = (abs / "catalog" / "embeddings.hnsw").string();
+    db.pq_path            = (abs / "catalog" / "embeddings.pq").string();
+    db.clusters_path      = (abs / "catalog" / "clusters.model").string();
+    db.shared_->catalog_meta_path = db.catalog_meta_path;
 
     if(fs::exists(db.manifest_path)){
         std::ifstream in(db.manifest_path);
@@ -95,6 +236,7 @@ ImageDB ImageDB::Open(const std::string& db_path) {
         }
 
         db.is_initialized = true;
+        db.MigrateToOrdinals();
     } else {
         db.is_initialized = false;
     }
@@ -102,8 +244,113 @@ ImageDB ImageDB::Open(const std::string& db_path) {
     return db;
 }
 
+WorkStealingPool& ImageDB::Pool() const {
+    std::call_once(shared_->pool_started,
+                   [this] { shared_->pool = std::make_unique<WorkStealingPool>(shared_->workers); });
+    return *shared_->pool;
+}
+
+PinnedSnapshot ImageDB::Snapshot() const {
+    // Pinned before the load, so the version loaded cannot be freed under us.
+    EpochDomain::Guard pin = shared_->epochs.Pin();
+    const CatalogSnapshot* snap = shared_->head.load();
+    // Nothing loaded yet, or another process committed: one load from the
+    // shared header tells.
+    if (!snap || shared_->lease.seq() != shared_->seen_seq.load()) {
+        // Appends alone are read from the committed tail while a writer
+        // may hold the lease; anything else is read whole under it.
+        {
+            const std::lock_guard<std::mutex> seen_lock(shared_->catchup_mu);
+            snap = CatchUp(false);
+        }
+        if (!snap) {
+            const std::lock_guard<Shared> lock(*shared_);
+            const std::lock_guard<std::mutex> seen_lock(shared_->catchup_mu);
+            snap = CatchUp(true);
+        }
+    }
+    return PinnedSnapshot(std::move(pin), snap);
+}
+
+const CatalogSnapshot* ImageDB::CatchUp(bool locked) const {
+    const CatalogSnapshot* cur = shared_->head.load();
+    WriterLease::State st;
+    // A commit in progress (or one a crash left open) is waited out, or
+    // closed, under the lease.
+    if (!shared_->lease.TryRead(&st)) {
+        if (!locked) return nullptr;
+        st = shared_->lease.Read();
+    }
+    WriterLease::State& seen = shared_->seen;
+    if (cur && st.seq == seen.seq) return cur;
+
+    CatalogSnapshot::Ptr next;
+    uint64_t size = st.catalog_bytes;
+    if (cur && st.generation == seen.generation && st.catalog_bytes >= seen.catalog_bytes) {
+        // Only imports since: read the committed records after the ones we
+        // have, not the whole catalog. Bytes past them may be a writer's
+        // uncommitted appends. A new generation while we read means they
+        // may not have been the bytes we wanted.
+        std::vector<ImageMeta> tail;
+        WriterLease::State after;
+        const bool read = map_catalog(catalog_meta_path, seen.catalog_bytes, st.catalog_bytes, &tail);
+        const bool same = shared_->lease.TryRead(&after) && after.generation == st.generation;
+        if (read && same) next = cur->WithRecords(tail);
+        else if (locked && !read) throw std::runtime_error("Snapshot: cannot read " + catalog_meta_path);
+    }
+    if (!next) {
+        if (!locked) return nullptr;
+        // Read before the records, so rows appended under this lease by
+        // the caller (not committed to the header yet) are counted as read.
+        size = shared_->CatalogBytes();
+        next = ReadSnapshot(cur ? cur->seq() + 1 : 0);
+    }
+    seen = st;
+    seen.catalog_bytes = size;
+    shared_->seen_seq.store(st.seq);
+    cur = next.get();
+    shared_->Install(std::move(next));
+    return cur;
+}
+
+CatalogSnapshot::Ptr ImageDB::ReadSnapshot(uint64_t seq) const {
+    std::vector<uint32_t> cluster_ords, clusters;
+    if (std::filesystem::exists(clusters_path)) {
+        const ClusterAssignments assign = ClusterAssignments::Open(catalog_dir);
+        cluster_ords.resize(assign.size());
+        clusters.resize(assign.size());
+        for (size_t row = 0; row < assign.size(); ++row) {
+            cluster_ords[row] = assign.ordinal(row);
+            clusters[row] = assign.cluster(row);
+        }
+    }
+    return CatalogSnapshot::Build(ScanCatalog(), ReadDeleted(), TagStore::Open(catalog_dir), cluster_ords, clusters,
+                                  seq);
+}
+
+void ImageDB::Publish(
+    const std::function<CatalogSnapshot::Ptr(const CatalogSnapshot&)>& fn, bool append) const {
+    shared_->committed = true;
+    shared_->rewrote = shared_->rewrote || !append;
+    // Until someone reads a snapshot there is nothing to keep current; the
+    // first Snapshot() reads the committed state from disk.
+    const std::lock_guard<std::mutex> seen_lock(shared_->catchup_mu);
+    const CatalogSnapshot* cur = shared_->head.load();
+    if (!cur) return;
+    if (!fn) {
+        shared_->Install(ReadSnapshot(cur->seq() + 1));
+        return;
+    }
+    // Another process committed since our last look: take its changes
+    // first. The catch-up may already include this commit, which fn then
+    // applies again to the same effect.
+    if (shared_->lease.seq() != shared_->seen_seq.load()) cur = CatchUp(true);
+    shared_->Install(fn(*cur));
+}
+
 bool ImageDB::Init(){
     namespace fs = std::filesystem;
+    const std::lock_guard<Shared> lock(*shared_);
 
     // 1) Sanity: root must be a directory (create if missing)
     if (db_root.empty()) {
@@ -202,40 +449,1266 @@ bool ImageDB::Init(){
     return true;
 }
 
-bool ImageDB::ImportFile(const std::string& file){
-    namespace fs = std::filesystem;
+bool ImageDB::ImportFile(const std::string& file, ImportResult* result, const std::string& sha256){
+    std::string hash = sha256.empty() ? sha256_file(file) : sha256;
+    ImportResult claim;
+    if (!ClaimImport(hash, &claim)) {
+        if (result) *result = claim;
+        return false;
+    }
+    // The claim holds a reference on the blob until the record commits;
+    // every step that fails or throws before then hands it back.
+    ImageMeta m;
+    ImgSignature sig;
+    bool have_sig = false;
+    try {
+        if (!atomic_copy(file, BlobPath(hash))) {
+            AbandonImport(hash, claim.image_id);
+            return false;
+        }
+
+        ImgDims dims;
 
-    std::string hash = sha256_file(file);
-    std::string blob_dir = db_root + "/blobs" + hash.substr(0,2);
-    std::string blob_path = blob_dir + "/" + hash;
-    std::string thumbs_path = db_root + "/thumbs";
+        if(!read_dims(file, &dims)){
+            std::cerr<<"Failed to read image dimensions\n";
+            AbandonImport(hash, claim.image_id);
+            return false;
+        }
+
+        m.image_id = claim.image_id;
+        m.sha256 = hash;
+        m.width = dims.width;
+        m.height = dims.height;
+        m.bytes = std::filesystem::file_size(file);
 
-    if(fs::exists(blob_path)) {
+        // Thumbnail first: its resized pixels also yield the perceptual hashes
+        // stored in the catalog record.
+        have_sig = make_thumbnail_256(file, ThumbnailPath(m.image_id), &sig);
+    } catch (...) {
+        AbandonImport(hash, claim.image_id);
+        throw;
+    }
+    // CommitImport throws only once the record is written.
+    if (!CommitImport(m, have_sig ? &sig : nullptr)) {
+        AbandonImport(hash, m.image_id);
+        return false;
+    }
+    if (result) result->image_id = m.image_id;
+    return true;
+};
+
+bool ImageDB::ClaimImport(const std::string& sha256, ImportResult* claim) {
+    namespace fs = std::filesystem;
+    const std::lock_guard<Shared> lock(*shared_);
+
+    // Most new images are told apart by the digest filter alone; only a
+    // possible hit goes to the blob and its reference count. A blob whose
+    // images were all deleted no longer counts, even before the GC removes
+    // it, and neither does a missing one: its content is stored again,
+    // even if that means a claim still copying it is imported twice.
+    BlockedBloom digests = Digests();
+    BlobRefs& refs = Refs();
+    const uint64_t digest_key = BlockedBloom::KeyOfSha256(sha256);
+    if(digests.MayContain(digest_key) && fs::exists(BlobPath(sha256)) && refs.Count(sha256) > 0) {
         std::cout<<"Already present (sha256 match). Skipped.\n";
+        claim->duplicate = true;
         return false;
     }
 
-    atomic_copy(file, blob_path);
+    // Added before the blob exists, so the filter never misses a stored
+    // digest, and the reference before the copy, so the GC never unlinks
+    // a blob an import is about to claim.
+    digests.Add(digest_key);
+    if (!refs.Increment(sha256)) return false;
 
-    ImgDims dims;
+    // Ids sort by import time; the mark file keeps them increasing across
+    // restarts and clock steps.
+    std::optional<IdGenerator>& ids = shared_->ids;
+    if (!ids) ids.emplace(IdGenerator::Open(catalog_dir + "/ids.hwm"));
+    char id[IdGenerator::kLen + 1];
+    if (!ids->Next(id)) return false;
+    claim->image_id = id;
+    return true;
+}
+
+bool ImageDB::AbandonImport(const std::string& sha256, const std::string& image_id) {
+    namespace fs = std::filesystem;
+    const std::lock_guard<Shared> lock(*shared_);
+    std::error_code ec;
+    fs::remove(ThumbnailPath(image_id), ec);
+    BlobRefs& refs = Refs();
+    if (!refs.Decrement(sha256)) return false;
+    // Images deleted before this claim may have left the blob; with no
+    // reference left it goes either way, and a retry writes it anew.
+    if (refs.Count(sha256) <= 0) fs::remove(BlobPath(sha256), ec);
+    return true;
+}
 
-    if(!read_dims(file, &dims)){
-        std::cerr<<"Failed to read image dimensions\n";
+bool ImageDB::CommitImport(ImageMeta& m, const ImgSignature* sig) {
+    namespace fs = std::filesystem;
+    const std::lock_guard<Shared> lock(*shared_);
+
+    // From the blob's signature, unless the caller had the bytes at hand.
+    if (m.mime.empty()) {
+        char head[12];
+        std::ifstream blob(BlobPath(m.sha256), std::ios::binary);
+        blob.read(head, sizeof head);
+        m.mime = image_mime(std::string_view(head, static_cast<size_t>(blob.gcount())));
+    }
+    m.created_unix = std::time(nullptr);
+    if (sig) {
+        m.dhash = sig->dhash;
+        m.phash = sig->phash;
+    }
+
+    // Everything ahead of the record reports failure instead of throwing,
+    // so the caller knows to abandon the claim exactly when nothing was
+    // recorded.
+    uint32_t cluster = CatalogColumns::kNoCluster;
+    std::optional<BlockedBloom> digests;
+    try {
+        // The ordinal is allocated before the record is written; a failure in
+        // between only leaves an unused ordinal.
+        OrdinalMap& ords = Ordinals();
+        m.ordinal = ords.Append(m.image_id);
+        if (m.ordinal == OrdinalMap::kNone) return false;
+
+        // Failed thumbnails still get a (zero) row so the sidecar covers every
+        // image. Written before the record, so no record is left without one;
+        // queries resolve rows through the snapshot and skip any whose record
+        // never lands.
+        if (!ColorStore::Open(catalog_dir).Append(m.ordinal, sig ? sig->color : ColorFeatures{})) return false;
+
+        // Join the nearest cluster of a catalog-feature model, likewise ahead
+        // of the record. Embedding clusters are fed by ImportEmbeddings once
+        // the vector arrives.
+        ClusterAssignments* assignments = nullptr;
+        ClusterModel* model = Clusters(&assignments);
+        if (model && sig && model->feature() != ClusterFeature::Embedding) {
+            float v[64];
+            if (model->feature() == ClusterFeature::PHash) phash_vector(m.phash, v);
+            else color_vector(sig->color.hist, v);
+            cluster = model->Update(v);
+            if (!assignments->Append(m.ordinal, cluster)) return false;
+        }
+
+        // Opened before the append so it is not taken for stale.
+        digests.emplace(Digests());
+    } catch (const std::exception& e) {
+        std::cerr << "Cannot commit " << m.image_id << ": " << e.what() << "\n";
         return false;
     }
+    if (!append_json_line(catalog_dir + "/meta.ndjson", meta_to_json(m))) return false;
+    digests->set_catalog_bytes(fs::file_size(catalog_meta_path));
+    // The range trees take the new row in place. While a query has one
+    // open it is left behind instead, and catches up at a later commit or
+    // is rebuilt once it trails by more than the slack.
+    const ColumnStore& projection = Columns();
+    for (NumColumn column : {NumColumn::CreatedAt, NumColumn::Bytes}) {
+        std::optional<BTree>& tree = shared_->trees[column == NumColumn::Bytes];
+        if (!tree || tree->synced_rows() > projection.size() ||
+            projection.size() - tree->synced_rows() > index_slack(tree->synced_rows())) {
+            tree.reset();
+            tree.emplace(RangeIndex(column, projection));
+        }
+        if (!insert_range_rows(*tree, column, projection)) tree.reset();
+    }
+
+    Publish([&](const CatalogSnapshot& s) { return s.WithRecord(m, cluster); },
+            cluster == CatalogColumns::kNoCluster);
+
+    std::cout << "Imported: " << m.image_id << " sha256=" << m.sha256 << "\n";
+    return true;
+}
+
+namespace {
+
+struct ImportBatch {
+    ImageDB& db;
+    IoExecutor& io;
+    WorkStealingPool& pool;
+    SerialWorker& catalog;
+    const std::vector<std::string>& files;
+    std::atomic<size_t> next{0};
+    std::atomic<size_t> imported{0};
+    std::unordered_set<std::string> claimed{};   // digests taken by this batch; catalog thread only
+};
+
+// co_await on_pool(batch, fn): runs fn on the pool, then resumes on
+// io's thread, so CPU work shares the pool with everything else and the
+// coroutine's own I/O never blocks a pool worker. Rethrows what fn threw.
+struct OnPool {
+    WorkStealingPool& pool;
+    IoExecutor& io;
+    std::function<void()> fn;
+    std::exception_ptr error;
+    bool await_ready() const noexcept { return false; }
+    void await_suspend(std::coroutine_handle<> h) {
+        pool.Submit([this, h] {
+            try {
+                fn();
+            } catch (...) {
+                error = std::current_exception();
+            }
+            io.Post(h);
+        });
+    }
+    void await_resume() const {
+        if (error) std::rethrow_exception(error);
+    }
+};
+
+OnPool on_pool(ImportBatch& b, std::function<void()> fn) {
+    return OnPool{b.pool, b.io, std::move(fn), {}};
+}
+
+// ImportFile for one file, with the bytes read once into memory: hashed,
+// written as the blob and decoded for the thumbnail from that copy.
+Task<void> import_one(ImportBatch& b, const std::string& file) {
+    std::string bytes;
+    if (!co_await ReadFile(b.io, file, &bytes)) co_return;
+    std::string hash;
+    co_await on_pool(b, [&] {
+        Sha256Ctx ctx;
+        sha256_init(ctx);
+        sha256_update(ctx, reinterpret_cast<const uint8_t*>(bytes.data()), bytes.size());
+        uint8_t digest[32];
+        sha256_final(ctx, digest);
+        hash = sha256_hex(digest);
+    });
 
+    ImportResult claim;
+    bool claimed = false;
+    co_await b.catalog.Call(b.io, [&] {
+        // The blob of an earlier file in the batch may not be written yet,
+        // so the store would not see it as a duplicate.
+        if (!b.claimed.insert(hash).second) {
+            std::cout << "Already present (sha256 match). Skipped.\n";
+            return;
+        }
+        claimed = b.db.ClaimImport(hash, &claim);
+    });
+    if (!claimed) co_return;
+    // As in ImportFile: until the record commits, a step that fails or
+    // throws hands the claim's blob reference back, and the digest, so a
+    // later file in the batch with the same content is imported.
+    auto abandon = [&]() -> Task<void> {
+        co_await b.catalog.Call(b.io, [&] {
+            b.claimed.erase(hash);
+            b.db.AbandonImport(hash, claim.image_id);
+        });
+    };
+    ImgSignature sig;
+    bool have_sig = false;
     ImageMeta m;
-    m.image_id = generate_id();
-    m.sha256 = hash;
-    m.mime = "image/jpeg";
-    m.width = dims.width;
-    m.height = dims.height;
-    m.bytes = std::filesystem::file_size(file);
-    m.created_unix = std::time(nullptr);
+    std::exception_ptr error;
+    try {
+        if (!co_await WriteFileAtomic(b.io, b.db.BlobPath(hash), bytes)) {
+            co_await abandon();
+            co_return;
+        }
+
+        ImgDims dims{0, 0, 0};
+        std::string png;
+        co_await on_pool(b, [&] { have_sig = thumbnail_256_from_memory(bytes, &png, &dims, &sig); });
+        if (dims.width == 0) {
+            std::cerr << "Failed to read image dimensions\n";
+            co_await abandon();
+            co_return;
+        }
+        if (have_sig) have_sig = co_await WriteFileAtomic(b.io, b.db.ThumbnailPath(claim.image_id), png);
+
+        m.image_id = claim.image_id;
+        m.sha256 = hash;
+        m.width = dims.width;
+        m.height = dims.height;
+        m.bytes = bytes.size();
+        m.mime = image_mime(bytes);
+    } catch (...) {
+        error = std::current_exception();   // no co_await in a handler
+    }
+    if (error) {
+        co_await abandon();
+        std::rethrow_exception(error);
+    }
+    // CommitImport throws only once the record is written.
+    bool committed = false;
+    co_await b.catalog.Call(b.io, [&] { committed = b.db.CommitImport(m, have_sig ? &sig : nullptr); });
+    if (committed) b.imported.fetch_add(1);
+    else co_await abandon();
+}
+
+// One of the batch's in-flight slots: imports files until none are left.
+Task<void> import_lane(ImportBatch& b) {
+    for (size_t i; (i = b.next.fetch_add(1)) < b.files.size();) {
+        try {
+            co_await import_one(b, b.files[i]);
+        } catch (const std::exception& e) {
+            std::cerr << "Import of " << b.files[i] << " failed: " << e.what() << "\n";
+        }
+    }
+}
+
+} // namespace
+
+size_t ImageDB::ImportFiles(const std::vector<std::string>& files, size_t in_flight) {
+    // One thread resumes coroutines between I/O and CPU steps; the CPU
+    // work itself is on the pool.
+    IoExecutor io(1);
+    SerialWorker catalog;
+    ImportBatch batch{*this, io, Pool(), catalog, files};
+    const size_t lanes = std::min(std::max<size_t>(1, in_flight), files.size());
+    for (size_t i = 0; i < lanes; ++i) io.Spawn(import_lane(batch));
+    io.Wait();
+    return batch.imported.load();
+}
+
+std::vector<ImageMeta> ImageDB::LoadCatalog() const {
+    return Snapshot()->Live();
+}
+
+std::vector<ImageMeta> ImageDB::ScanCatalog() const {
+    std::vector<ImageMeta> records;
+    bool ok = true;
+    Records().Scan([&](uint32_t, std::string_view json) {
+        ImageMeta m;
+        if (meta_from_json(std::string(json), &m)) records.push_back(std::move(m));
+        else ok = false;
+    });
+    if (!ok) throw std::runtime_error("LoadCatalog: bad record in " + catalog_dir + "/lsm");
+    return records;
+}
+
+LsmStore& ImageDB::Records() const {
+    namespace fs = std::filesystem;
+    const std::string dir = catalog_dir + "/lsm";
+    const std::lock_guard<Shared> lock(*shared_);
+    const uint64_t size = fs::file_size(catalog_meta_path);
+    // Kept open across commits, so writes go to its memtable and log and
+    // compaction runs in the background between flushes.
+    std::optional<LsmStore>& records = shared_->records;
+    if (!records) records.emplace(LsmStore::Open(dir));
+    // A catalog that shrank was rewritten: start over from it.
+    if (records->catalog_bytes() > size) {
+        records.reset();
+        fs::remove_all(dir);
+        records.emplace(LsmStore::Open(dir));
+    }
+    LsmStore& lsm = *records;
+    if (lsm.catalog_bytes() == size) return lsm;
+
+    std::vector<ImageMeta> tail;
+    if (!load_catalog(catalog_meta_path, &tail, lsm.catalog_bytes())) {
+        throw std::runtime_error("Records: cannot read " + catalog_meta_path);
+    }
+    bool ok = true;
+    if (lsm.catalog_bytes() == 0 && lsm.run_count() == 0) {
+        // Deletes are tombstones in the store; rebuilt from the import log,
+        // it leaves the deleted ordinals out instead.
+        const RoaringBitmap deleted = ReadDeleted();
+        std::vector<std::pair<uint32_t, std::string>> rows;
+        rows.reserve(tail.size());
+        for (const ImageMeta& m : tail) {
+            if (!deleted.Contains(m.ordinal)) rows.emplace_back(m.ordinal, meta_to_json(m));
+        }
+        std::sort(rows.begin(), rows.end(), [](const auto& a, const auto& b) { return a.first < b.first; });
+        ok = lsm.Ingest(rows);
+    } else {
+        for (const ImageMeta& m : tail) ok = ok && lsm.Put(m.ordinal, meta_to_json(m));
+    }
+    if (!ok || !lsm.SetCatalogBytes(size)) throw std::runtime_error("Records: cannot update " + dir);
+    return lsm;
+}
+
+std::optional<ImageMeta> ImageDB::GetImage(const std::string& image_id) const {
+    const PinnedSnapshot snap = Snapshot();
+    const std::optional<uint32_t> ordinal = snap->Find(image_id);
+    if (!ordinal) return std::nullopt;
+    return *snap->Get(*ordinal);
+}
+
+bool ImageDB::UpdateImage(const ImageMeta& m) {
+    const std::lock_guard<Shared> lock(*shared_);
+    const std::optional<ImageMeta> old = GetImage(m.image_id);
+    if (!old) {
+        std::cerr << "UpdateImage: no image " << m.image_id << "\n";
+        return false;
+    }
+    if (old->ordinal != m.ordinal || old->sha256 != m.sha256) {
+        std::cerr << "UpdateImage: ordinal and sha256 of " << m.image_id << " cannot change\n";
+        return false;
+    }
+    // The projection and range trees are append-only and read by queries
+    // of any snapshot, so the fields they hold stay as imported.
+    if (old->width != m.width || old->height != m.height || old->bytes != m.bytes ||
+        old->created_unix != m.created_unix) {
+        std::cerr << "UpdateImage: width, height, bytes and created_at of " << m.image_id << " cannot change\n";
+        return false;
+    }
+    if (!Records().Put(m.ordinal, meta_to_json(m))) return false;
+    Publish([&](const CatalogSnapshot& s) { return s.WithRecord(m); });
+    return true;
+}
+
+ClusterModel* ImageDB::Clusters(ClusterAssignments** assignments) const {
+    const std::lock_guard<Shared> lock(*shared_);
+    if (!shared_->clusters_loaded) {
+        shared_->cluster_model = ClusterModel::Load(clusters_path);
+        if (shared_->cluster_model) shared_->assignments.emplace(ClusterAssignments::Open(catalog_dir));
+        shared_->clusters_loaded = true;
+    }
+    if (!shared_->cluster_model) return nullptr;
+    *assignments = &*shared_->assignments;
+    return &*shared_->cluster_model;
+}
 
-    append_json_line(catalog_dir + "/meta.ndjson", meta_to_json(m));
-    make_thumbnail_256(file, thumbs_path + "/" + m.image_id + "_256.jpg");
+OrdinalMap& ImageDB::Ordinals() const {
+    const std::lock_guard<Shared> lock(*shared_);
+    std::optional<OrdinalMap>& ords = shared_->ordinals;
+    // Ids another process appended since are read from the tail; a file
+    // that shrank was rewritten.
+    std::error_code ec;
+    const uint64_t size = std::filesystem::file_size(catalog_dir + "/ordinals.ids", ec);
+    if (!ords || (!ec && size < ords->file_bytes())) ords.emplace(OrdinalMap::Open(catalog_dir));
+    else if (!ec && size > ords->file_bytes()) ords->Refresh();
+    return *ords;
+}
+
+const ColumnStore& ImageDB::Columns() const {
+    namespace fs = std::filesystem;
+    const std::lock_guard<Shared> lock(*shared_);
+    const uint64_t size = fs::file_size(catalog_meta_path);
+    std::optional<ColumnStore>& cs = shared_->projection;
+    if (!cs) cs.emplace(ColumnStore::Open(catalog_dir));
+    if (cs->catalog_bytes() == size) return *cs;
+
+    // A catalog that shrank was rewritten: project it again from scratch.
+    if (cs->catalog_bytes() > size) {
+        cs.reset();
+        for (const char* name : {"width", "height", "bytes", "created_at", "zones", "ords"}) {
+            fs::remove(catalog_dir + "/columns." + name);
+        }
+        cs.emplace(ColumnStore::Open(catalog_dir));
+    }
+
+    std::vector<ImageMeta> tail;
+    if (!load_catalog(catalog_meta_path, &tail, cs->catalog_bytes(), static_cast<uint32_t>(cs->size()))) {
+        throw std::runtime_error("Columns: cannot read " + catalog_meta_path);
+    }
+    // Rows appended before a crash kept the covered size from advancing.
+    const int64_t last = cs->size() ? static_cast<int64_t>(cs->ordinal(cs->size() - 1)) : -1;
+    tail.erase(std::remove_if(tail.begin(), tail.end(),
+                              [&](const ImageMeta& m) { return static_cast<int64_t>(m.ordinal) <= last; }),
+               tail.end());
+    if (!cs->Append(tail.data(), tail.size()) || !cs->SetCatalogBytes(size) || !cs->Refresh()) {
+        cs.reset();
+        throw std::runtime_error("Columns: cannot extend the projection in " + catalog_dir);
+    }
+    return *cs;
+}
 
-    std::cout << "Imported: " << m.image_id << " sha256=" << hash << "\n";
+std::shared_ptr<const ColumnStore> ImageDB::ProjectionView() const {
+    std::error_code ec;
+    const uint64_t on_disk = std::filesystem::file_size(catalog_dir + "/columns.ords", ec) / sizeof(uint32_t);
+    const std::lock_guard<std::mutex> lock(shared_->view_mu);
+    std::shared_ptr<const ColumnStore>& view = shared_->view;
+    if (ec || on_disk == 0 || (view && on_disk <= view->size() + index_slack(view->size()))) return view;
+    // The files only grow, and their ordinals are written last: an open
+    // without the commit lock sees a consistent prefix.
+    try {
+        view = std::make_shared<const ColumnStore>(ColumnStore::Open(catalog_dir));
+    } catch (const std::exception& e) {
+        std::cerr << "Query: projection unavailable: " << e.what() << "\n";
+    }
+    return view;
+}
+
+namespace {
+
+std::string range_index_path(const std::string& catalog_dir, NumColumn column) {
+    return catalog_dir + (column == NumColumn::CreatedAt ? "/created_at.bt" : "/bytes.bt");
+}
+
+bool bulk_load_range_index(const std::string& path, NumColumn column, const ColumnStore& projection) {
+    std::vector<BTree::Entry> entries(projection.size());
+    for (size_t row = 0; row < projection.size(); ++row) {
+        entries[row] = {projection.value(column, row), projection.ordinal(row)};
+    }
+    std::sort(entries.begin(), entries.end());
+    entries.erase(std::unique(entries.begin(), entries.end()), entries.end());
+    return BTree::BulkLoad(path, entries, projection.size());
+}
+
+} // namespace
+
+BTree ImageDB::RangeIndex(NumColumn column, const ColumnStore& projection) const {
+    if (column != NumColumn::CreatedAt && column != NumColumn::Bytes) {
+        throw std::runtime_error("RangeIndex: only created_at and bytes are indexed");
+    }
+    const std::lock_guard<Shared> lock(*shared_);
+    const std::string path = range_index_path(catalog_dir, column);
+    std::optional<BTree> tree = BTree::Open(path);
+    if (tree && tree->synced_rows() <= projection.size() &&
+        projection.size() - tree->synced_rows() <= index_slack(tree->synced_rows())) {
+        return std::move(*tree);
+    }
+    tree.reset();
+    if (!bulk_load_range_index(path, column, projection) || !(tree = BTree::Open(path))) {
+        throw std::runtime_error("RangeIndex: cannot build " + path);
+    }
+    return std::move(*tree);
+}
+
+bool ImageDB::BuildRangeIndexes() const {
+    const std::lock_guard<Shared> lock(*shared_);
+    const ColumnStore& projection = Columns();
+    for (NumColumn column : {NumColumn::CreatedAt, NumColumn::Bytes}) {
+        const std::string path = range_index_path(catalog_dir, column);
+        shared_->trees[column == NumColumn::Bytes].reset();
+        if (!bulk_load_range_index(path, column, projection)) return false;
+        const std::optional<BTree> tree = BTree::Open(path);
+        if (!tree) {
+            std::cerr << "BuildRangeIndexes: cannot open " << path << "\n";
+            return false;
+        }
+        std::cout << path << ": " << tree->size() << " entries, height " << tree->height() << ", "
+                  << tree->page_count() << " pages\n";
+    }
     return true;
-};
\ No newline at end of file
+}
+
+BlockedBloom ImageDB::Digests() const {
+    const std::lock_guard<Shared> lock(*shared_);
+    const uint64_t size = std::filesystem::file_size(catalog_meta_path);
+    std::optional<BlockedBloom> f = BlockedBloom::Open(catalog_dir + "/sha256.bloom");
+    if (f && f->catalog_bytes() == size && f->count() < f->capacity()) return std::move(*f);
+    return BuildDigests();
+}
+
+BlockedBloom ImageDB::BuildDigests() const {
+    constexpr uint64_t kMinCapacity = 1 << 16;
+    const std::lock_guard<Shared> lock(*shared_);
+    const uint64_t size = std::filesystem::file_size(catalog_meta_path);
+    const std::vector<ImageMeta> records = LoadCatalog();
+    BlockedBloom f = BlockedBloom::Create(catalog_dir + "/sha256.bloom",
+                                          std::max<uint64_t>(kMinCapacity, 2 * records.size()));
+    for (const ImageMeta& m : records) f.Add(BlockedBloom::KeyOfSha256(m.sha256));
+    f.set_catalog_bytes(size);
+    if (!f.Sync()) throw std::runtime_error("Digests: cannot write " + catalog_dir + "/sha256.bloom");
+    return f;
+}
+
+std::string ImageDB::BlobPath(const std::string& sha256) const {
+    // Blobs sit in blobs<first two hex digits>/ next to blobs/, as every
+    // existing DB stores them.
+    return db_root + "/blobs" + sha256.substr(0, 2) + "/" + sha256;
+}
+
+std::string ImageDB::ThumbnailPath(const std::string& image_id) const {
+    return thumbs_dir + "/" + image_id + "_256.jpg";
+}
+
+RoaringBitmap ImageDB::Deleted() const {
+    return Snapshot()->deleted();
+}
+
+RoaringBitmap ImageDB::ReadDeleted() const {
+    RoaringBitmap deleted;
+    for (uint32_t ordinal : read_ordinal_column(catalog_dir + "/deleted.ords")) deleted.Add(ordinal);
+    return deleted;
+}
+
+BlobRefs& ImageDB::Refs() const {
+    const std::lock_guard<Shared> lock(*shared_);
+    std::optional<BlobRefs>& refs = shared_->refs;
+    if (!refs) refs.emplace(BlobRefs::Open(blobs_dir));
+    if (refs->exists()) return *refs;
+    std::unordered_map<std::string, int64_t> counts;
+    for (const ImageMeta& m : LoadCatalog()) ++counts[m.sha256];
+    if (!refs->Compact(&counts)) throw std::runtime_error("Refs: cannot write " + blobs_dir + "/refs.log");
+    return *refs;
+}
+
+bool ImageDB::Delete(const std::string& image_id) {
+    const std::lock_guard<Shared> lock(*shared_);
+    const std::optional<ImageMeta> m = GetImage(image_id);
+    if (!m) {
+        std::cerr << "Delete: no image " << image_id << "\n";
+        return false;
+    }
+    const uint32_t ordinal = m->ordinal;
+    BlobRefs& refs = Refs();
+
+    // Hidden first and unreferenced last: a crash in between leaks the
+    // blob rather than freeing one a live record points at.
+    const std::string deleted_path = catalog_dir + "/deleted.ords";
+    const std::vector<uint32_t> deleted = read_ordinal_column(deleted_path);
+    if (std::find(deleted.begin(), deleted.end(), ordinal) == deleted.end()) {
+        std::fstream out;
+        if (!put_ordinal(out, deleted_path, deleted.size(), ordinal)) return false;
+    }
+    if (!Records().Delete(ordinal)) return false;
+
+    TagStore tags = TagStore::Open(catalog_dir);
+    for (size_t t = 0; t < tags.size(); ++t) {
+        if (!tags.postings(t).Contains(ordinal)) continue;
+        const std::string name(tags.name(t));
+        if (!tags.Remove(ordinal, name)) return false;
+    }
+    Publish([&](const CatalogSnapshot& s) { return s.WithDeleted(ordinal, std::move(tags)); });
+    return refs.Decrement(m->sha256);
+}
+
+bool ImageDB::CollectGarbage() {
+    namespace fs = std::filesystem;
+    // The scan and the unlinking take no lease, so imports (through this
+    // handle or others) go on meanwhile; they are read from the log with
+    // an object of our own rather than the writer's.
+    const BlobRefs refs = BlobRefs::Open(blobs_dir);
+    const std::unordered_map<std::string, int64_t> counts = refs.Counts();
+
+    const std::string trash = blobs_dir + "/.trash";
+    std::error_code ec;
+    fs::create_directories(trash, ec);
+    std::vector<std::string> moved;
+    for (const auto& [sha, n] : counts) {
+        if (n > 0) continue;
+        fs::rename(BlobPath(sha), trash + "/" + sha, ec);
+        if (!ec) moved.push_back(sha);
+    }
+
+    // Referenced again since the counts were read: those imports copy the
+    // blob after referencing it, so put it back unless one already has.
+    uint64_t blobs = 0, bytes = 0;
+    for (const std::string& sha : moved) {
+        const std::string aside = trash + "/" + sha;
+        if (refs.Count(sha) > 0 && !fs::exists(BlobPath(sha))) {
+            fs::rename(aside, BlobPath(sha), ec);
+            if (ec) {
+                std::cerr << "CollectGarbage: cannot restore " << BlobPath(sha) << "\n";
+                return false;
+            }
+            continue;
+        }
+        const uint64_t size = fs::file_size(aside, ec);
+        if (fs::remove(aside, ec)) {
+            ++blobs;
+            bytes += size;
+        }
+    }
+
+    // Deleted ordinals stay deleted, and their ids are in the map for good.
+    const RoaringBitmap deleted = Deleted();
+    const OrdinalMap ords = OrdinalMap::Open(catalog_dir);
+    uint64_t thumbs = 0;
+    for (uint32_t ordinal : deleted.ToVector()) {
+        if (ordinal >= ords.size()) continue;
+        thumbs += fs::remove(ThumbnailPath(std::string(ords.image_id(ordinal))), ec);
+    }
+
+    // Only replacing the log needs the lease: no append may land in the
+    // file being replaced.
+    {
+        const std::lock_guard<Shared> lock(*shared_);
+        if (!Refs().Compact()) return false;
+    }
+    std::cout << "gc: removed " << blobs << " blobs (" << bytes << " bytes) and " << thumbs << " thumbnails\n";
+    return true;
+}
+
+bool ImageDB::Checkpoint() {
+    const std::lock_guard<Shared> lock(*shared_);
+    LsmStore& records = Records();
+    if (!records.CompactAll()) return false;
+    const BlockedBloom digests = BuildDigests();
+    const ColumnStore& projection = Columns();
+    for (NumColumn column : {NumColumn::CreatedAt, NumColumn::Bytes}) {
+        if (RangeIndex(column, projection).synced_rows() == projection.size()) continue;
+        shared_->trees[column == NumColumn::Bytes].reset();
+        if (!bulk_load_range_index(range_index_path(catalog_dir, column), column, projection)) return false;
+    }
+    std::cout << "records: " << records.run_count() << " run\n"
+              << "digests: " << digests.count() << " of " << digests.capacity() << " capacity\n"
+              << "projection: " << projection.size() << " rows\n";
+    return true;
+}
+
+void ImageDB::MigrateToOrdinals() const {
+    namespace fs = std::filesystem;
+
+    const std::lock_guard<Shared> lock(*shared_);
+
+    // Catalogs from before ordinals: number records in catalog order, which
+    // is also what load_catalog reports for records without an ordinal.
+    const std::string map_path = catalog_dir + "/ordinals.ids";
+    if (!fs::exists(map_path) && fs::exists(catalog_meta_path)) {
+        const std::string tmp = map_path + ".tmp";
+        {
+            std::ofstream out(tmp, std::ios::trunc);
+            for (const ImageMeta& m : ScanCatalog()) out << m.image_id << '\n';
+            if (!out.flush()) throw std::runtime_error("Ordinals: cannot write " + tmp);
+        }
+        fs::rename(tmp, map_path);
+    }
+
+    // Sidecars that still key rows by image_id line get an ordinal column.
+    const OrdinalMap* ords = nullptr;
+    for (const std::string& base : {catalog_dir + "/color", catalog_dir + "/clusters", embeddings_path, pq_path}) {
+        const std::string ids_path = base + ".ids";
+        if (!fs::exists(ids_path)) continue;
+        if (!ords) ords = &Ordinals();
+        std::vector<uint32_t> col;
+        std::ifstream in(ids_path);
+        for (std::string line; std::getline(in, line);) col.push_back(ords->Find(line));
+        if (!write_ordinal_column(base + ".ords", col)) throw std::runtime_error("Ordinals: cannot convert " + ids_path);
+        fs::remove(ids_path);
+    }
+}
+
+std::vector<SimilarHit> ImageDB::FindSimilar(const std::string& file, int radius) const {
+    ImgSignature sig;
+    if (!compute_signature(file, &sig)) {
+        throw std::runtime_error("FindSimilar: cannot hash " + file);
+    }
+
+    // Records imported before hashing existed have no pHash and are
+    // skipped rather than matched as the all-zero hash.
+    const PinnedSnapshot snap = Snapshot();
+    std::vector<SimilarHit> hits;
+    for (const auto& [ordinal, distance] : snap->Similar(sig.phash, radius)) {
+        hits.push_back({snap->Get(ordinal)->image_id, distance});
+    }
+    std::stable_sort(hits.begin(), hits.end(),
+                     [](const SimilarHit& a, const SimilarHit& b) { return a.distance < b.distance; });
+    return hits;
+}
+
+bool ImageDB::ImportEmbeddings(const std::string& file, EmbedDType dtype) {
+    namespace fs = std::filesystem;
+    const std::lock_guard<Shared> lock(*shared_);
+
+    std::ifstream in(file);
+    if (!in) {
+        std::cerr << "ImportEmbeddings: cannot open " << file << "\n";
+        return false;
+    }
+
+    const OrdinalMap& ords = Ordinals();
+
+    // Either store may be absent: the float store until the first import,
+    // the PQ store until pq-train, and the float store again once the DB
+    // runs fully compressed.
+    std::optional<EmbeddingStore> store;
+    std::optional<PqStore> pq;
+    if (fs::exists(embeddings_path)) store.emplace(EmbeddingStore::Open(embeddings_path));
+    if (fs::exists(pq_path)) pq.emplace(PqStore::Open(pq_path));
+    const bool compressed = pq && !store;
+
+    std::vector<bool> present(ords.size(), false);
+    if (store) {
+        for (size_t i = 0; i < store->size(); ++i) present[store->ordinal(i)] = true;
+    } else if (pq) {
+        for (size_t i = 0; i < pq->size(); ++i) present[pq->ordinal(i)] = true;
+    }
+
+    ClusterAssignments* assignments = nullptr;
+    ClusterModel* clusters = Clusters(&assignments);
+    if (clusters && clusters->feature() != ClusterFeature::Embedding) clusters = nullptr;
+
+    size_t added = 0, skipped = 0;
+    std::string line;
+    std::vector<float> v;
+    while (std::getline(in, line)) {
+        std::istringstream ls(line);
+        std::string id;
+        if (!(ls >> id) || id[0] == '#') continue;
+        v.clear();
+        for (float x; ls >> x;) v.push_back(x);
+
+        const uint32_t ord = ords.Find(id);
+        if (ord == OrdinalMap::kNone || present[ord]) {
+            ++skipped;
+            continue;
+        }
+        if (!store && !compressed) {
+            if (v.empty()) {
+                std::cerr << "ImportEmbeddings: empty vector for " << id << "\n";
+                return false;
+            }
+            store.emplace(EmbeddingStore::Create(embeddings_path, static_cast<uint32_t>(v.size()), dtype));
+        }
+        const uint32_t dim = store ? store->dim() : pq->quantizer().dim();
+        if (v.size() != dim) {
+            std::cerr << "ImportEmbeddings: " << id << " has " << v.size()
+                      << " values, store dimension is " << dim << "\n";
+            return false;
+        }
+        if (store && !store->Append(ord, v.data())) return false;
+        if (pq && !pq->Append(ord, v.data())) return false;
+        if (clusters && clusters->dim() == dim && !assignments->Append(ord, clusters->Update(v.data()))) return false;
+        present[ord] = true;
+        ++added;
+    }
+
+    if (clusters && added > 0) Publish(nullptr);
+    if (!store && !pq) {
+        std::cerr << "ImportEmbeddings: nothing to import\n";
+        return false;
+    }
+
+    if (store) {
+        store->Refresh();
+
+        // Extend the saved graph instead of rebuilding it.
+        std::optional<Hnsw> index = Hnsw::Load(hnsw_path, &*store);
+        if (!index) index.emplace(&*store);
+        for (size_t row = index->size(); row < store->size(); ++row) index->Add(static_cast<uint32_t>(row));
+        if (!index->Save(hnsw_path)) {
+            std::cerr << "ImportEmbeddings: failed to save index " << hnsw_path << "\n";
+            return false;
+        }
+    }
+
+    std::cout << "Imported " << added << " embeddings (" << skipped
+              << " skipped: unknown or already present)\n";
+    return true;
+}
+
+bool ImageDB::TrainPq(int m, size_t sample_size, bool drop_float) {
+    namespace fs = std::filesystem;
+    const std::lock_guard<Shared> lock(*shared_);
+
+    if (!fs::exists(embeddings_path)) {
+        std::cerr << "TrainPq: no float embeddings to train from\n";
+        return false;
+    }
+    EmbeddingStore store = EmbeddingStore::Open(embeddings_path);
+    if (store.size() == 0) {
+        std::cerr << "TrainPq: embedding store is empty\n";
+        return false;
+    }
+
+    // Uniform sample without replacement (partial Fisher-Yates over rows).
+    const size_t n = std::min(sample_size, store.size());
+    std::vector<uint32_t> rows(store.size());
+    for (size_t i = 0; i < rows.size(); ++i) rows[i] = static_cast<uint32_t>(i);
+    std::mt19937_64 rng(12345);
+    for (size_t i = 0; i < n; ++i) std::swap(rows[i], rows[i + rng() % (rows.size() - i)]);
+
+    const uint32_t dim = store.dim();
+    std::vector<float> sample(n * dim);
+    for (size_t i = 0; i < n; ++i) store.Decode(rows[i], &sample[i * dim]);
+
+    ProductQuantizer quantizer;
+    try {
+        quantizer = ProductQuantizer::Train(sample.data(), n, dim, m);
+    } catch (const std::invalid_argument& ex) {
+        std::cerr << "TrainPq: " << ex.what() << "\n";
+        return false;
+    }
+
+    // Encode into a temp store and publish it with a rename.
+    const std::string tmp = pq_path + ".tmp";
+    {
+        PqStore pq = PqStore::Create(tmp, std::move(quantizer));
+        std::vector<float> v(dim);
+        for (size_t row = 0; row < store.size(); ++row) {
+            store.Decode(row, v.data());
+            if (!pq.Append(store.ordinal(row), v.data())) return false;
+        }
+    }
+    std::error_code ec;
+    fs::rename(tmp + ".ords", pq_path + ".ords", ec);
+    if (!ec) fs::rename(tmp, pq_path, ec);
+    if (ec) {
+        std::cerr << "TrainPq: cannot publish " << pq_path << ": " << ec.message() << "\n";
+        return false;
+    }
+
+    std::cout << "Trained PQ (M=" << m << ", " << n << " samples) and encoded "
+              << store.size() << " vectors: " << dim * 4 << " -> " << m << " bytes each\n";
+
+    if (drop_float) {
+        fs::remove(embeddings_path, ec);
+        fs::remove(embeddings_path + ".ords", ec);
+        fs::remove(hnsw_path, ec);
+        std::cout << "Dropped float embeddings; the store now runs fully compressed\n";
+    }
+    return true;
+}
+
+std::vector<KnnHit> ImageDB::NearestByVector(const std::vector<float>& q, int k,
+                                             const KnnOptions& opts) const {
+    namespace fs = std::filesystem;
+    // No lock: the sidecars are read as they stand and their rows resolved
+    // through a pinned snapshot, which also leaves out deleted images.
+    const PinnedSnapshot snap = Snapshot();
+    const RoaringBitmap& deleted = snap->deleted();
+    const auto live = [&](uint32_t ordinal) -> const ImageMeta* { return snap->Get(ordinal); };
+
+    const bool have_float = fs::exists(embeddings_path);
+    if (!opts.use_pq && have_float) {
+        std::optional<EmbeddingStore> store;
+        std::optional<Hnsw> index;
+        // An import may save a longer graph between the two opens; the
+        // store reopened after it covers every row the graph has.
+        for (int attempt = 0; attempt < 2 && !index; ++attempt) {
+            store.emplace(EmbeddingStore::OpenReadOnly(embeddings_path));
+            if (q.size() != store->dim()) {
+                throw std::invalid_argument("NearestByVector: query has " + std::to_string(q.size()) +
+                                            " values, store dimension is " + std::to_string(store->dim()));
+            }
+            index = Hnsw::Load(hnsw_path, &*store);
+        }
+        if (!index) throw std::runtime_error("NearestByVector: missing or stale index " + hnsw_path);
+
+        // Deleted images keep their vectors: ask for enough extra
+        // neighbours to still return k live ones.
+        std::vector<KnnHit> hits;
+        for (const auto& [dist, row] : index->Search(q.data(), k + static_cast<int>(deleted.Cardinality()), opts.ef)) {
+            const ImageMeta* m = live(store->ordinal(row));
+            if (!m) continue;
+            if (hits.size() == static_cast<size_t>(k)) break;
+            hits.push_back({m->image_id, dist});
+        }
+        return hits;
+    }
+
+    if (!fs::exists(pq_path)) throw std::runtime_error("NearestByVector: no embedding index");
+    PqStore pq = PqStore::Open(pq_path);
+    if (q.size() != pq.quantizer().dim()) {
+        throw std::invalid_argument("NearestByVector: query has " + std::to_string(q.size()) +
+                                    " values, store dimension is " + std::to_string(pq.quantizer().dim()));
+    }
+
+    // ADC shortlist, then optionally re-rank it with exact distances from
+    // the float rows (read through the mmap, so only shortlisted rows are
+    // paged in).
+    const size_t shortlist = std::max<size_t>(k, have_float ? opts.rerank : 0) + deleted.Cardinality();
+    std::vector<std::pair<float, uint32_t>> cands = pq.Search(q.data(), shortlist);
+    cands.erase(std::remove_if(cands.begin(), cands.end(),
+                               [&](const auto& c) { return !live(pq.ordinal(c.second)); }),
+                cands.end());
+
+    std::vector<KnnHit> hits;
+    if (have_float && opts.rerank > 0) {
+        const EmbeddingStore store = EmbeddingStore::OpenReadOnly(embeddings_path);
+        for (auto& c : cands) {
+            // PQ rows and float rows share row numbers: both are appended in
+            // the same order by ImportEmbeddings and TrainPq.
+            if (c.second < store.size()) c.first = store.Distance(q.data(), c.second);
+        }
+        std::sort(cands.begin(), cands.end());
+    }
+    if (cands.size() > static_cast<size_t>(k)) cands.resize(k);
+    for (const auto& [dist, row] : cands) hits.push_back({live(pq.ordinal(row))->image_id, dist});
+    return hits;
+}
+
+std::vector<KnnHit> ImageDB::NearestByEmbedding(const std::string& image_id, int k,
+                                                const KnnOptions& opts) const {
+    namespace fs = std::filesystem;
+    const std::optional<uint32_t> found = Snapshot()->Find(image_id);
+    if (!found) throw std::runtime_error("NearestByEmbedding: unknown image " + image_id);
+    const uint32_t ord = *found;
+
+    if (fs::exists(embeddings_path)) {
+        const EmbeddingStore store = EmbeddingStore::OpenReadOnly(embeddings_path);
+        for (size_t row = 0; row < store.size(); ++row) {
+            if (store.ordinal(row) != ord) continue;
+            std::vector<float> q(store.dim());
+            store.Decode(row, q.data());
+            return NearestByVector(q, k, opts);
+        }
+    } else if (fs::exists(pq_path)) {
+        // Fully compressed: the reconstruction is the best query we have.
+        PqStore pq = PqStore::Open(pq_path);
+        for (size_t row = 0; row < pq.size(); ++row) {
+            if (pq.ordinal(row) != ord) continue;
+            std::vector<float> q(pq.quantizer().dim());
+            pq.quantizer().Decode(pq.code(row), q.data());
+            return NearestByVector(q, k, opts);
+        }
+    }
+    throw std::runtime_error("NearestByEmbedding: no embedding for " + image_id);
+}
+
+// Rows of the color sidecar scored per pool task.
+constexpr size_t kColorScanGrain = 16384;
+
+std::vector<ColorHit> ImageDB::SearchColor(const uint16_t* query, size_t k, float min_score) const {
+    // No lock: rows are resolved through a pinned snapshot, so one whose
+    // record is not committed yet, or was deleted, is left out.
+    const PinnedSnapshot snap = Snapshot();
+    const ColorStore colors = ColorStore::OpenReadOnly(catalog_dir);
+    const size_t n = colors.size();
+
+    std::vector<uint32_t> scores(n);
+    Pool().ParallelFor(n, kColorScanGrain, [&](size_t begin, size_t end) {
+        hist_intersection_batch(query, colors.hists() + begin * kColorBins, end - begin, scores.data() + begin);
+    }, TaskPriority::High);
+
+    const uint32_t min_raw = static_cast<uint32_t>(std::ceil(min_score * kHistTotal));
+    std::vector<uint32_t> rows;
+    for (size_t i = 0; i < n; ++i) {
+        if (scores[i] >= min_raw && scores[i] > 0 && snap->Get(colors.ordinal(i))) {
+            rows.push_back(static_cast<uint32_t>(i));
+        }
+    }
+    const size_t top = std::min(k, rows.size());
+    std::partial_sort(rows.begin(), rows.begin() + top, rows.end(),
+                      [&](uint32_t a, uint32_t b) { return scores[a] > scores[b]; });
+
+    std::vector<ColorHit> hits;
+    for (size_t i = 0; i < top; ++i) {
+        ColorHit h;
+        h.image_id = snap->Get(colors.ordinal(rows[i]))->image_id;
+        h.score = static_cast<float>(scores[rows[i]]) / kHistTotal;
+        std::copy(colors.dominant(rows[i]), colors.dominant(rows[i]) + 3, h.dominant);
+        hits.push_back(std::move(h));
+    }
+    return hits;
+}
+
+namespace {
+
+// Per-image feature rows for clustering: `ords[i]` and a fetch of row i,
+// reading from the inputs held alongside. `end` is how far into its
+// source it read (ordinals for pHash, sidecar rows otherwise), so a later
+// load can take only what was added since.
+struct FeatureSource {
+    uint32_t dim = 0;
+    std::vector<uint32_t> ords;
+    std::function<void(size_t, float*)> fetch;
+    size_t end = 0;
+
+    std::vector<uint64_t> phashes;
+    std::optional<ColorStore> colors;
+    std::vector<size_t> color_rows;
+    std::optional<EmbeddingStore> store;
+    std::optional<PqStore> pq;
+
+    FeatureSource() = default;
+    FeatureSource(const FeatureSource&) = delete;   // fetch points into it
+    FeatureSource& operator=(const FeatureSource&) = delete;
+};
+
+// Rows of `feature` from position `from` of its source on. pHashes come
+// from `snap`; colour rows and embeddings are read through the sidecars'
+// mappings, so the caller needs the commit lock only while this runs.
+void load_features(FeatureSource* src, const ImageDB& db, const CatalogSnapshot& snap, ClusterFeature feature,
+                   size_t from) {
+    namespace fs = std::filesystem;
+    if (feature == ClusterFeature::PHash) {
+        for (const ImageMeta& m : snap.Live()) {
+            if (m.phash == 0 || m.ordinal < from) continue;
+            src->ords.push_back(m.ordinal);
+            src->phashes.push_back(m.phash);
+        }
+        src->dim = 64;
+        src->end = snap.ordinal_end();
+        src->fetch = [src](size_t i, float* out) { phash_vector(src->phashes[i], out); };
+    } else if (feature == ClusterFeature::Color) {
+        src->colors.emplace(ColorStore::Open(db.catalog_dir));
+        for (size_t row = from; row < src->colors->size(); ++row) {
+            // All-zero rows belong to images whose thumbnail failed.
+            const uint16_t* h = src->colors->hist(row);
+            if (std::all_of(h, h + kColorBins, [](uint16_t x) { return x == 0; })) continue;
+            src->ords.push_back(src->colors->ordinal(row));
+            src->color_rows.push_back(row);
+        }
+        src->dim = kColorBins;
+        src->end = src->colors->size();
+        src->fetch = [src](size_t i, float* out) { color_vector(src->colors->hist(src->color_rows[i]), out); };
+    } else if (fs::exists(db.embeddings_path)) {
+        src->store.emplace(EmbeddingStore::Open(db.embeddings_path));
+        for (size_t row = from; row < src->store->size(); ++row) src->ords.push_back(src->store->ordinal(row));
+        src->dim = src->store->dim();
+        src->end = src->store->size();
+        src->fetch = [src, from](size_t i, float* out) { src->store->Decode(from + i, out); };
+    } else if (fs::exists(db.pq_path)) {
+        src->pq.emplace(PqStore::Open(db.pq_path));
+        for (size_t row = from; row < src->pq->size(); ++row) src->ords.push_back(src->pq->ordinal(row));
+        src->dim = src->pq->quantizer().dim();
+        src->end = src->pq->size();
+        src->fetch = [src, from](size_t i, float* out) { src->pq->quantizer().Decode(src->pq->code(from + i), out); };
+    }
+}
+
+} // namespace
+
+bool ImageDB::TrainClusters(ClusterFeature feature, int k, size_t batch, int iters) {
+    // Training and assignment read a pinned snapshot and the sidecars as
+    // they stood at the start, without the commit lock, so imports go on
+    // meanwhile. Images committed in between are assigned under the lock
+    // just before the assignments are replaced.
+    FeatureSource src;
+    {
+        const std::lock_guard<Shared> lock(*shared_);
+        load_features(&src, *this, *Snapshot(), feature, 0);
+    }
+
+    const size_t n = src.ords.size();
+    if (n == 0) {
+        std::cerr << "TrainClusters: no images have a " << cluster_feature_name(feature) << " feature\n";
+        return false;
+    }
+    if (k <= 0 || batch == 0 || iters <= 0) {
+        std::cerr << "TrainClusters: k, batch and iters must be positive\n";
+        return false;
+    }
+
+    // Mini-batch k-means touches at most batch * iters rows, so train on a
+    // uniform sample of that many (partial Fisher-Yates) rather than
+    // materializing every feature vector.
+    const uint32_t dim = src.dim;
+    const size_t sample_n = std::min(n, batch * static_cast<size_t>(iters));
+    std::vector<uint32_t> rows(n);
+    for (size_t i = 0; i < n; ++i) rows[i] = static_cast<uint32_t>(i);
+    std::mt19937_64 rng(12345);
+    for (size_t i = 0; i < sample_n; ++i) std::swap(rows[i], rows[i + rng() % (n - i)]);
+    std::vector<float> sample(sample_n * dim);
+    for (size_t i = 0; i < sample_n; ++i) src.fetch(rows[i], &sample[i * dim]);
+
+    ClusterModel model = ClusterModel::Train(feature, sample.data(), sample_n, dim, k, batch, iters);
+
+    std::vector<uint32_t> ords = src.ords;
+    std::vector<uint32_t> assigned(n);
+    std::vector<float> v(dim);
+    for (size_t i = 0; i < n; ++i) {
+        src.fetch(i, v.data());
+        assigned[i] = model.Assign(v.data());
+    }
+
+    const std::lock_guard<Shared> lock(*shared_);
+    FeatureSource added;
+    load_features(&added, *this, *Snapshot(), feature, src.end);
+    if (added.dim == dim) {
+        for (size_t i = 0; i < added.ords.size(); ++i) {
+            added.fetch(i, v.data());
+            ords.push_back(added.ords[i]);
+            assigned.push_back(model.Assign(v.data()));
+        }
+    }
+    // Copies kept for imports describe the files being replaced.
+    shared_->clusters_loaded = false;
+    shared_->cluster_model.reset();
+    shared_->assignments.reset();
+    if (!ClusterAssignments::Rewrite(catalog_dir, ords, assigned) || !model.Save(clusters_path)) return false;
+    Publish(nullptr);
+
+    std::cout << "Clustered " << ords.size() << " images into " << k << " clusters by "
+              << cluster_feature_name(feature) << " (" << sample_n << " training rows)\n";
+    return true;
+}
+
+std::vector<size_t> ImageDB::ClusterSizes(ClusterFeature* feature) const {
+    // The snapshot carries the assignments; the model file only says how
+    // many clusters there are.
+    const PinnedSnapshot snap = Snapshot();
+    std::optional<ClusterModel> model = ClusterModel::Load(clusters_path);
+    if (!model) throw std::runtime_error("ClusterSizes: no cluster model at " + clusters_path);
+    if (feature) *feature = model->feature();
+
+    const CatalogColumns& cols = snap->Columns();
+    std::vector<size_t> sizes(model->k(), 0);
+    for (size_t row = 0; row < cols.size(); ++row) {
+        if (cols.cluster[row] < sizes.size() && !snap->deleted().Contains(cols.ordinal[row])) ++sizes[cols.cluster[row]];
+    }
+    return sizes;
+}
+
+std::vector<std::string> ImageDB::ClusterMembers(uint32_t cluster, size_t offset, size_t limit) const {
+    const PinnedSnapshot snap = Snapshot();
+    const CatalogColumns& cols = snap->Columns();
+    std::vector<std::string> out;
+    for (size_t row = 0; row < cols.size() && out.size() < limit; ++row) {
+        if (cols.cluster[row] != cluster || snap->deleted().Contains(cols.ordinal[row])) continue;
+        if (offset > 0) {
+            --offset;
+            continue;
+        }
+        out.push_back(cols.image_id[row]);
+    }
+    return out;
+}
+
+bool ImageDB::TagImage(const std::string& image_id, const std::vector<std::string>& add,
+                       const std::vector<std::string>& remove) {
+    const std::lock_guard<Shared> lock(*shared_);
+    const uint32_t ordinal = Ordinals().Find(image_id);
+    if (ordinal == OrdinalMap::kNone) {
+        std::cerr << "TagImage: unknown image " << image_id << "\n";
+        return false;
+    }
+
+    TagStore tags = TagStore::Open(catalog_dir);
+    for (const std::string& t : add) {
+        if (!tags.Add(ordinal, t)) return false;
+    }
+    for (const std::string& t : remove) {
+        if (!tags.Remove(ordinal, t)) return false;
+    }
+    Publish([&](const CatalogSnapshot& s) { return s.WithTags(std::move(tags)); });
+    return true;
+}
+
+std::vector<std::pair<std::string, uint64_t>> ImageDB::ListTags() const {
+    const PinnedSnapshot snap = Snapshot();
+    const TagStore& tags = snap->tags();
+    std::vector<std::pair<std::string, uint64_t>> out;
+    for (size_t t = 0; t < tags.size(); ++t) out.emplace_back(tags.name(t), tags.postings(t).Cardinality());
+    return out;
+}
+
+std::vector<std::string> ImageDB::FindByTags(const std::string& expr, size_t offset, size_t limit,
+                                             uint64_t* total, const CatalogSnapshot* at) const {
+    const PinnedSnapshot latest = at ? PinnedSnapshot() : Snapshot();
+    const CatalogSnapshot& snap = at ? *at : *latest;
+    // A NOT query complements over every ordinal, deleted ones included.
+    const RoaringBitmap hits = RoaringBitmap::AndNot(snap.tags().Query(expr, snap.ordinal_end()), snap.deleted());
+    if (total) *total = hits.Cardinality();
+
+    std::vector<std::string> out;
+    for (uint32_t ordinal : hits.ToVector(offset, limit)) {
+        if (const ImageMeta* m = snap.Get(ordinal)) out.push_back(m->image_id);
+    }
+    return out;
+}
+
+void ImageDB::RunQuery(const std::string& sql, std::ostream& out, const CatalogSnapshot* at) const {
+    const SqlQuery q = parse_sql(sql);
+    // The columns, id index, tags and deleted set come from one snapshot,
+    // so a query sees a single commit point and never waits for a writer.
+    // The projection and range trees on disk may be at another commit; the
+    // planner only takes their ordinals the snapshot has and checks the
+    // snapshot's rows past their end itself (see QueryIndexes).
+    const PinnedSnapshot latest = at ? PinnedSnapshot() : Snapshot();
+    const CatalogSnapshot& snap = at ? *at : *latest;
+    QueryIndexes indexes;
+    indexes.find_id = [&snap](std::string_view id) { return snap.Find(id).value_or(OrdinalMap::kNone); };
+    indexes.tags = &snap.tags();
+    indexes.deleted = &snap.deleted();
+    indexes.pool = &Pool();
+
+    // A tree opened here stays consistent while writers go on: they update
+    // it in place only while no query has it open, and otherwise replace
+    // it whole by rename.
+    std::shared_ptr<const ColumnStore> projection;
+    std::optional<BTree> trees[2];
+    if (q.where) {
+        projection = ProjectionView();
+        indexes.columns = projection.get();
+    }
+    if (projection) {
+        for (NumColumn column : {NumColumn::CreatedAt, NumColumn::Bytes}) {
+            const bool bytes = column == NumColumn::Bytes;
+            if (!sql_query_uses(q, bytes ? SqlColumn::Bytes : SqlColumn::CreatedAt)) continue;
+            trees[bytes] = BTree::OpenReadOnly(range_index_path(catalog_dir, column));
+            if (trees[bytes]) (bytes ? indexes.bytes : indexes.created_at) = &*trees[bytes];
+        }
+    }
+    const QueryEngine engine(snap.Columns(), indexes);
+    if (q.explain) out << engine.Explain(q);
+    else engine.Write(q, engine.Run(q), out);
+}
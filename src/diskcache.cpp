@@ -0,0 +1,194 @@
+#include "diskcache.h"
+
+#include <algorithm>
+#include <atomic>
+#include <filesystem>
+#include <iostream>
+#include <list>
+#include <mutex>
+#include <stdexcept>
+#include <unordered_map>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+// Temp files start with '~', which keys cannot contain.
+constexpr char kTempPrefix[] = "~tmp-";
+
+bool valid_key(const std::string& key) {
+    if (key.size() < 2 || key.size() > 200 || key[0] == '.') return false;
+    return std::all_of(key.begin(), key.end(), [](char ch) {
+        return (ch >= 'a' && ch <= 'z') || (ch >= 'A' && ch <= 'Z') || (ch >= '0' && ch <= '9') || ch == '.' ||
+               ch == '_' || ch == '-';
+    });
+}
+
+bool write_all(int fd, const std::string& bytes) {
+    size_t done = 0;
+    while (done < bytes.size()) {
+        const ssize_t n = ::write(fd, bytes.data() + done, bytes.size() - done);
+        if (n < 0) return false;
+        done += static_cast<size_t>(n);
+    }
+    return true;
+}
+
+} // namespace
+
+struct DiskCache::State {
+    struct Entry {
+        std::string key;
+        uint64_t bytes;
+    };
+    using List = std::list<Entry>;   // most recently used first
+
+    std::string Path(const std::string& key) const { return dir + "/" + key.substr(0, 2) + "/" + key; }
+
+    // Caller holds mu.
+    void Drop(List::iterator it) {
+        ::unlink(Path(it->key).c_str());
+        total -= it->bytes;
+        index.erase(it->key);
+        lru.erase(it);
+    }
+
+    std::string dir;
+    uint64_t budget = 0;
+    mutable std::mutex mu;
+    List lru;
+    std::unordered_map<std::string, List::iterator> index;
+    uint64_t total = 0;
+    uint64_t hits = 0, misses = 0, evictions = 0;
+    std::atomic<uint64_t> temps{0};
+};
+
+DiskCache::~DiskCache() = default;
+DiskCache::DiskCache(DiskCache&& o) noexcept = default;
+DiskCache& DiskCache::operator=(DiskCache&& o) noexcept = default;
+
+DiskCache DiskCache::Open(const std::string& dir, uint64_t budget_bytes) {
+    namespace fs = std::filesystem;
+    std::error_code ec;
+    fs::create_directories(dir, ec);
+    if (!fs::is_directory(dir)) throw std::runtime_error("DiskCache: cannot create " + dir);
+
+    DiskCache cache;
+    cache.s_ = std::make_unique<State>();
+    State& s = *cache.s_;
+    s.dir = dir;
+    s.budget = budget_bytes;
+
+    struct Found {
+        std::string key;
+        uint64_t bytes;
+        fs::file_time_type mtime;
+    };
+    std::vector<Found> found;
+    for (auto it = fs::recursive_directory_iterator(dir, ec); !ec && it != fs::recursive_directory_iterator();
+         it.increment(ec)) {
+        if (!it->is_regular_file(ec)) continue;
+        const std::string name = it->path().filename().string();
+        if (name.rfind(kTempPrefix, 0) == 0 || !valid_key(name) || it.depth() != 1 ||
+            it->path().parent_path().filename() != name.substr(0, 2)) {
+            fs::remove(it->path(), ec);   // crashed writes and strays
+            continue;
+        }
+        found.push_back({name, it->file_size(ec), it->last_write_time(ec)});
+    }
+    std::sort(found.begin(), found.end(), [](const Found& a, const Found& b) { return a.mtime > b.mtime; });
+    for (const Found& f : found) {
+        s.lru.push_back({f.key, f.bytes});
+        s.index.emplace(f.key, std::prev(s.lru.end()));
+        s.total += f.bytes;
+    }
+    while (s.total > s.budget) {
+        s.Drop(std::prev(s.lru.end()));
+        ++s.evictions;
+    }
+    return cache;
+}
+
+std::string DiskCache::Lookup(const std::string& key) {
+    State& s = *s_;
+    std::lock_guard<std::mutex> lock(s.mu);
+    const auto found = s.index.find(key);
+    if (found == s.index.end()) {
+        ++s.misses;
+        return "";
+    }
+    ++s.hits;
+    s.lru.splice(s.lru.begin(), s.lru, found->second);
+    std::string path = s.Path(key);
+    ::utimensat(AT_FDCWD, path.c_str(), nullptr, 0);
+    return path;
+}
+
+bool DiskCache::Insert(const std::string& key, const std::string& bytes) {
+    State& s = *s_;
+    if (!valid_key(key)) {
+        std::cerr << "DiskCache: invalid key " << key << "\n";
+        return false;
+    }
+    if (bytes.size() > s.budget) return true;
+
+    const std::string path = s.Path(key);
+    const std::string subdir = s.dir + "/" + key.substr(0, 2);
+    ::mkdir(subdir.c_str(), 0755);
+    const std::string tmp = subdir + "/" + kTempPrefix + std::to_string(::getpid()) + "-" +
+                            std::to_string(s.temps.fetch_add(1));
+    const int fd = ::open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        std::cerr << "DiskCache: cannot create " << tmp << "\n";
+        return false;
+    }
+    // Synced before the rename, so a crash never leaves a truncated file
+    // under a valid key.
+    const bool ok = write_all(fd, bytes) && ::fdatasync(fd) == 0;
+    ::close(fd);
+    if (!ok || ::rename(tmp.c_str(), path.c_str()) != 0) {
+        std::cerr << "DiskCache: cannot write " << path << "\n";
+        ::unlink(tmp.c_str());
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(s.mu);
+    const auto found = s.index.find(key);
+    if (found != s.index.end()) {
+        s.total -= found->second->bytes;
+        s.lru.erase(found->second);
+        s.index.erase(found);
+    }
+    s.lru.push_front({key, bytes.size()});
+    s.index.emplace(key, s.lru.begin());
+    s.total += bytes.size();
+    while (s.total > s.budget) {
+        s.Drop(std::prev(s.lru.end()));
+        ++s.evictions;
+    }
+    return true;
+}
+
+void DiskCache::Erase(const std::string& key) {
+    State& s = *s_;
+    std::lock_guard<std::mutex> lock(s.mu);
+    const auto found = s.index.find(key);
+    if (found != s.index.end()) s.Drop(found->second);
+}
+
+DiskCache::Stats DiskCache::stats() const {
+    const State& s = *s_;
+    std::lock_guard<std::mutex> lock(s.mu);
+    Stats st;
+    st.hits = s.hits;
+    st.misses = s.misses;
+    st.evictions = s.evictions;
+    st.entries = s.index.size();
+    st.bytes = s.total;
+    return st;
+}
+
+uint64_t DiskCache::budget() const { return s_->budget; }
@@ -0,0 +1,207 @@
+#include "distance.h"
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define IMGDB_X86 1
+#include <immintrin.h>
+#endif
+
+namespace {
+
+// ---- scalar ----
+
+float l2sq_f32_scalar(const float* a, const float* b, size_t n) {
+    float s = 0.f;
+    for (size_t i = 0; i < n; ++i) {
+        const float d = a[i] - b[i];
+        s += d * d;
+    }
+    return s;
+}
+
+float l2sq_f16_scalar(const float* q, const uint16_t* row, size_t n) {
+    float s = 0.f;
+    for (size_t i = 0; i < n; ++i) {
+        const float d = q[i] - half_to_float(row[i]);
+        s += d * d;
+    }
+    return s;
+}
+
+float dot_f32_scalar(const float* a, const float* b, size_t n) {
+    float s = 0.f;
+    for (size_t i = 0; i < n; ++i) s += a[i] * b[i];
+    return s;
+}
+
+// ---- AVX2 / FMA / F16C ----
+
+#ifdef IMGDB_X86
+
+__attribute__((target("avx2,fma")))
+inline float hsum256(__m256 v) {
+    __m128 lo = _mm256_castps256_ps128(v);
+    __m128 hi = _mm256_extractf128_ps(v, 1);
+    lo = _mm_add_ps(lo, hi);
+    lo = _mm_add_ps(lo, _mm_movehl_ps(lo, lo));
+    lo = _mm_add_ss(lo, _mm_movehdup_ps(lo));
+    return _mm_cvtss_f32(lo);
+}
+
+// Two accumulators hide FMA latency; rows are 64-byte aligned in the store
+// but queries may not be, so loads stay unaligned.
+__attribute__((target("avx2,fma")))
+float l2sq_f32_avx2(const float* a, const float* b, size_t n) {
+    __m256 acc0 = _mm256_setzero_ps(), acc1 = _mm256_setzero_ps();
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m256 d0 = _mm256_sub_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i));
+        __m256 d1 = _mm256_sub_ps(_mm256_loadu_ps(a + i + 8), _mm256_loadu_ps(b + i + 8));
+        acc0 = _mm256_fmadd_ps(d0, d0, acc0);
+        acc1 = _mm256_fmadd_ps(d1, d1, acc1);
+    }
+    for (; i + 8 <= n; i += 8) {
+        __m256 d = _mm256_sub_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i));
+        acc0 = _mm256_fmadd_ps(d, d, acc0);
+    }
+    float s = hsum256(_mm256_add_ps(acc0, acc1));
+    for (; i < n; ++i) {
+        const float d = a[i] - b[i];
+        s += d * d;
+    }
+    return s;
+}
+
+__attribute__((target("avx2,fma,f16c")))
+float l2sq_f16_avx2(const float* q, const uint16_t* row, size_t n) {
+    __m256 acc0 = _mm256_setzero_ps(), acc1 = _mm256_setzero_ps();
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m256 r0 = _mm256_cvtph_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(row + i)));
+        __m256 r1 = _mm256_cvtph_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(row + i + 8)));
+        __m256 d0 = _mm256_sub_ps(_mm256_loadu_ps(q + i), r0);
+        __m256 d1 = _mm256_sub_ps(_mm256_loadu_ps(q + i + 8), r1);
+        acc0 = _mm256_fmadd_ps(d0, d0, acc0);
+        acc1 = _mm256_fmadd_ps(d1, d1, acc1);
+    }
+    float s = hsum256(_mm256_add_ps(acc0, acc1));
+    for (; i < n; ++i) {
+        const float d = q[i] - half_to_float(row[i]);
+        s += d * d;
+    }
+    return s;
+}
+
+__attribute__((target("avx2,fma")))
+float dot_f32_avx2(const float* a, const float* b, size_t n) {
+    __m256 acc0 = _mm256_setzero_ps(), acc1 = _mm256_setzero_ps();
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        acc0 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i), acc0);
+        acc1 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i + 8), _mm256_loadu_ps(b + i + 8), acc1);
+    }
+    float s = hsum256(_mm256_add_ps(acc0, acc1));
+    for (; i < n; ++i) s += a[i] * b[i];
+    return s;
+}
+
+bool cpu_has_avx2() {
+    static const bool ok = [] {
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+    }();
+    return ok;
+}
+
+bool cpu_has_f16c() {
+    static const bool ok = cpu_has_avx2() && __builtin_cpu_supports("f16c");
+    return ok;
+}
+
+#else
+
+bool cpu_has_avx2() { return false; }
+bool cpu_has_f16c() { return false; }
+constexpr auto l2sq_f32_avx2 = l2sq_f32_scalar;
+constexpr auto l2sq_f16_avx2 = l2sq_f16_scalar;
+constexpr auto dot_f32_avx2 = dot_f32_scalar;
+
+#endif
+
+} // namespace
+
+float l2sq_f32(const float* a, const float* b, size_t n) {
+    static const auto fn = cpu_has_avx2() ? l2sq_f32_avx2 : l2sq_f32_scalar;
+    return fn(a, b, n);
+}
+
+float l2sq_f16(const float* q, const uint16_t* row, size_t n) {
+    static const auto fn = cpu_has_f16c() ? l2sq_f16_avx2 : l2sq_f16_scalar;
+    return fn(q, row, n);
+}
+
+float dot_f32(const float* a, const float* b, size_t n) {
+    static const auto fn = cpu_has_avx2() ? dot_f32_avx2 : dot_f32_scalar;
+    return fn(a, b, n);
+}
+
+bool simd_distance_available() {
+    return cpu_has_avx2();
+}
+
+uint16_t float_to_half(float f) {
+    uint32_t x;
+    std::memcpy(&x, &f, sizeof x);
+    const uint32_t sign = (x >> 16) & 0x8000u;
+    const int32_t exp = static_cast<int32_t>((x >> 23) & 0xFF) - 127 + 15;
+    uint32_t mant = x & 0x7FFFFFu;
+
+    if (((x >> 23) & 0xFF) == 0xFF) {                      // inf / nan
+        return static_cast<uint16_t>(sign | 0x7C00u | (mant ? 0x200u : 0u));
+    }
+    if (exp >= 31) return static_cast<uint16_t>(sign | 0x7C00u);   // overflow -> inf
+    if (exp <= 0) {                                        // subnormal / zero
+        if (exp < -10) return static_cast<uint16_t>(sign);
+        mant |= 0x800000u;
+        const int shift = 14 - exp;
+        uint32_t half = mant >> shift;
+        const uint32_t rem = mant & ((1u << shift) - 1);
+        const uint32_t mid = 1u << (shift - 1);
+        if (rem > mid || (rem == mid && (half & 1u))) ++half;
+        return static_cast<uint16_t>(sign | half);
+    }
+    uint32_t half = sign | (static_cast<uint32_t>(exp) << 10) | (mant >> 13);
+    const uint32_t rem = mant & 0x1FFFu;
+    if (rem > 0x1000u || (rem == 0x1000u && (half & 1u))) ++half;  // may carry into exp: correct
+    return static_cast<uint16_t>(half);
+}
+
+float half_to_float(uint16_t h) {
+    const uint32_t sign = static_cast<uint32_t>(h & 0x8000u) << 16;
+    uint32_t exp = (h >> 10) & 0x1Fu;
+    uint32_t mant = h & 0x3FFu;
+    uint32_t x;
+    if (exp == 0x1F) {
+        x = sign | 0x7F800000u | (mant << 13);
+    } else if (exp == 0) {
+        if (mant == 0) {
+            x = sign;
+        } else {
+            exp = 127 - 15 + 1;
+            while ((mant & 0x400u) == 0) {
+                mant <<= 1;
+                --exp;
+            }
+            x = sign | (exp << 23) | ((mant & 0x3FFu) << 13);
+        }
+    } else {
+        x = sign | ((exp + 127 - 15) << 23) | (mant << 13);
+    }
+    float f;
+    std::memcpy(&f, &x, sizeof f);
+    return f;
+}
+
+void halves_to_floats(const uint16_t* in, float* out, size_t n) {
+    for (size_t i = 0; i < n; ++i) out[i] = half_to_float(in[i]);
+}
@@ -0,0 +1,188 @@
+#include "embed.h"
+#include "distance.h"
+#include "ordinals.h"
+
+#include <cstddef>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <utility>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+constexpr char kMagic[8] = {'I', 'M', 'G', 'E', 'M', 'B', '0', '1'};
+
+struct Header {
+    char     magic[8];
+    uint32_t dim;
+    uint32_t dtype;
+    uint64_t count;
+    uint64_t row_bytes;
+    unsigned char reserved[32];
+};
+static_assert(sizeof(Header) == EmbeddingStore::kAlign, "header must fill one cache line");
+
+size_t padded_row_bytes(uint32_t dim, EmbedDType dtype) {
+    const size_t raw = static_cast<size_t>(dim) * (dtype == EmbedDType::F16 ? 2 : 4);
+    return (raw + EmbeddingStore::kAlign - 1) / EmbeddingStore::kAlign * EmbeddingStore::kAlign;
+}
+
+} // namespace
+
+EmbeddingStore EmbeddingStore::Create(const std::string& path, uint32_t dim, EmbedDType dtype) {
+    if (dim == 0) throw std::invalid_argument("EmbeddingStore: dim must be > 0");
+
+    int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_EXCL, 0644);
+    if (fd < 0) throw std::runtime_error("EmbeddingStore: cannot create " + path);
+
+    Header h{};
+    std::memcpy(h.magic, kMagic, sizeof kMagic);
+    h.dim = dim;
+    h.dtype = static_cast<uint32_t>(dtype);
+    h.count = 0;
+    h.row_bytes = padded_row_bytes(dim, dtype);
+    if (::pwrite(fd, &h, sizeof h, 0) != static_cast<ssize_t>(sizeof h) || ::fsync(fd) != 0) {
+        ::close(fd);
+        throw std::runtime_error("EmbeddingStore: cannot write header to " + path);
+    }
+    ::close(fd);
+
+    if (!write_ordinal_column(path + ".ords", {})) {
+        throw std::runtime_error("EmbeddingStore: cannot create " + path + ".ords");
+    }
+
+    return Open(path);
+}
+
+EmbeddingStore EmbeddingStore::Open(const std::string& path) { return Open(path, O_RDWR); }
+
+EmbeddingStore EmbeddingStore::OpenReadOnly(const std::string& path) { return Open(path, O_RDONLY); }
+
+EmbeddingStore EmbeddingStore::Open(const std::string& path, int flags) {
+    EmbeddingStore s;
+    s.path_ = path;
+    s.fd_ = ::open(path.c_str(), flags);
+    if (s.fd_ < 0) throw std::runtime_error("EmbeddingStore: cannot open " + path);
+
+    Header h{};
+    if (::pread(s.fd_, &h, sizeof h, 0) != static_cast<ssize_t>(sizeof h) ||
+        std::memcmp(h.magic, kMagic, sizeof kMagic) != 0) {
+        throw std::runtime_error("EmbeddingStore: bad header in " + path);
+    }
+    if (h.dtype > static_cast<uint32_t>(EmbedDType::F16) ||
+        h.row_bytes != padded_row_bytes(h.dim, static_cast<EmbedDType>(h.dtype))) {
+        throw std::runtime_error("EmbeddingStore: unsupported layout in " + path);
+    }
+    s.dim_ = h.dim;
+    s.dtype_ = static_cast<EmbedDType>(h.dtype);
+    s.row_bytes_ = h.row_bytes;
+
+    // A crash between the data append and the header update leaves an
+    // extra row or ordinal behind; the header count is the commit point.
+    s.ords_ = read_ordinal_column(path + ".ords");
+    if (s.ords_.size() < h.count) {
+        throw std::runtime_error("EmbeddingStore: ordinal column shorter than header count in " + path);
+    }
+    s.ords_.resize(h.count);
+    s.count_ = h.count;
+
+    if (!s.Map()) throw std::runtime_error("EmbeddingStore: mmap failed for " + path);
+    return s;
+}
+
+EmbeddingStore::~EmbeddingStore() {
+    Unmap();
+    if (fd_ >= 0) ::close(fd_);
+}
+
+EmbeddingStore::EmbeddingStore(EmbeddingStore&& o) noexcept { *this = std::move(o); }
+
+EmbeddingStore& EmbeddingStore::operator=(EmbeddingStore&& o) noexcept {
+    if (this == &o) return *this;
+    Unmap();
+    if (fd_ >= 0) ::close(fd_);
+    path_ = std::move(o.path_);
+    fd_ = std::exchange(o.fd_, -1);
+    dim_ = o.dim_;
+    dtype_ = o.dtype_;
+    row_bytes_ = o.row_bytes_;
+    count_ = std::exchange(o.count_, 0);
+    map_ = std::exchange(o.map_, nullptr);
+    map_len_ = std::exchange(o.map_len_, 0);
+    data_ = std::exchange(o.data_, nullptr);
+    ords_ = std::move(o.ords_);
+    ords_out_ = std::move(o.ords_out_);
+    return *this;
+}
+
+bool EmbeddingStore::Map() {
+    Unmap();
+    map_len_ = sizeof(Header) + count_ * row_bytes_;
+    void* p = ::mmap(nullptr, map_len_, PROT_READ, MAP_SHARED, fd_, 0);
+    if (p == MAP_FAILED) {
+        map_len_ = 0;
+        return false;
+    }
+    // Distance scans touch rows in graph order, not sequentially.
+    ::madvise(p, map_len_, MADV_RANDOM);
+    map_ = static_cast<const unsigned char*>(p);
+    data_ = map_ + sizeof(Header);
+    return true;
+}
+
+void EmbeddingStore::Unmap() {
+    if (map_) ::munmap(const_cast<unsigned char*>(map_), map_len_);
+    map_ = nullptr;
+    data_ = nullptr;
+    map_len_ = 0;
+}
+
+bool EmbeddingStore::Append(uint32_t ordinal, const float* v) {
+    std::vector<unsigned char> row(row_bytes_, 0);
+    if (dtype_ == EmbedDType::F32) {
+        std::memcpy(row.data(), v, static_cast<size_t>(dim_) * sizeof(float));
+    } else {
+        auto* out = reinterpret_cast<uint16_t*>(row.data());
+        for (uint32_t i = 0; i < dim_; ++i) out[i] = float_to_half(v[i]);
+    }
+
+    // Row and ordinal first, header count last: the count is the commit point.
+    const size_t n = ords_.size();
+    const off_t off = static_cast<off_t>(sizeof(Header) + n * row_bytes_);
+    if (::pwrite(fd_, row.data(), row_bytes_, off) != static_cast<ssize_t>(row_bytes_)) {
+        std::cerr << "EmbeddingStore: row write failed\n";
+        return false;
+    }
+    if (!put_ordinal(ords_out_, path_ + ".ords", n, ordinal)) return false;
+    const uint64_t count = n + 1;
+    if (::pwrite(fd_, &count, sizeof count, offsetof(Header, count)) != static_cast<ssize_t>(sizeof count)) {
+        std::cerr << "EmbeddingStore: header update failed\n";
+        return false;
+    }
+    ords_.push_back(ordinal);
+    return true;
+}
+
+bool EmbeddingStore::Refresh() {
+    count_ = ords_.size();
+    return Map();
+}
+
+void EmbeddingStore::Decode(size_t row, float* out) const {
+    if (dtype_ == EmbedDType::F32) {
+        std::memcpy(out, Row(row), static_cast<size_t>(dim_) * sizeof(float));
+    } else {
+        halves_to_floats(static_cast<const uint16_t*>(Row(row)), out, dim_);
+    }
+}
+
+float EmbeddingStore::Distance(const float* q, size_t row) const {
+    if (dtype_ == EmbedDType::F32) return l2sq_f32(q, static_cast<const float*>(Row(row)), dim_);
+    return l2sq_f16(q, static_cast<const uint16_t*>(Row(row)), dim_);
+}
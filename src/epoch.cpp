@@ -0,0 +1,81 @@
+#include "epoch.h"
+
+#include <algorithm>
+#include <iterator>
+#include <thread>
+
+EpochDomain::EpochDomain() : slots_(new Slot[kSlots]) {}
+
+EpochDomain::~EpochDomain() {
+    for (Retired& r : retired_) r.free();
+}
+
+EpochDomain::Guard& EpochDomain::Guard::operator=(Guard&& o) noexcept {
+    if (this != &o) {
+        Release();
+        domain_ = std::exchange(o.domain_, nullptr);
+        slot_ = o.slot_;
+        epoch_ = o.epoch_;
+    }
+    return *this;
+}
+
+void EpochDomain::Guard::Release() {
+    if (!domain_) return;
+    // Release: the reader's accesses happen before a Collect that sees the
+    // slot free.
+    domain_->slots_[slot_].epoch.store(kFree, std::memory_order_release);
+    domain_ = nullptr;
+}
+
+EpochDomain::Guard EpochDomain::Pin() {
+    // Threads start their search at different slots so pins rarely collide.
+    const size_t start = std::hash<std::thread::id>{}(std::this_thread::get_id()) % kSlots;
+    for (;;) {
+        for (size_t i = 0; i < kSlots; ++i) {
+            const size_t slot = (start + i) % kSlots;
+            // The announced epoch may be stale by the time the CAS lands;
+            // that only makes the pin more conservative. Both operations
+            // are sequentially consistent, so a writer whose Collect misses
+            // this pin swapped its pointer before the reader loads it.
+            const uint64_t e = epoch_.load();
+            uint64_t expected = kFree;
+            if (slots_[slot].epoch.compare_exchange_strong(expected, e)) return Guard(this, slot, e);
+        }
+        std::this_thread::yield();
+    }
+}
+
+void EpochDomain::Retire(std::function<void()> free) {
+    // Readers pinned at or before this epoch may hold the object.
+    const uint64_t e = epoch_.fetch_add(1);
+    std::lock_guard<std::mutex> lock(retired_mu_);
+    retired_.push_back({e, std::move(free)});
+}
+
+size_t EpochDomain::Collect() {
+    uint64_t oldest = kFree;
+    for (size_t i = 0; i < kSlots; ++i) oldest = std::min(oldest, slots_[i].epoch.load());
+
+    std::vector<Retired> ready;
+    {
+        std::lock_guard<std::mutex> lock(retired_mu_);
+        auto keep = std::partition(retired_.begin(), retired_.end(),
+                                   [&](const Retired& r) { return r.epoch >= oldest; });
+        std::move(keep, retired_.end(), std::back_inserter(ready));
+        retired_.erase(keep, retired_.end());
+    }
+    for (Retired& r : ready) r.free();
+    return ready.size();
+}
+
+size_t EpochDomain::pending() const {
+    std::lock_guard<std::mutex> lock(retired_mu_);
+    return retired_.size();
+}
+
+size_t EpochDomain::pinned() const {
+    size_t n = 0;
+    for (size_t i = 0; i < kSlots; ++i) n += slots_[i].epoch.load(std::memory_order_relaxed) != kFree;
+    return n;
+}
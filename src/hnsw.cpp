@@ -0,0 +1,286 @@
+#include "hnsw.h"
+#include "embed.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <queue>
+
+namespace {
+
+constexpr char kMagic[8] = {'I', 'M', 'G', 'H', 'N', 'S', 'W', '1'};
+
+// Per-thread visited marks; bumping the epoch clears them in O(1).
+struct Visited {
+    std::vector<uint32_t> marks;
+    uint32_t epoch = 0;
+
+    void Reset(size_t n) {
+        if (marks.size() < n) marks.resize(n, 0);
+        if (++epoch == 0) {
+            std::fill(marks.begin(), marks.end(), 0);
+            epoch = 1;
+        }
+    }
+    bool TestAndSet(uint32_t id) {
+        if (marks[id] == epoch) return true;
+        marks[id] = epoch;
+        return false;
+    }
+};
+
+Visited& visited() {
+    thread_local Visited v;
+    return v;
+}
+
+// Returns a float32 view of `row`, decoding into `scratch` for f16 stores.
+const float* row_f32(const EmbeddingStore& s, uint32_t row, std::vector<float>& scratch) {
+    if (s.dtype() == EmbedDType::F32) return static_cast<const float*>(s.Row(row));
+    scratch.resize(s.dim());
+    s.Decode(row, scratch.data());
+    return scratch.data();
+}
+
+struct CloserFirst {
+    bool operator()(const Hnsw::Hit& a, const Hnsw::Hit& b) const { return a.first > b.first; }
+};
+
+} // namespace
+
+Hnsw::Hnsw(const EmbeddingStore* store) : Hnsw(store, Params{}) {}
+
+Hnsw::Hnsw(const EmbeddingStore* store, Params p)
+    : store_(store), p_(p), rng_(p.seed), level_mult_(1.0 / std::log(std::max(2, p.M))) {}
+
+int Hnsw::RandomLevel() {
+    std::uniform_real_distribution<double> u(0.0, 1.0);
+    const double r = -std::log(std::max(u(rng_), 1e-12)) * level_mult_;
+    return std::min(static_cast<int>(r), 255);
+}
+
+uint32_t* Hnsw::Links(uint32_t node, int level) {
+    if (level == 0) return &level0_[static_cast<size_t>(node) * (2 * p_.M + 1)];
+    return &upper_[node][static_cast<size_t>(level - 1) * (p_.M + 1)];
+}
+
+const uint32_t* Hnsw::Links(uint32_t node, int level) const {
+    return const_cast<Hnsw*>(this)->Links(node, level);
+}
+
+std::vector<Hnsw::Hit> Hnsw::SearchLayer(const float* q, uint32_t entry, int ef, int level) const {
+    Visited& vis = visited();
+    vis.Reset(size());
+
+    // candidates: min-heap by distance; results: max-heap capped at ef.
+    std::priority_queue<Hit, std::vector<Hit>, CloserFirst> candidates;
+    std::priority_queue<Hit> results;
+
+    const float d0 = store_->Distance(q, entry);
+    vis.TestAndSet(entry);
+    candidates.emplace(d0, entry);
+    results.emplace(d0, entry);
+
+    while (!candidates.empty()) {
+        const Hit c = candidates.top();
+        if (c.first > results.top().first && static_cast<int>(results.size()) >= ef) break;
+        candidates.pop();
+
+        const uint32_t* links = Links(c.second, level);
+        const uint32_t n = links[0];
+        for (uint32_t i = 1; i <= n; ++i) {
+            const uint32_t nb = links[i];
+            if (vis.TestAndSet(nb)) continue;
+            __builtin_prefetch(store_->Row(nb));
+            const float d = store_->Distance(q, nb);
+            if (static_cast<int>(results.size()) < ef || d < results.top().first) {
+                candidates.emplace(d, nb);
+                results.emplace(d, nb);
+                if (static_cast<int>(results.size()) > ef) results.pop();
+            }
+        }
+    }
+
+    std::vector<Hit> out(results.size());
+    for (size_t i = out.size(); i-- > 0;) {
+        out[i] = results.top();
+        results.pop();
+    }
+    return out;
+}
+
+// Walks from the entry point down to layer `stop` (exclusive), moving to the
+// closest neighbour on each layer until no neighbour improves.
+uint32_t Hnsw::GreedyDescend(const float* q, int from, int stop) const {
+    uint32_t cur = entry_;
+    float cur_d = store_->Distance(q, cur);
+    for (int l = from; l > stop; --l) {
+        bool changed = true;
+        while (changed) {
+            changed = false;
+            const uint32_t* links = Links(cur, l);
+            for (uint32_t i = 1; i <= links[0]; ++i) {
+                const float d = store_->Distance(q, links[i]);
+                if (d < cur_d) {
+                    cur_d = d;
+                    cur = links[i];
+                    changed = true;
+                }
+            }
+        }
+    }
+    return cur;
+}
+
+// Neighbour-diversity heuristic (algorithm 4 in the paper): keep a candidate
+// only if it is closer to the base point than to every neighbour already
+// kept, so links spread across clusters instead of piling into one.
+std::vector<uint32_t> Hnsw::SelectNeighbors(std::vector<Hit> candidates, int m) const {
+    std::sort(candidates.begin(), candidates.end());
+    std::vector<uint32_t> kept;
+    std::vector<float> scratch;
+    for (const Hit& c : candidates) {
+        if (static_cast<int>(kept.size()) >= m) break;
+        const float* cv = row_f32(*store_, c.second, scratch);
+        bool good = true;
+        for (uint32_t r : kept) {
+            if (store_->Distance(cv, r) < c.first) {
+                good = false;
+                break;
+            }
+        }
+        if (good) kept.push_back(c.second);
+    }
+    return kept;
+}
+
+void Hnsw::Connect(uint32_t from, uint32_t to, int level) {
+    uint32_t* links = Links(from, level);
+    const int max_links = MaxLinks(level);
+    if (static_cast<int>(links[0]) < max_links) {
+        links[++links[0]] = to;
+        return;
+    }
+
+    std::vector<float> scratch;
+    const float* fv = row_f32(*store_, from, scratch);
+    std::vector<Hit> cands;
+    cands.reserve(links[0] + 1);
+    for (uint32_t i = 1; i <= links[0]; ++i) cands.emplace_back(store_->Distance(fv, links[i]), links[i]);
+    cands.emplace_back(store_->Distance(fv, to), to);
+
+    const std::vector<uint32_t> kept = SelectNeighbors(std::move(cands), max_links);
+    links[0] = static_cast<uint32_t>(kept.size());
+    std::copy(kept.begin(), kept.end(), links + 1);
+}
+
+void Hnsw::Add(uint32_t row) {
+    const int level = RandomLevel();
+    levels_.push_back(static_cast<uint8_t>(level));
+    level0_.resize(level0_.size() + 2 * p_.M + 1, 0);
+    upper_.emplace_back(static_cast<size_t>(level) * (p_.M + 1), 0);
+
+    if (max_level_ < 0) {
+        entry_ = row;
+        max_level_ = level;
+        return;
+    }
+
+    std::vector<float> qbuf(store_->dim());
+    store_->Decode(row, qbuf.data());
+    const float* q = qbuf.data();
+
+    // Greedy descent through the layers above the new node's level.
+    uint32_t cur = GreedyDescend(q, max_level_, level);
+
+    for (int l = std::min(level, max_level_); l >= 0; --l) {
+        std::vector<Hit> w = SearchLayer(q, cur, p_.ef_construction, l);
+        const std::vector<uint32_t> nbrs = SelectNeighbors(w, p_.M);
+
+        uint32_t* links = Links(row, l);
+        links[0] = static_cast<uint32_t>(nbrs.size());
+        std::copy(nbrs.begin(), nbrs.end(), links + 1);
+        for (uint32_t nb : nbrs) Connect(nb, row, l);
+
+        cur = w.front().second;
+    }
+
+    if (level > max_level_) {
+        max_level_ = level;
+        entry_ = row;
+    }
+}
+
+std::vector<Hnsw::Hit> Hnsw::Search(const float* q, int k, int ef) const {
+    if (max_level_ < 0 || k <= 0) return {};
+
+    const uint32_t cur = GreedyDescend(q, max_level_, 0);
+
+    std::vector<Hit> w = SearchLayer(q, cur, std::max(ef, k), 0);
+    if (static_cast<int>(w.size()) > k) w.resize(k);
+    return w;
+}
+
+bool Hnsw::Save(const std::string& path) const {
+    const std::string tmp = path + ".tmp";
+    {
+        std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+        if (!out) return false;
+        auto put = [&](const void* p, size_t n) { out.write(static_cast<const char*>(p), static_cast<std::streamsize>(n)); };
+
+        const uint32_t dim = store_->dim();
+        const uint64_t n = size();
+        const int32_t max_level = max_level_;
+        put(kMagic, sizeof kMagic);
+        put(&p_.M, sizeof p_.M);
+        put(&p_.ef_construction, sizeof p_.ef_construction);
+        put(&dim, sizeof dim);
+        put(&max_level, sizeof max_level);
+        put(&entry_, sizeof entry_);
+        put(&n, sizeof n);
+        put(levels_.data(), levels_.size());
+        put(level0_.data(), level0_.size() * sizeof(uint32_t));
+        for (const auto& u : upper_) put(u.data(), u.size() * sizeof(uint32_t));
+        if (!out.flush()) return false;
+    }
+    return std::rename(tmp.c_str(), path.c_str()) == 0;
+}
+
+std::optional<Hnsw> Hnsw::Load(const std::string& path, const EmbeddingStore* store) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in) return std::nullopt;
+    auto get = [&](void* p, size_t n) { return static_cast<bool>(in.read(static_cast<char*>(p), static_cast<std::streamsize>(n))); };
+
+    char magic[8];
+    Params p;
+    uint32_t dim = 0;
+    int32_t max_level = -1;
+    uint32_t entry = 0;
+    uint64_t n = 0;
+    if (!get(magic, sizeof magic) || std::memcmp(magic, kMagic, sizeof kMagic) != 0) return std::nullopt;
+    if (!get(&p.M, sizeof p.M) || !get(&p.ef_construction, sizeof p.ef_construction) ||
+        !get(&dim, sizeof dim) || !get(&max_level, sizeof max_level) ||
+        !get(&entry, sizeof entry) || !get(&n, sizeof n)) {
+        return std::nullopt;
+    }
+    if (dim != store->dim() || p.M <= 0 || n > store->size()) return std::nullopt;
+
+    Hnsw h(store, p);
+    h.max_level_ = max_level;
+    h.entry_ = entry;
+    h.levels_.resize(n);
+    h.level0_.resize(n * (2 * p.M + 1));
+    if (!get(h.levels_.data(), n) || !get(h.level0_.data(), h.level0_.size() * sizeof(uint32_t))) {
+        return std::nullopt;
+    }
+    h.upper_.resize(n);
+    for (uint64_t i = 0; i < n; ++i) {
+        h.upper_[i].resize(static_cast<size_t>(h.levels_[i]) * (p.M + 1));
+        if (!get(h.upper_[i].data(), h.upper_[i].size() * sizeof(uint32_t))) return std::nullopt;
+    }
+    // Continue the level sequence rather than replaying the build's seed.
+    h.rng_.seed(p.seed ^ n);
+    return h;
+}
@@ -0,0 +1,688 @@
+#include "http.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <unordered_map>
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/sendfile.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+constexpr size_t kMaxHeaderBytes = 16 << 10;
+constexpr size_t kMaxInFlight = 64;   // pipelined requests per connection before reads pause
+constexpr size_t kReadChunk = 64 << 10;
+constexpr size_t kSendfileChunk = 4 << 20;   // per call, so one big body cannot starve the loop
+
+bool iequals(std::string_view a, std::string_view b) {
+    return a.size() == b.size() && std::equal(a.begin(), a.end(), b.begin(), [](char x, char y) {
+               return std::tolower(static_cast<unsigned char>(x)) == std::tolower(static_cast<unsigned char>(y));
+           });
+}
+
+std::string_view trim(std::string_view s) {
+    while (!s.empty() && (s.front() == ' ' || s.front() == '\t')) s.remove_prefix(1);
+    while (!s.empty() && (s.back() == ' ' || s.back() == '\t')) s.remove_suffix(1);
+    return s;
+}
+
+} // namespace
+
+const std::string* HttpRequest::header(std::string_view name) const {
+    for (const auto& [k, v] : headers) {
+        if (k == name) return &v;
+    }
+    return nullptr;
+}
+
+std::optional<std::string> HttpRequest::param(std::string_view name) const {
+    std::string_view rest = query;
+    while (!rest.empty()) {
+        const size_t amp = rest.find('&');
+        const std::string_view pair = rest.substr(0, amp);
+        rest = amp == std::string_view::npos ? std::string_view() : rest.substr(amp + 1);
+        const size_t eq = pair.find('=');
+        if (url_decode(pair.substr(0, eq)) != name) continue;
+        return eq == std::string_view::npos ? std::string() : url_decode(pair.substr(eq + 1));
+    }
+    return std::nullopt;
+}
+
+HttpFile::~HttpFile() {
+    if (fd >= 0) ::close(fd);
+}
+
+HttpResponse HttpResponse::Text(int status, std::string body) {
+    HttpResponse r;
+    r.status = status;
+    r.body = std::move(body);
+    return r;
+}
+
+HttpResponse HttpResponse::File(const HttpRequest& req, const std::string& path, std::string content_type) {
+    const int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    struct stat st;
+    if (fd < 0 || ::fstat(fd, &st) != 0) {
+        if (fd >= 0) ::close(fd);
+        return Text(404, "Not Found\n");
+    }
+    const uint64_t size = static_cast<uint64_t>(st.st_size);
+    auto file = std::make_shared<HttpFile>(fd, 0, size);
+
+    HttpResponse r;
+    r.content_type = std::move(content_type);
+    r.headers.emplace_back("Accept-Ranges", "bytes");
+    uint64_t first = 0, last = 0;
+    const std::string* range = req.header("range");
+    const int rc = range ? parse_http_range(*range, size, &first, &last) : 0;
+    if (rc < 0) {
+        r = Text(416, "Range Not Satisfiable\n");
+        r.headers.emplace_back("Content-Range", "bytes */" + std::to_string(size));
+        return r;
+    }
+    if (rc > 0) {
+        r.status = 206;
+        r.headers.emplace_back("Content-Range", "bytes " + std::to_string(first) + "-" + std::to_string(last) + "/" +
+                                                    std::to_string(size));
+        file->offset = first;
+        file->length = last - first + 1;
+    }
+    r.file = std::move(file);
+    return r;
+}
+
+int parse_http_range(std::string_view value, uint64_t size, uint64_t* first, uint64_t* last) {
+    value = trim(value);
+    if (value.substr(0, 6) != "bytes=") return 0;
+    value = trim(value.substr(6));
+    const size_t dash = value.find('-');
+    if (dash == std::string_view::npos || value.find(',') != std::string_view::npos) return 0;
+    const std::string_view a = trim(value.substr(0, dash)), b = trim(value.substr(dash + 1));
+    auto number = [](std::string_view s, uint64_t* out) {
+        if (s.empty() || s.size() > 19 || !std::all_of(s.begin(), s.end(), [](char c) { return c >= '0' && c <= '9'; })) {
+            return false;
+        }
+        *out = std::stoull(std::string(s));
+        return true;
+    };
+    uint64_t x = 0, y = 0;
+    if (a.empty()) {
+        // Suffix range: the last y bytes.
+        if (!number(b, &y)) return 0;
+        if (y == 0 || size == 0) return -1;
+        *first = size - std::min(y, size);
+        *last = size - 1;
+        return 1;
+    }
+    if (!number(a, &x) || (!b.empty() && !number(b, &y))) return 0;
+    if (!b.empty() && y < x) return 0;
+    if (x >= size) return -1;
+    *first = x;
+    *last = b.empty() ? size - 1 : std::min(y, size - 1);
+    return 1;
+}
+
+std::string url_decode(std::string_view s) {
+    auto hex = [](char c) {
+        if (c >= '0' && c <= '9') return c - '0';
+        if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+        if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+        return -1;
+    };
+    std::string out;
+    out.reserve(s.size());
+    for (size_t i = 0; i < s.size(); ++i) {
+        if (s[i] == '+') {
+            out += ' ';
+        } else if (s[i] == '%' && i + 2 < s.size() && hex(s[i + 1]) >= 0 && hex(s[i + 2]) >= 0) {
+            out += static_cast<char>(hex(s[i + 1]) * 16 + hex(s[i + 2]));
+            i += 2;
+        } else {
+            out += s[i];
+        }
+    }
+    return out;
+}
+
+const char* http_reason(int status) {
+    switch (status) {
+    case 200: return "OK";
+    case 201: return "Created";
+    case 202: return "Accepted";
+    case 204: return "No Content";
+    case 206: return "Partial Content";
+    case 400: return "Bad Request";
+    case 404: return "Not Found";
+    case 405: return "Method Not Allowed";
+    case 409: return "Conflict";
+    case 413: return "Content Too Large";
+    case 416: return "Range Not Satisfiable";
+    case 429: return "Too Many Requests";
+    case 431: return "Request Header Fields Too Large";
+    case 500: return "Internal Server Error";
+    case 501: return "Not Implemented";
+    case 503: return "Service Unavailable";
+    default: return "Unknown";
+    }
+}
+
+int parse_http_request(std::string_view buf, size_t max_body, HttpRequest* req, size_t* consumed) {
+    size_t head = 0;
+    uint64_t content_length = 0;
+    const int rc = parse_http_head(buf, max_body, req, &head, &content_length);
+    if (rc != 0) return rc;
+    if (buf.size() - head < content_length) return -1;
+    req->body = buf.substr(head, content_length);
+    *consumed = head + content_length;
+    return 0;
+}
+
+int parse_http_head(std::string_view buf, size_t max_body, HttpRequest* req, size_t* head_bytes,
+                    uint64_t* content_length) {
+    const size_t end = buf.find("\r\n\r\n");
+    if (end == std::string_view::npos) return buf.size() > kMaxHeaderBytes ? 431 : -1;
+    if (end > kMaxHeaderBytes) return 431;
+
+    *req = HttpRequest();
+    std::string_view head = buf.substr(0, end);
+    const size_t eol = head.find("\r\n");
+    const std::string_view line = head.substr(0, eol);
+    head = eol == std::string_view::npos ? std::string_view() : head.substr(eol + 2);
+
+    const size_t sp1 = line.find(' ');
+    const size_t sp2 = sp1 == std::string_view::npos ? sp1 : line.find(' ', sp1 + 1);
+    if (sp2 == std::string_view::npos || sp1 == 0 || sp2 == sp1 + 1) return 400;
+    req->method = line.substr(0, sp1);
+    req->target = line.substr(sp1 + 1, sp2 - sp1 - 1);
+    const std::string_view version = line.substr(sp2 + 1);
+    if (version != "HTTP/1.1" && version != "HTTP/1.0") return 400;
+    if (req->target.front() != '/') return 400;
+    const size_t q = req->target.find('?');
+    req->path = req->target.substr(0, q);
+    if (q != std::string::npos) req->query = req->target.substr(q + 1);
+    req->keep_alive = version == "HTTP/1.1";
+
+    uint64_t length = 0;
+    while (!head.empty()) {
+        const size_t next = head.find("\r\n");
+        const std::string_view h = head.substr(0, next);
+        head = next == std::string_view::npos ? std::string_view() : head.substr(next + 2);
+        const size_t colon = h.find(':');
+        if (colon == std::string_view::npos || colon == 0) return 400;
+        std::string name(h.substr(0, colon));
+        std::transform(name.begin(), name.end(), name.begin(),
+                       [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+        const std::string_view value = trim(h.substr(colon + 1));
+        if (name == "content-length") {
+            if (value.empty() || value.size() > 18 ||
+                !std::all_of(value.begin(), value.end(), [](char c) { return c >= '0' && c <= '9'; })) {
+                return 400;
+            }
+            length = std::stoull(std::string(value));
+        } else if (name == "transfer-encoding") {
+            return 501;
+        } else if (name == "connection") {
+            if (iequals(value, "close")) req->keep_alive = false;
+            else if (iequals(value, "keep-alive")) req->keep_alive = true;
+        }
+        req->headers.emplace_back(std::move(name), std::string(value));
+    }
+    if (length > max_body) return 413;
+    *head_bytes = end + 4;
+    *content_length = length;
+    return 0;
+}
+
+std::string serialize_http_response(const HttpResponse& r, bool keep_alive) {
+    std::string out = "HTTP/1.1 " + std::to_string(r.status) + " " + http_reason(r.status) + "\r\n";
+    out += "Content-Type: " + r.content_type + "\r\n";
+    const uint64_t length = r.file ? r.file->length : r.shared_body ? r.shared_body->size() : r.body.size();
+    if (r.status != 204) out += "Content-Length: " + std::to_string(length) + "\r\n";
+    for (const auto& [k, v] : r.headers) out += k + ": " + v + "\r\n";
+    if (!keep_alive) out += "Connection: close\r\n";
+    out += "\r\n";
+    if (!r.file && !r.shared_body) out += r.body;
+    return out;
+}
+
+// --- Server ---
+
+namespace {
+
+struct Job {
+    uint64_t conn;
+    uint64_t seq;
+    HttpRequest req;
+};
+
+struct Done {
+    uint64_t conn;
+    uint64_t seq;
+    std::string bytes;
+    std::shared_ptr<const std::string> shared;   // sent after `bytes`
+    std::shared_ptr<HttpFile> file;              // or this
+    bool close;
+};
+
+// Pending output: owned bytes, shared bytes, or a file range still to
+// sendfile.
+struct Chunk {
+    std::string bytes;
+    std::shared_ptr<const std::string> shared;
+    size_t sent = 0;
+    std::shared_ptr<HttpFile> file;
+    uint64_t file_pos = 0;
+    uint64_t file_end = 0;
+
+    const std::string& data() const { return shared ? *shared : bytes; }
+    bool done() const { return file ? file_pos == file_end : sent == data().size(); }
+};
+
+struct Conn {
+    int fd = -1;
+    std::string in;
+    std::deque<Chunk> out;
+    uint64_t next_seq = 0;                  // assigned to the next parsed request
+    uint64_t next_send = 0;                 // response to append to `out` next
+    std::map<uint64_t, Done> ready;         // finished out of order
+    bool reading = true;                    // false after EOF, an error or Connection: close
+    bool close_after_send = false;
+    bool admitted = false;                  // the head handler has seen the request at the front of `in`
+    // Body bytes still to come of a request the head handler took: they
+    // go to the sink of `streaming`, or are dropped if it answered.
+    std::optional<HttpRequest> streaming;
+    uint64_t body_left = 0;
+    uint32_t events = 0;
+};
+
+constexpr uint64_t kListenTag = 0;
+constexpr uint64_t kWakeTag = 1;
+
+} // namespace
+
+struct HttpServer::State {
+    HttpServerOptions opts;
+    Handler handler;
+    HeadHandler head_handler;
+    int listen_fd = -1;
+    int epoll_fd = -1;
+    int wake_fd = -1;
+    uint16_t port = 0;
+    std::atomic<bool> stopping{false};
+
+    std::mutex jobs_mu;
+    std::condition_variable jobs_cv;
+    std::deque<Job> jobs;
+    bool workers_stop = false;
+    std::mutex done_mu;
+    std::vector<Done> done;
+
+    std::unordered_map<uint64_t, Conn> conns;
+    uint64_t next_conn = 2;
+
+    ~State() {
+        for (auto& [id, c] : conns) ::close(c.fd);
+        for (int fd : {listen_fd, epoll_fd, wake_fd}) {
+            if (fd >= 0) ::close(fd);
+        }
+    }
+
+    void Wake() {
+        const uint64_t one = 1;
+        [[maybe_unused]] const ssize_t n = ::write(wake_fd, &one, sizeof one);
+    }
+
+    void Work() {
+        for (;;) {
+            Job job;
+            {
+                std::unique_lock<std::mutex> lock(jobs_mu);
+                jobs_cv.wait(lock, [&] { return workers_stop || !jobs.empty(); });
+                if (jobs.empty()) return;
+                job = std::move(jobs.front());
+                jobs.pop_front();
+            }
+            HttpResponse r;
+            try {
+                r = handler(job.req);
+            } catch (const std::exception& e) {
+                r = HttpResponse::Text(500, std::string(e.what()) + "\n");
+            }
+            Done d{job.conn, job.seq, serialize_http_response(r, job.req.keep_alive), r.shared_body, r.file,
+                   !job.req.keep_alive};
+            {
+                std::lock_guard<std::mutex> lock(done_mu);
+                done.push_back(std::move(d));
+            }
+            Wake();
+        }
+    }
+
+    void Watch(uint64_t id, Conn& c) {
+        uint32_t want = 0;
+        if (c.reading && c.next_seq - c.next_send < kMaxInFlight) want |= EPOLLIN | EPOLLRDHUP;
+        if (!c.out.empty()) want |= EPOLLOUT;
+        if (want == c.events) return;
+        epoll_event ev{};
+        ev.events = want;
+        ev.data.u64 = id;
+        ::epoll_ctl(epoll_fd, EPOLL_CTL_MOD, c.fd, &ev);
+        c.events = want;
+    }
+
+    void Close(uint64_t id) {
+        const auto it = conns.find(id);
+        if (it == conns.end()) return;
+        ::close(it->second.fd);
+        conns.erase(it);
+    }
+
+    void Accept() {
+        for (;;) {
+            const int fd = ::accept4(listen_fd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+            if (fd < 0) return;
+            const int one = 1;
+            ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof one);
+            const uint64_t id = next_conn++;
+            Conn& c = conns[id];
+            c.fd = fd;
+            c.events = EPOLLIN | EPOLLRDHUP;
+            epoll_event ev{};
+            ev.events = c.events;
+            ev.data.u64 = id;
+            if (::epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev) != 0) Close(id);
+        }
+    }
+
+    // Queues a response made on the event thread (a parse error, or the
+    // head handler's answer) in sequence with the workers' ones.
+    void Queue(Conn& c, const HttpResponse& r, bool keep_alive) {
+        const uint64_t seq = c.next_seq++;
+        c.ready.emplace(seq, Done{0, seq, serialize_http_response(r, keep_alive), r.shared_body, r.file, !keep_alive});
+        if (!keep_alive) c.reading = false;
+    }
+
+    void Reject(Conn& c, int status) {
+        Queue(c, HttpResponse::Text(status, std::string(http_reason(status)) + "\n"), false);
+        c.streaming.reset();
+    }
+
+    void Submit(Conn& c, uint64_t id, HttpRequest req) {
+        if (!req.keep_alive) c.reading = false;
+        c.admitted = false;
+        {
+            std::lock_guard<std::mutex> lock(jobs_mu);
+            jobs.push_back(Job{id, c.next_seq++, std::move(req)});
+        }
+        jobs_cv.notify_one();
+    }
+
+    // Hands every complete buffered request to the workers, and buffered
+    // body bytes to the sink of a streamed request (or drops them, for
+    // one the head handler answered).
+    void Parse(Conn& c, uint64_t id) {
+        size_t off = 0;
+        while (c.reading && c.next_seq - c.next_send < kMaxInFlight) {
+            const std::string_view buf = std::string_view(c.in).substr(off);
+            if (c.streaming || c.body_left > 0) {
+                const size_t n = static_cast<size_t>(std::min<uint64_t>(buf.size(), c.body_left));
+                if (c.streaming && n > 0 && !c.streaming->body_sink->Write(buf.substr(0, n))) {
+                    Reject(c, 500);
+                    break;
+                }
+                off += n;
+                c.body_left -= n;
+                if (c.body_left > 0) break;
+                if (c.streaming) {
+                    HttpRequest req = std::move(*c.streaming);
+                    c.streaming.reset();
+                    Submit(c, id, std::move(req));
+                }
+                continue;
+            }
+
+            HttpRequest req;
+            size_t head = 0;
+            uint64_t length = 0;
+            const int rc = parse_http_head(buf, opts.max_body, &req, &head, &length);
+            if (rc < 0) break;
+            if (rc > 0) {
+                Reject(c, rc);
+                break;
+            }
+            if (head_handler && !c.admitted) {
+                c.admitted = true;
+                std::shared_ptr<HttpBodySink> sink;
+                std::optional<HttpResponse> early;
+                try {
+                    early = head_handler(req, &sink);
+                } catch (const std::exception& e) {
+                    early = HttpResponse::Text(500, std::string(e.what()) + "\n");
+                }
+                if (early || sink) {
+                    off += head;
+                    c.body_left = length;
+                    c.admitted = false;
+                    if (early) Queue(c, *early, req.keep_alive);
+                    req.body_sink = std::move(sink);
+                    if (req.body_sink) c.streaming = std::move(req);
+                    continue;
+                }
+            }
+            if (buf.size() - head < length) break;
+            req.body = buf.substr(head, length);
+            off += head + length;
+            Submit(c, id, std::move(req));
+        }
+        c.in.erase(0, off);
+    }
+
+    // Moves finished responses into the output queue in request order
+    // and writes what the socket takes. Returns false once the connection
+    // is done with.
+    bool Flush(Conn& c) {
+        for (auto it = c.ready.find(c.next_send); it != c.ready.end(); it = c.ready.find(c.next_send)) {
+            Done& d = it->second;
+            // Small pipelined responses coalesce into one send.
+            if (!c.out.empty() && !c.out.back().file && !c.out.back().shared) c.out.back().bytes += d.bytes;
+            else c.out.push_back(Chunk{std::move(d.bytes), nullptr, 0, nullptr, 0, 0});
+            if (d.shared && !d.shared->empty()) c.out.push_back(Chunk{std::string(), std::move(d.shared), 0, nullptr, 0, 0});
+            if (d.file && d.file->length > 0) {
+                const uint64_t begin = d.file->offset, end = begin + d.file->length;
+                c.out.push_back(Chunk{std::string(), nullptr, 0, std::move(d.file), begin, end});
+            }
+            c.close_after_send |= d.close;
+            c.ready.erase(it);
+            ++c.next_send;
+        }
+        while (!c.out.empty()) {
+            Chunk& k = c.out.front();
+            ssize_t n;
+            if (k.file) {
+                off_t pos = static_cast<off_t>(k.file_pos);
+                n = ::sendfile(c.fd, k.file->fd, &pos, std::min<uint64_t>(k.file_end - k.file_pos, kSendfileChunk));
+                if (n == 0) return false;   // file shrank under us: the response cannot be completed
+                if (n > 0) k.file_pos += static_cast<uint64_t>(n);
+            } else {
+                // MSG_MORE holds a head back until its body follows.
+                const int more = c.out.size() > 1 ? MSG_MORE : 0;
+                n = ::send(c.fd, k.data().data() + k.sent, k.data().size() - k.sent, MSG_NOSIGNAL | more);
+                if (n > 0) k.sent += static_cast<size_t>(n);
+            }
+            if (n < 0) {
+                if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+                if (errno == EINTR) continue;
+                return false;
+            }
+            if (k.done()) c.out.pop_front();
+        }
+        if (c.out.empty()) {
+            if (c.close_after_send) return false;
+            if (!c.reading && c.next_send == c.next_seq) return false;
+        }
+        return true;
+    }
+
+    void OnReadable(uint64_t id, Conn& c) {
+        char buf[kReadChunk];
+        for (;;) {
+            const ssize_t n = ::recv(c.fd, buf, sizeof buf, 0);
+            if (n > 0) {
+                c.in.append(buf, static_cast<size_t>(n));
+                if (static_cast<size_t>(n) < sizeof buf) break;
+                // Parsed as it comes, so a streamed or dropped body is
+                // dealt with a chunk at a time rather than piled up here.
+                Parse(c, id);
+                if (!c.reading) break;
+                continue;
+            }
+            if (n < 0 && errno == EINTR) continue;
+            if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+            c.reading = false;   // EOF or error: answer what was received
+            break;
+        }
+        Parse(c, id);
+    }
+
+    void DrainDone() {
+        uint64_t count;
+        [[maybe_unused]] const ssize_t n = ::read(wake_fd, &count, sizeof count);
+        std::vector<Done> batch;
+        {
+            std::lock_guard<std::mutex> lock(done_mu);
+            batch.swap(done);
+        }
+        for (Done& d : batch) {
+            const auto it = conns.find(d.conn);
+            if (it == conns.end()) continue;   // client went away
+            const uint64_t seq = d.seq;
+            it->second.ready.emplace(seq, std::move(d));
+        }
+        for (const Done& d : batch) {
+            const auto it = conns.find(d.conn);
+            if (it == conns.end()) continue;
+            Service(d.conn, it->second);
+        }
+    }
+
+    // Parses newly unblocked requests, flushes, and updates interest.
+    void Service(uint64_t id, Conn& c) {
+        Parse(c, id);
+        if (!Flush(c)) {
+            Close(id);
+            return;
+        }
+        Watch(id, c);
+    }
+};
+
+HttpServer::HttpServer(std::unique_ptr<State> s) : s_(std::move(s)) {}
+HttpServer::~HttpServer() = default;
+HttpServer::HttpServer(HttpServer&&) noexcept = default;
+HttpServer& HttpServer::operator=(HttpServer&&) noexcept = default;
+
+HttpServer HttpServer::Listen(const HttpServerOptions& opts, Handler handler, HeadHandler head) {
+    auto s = std::make_unique<State>();
+    s->opts = opts;
+    s->handler = std::move(handler);
+    s->head_handler = std::move(head);
+
+    s->listen_fd = ::socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (s->listen_fd < 0) throw std::runtime_error("HttpServer: socket failed");
+    const int one = 1;
+    ::setsockopt(s->listen_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof one);
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(opts.port);
+    if (::inet_pton(AF_INET, opts.host.c_str(), &addr.sin_addr) != 1) {
+        throw std::runtime_error("HttpServer: bad address " + opts.host);
+    }
+    if (::bind(s->listen_fd, reinterpret_cast<sockaddr*>(&addr), sizeof addr) != 0 ||
+        ::listen(s->listen_fd, SOMAXCONN) != 0) {
+        throw std::runtime_error("HttpServer: cannot listen on " + opts.host + ":" + std::to_string(opts.port) +
+                                 ": " + std::strerror(errno));
+    }
+    socklen_t len = sizeof addr;
+    ::getsockname(s->listen_fd, reinterpret_cast<sockaddr*>(&addr), &len);
+    s->port = ntohs(addr.sin_port);
+
+    s->epoll_fd = ::epoll_create1(EPOLL_CLOEXEC);
+    s->wake_fd = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (s->epoll_fd < 0 || s->wake_fd < 0) throw std::runtime_error("HttpServer: epoll setup failed");
+    epoll_event ev{};
+    ev.events = EPOLLIN;
+    ev.data.u64 = kListenTag;
+    ::epoll_ctl(s->epoll_fd, EPOLL_CTL_ADD, s->listen_fd, &ev);
+    ev.data.u64 = kWakeTag;
+    ::epoll_ctl(s->epoll_fd, EPOLL_CTL_ADD, s->wake_fd, &ev);
+    return HttpServer(std::move(s));
+}
+
+uint16_t HttpServer::port() const { return s_->port; }
+
+void HttpServer::Stop() {
+    s_->stopping.store(true);
+    s_->Wake();
+}
+
+void HttpServer::Run() {
+    State& s = *s_;
+    const int n_workers = s.opts.workers > 0 ? s.opts.workers
+                                             : std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+    std::vector<std::thread> workers;
+    for (int i = 0; i < n_workers; ++i) workers.emplace_back([&s] { s.Work(); });
+
+    epoll_event events[256];
+    while (!s.stopping.load()) {
+        const int n = ::epoll_wait(s.epoll_fd, events, 256, -1);
+        if (n < 0 && errno != EINTR) {
+            std::cerr << "HttpServer: epoll_wait failed: " << std::strerror(errno) << "\n";
+            break;
+        }
+        for (int i = 0; i < n; ++i) {
+            const uint64_t id = events[i].data.u64;
+            if (id == kListenTag) {
+                s.Accept();
+                continue;
+            }
+            if (id == kWakeTag) {
+                s.DrainDone();
+                continue;
+            }
+            const auto it = s.conns.find(id);
+            if (it == s.conns.end()) continue;
+            Conn& c = it->second;
+            if (events[i].events & EPOLLERR) {
+                s.Close(id);
+                continue;
+            }
+            if (events[i].events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP)) s.OnReadable(id, c);
+            s.Service(id, c);
+        }
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(s.jobs_mu);
+        s.workers_stop = true;
+        s.jobs.clear();
+    }
+    s.jobs_cv.notify_all();
+    for (std::thread& t : workers) t.join();
+}
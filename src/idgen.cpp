@@ -0,0 +1,109 @@
+#include "idgen.h"
+
+#include <chrono>
+#include <filesystem>
+#include <iostream>
+#include <random>
+#include <algorithm>
+#include <stdexcept>
+
+namespace {
+
+constexpr char kCrockford[] = "0123456789ABCDEFGHJKMNPQRSTVWXYZ";
+
+// xorshift128+: the random bits only need to separate concurrent writers.
+uint64_t next_random(uint64_t* s) {
+    uint64_t x = s[0];
+    const uint64_t y = s[1];
+    s[0] = y;
+    x ^= x << 23;
+    s[1] = x ^ y ^ (x >> 17) ^ (y >> 26);
+    return s[1] + y;
+}
+
+int crockford_value(char c) {
+    for (int i = 0; i < 32; ++i) {
+        if (kCrockford[i] == c) return i;
+    }
+    return -1;
+}
+
+} // namespace
+
+IdGenerator IdGenerator::Open(const std::string& path) {
+    namespace fs = std::filesystem;
+    IdGenerator g;
+    g.path_ = path;
+    if (!fs::exists(path)) std::ofstream(path, std::ios::binary);
+
+    std::ifstream in(path, std::ios::binary);
+    uint64_t mark = 0;
+    if (in.read(reinterpret_cast<char*>(&mark), sizeof mark)) g.floor_ = g.reserved_ = mark;
+    else if (fs::file_size(path) != 0) throw std::runtime_error("IdGenerator: truncated mark in " + path);
+
+    std::random_device rd;
+    g.rng_[0] = (static_cast<uint64_t>(rd()) << 32) | rd();
+    g.rng_[1] = (static_cast<uint64_t>(rd()) << 32) | rd() | 1;
+    return g;
+}
+
+bool IdGenerator::Next(char (&out)[kLen + 1]) {
+    using namespace std::chrono;
+    const auto now = duration_cast<milliseconds>(system_clock::now().time_since_epoch()).count();
+    return Next(static_cast<uint64_t>(now), out);
+}
+
+bool IdGenerator::Next(uint64_t now_ms, char (&out)[kLen + 1]) {
+    uint64_t ms = std::max(now_ms, floor_);
+    if (ms <= last_ms_) {
+        ms = last_ms_;
+        // 80-bit increment; on overflow borrow the next millisecond.
+        if (++rand_lo_ == 0 && (rand_hi_ = (rand_hi_ + 1) & 0xFFFF) == 0) ++ms;
+    }
+    if (ms != last_ms_) {
+        rand_lo_ = next_random(rng_);
+        rand_hi_ = next_random(rng_) & 0xFFFF;
+    }
+    if (ms >= reserved_ && !Reserve(ms + kLeaseMs)) return false;
+    last_ms_ = ms;
+
+    // 10 chars of time (48 bits, top 2 of 50 zero), 16 of randomness.
+    for (int i = 9; i >= 0; --i, ms >>= 5) out[i] = kCrockford[ms & 31];
+    uint64_t lo = rand_lo_, hi = rand_hi_;
+    for (int i = 25; i >= 10; --i) {
+        out[i] = kCrockford[lo & 31];
+        lo = (lo >> 5) | (hi << 59);
+        hi >>= 5;
+    }
+    out[kLen] = '\0';
+    return true;
+}
+
+bool IdGenerator::Reserve(uint64_t ms) {
+    if (!file_.is_open()) file_.open(path_, std::ios::binary | std::ios::in | std::ios::out);
+    // Another generator on the same file may have reserved further ahead;
+    // the mark only moves up, so a restart resumes above both.
+    uint64_t mark = 0;
+    file_.seekg(0);
+    if (file_.read(reinterpret_cast<char*>(&mark), sizeof mark)) ms = std::max(ms, mark);
+    file_.clear();
+    file_.seekp(0);
+    file_.write(reinterpret_cast<const char*>(&ms), sizeof ms);
+    if (!file_.flush()) {
+        std::cerr << "IdGenerator: cannot persist high-water mark to " << path_ << "\n";
+        file_.clear();
+        return false;
+    }
+    reserved_ = ms;
+    return true;
+}
+
+uint64_t IdGenerator::Timestamp(const char* id) {
+    uint64_t ms = 0;
+    for (size_t i = 0; i < 10; ++i) {
+        const int v = crockford_value(id[i]);
+        if (v < 0) return 0;
+        ms = (ms << 5) | static_cast<uint64_t>(v);
+    }
+    return ms;
+}
@@ -2,13 +2,20 @@
 #define STB_IMAGE_RESIZE2_IMPLEMENTATION
 #define STB_IMAGE_WRITE_IMPLEMENTATION 
 #define STBIW_SPRINTF snprintf
+// The stb implementations are not clean under the -Wextra that test_db
+// builds this file with.
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmissing-field-initializers"
 #include "stb_image.h"
 #include "stb_image_resize2.h"
 #include "stb_image_write.h"
+#pragma GCC diagnostic pop
 #include <string>
 #include <image.h>
+#include <phash.h>
 #include <iostream>
-#include <algorithm> 
+#include <algorithm>
+#include <vector>
 
 bool read_dims(const std::string& filepath, ImgDims* out) {
     int w, h, c;
@@ -22,45 +29,175 @@ bool read_dims(const std::string& filepath, ImgDims* out) {
     return true;
 }
 
-bool make_thumbnail_256(const std::string& input_path, const std::string& output_path) {
-    int w, h, c;
-    unsigned char* data = stbi_load(input_path.c_str(), &w, &h, &c, 0);
-    if (!data) {
-        std::cerr << "Failed to load image: " << input_path << std::endl;
-        return false;
-    }
+std::string image_mime(std::string_view head) {
+    auto starts = [&](std::string_view magic, size_t at = 0) {
+        return head.size() >= at + magic.size() && head.substr(at, magic.size()) == magic;
+    };
+    if (starts("\xFF\xD8\xFF")) return "image/jpeg";
+    if (starts("\x89PNG\r\n\x1A\n")) return "image/png";
+    if (starts("GIF87a") || starts("GIF89a")) return "image/gif";
+    if (starts("RIFF") && starts("WEBP", 8)) return "image/webp";
+    if (starts("BM")) return "image/bmp";
+    if (starts(std::string_view("II*\0", 4)) || starts(std::string_view("MM\0*", 4))) return "image/tiff";
+    if (starts("8BPS")) return "image/vnd.adobe.photoshop";
+    return "application/octet-stream";
+}
+
+namespace {
 
-    const int target_size = 256;
-    unsigned char* resized = new unsigned char[target_size * target_size * c];
+// Decoded original scaled so its longest side is 256px.
+struct Resized {
+    std::vector<unsigned char> pixels;
+    int w = 0, h = 0, c = 0;
+};
 
-    stbir_pixel_layout layout = (c == 4) ? STBIR_RGBA : STBIR_RGB;
+// Scales decoded pixels so the longest side is 256px; frees `data`.
+bool resize_256(unsigned char* data, int w, int h, int c, Resized* out) {
+    stbir_pixel_layout layout = (c == 4) ? STBIR_RGBA
+                              : (c == 3) ? STBIR_RGB
+                              : (c == 2) ? STBIR_RA
+                              : STBIR_1CHANNEL;
 
     double scale = 256.0 / std::max(w, h);
     int target_w = std::max(1, int(w * scale));
     int target_h = std::max(1, int(h * scale));
 
+    out->pixels.resize(static_cast<size_t>(target_w) * target_h * c);
     unsigned char* ok = stbir_resize_uint8_srgb(
         data, w, h, 0,                 // input
-        resized, target_w, target_h, 0,// output (compute target_w/h to preserve aspect)
+        out->pixels.data(), target_w, target_h, 0,// output (compute target_w/h to preserve aspect)
         layout
     );
+    stbi_image_free(data);
 
     if (!ok) {
         std::cerr << "Resize failed.\n";
-        stbi_image_free(data);
-        delete[] resized;
         return false;
     }
 
+    out->w = target_w;
+    out->h = target_h;
+    out->c = c;
+    return true;
+}
+
+bool load_resized_256(const std::string& input_path, Resized* out) {
+    int w, h, c;
+    unsigned char* data = stbi_load(input_path.c_str(), &w, &h, &c, 0);
+    if (!data) {
+        std::cerr << "Failed to load image: " << input_path << std::endl;
+        return false;
+    }
+    return resize_256(data, w, h, c, out);
+}
+
+void append_bytes(void* ctx, void* data, int size) {
+    static_cast<std::string*>(ctx)->append(static_cast<const char*>(data), size);
+}
+
+void signature_from(const Resized& r, ImgSignature* sig) {
+    float gray[kHashSide * kHashSide];
+    if (gray_reduce(r.pixels.data(), r.w, r.h, r.c, gray)) {
+        sig->dhash = dhash64(gray);
+        sig->phash = phash64(gray);
+    }
+    color_features(r.pixels.data(), r.w, r.h, r.c, &sig->color);
+}
+
+} // namespace
+
+bool make_thumbnail_256(const std::string& input_path, const std::string& output_path,
+                        ImgSignature* sig) {
+    Resized r;
+    if (!load_resized_256(input_path, &r)) return false;
+
+    if (sig) signature_from(r, sig);
+
     // Save as PNG
-    if (!stbi_write_png(output_path.c_str(), target_size, target_size, c, resized, target_size * c)) {
+    if (!stbi_write_png(output_path.c_str(), r.w, r.h, r.c, r.pixels.data(), r.w * r.c)) {
         std::cerr << "Failed to write thumbnail.\n";
-        stbi_image_free(data);
-        delete[] resized;
         return false;
     }
+    return true;
+}
 
+bool thumbnail_256_from_memory(const std::string& bytes, std::string* png, ImgDims* dims, ImgSignature* sig) {
+    int w, h, c;
+    unsigned char* data = stbi_load_from_memory(reinterpret_cast<const stbi_uc*>(bytes.data()),
+                                                static_cast<int>(bytes.size()), &w, &h, &c, 0);
+    if (!data) {
+        std::cerr << "Failed to decode image: " << stbi_failure_reason() << std::endl;
+        return false;
+    }
+    *dims = ImgDims{w, h, c};
+    Resized r;
+    if (!resize_256(data, w, h, c, &r)) return false;
+    if (sig) signature_from(r, sig);
+    png->clear();
+    if (!stbi_write_png_to_func(append_bytes, png, r.w, r.h, r.c, r.pixels.data(), r.w * r.c)) {
+        std::cerr << "Failed to encode thumbnail.\n";
+        return false;
+    }
+    return true;
+}
+
+bool compute_signature(const std::string& input_path, ImgSignature* sig) {
+    Resized r;
+    if (!load_resized_256(input_path, &r)) return false;
+    signature_from(r, sig);
+    return true;
+}
+
+double resize_scale(int src_w, int src_h, const ResizeSpec& spec) {
+    const double sx = spec.width > 0 ? static_cast<double>(spec.width) / src_w : 0;
+    const double sy = spec.height > 0 ? static_cast<double>(spec.height) / src_h : 0;
+    if (sx == 0) return sy;
+    if (sy == 0) return sx;
+    return spec.fit == ResizeFit::Cover ? std::max(sx, sy) : std::min(sx, sy);
+}
+
+bool render_resized(const std::string& src_path, const ResizeSpec& spec, std::string* out) {
+    int w, h, c;
+    unsigned char* data = stbi_load(src_path.c_str(), &w, &h, &c, 0);
+    if (!data) {
+        std::cerr << "Failed to load image: " << src_path << std::endl;
+        return false;
+    }
+    const double scale = resize_scale(w, h, spec);
+
+    // Source rectangle and output size. For Cover the box is cut out of the
+    // scaled image, which is the same as resizing the matching centred
+    // source rectangle straight to the box.
+    int crop_w = w, crop_h = h;
+    int out_w = std::max(1, static_cast<int>(w * scale + 0.5));
+    int out_h = std::max(1, static_cast<int>(h * scale + 0.5));
+    if (spec.fit == ResizeFit::Cover && spec.width > 0 && spec.height > 0) {
+        out_w = spec.width;
+        out_h = spec.height;
+        crop_w = std::clamp(static_cast<int>(out_w / scale + 0.5), 1, w);
+        crop_h = std::clamp(static_cast<int>(out_h / scale + 0.5), 1, h);
+    }
+    const unsigned char* origin = data + (static_cast<size_t>((h - crop_h) / 2) * w + (w - crop_w) / 2) * c;
+
+    stbir_pixel_layout layout = (c == 4) ? STBIR_RGBA
+                              : (c == 3) ? STBIR_RGB
+                              : (c == 2) ? STBIR_RA
+                              : STBIR_1CHANNEL;
+    std::vector<unsigned char> pixels(static_cast<size_t>(out_w) * out_h * c);
+    unsigned char* ok = stbir_resize_uint8_srgb(origin, crop_w, crop_h, w * c,
+                                                pixels.data(), out_w, out_h, 0, layout);
     stbi_image_free(data);
-    delete[] resized;
+    if (!ok) {
+        std::cerr << "Resize failed.\n";
+        return false;
+    }
+
+    out->clear();
+    const int written = spec.png ? stbi_write_png_to_func(append_bytes, out, out_w, out_h, c, pixels.data(), out_w * c)
+                                 : stbi_write_jpg_to_func(append_bytes, out, out_w, out_h, c, pixels.data(), 85);
+    if (!written) {
+        std::cerr << "Failed to encode resized image.\n";
+        return false;
+    }
     return true;
-}
\ No newline at end of file
+}
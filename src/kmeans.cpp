@@ -0,0 +1,125 @@
+#include "kmeans.h"
+#include "distance.h"
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <random>
+
+int nearest_centroid(const float* centroids, int k, uint32_t dim, const float* v, float* dist) {
+    int best = 0;
+    float best_d = std::numeric_limits<float>::max();
+    for (int c = 0; c < k; ++c) {
+        const float d = l2sq_f32(v, centroids + static_cast<size_t>(c) * dim, dim);
+        if (d < best_d) {
+            best_d = d;
+            best = c;
+        }
+    }
+    if (dist) *dist = best_d;
+    return best;
+}
+
+std::vector<float> kmeans_train(const float* data, size_t n, uint32_t dim, int k,
+                                int iters, uint64_t seed) {
+    std::vector<float> cent(static_cast<size_t>(k) * dim, 0.f);
+    if (n == 0 || k <= 0) return cent;
+
+    std::mt19937_64 rng(seed);
+    auto row = [&](size_t i) { return data + i * dim; };
+
+    // k-means++ seeding: each new seed is drawn proportionally to its squared
+    // distance from the nearest seed chosen so far.
+    std::vector<float> d2(n, std::numeric_limits<float>::max());
+    size_t pick = rng() % n;
+    for (int c = 0; c < k; ++c) {
+        std::memcpy(&cent[static_cast<size_t>(c) * dim], row(pick), dim * sizeof(float));
+        double total = 0.0;
+        for (size_t i = 0; i < n; ++i) {
+            d2[i] = std::min(d2[i], l2sq_f32(row(i), &cent[static_cast<size_t>(c) * dim], dim));
+            total += d2[i];
+        }
+        if (total <= 0.0) {
+            pick = rng() % n;
+            continue;
+        }
+        double r = std::uniform_real_distribution<double>(0.0, total)(rng);
+        for (pick = 0; pick + 1 < n; ++pick) {
+            r -= d2[pick];
+            if (r <= 0.0) break;
+        }
+    }
+
+    std::vector<int> assign(n, 0);
+    std::vector<float> dist(n, 0.f);
+    std::vector<double> sums(static_cast<size_t>(k) * dim);
+    std::vector<size_t> counts(k);
+    for (int it = 0; it < iters; ++it) {
+        bool changed = false;
+        for (size_t i = 0; i < n; ++i) {
+            const int a = nearest_centroid(cent.data(), k, dim, row(i), &dist[i]);
+            changed |= (a != assign[i]) || it == 0;
+            assign[i] = a;
+        }
+        if (!changed) break;
+
+        std::fill(sums.begin(), sums.end(), 0.0);
+        std::fill(counts.begin(), counts.end(), 0);
+        for (size_t i = 0; i < n; ++i) {
+            double* s = &sums[static_cast<size_t>(assign[i]) * dim];
+            const float* x = row(i);
+            for (uint32_t d = 0; d < dim; ++d) s[d] += x[d];
+            ++counts[assign[i]];
+        }
+        for (int c = 0; c < k; ++c) {
+            float* out = &cent[static_cast<size_t>(c) * dim];
+            if (counts[c] == 0) {
+                // Re-seed from the worst-served point and stop it being picked twice.
+                const size_t far = static_cast<size_t>(std::max_element(dist.begin(), dist.end()) - dist.begin());
+                std::memcpy(out, row(far), dim * sizeof(float));
+                dist[far] = 0.f;
+                continue;
+            }
+            const double* s = &sums[static_cast<size_t>(c) * dim];
+            for (uint32_t d = 0; d < dim; ++d) out[d] = static_cast<float>(s[d] / counts[c]);
+        }
+    }
+    return cent;
+}
+
+std::vector<float> minibatch_kmeans(const float* data, size_t n, uint32_t dim, int k,
+                                    size_t batch, int iters, uint64_t seed,
+                                    std::vector<uint64_t>* counts) {
+    std::vector<uint64_t> local;
+    std::vector<uint64_t>& cnt = counts ? *counts : local;
+    cnt.assign(k, 0);
+    if (n == 0 || k <= 0) return std::vector<float>(static_cast<size_t>(k) * dim, 0.f);
+
+    std::mt19937_64 rng(seed);
+    batch = std::max<size_t>(1, std::min(batch, n));
+
+    // Seed from one random batch (at least k rows when available).
+    const size_t seed_n = std::min(n, std::max(batch, static_cast<size_t>(k)));
+    std::vector<float> seed_rows(seed_n * dim);
+    for (size_t i = 0; i < seed_n; ++i) {
+        const size_t r = seed_n == n ? i : rng() % n;
+        std::memcpy(&seed_rows[i * dim], data + r * dim, dim * sizeof(float));
+    }
+    std::vector<float> cent = kmeans_train(seed_rows.data(), seed_n, dim, k, 1, seed);
+
+    std::vector<size_t> picks(batch);
+    std::vector<int> assign(batch);
+    for (int it = 0; it < iters; ++it) {
+        for (size_t i = 0; i < batch; ++i) {
+            picks[i] = rng() % n;
+            assign[i] = nearest_centroid(cent.data(), k, dim, data + picks[i] * dim);
+        }
+        for (size_t i = 0; i < batch; ++i) {
+            float* c = &cent[static_cast<size_t>(assign[i]) * dim];
+            const float* x = data + picks[i] * dim;
+            const float eta = 1.f / static_cast<float>(++cnt[assign[i]]);
+            for (uint32_t d = 0; d < dim; ++d) c[d] += eta * (x[d] - c[d]);
+        }
+    }
+    return cent;
+}
@@ -0,0 +1,153 @@
+#include "lease.h"
+
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+#include <thread>
+#include <utility>
+
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+constexpr char kMagic[8] = {'I', 'M', 'G', 'H', 'E', 'A', 'D', '1'};
+
+int flock_retry(int fd, int op) {
+    int rc;
+    do rc = ::flock(fd, op);
+    while (rc != 0 && errno == EINTR);
+    return rc;
+}
+
+} // namespace
+
+// Lock-free 64-bit atomics are address-free, so they work across
+// processes mapping the same page.
+struct WriterLease::Header {
+    char magic[8];
+    std::atomic<uint64_t> seq;
+    std::atomic<uint64_t> catalog_bytes;
+    std::atomic<uint64_t> generation;
+    std::atomic<uint64_t> writer_pid;
+    char pad[24];
+};
+static_assert(std::atomic<uint64_t>::is_always_lock_free);
+
+WriterLease WriterLease::Open(const std::string& db_root) {
+    static_assert(sizeof(Header) == 64);
+    const std::string lock_path = db_root + "/LOCK", head_path = db_root + "/HEAD";
+    WriterLease l;
+    l.lock_fd_ = ::open(lock_path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (l.lock_fd_ < 0) throw std::runtime_error("WriterLease: cannot open " + lock_path);
+
+    // Created under the lock, so two processes opening a fresh root agree
+    // on one header.
+    if (flock_retry(l.lock_fd_, LOCK_EX) != 0) throw std::runtime_error("WriterLease: cannot lock " + lock_path);
+    const int fd = ::open(head_path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    struct stat st;
+    bool ok = fd >= 0 && ::fstat(fd, &st) == 0;
+    if (ok && st.st_size == 0) {
+        char init[sizeof(Header)] = {};
+        std::memcpy(init, kMagic, sizeof kMagic);
+        ok = ::pwrite(fd, init, sizeof init, 0) == static_cast<ssize_t>(sizeof init) && ::fsync(fd) == 0;
+    } else if (ok) {
+        char magic[sizeof kMagic];
+        ok = st.st_size == static_cast<off_t>(sizeof(Header)) &&
+             ::pread(fd, magic, sizeof magic, 0) == static_cast<ssize_t>(sizeof magic) &&
+             std::memcmp(magic, kMagic, sizeof kMagic) == 0;
+    }
+    void* map = ok ? ::mmap(nullptr, sizeof(Header), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0) : MAP_FAILED;
+    if (fd >= 0) ::close(fd);
+    flock_retry(l.lock_fd_, LOCK_UN);
+    if (map == MAP_FAILED) throw std::runtime_error("WriterLease: cannot map " + head_path);
+    l.head_ = static_cast<Header*>(map);
+    return l;
+}
+
+WriterLease::~WriterLease() {
+    if (head_) ::munmap(head_, sizeof(Header));
+    if (lock_fd_ >= 0) ::close(lock_fd_);   // also drops a lease still held
+}
+
+WriterLease::WriterLease(WriterLease&& o) noexcept
+    : lock_fd_(std::exchange(o.lock_fd_, -1)), head_(std::exchange(o.head_, nullptr)),
+      held_(std::exchange(o.held_, false)) {}
+
+WriterLease& WriterLease::operator=(WriterLease&& o) noexcept {
+    if (this != &o) {
+        if (head_) ::munmap(head_, sizeof(Header));
+        if (lock_fd_ >= 0) ::close(lock_fd_);
+        lock_fd_ = std::exchange(o.lock_fd_, -1);
+        head_ = std::exchange(o.head_, nullptr);
+        held_ = std::exchange(o.held_, false);
+    }
+    return *this;
+}
+
+bool WriterLease::Acquire() {
+    if (flock_retry(lock_fd_, LOCK_EX) != 0) {
+        std::cerr << "WriterLease: flock failed: " << std::strerror(errno) << "\n";
+        return false;
+    }
+    held_ = true;
+    // An odd seq is a Commit() cut short by a crash: close it.
+    const uint64_t s = head_->seq.load(std::memory_order_relaxed);
+    if (s & 1) head_->seq.store(s + 1, std::memory_order_release);
+    head_->writer_pid.store(static_cast<uint64_t>(::getpid()), std::memory_order_relaxed);
+    return true;
+}
+
+void WriterLease::Release() {
+    if (!held_) return;
+    head_->writer_pid.store(0, std::memory_order_relaxed);
+    held_ = false;
+    flock_retry(lock_fd_, LOCK_UN);
+}
+
+WriterLease::State WriterLease::Read() const {
+    State st;
+    while (!TryRead(&st)) std::this_thread::yield();
+    return st;
+}
+
+bool WriterLease::TryRead(State* out) const {
+    for (;;) {
+        const uint64_t s = head_->seq.load(std::memory_order_acquire);
+        if (s & 1) return false;
+        State st;
+        st.catalog_bytes = head_->catalog_bytes.load(std::memory_order_relaxed);
+        st.generation = head_->generation.load(std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (head_->seq.load(std::memory_order_relaxed) != s) continue;
+        st.seq = s;
+        *out = st;
+        return true;
+    }
+}
+
+uint64_t WriterLease::seq() const {
+    return head_->seq.load(std::memory_order_acquire);
+}
+
+WriterLease::State WriterLease::Commit(uint64_t catalog_bytes, bool rewrote) {
+    State st;
+    const uint64_t s = head_->seq.load(std::memory_order_relaxed);
+    head_->seq.store(s + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    head_->catalog_bytes.store(catalog_bytes, std::memory_order_relaxed);
+    st.generation = head_->generation.load(std::memory_order_relaxed) + (rewrote ? 1 : 0);
+    head_->generation.store(st.generation, std::memory_order_relaxed);
+    head_->seq.store(s + 2, std::memory_order_release);
+    st.seq = s + 2;
+    st.catalog_bytes = catalog_bytes;
+    return st;
+}
+
+uint64_t WriterLease::writer_pid() const {
+    return head_->writer_pid.load(std::memory_order_relaxed);
+}
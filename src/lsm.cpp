@@ -0,0 +1,689 @@
+#include "lsm.h"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <shared_mutex>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+constexpr char kMagic[8] = {'I', 'M', 'G', 'L', 'S', 'M', '0', '1'};
+// Log record key carrying catalog_bytes (as 8 bytes) rather than an entry.
+constexpr uint32_t kCatalogBytesKey = UINT32_MAX;
+
+struct Footer {
+    uint64_t index_offset;   // == end of data
+    uint64_t blocks;
+    uint64_t bloom_offset;
+    uint64_t bloom_words;
+    uint64_t count;
+    uint32_t min_key, max_key;
+    uint32_t bloom_k, pad;
+    char magic[8];
+};
+
+uint64_t mix64(uint64_t x) {
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33;
+    x *= 0xc4ceb9fe1a85ec53ULL;
+    return x ^ (x >> 33);
+}
+
+// Bit positions h1 + i*h2 (double hashing) for i < k.
+template <typename Fn>
+void bloom_bits(uint32_t key, uint32_t k, uint64_t nbits, Fn&& fn) {
+    const uint64_t h = mix64(key);
+    const uint64_t h1 = h & 0xffffffff, h2 = (h >> 32) | 1;
+    for (uint32_t i = 0; i < k; ++i) fn((h1 + i * h2) % nbits);
+}
+
+bool write_all(int fd, const char* p, size_t n) {
+    while (n > 0) {
+        const ssize_t w = ::write(fd, p, n);
+        if (w <= 0) return false;
+        p += w;
+        n -= static_cast<size_t>(w);
+    }
+    return true;
+}
+
+bool read_at(int fd, void* p, size_t n, uint64_t off) {
+    return ::pread(fd, p, n, static_cast<off_t>(off)) == static_cast<ssize_t>(n);
+}
+
+void put_record(std::string* out, uint32_t key, bool tomb, std::string_view value) {
+    const uint32_t len = tomb ? LsmStore::kTombstone : static_cast<uint32_t>(value.size());
+    out->append(reinterpret_cast<const char*>(&key), 4);
+    out->append(reinterpret_cast<const char*>(&len), 4);
+    if (!tomb) out->append(value);
+}
+
+// Writes a file through a temp name: fsync, then rename.
+bool publish(const std::string& path, const std::string& bytes) {
+    const std::string tmp = path + ".tmp";
+    const int fd = ::open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) return false;
+    const bool ok = write_all(fd, bytes.data(), bytes.size()) && ::fdatasync(fd) == 0;
+    ::close(fd);
+    std::error_code ec;
+    if (ok) std::filesystem::rename(tmp, path, ec);
+    return ok && !ec;
+}
+
+} // namespace
+
+// ---- memtable: skiplist keyed by u32 ----
+
+struct LsmStore::Memtable {
+    static constexpr int kMaxLevel = 12;
+
+    struct Node {
+        uint32_t key = 0;
+        bool tomb = false;
+        std::string value;
+        std::vector<Node*> next;
+    };
+
+    Memtable() { head.next.assign(kMaxLevel, nullptr); }
+
+    void Put(uint32_t key, std::string_view value, bool tomb) {
+        Node* prev[kMaxLevel];
+        Node* x = &head;
+        for (int l = level - 1; l >= 0; --l) {
+            while (x->next[l] && x->next[l]->key < key) x = x->next[l];
+            prev[l] = x;
+        }
+        x = x->next[0];
+        if (x && x->key == key) {
+            bytes = bytes + value.size() - x->value.size();
+            x->value.assign(value);
+            x->tomb = tomb;
+            return;
+        }
+        // Level l with probability 4^-l.
+        int h = 1;
+        for (rng ^= rng << 13, rng ^= rng >> 7, rng ^= rng << 17; h < kMaxLevel && ((rng >> (2 * h)) & 3) == 0;) ++h;
+        for (; level < h; ++level) prev[level] = &head;
+        nodes.push_back(std::make_unique<Node>());
+        Node* n = nodes.back().get();
+        n->key = key;
+        n->tomb = tomb;
+        n->value.assign(value);
+        n->next.assign(h, nullptr);
+        for (int l = 0; l < h; ++l) {
+            n->next[l] = prev[l]->next[l];
+            prev[l]->next[l] = n;
+        }
+        bytes += value.size() + 8 + sizeof(Node);
+    }
+
+    const Node* Find(uint32_t key) const {
+        const Node* x = &head;
+        for (int l = level - 1; l >= 0; --l) {
+            while (x->next[l] && x->next[l]->key < key) x = x->next[l];
+        }
+        x = x->next[0];
+        return x && x->key == key ? x : nullptr;
+    }
+
+    const Node* First() const { return head.next[0]; }
+    bool empty() const { return nodes.empty(); }
+
+    Node head;
+    int level = 1;
+    uint64_t rng = 0x9e3779b97f4a7c15ULL;
+    size_t bytes = 0;
+    std::vector<std::unique_ptr<Node>> nodes;
+};
+
+// ---- runs ----
+
+struct LsmStore::Run {
+    std::string path;
+    int fd = -1;
+    uint64_t file_bytes = 0;
+    Footer footer{};
+    std::vector<uint32_t> block_keys;   // first key of each block
+    std::vector<uint64_t> block_offs;   // block starts, then the end of data
+    std::vector<uint64_t> bloom;
+
+    ~Run() {
+        if (fd >= 0) ::close(fd);
+    }
+
+    static std::shared_ptr<Run> Load(const std::string& path) {
+        auto r = std::make_shared<Run>();
+        r->path = path;
+        r->fd = ::open(path.c_str(), O_RDONLY);
+        struct stat st;
+        if (r->fd < 0 || ::fstat(r->fd, &st) != 0 || static_cast<size_t>(st.st_size) < sizeof(Footer)) return nullptr;
+        r->file_bytes = static_cast<uint64_t>(st.st_size);
+        Footer& f = r->footer;
+        if (!read_at(r->fd, &f, sizeof f, r->file_bytes - sizeof f) || std::memcmp(f.magic, kMagic, 8) != 0) {
+            return nullptr;
+        }
+        std::vector<char> index(f.blocks * 12);
+        r->bloom.resize(f.bloom_words);
+        if (!read_at(r->fd, index.data(), index.size(), f.index_offset) ||
+            !read_at(r->fd, r->bloom.data(), f.bloom_words * 8, f.bloom_offset)) {
+            return nullptr;
+        }
+        r->block_keys.resize(f.blocks);
+        r->block_offs.resize(f.blocks + 1);
+        for (size_t b = 0; b < f.blocks; ++b) {
+            std::memcpy(&r->block_keys[b], &index[b * 12], 4);
+            std::memcpy(&r->block_offs[b], &index[b * 12 + 4], 8);
+        }
+        r->block_offs[f.blocks] = f.index_offset;
+        return r;
+    }
+
+    bool MayContain(uint32_t key) const {
+        if (footer.count == 0 || key < footer.min_key || key > footer.max_key) return false;
+        const uint64_t nbits = bloom.size() * 64;
+        bool hit = true;
+        bloom_bits(key, footer.bloom_k, nbits, [&](uint64_t b) { hit = hit && (bloom[b / 64] >> (b % 64) & 1); });
+        return hit;
+    }
+
+    bool ReadBlock(size_t b, std::string* out) const {
+        out->resize(block_offs[b + 1] - block_offs[b]);
+        return read_at(fd, out->data(), out->size(), block_offs[b]);
+    }
+};
+
+namespace {
+
+// Writes a run from records added in key order.
+class RunBuilder {
+public:
+    explicit RunBuilder(std::string path) : path_(std::move(path)) {
+        fd_ = ::open((path_ + ".tmp").c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    }
+    ~RunBuilder() {
+        if (fd_ >= 0) ::close(fd_);
+    }
+
+    void Add(uint32_t key, bool tomb, std::string_view value) {
+        if (keys_.empty() || buf_.size() + written_ - block_start_ >= LsmStore::kBlockBytes) {
+            block_start_ = buf_.size() + written_;
+            index_.append(reinterpret_cast<const char*>(&key), 4);
+            index_.append(reinterpret_cast<const char*>(&block_start_), 8);
+        }
+        put_record(&buf_, key, tomb, value);
+        keys_.push_back(key);
+        if (buf_.size() >= (1u << 20)) Drain();
+    }
+
+    // Appends the index, bloom filter and footer, syncs and renames.
+    bool Finish() {
+        Footer f{};
+        f.index_offset = written_ + buf_.size();
+        f.blocks = index_.size() / 12;
+        f.count = keys_.size();
+        f.min_key = keys_.empty() ? 0 : keys_.front();
+        f.max_key = keys_.empty() ? 0 : keys_.back();
+        f.bloom_k = 7;   // ~ln 2 * kBloomBitsPerKey
+        buf_ += index_;
+        f.bloom_offset = written_ + buf_.size();
+        std::vector<uint64_t> bloom((keys_.size() * LsmStore::kBloomBitsPerKey + 63) / 64 + 1);
+        for (uint32_t k : keys_) {
+            bloom_bits(k, f.bloom_k, bloom.size() * 64, [&](uint64_t b) { bloom[b / 64] |= uint64_t{1} << (b % 64); });
+        }
+        f.bloom_words = bloom.size();
+        buf_.append(reinterpret_cast<const char*>(bloom.data()), bloom.size() * 8);
+        std::memcpy(f.magic, kMagic, 8);
+        buf_.append(reinterpret_cast<const char*>(&f), sizeof f);
+        ok_ = ok_ && fd_ >= 0;
+        Drain();
+        ok_ = ok_ && ::fdatasync(fd_) == 0;
+        ::close(fd_);
+        fd_ = -1;
+        std::error_code ec;
+        if (ok_) std::filesystem::rename(path_ + ".tmp", path_, ec);
+        if (!ok_ || ec) std::cerr << "LsmStore: cannot write " << path_ << "\n";
+        return ok_ && !ec;
+    }
+
+    size_t count() const { return keys_.size(); }
+
+private:
+    void Drain() {
+        ok_ = ok_ && fd_ >= 0 && write_all(fd_, buf_.data(), buf_.size());
+        written_ += buf_.size();
+        buf_.clear();
+    }
+
+    std::string path_;
+    int fd_ = -1;
+    bool ok_ = true;
+    std::string buf_, index_;
+    uint64_t written_ = 0, block_start_ = 0;
+    std::vector<uint32_t> keys_;
+};
+
+struct Item {
+    uint32_t key = 0;
+    bool tomb = false;
+    std::string value;
+};
+
+// One sorted input to a merge.
+class Source {
+public:
+    virtual ~Source() = default;
+    virtual bool Next(Item* out) = 0;
+};
+
+template <typename Node>
+class MemSource : public Source {
+public:
+    explicit MemSource(const Node* first) : n_(first) {}
+    bool Next(Item* out) override {
+        if (!n_) return false;
+        out->key = n_->key;
+        out->tomb = n_->tomb;
+        out->value = n_->value;
+        n_ = n_->next[0];
+        return true;
+    }
+
+private:
+    const Node* n_;
+};
+
+template <typename Run>
+class RunSource : public Source {
+public:
+    explicit RunSource(std::shared_ptr<Run> r) : r_(std::move(r)) {}
+    bool Next(Item* out) override {
+        while (pos_ == block_.size()) {
+            if (b_ == r_->block_keys.size()) return false;
+            if (!r_->ReadBlock(b_++, &block_)) {
+                std::cerr << "LsmStore: cannot read " << r_->path << "\n";
+                return false;
+            }
+            pos_ = 0;
+        }
+        uint32_t len;
+        std::memcpy(&out->key, &block_[pos_], 4);
+        std::memcpy(&len, &block_[pos_ + 4], 4);
+        pos_ += 8;
+        out->tomb = len == LsmStore::kTombstone;
+        if (out->tomb) len = 0;
+        out->value.assign(block_, pos_, len);
+        pos_ += len;
+        return true;
+    }
+
+private:
+    std::shared_ptr<Run> r_;
+    size_t b_ = 0, pos_ = 0;
+    std::string block_;
+};
+
+// K-way merge of sources ordered newest first; for each key only the
+// newest item reaches `fn`.
+void merge(std::vector<std::unique_ptr<Source>>& sources, const std::function<void(const Item&)>& fn) {
+    std::vector<Item> head(sources.size());
+    std::vector<bool> live(sources.size());
+    for (size_t i = 0; i < sources.size(); ++i) live[i] = sources[i]->Next(&head[i]);
+    for (;;) {
+        size_t best = SIZE_MAX;
+        for (size_t i = 0; i < sources.size(); ++i) {
+            if (live[i] && (best == SIZE_MAX || head[i].key < head[best].key)) best = i;
+        }
+        if (best == SIZE_MAX) return;
+        const uint32_t key = head[best].key;
+        fn(head[best]);
+        for (size_t i = 0; i < sources.size(); ++i) {
+            if (live[i] && head[i].key == key) live[i] = sources[i]->Next(&head[i]);
+        }
+    }
+}
+
+} // namespace
+
+// ---- store ----
+
+struct LsmStore::State {
+    std::string dir;
+    mutable std::shared_mutex mu;            // memtable, runs, manifest fields, log
+    std::unique_ptr<Memtable> mem = std::make_unique<Memtable>();
+    std::vector<std::shared_ptr<Run>> runs;   // newest first
+    uint64_t catalog_bytes = 0;
+    uint64_t next_run = 1;
+    int log_fd = -1;
+    mutable std::atomic<uint64_t> disk_reads{0};
+
+    std::mutex compact_mu;                   // one merge at a time
+    std::mutex wake_mu;
+    std::condition_variable wake, idle;
+    bool stop = false, pending = false, busy = false;
+    std::thread worker;
+
+    ~State() {
+        {
+            std::lock_guard<std::mutex> l(wake_mu);
+            stop = true;
+        }
+        wake.notify_all();
+        if (worker.joinable()) worker.join();
+        if (log_fd >= 0) ::close(log_fd);
+    }
+
+    std::vector<std::shared_ptr<Run>> Runs() const {
+        std::shared_lock<std::shared_mutex> l(mu);
+        return runs;
+    }
+
+    std::string RunPath(uint64_t n) const { return dir + "/run-" + std::to_string(n) + ".sst"; }
+
+    // Caller holds mu exclusively.
+    bool WriteManifest() {
+        std::ostringstream out;
+        out << std::string(kMagic, 8) << "\n" << catalog_bytes << "\n" << next_run << "\n";
+        for (const auto& r : runs) out << std::filesystem::path(r->path).filename().string() << "\n";
+        if (!publish(dir + "/MANIFEST", out.str())) {
+            std::cerr << "LsmStore: cannot write " << dir << "/MANIFEST\n";
+            return false;
+        }
+        return true;
+    }
+
+    // Caller holds mu exclusively.
+    bool Flush() {
+        if (mem->empty()) return true;
+        const std::string path = RunPath(next_run++);
+        RunBuilder b(path);
+        for (const Memtable::Node* n = mem->First(); n; n = n->next[0]) b.Add(n->key, n->tomb, n->value);
+        if (!b.Finish()) return false;
+        std::shared_ptr<Run> run = Run::Load(path);
+        if (!run) return false;
+        runs.insert(runs.begin(), std::move(run));
+        // The run is durable and listed before the log is dropped.
+        if (!WriteManifest() || ::ftruncate(log_fd, 0) != 0) return false;
+        mem = std::make_unique<Memtable>();
+        Signal();
+        return true;
+    }
+
+    void Signal() {
+        {
+            std::lock_guard<std::mutex> l(wake_mu);
+            pending = true;
+        }
+        wake.notify_one();
+    }
+
+    // Merges `inputs` (adjacent runs, newest first) into one run that takes
+    // their place. Caller holds compact_mu.
+    bool Merge(const std::vector<std::shared_ptr<Run>>& inputs, bool drop_tombstones) {
+        uint64_t n;
+        {
+            std::unique_lock<std::shared_mutex> l(mu);
+            n = next_run++;
+        }
+        const std::string path = RunPath(n);
+        RunBuilder b(path);
+        std::vector<std::unique_ptr<Source>> sources;
+        for (const auto& r : inputs) sources.push_back(std::make_unique<RunSource<Run>>(r));
+        merge(sources, [&](const Item& it) {
+            if (!(drop_tombstones && it.tomb)) b.Add(it.key, it.tomb, it.value);
+        });
+        if (!b.Finish()) return false;
+        std::shared_ptr<Run> merged = Run::Load(path);
+        if (!merged) return false;
+
+        std::unique_lock<std::shared_mutex> l(mu);
+        // Flushes only prepend, so the inputs are still adjacent.
+        const auto first = std::find(runs.begin(), runs.end(), inputs.front());
+        if (first == runs.end() || static_cast<size_t>(runs.end() - first) < inputs.size()) return false;
+        *first = std::move(merged);
+        runs.erase(first + 1, first + static_cast<std::ptrdiff_t>(inputs.size()));
+        if (!WriteManifest()) return false;
+        for (const auto& r : inputs) std::filesystem::remove(r->path);   // open readers keep their fd
+        return true;
+    }
+
+    // Size-tiered: merges the newest kTierRuns adjacent runs of similar size.
+    bool CompactOnce() {
+        std::lock_guard<std::mutex> c(compact_mu);
+        const std::vector<std::shared_ptr<Run>> snapshot = Runs();
+        for (size_t i = 0; i + kTierRuns <= snapshot.size(); ++i) {
+            uint64_t lo = UINT64_MAX, hi = 0;
+            for (size_t j = i; j < i + kTierRuns; ++j) {
+                lo = std::min(lo, snapshot[j]->file_bytes);
+                hi = std::max(hi, snapshot[j]->file_bytes);
+            }
+            if (static_cast<double>(hi) > kTierRatio * static_cast<double>(lo)) continue;
+            const std::vector<std::shared_ptr<Run>> window(snapshot.begin() + static_cast<std::ptrdiff_t>(i),
+                                                           snapshot.begin() + static_cast<std::ptrdiff_t>(i + kTierRuns));
+            return Merge(window, i + kTierRuns == snapshot.size());
+        }
+        return false;
+    }
+
+    void Worker() {
+        for (;;) {
+            {
+                std::unique_lock<std::mutex> l(wake_mu);
+                wake.wait(l, [&] { return stop || pending; });
+                if (stop) return;
+                pending = false;
+                busy = true;
+            }
+            while (CompactOnce()) {
+                std::lock_guard<std::mutex> l(wake_mu);
+                if (stop) break;
+            }
+            {
+                std::lock_guard<std::mutex> l(wake_mu);
+                busy = false;
+            }
+            idle.notify_all();
+        }
+    }
+};
+
+LsmStore::~LsmStore() = default;
+LsmStore::LsmStore(LsmStore&& o) noexcept = default;
+LsmStore& LsmStore::operator=(LsmStore&& o) noexcept = default;
+
+LsmStore LsmStore::Open(const std::string& dir) {
+    namespace fs = std::filesystem;
+    std::error_code ec;
+    fs::create_directories(dir, ec);
+
+    LsmStore store;
+    store.s_ = std::make_unique<State>();
+    State& s = *store.s_;
+    s.dir = dir;
+
+    std::vector<std::string> listed;
+    if (std::ifstream in{dir + "/MANIFEST"}) {
+        std::string magic;
+        if (!std::getline(in, magic) || magic != std::string(kMagic, 8) || !(in >> s.catalog_bytes >> s.next_run)) {
+            throw std::runtime_error("LsmStore: bad MANIFEST in " + dir);
+        }
+        for (std::string name; in >> name;) {
+            std::shared_ptr<Run> run = Run::Load(dir + "/" + name);
+            if (!run) throw std::runtime_error("LsmStore: cannot read run " + dir + "/" + name);
+            s.runs.push_back(std::move(run));
+            listed.push_back(name);
+        }
+    }
+    // Runs a crash left unlisted, and temp files.
+    for (const auto& e : fs::directory_iterator(dir, ec)) {
+        const std::string name = e.path().filename().string();
+        if ((name.rfind("run-", 0) == 0 && std::find(listed.begin(), listed.end(), name) == listed.end()) ||
+            e.path().extension() == ".tmp") {
+            fs::remove(e.path(), ec);
+        }
+    }
+
+    // Replay the log; a torn last record is cut off.
+    const std::string log = dir + "/log";
+    s.log_fd = ::open(log.c_str(), O_RDWR | O_CREAT | O_APPEND, 0644);
+    if (s.log_fd < 0) throw std::runtime_error("LsmStore: cannot open " + log);
+    std::string bytes;
+    {
+        std::ifstream in(log, std::ios::binary);
+        bytes.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+    }
+    size_t pos = 0;
+    while (pos + 8 <= bytes.size()) {
+        uint32_t key, len;
+        std::memcpy(&key, &bytes[pos], 4);
+        std::memcpy(&len, &bytes[pos + 4], 4);
+        const size_t n = len == kTombstone ? 0 : len;
+        if (pos + 8 + n > bytes.size()) break;
+        if (key == kCatalogBytesKey && n == sizeof s.catalog_bytes) {
+            std::memcpy(&s.catalog_bytes, &bytes[pos + 8], n);
+        } else {
+            s.mem->Put(key, std::string_view(bytes).substr(pos + 8, n), len == kTombstone);
+        }
+        pos += 8 + n;
+    }
+    if (pos != bytes.size() && ::ftruncate(s.log_fd, static_cast<off_t>(pos)) != 0) {
+        throw std::runtime_error("LsmStore: cannot repair " + log);
+    }
+
+    s.worker = std::thread([&s] { s.Worker(); });
+    if (s.runs.size() >= kTierRuns) s.Signal();
+    return store;
+}
+
+bool LsmStore::Put(uint32_t key, std::string_view value) {
+    std::unique_lock<std::shared_mutex> l(s_->mu);
+    std::string rec;
+    put_record(&rec, key, false, value);
+    if (!write_all(s_->log_fd, rec.data(), rec.size())) {
+        std::cerr << "LsmStore: cannot append to " << s_->dir << "/log\n";
+        return false;
+    }
+    s_->mem->Put(key, value, false);
+    return s_->mem->bytes < kMemtableBytes || s_->Flush();
+}
+
+bool LsmStore::Delete(uint32_t key) {
+    std::unique_lock<std::shared_mutex> l(s_->mu);
+    std::string rec;
+    put_record(&rec, key, true, {});
+    if (!write_all(s_->log_fd, rec.data(), rec.size())) {
+        std::cerr << "LsmStore: cannot append to " << s_->dir << "/log\n";
+        return false;
+    }
+    s_->mem->Put(key, {}, true);
+    return s_->mem->bytes < kMemtableBytes || s_->Flush();
+}
+
+std::optional<std::string> LsmStore::Get(uint32_t key) const {
+    std::shared_lock<std::shared_mutex> l(s_->mu);
+    if (const Memtable::Node* n = s_->mem->Find(key)) {
+        if (n->tomb) return std::nullopt;
+        return n->value;
+    }
+    std::string block;
+    for (const auto& run : s_->runs) {
+        if (!run->MayContain(key)) continue;
+        const auto it = std::upper_bound(run->block_keys.begin(), run->block_keys.end(), key);
+        const size_t b = static_cast<size_t>(it - run->block_keys.begin()) - 1;
+        s_->disk_reads.fetch_add(1, std::memory_order_relaxed);
+        if (!run->ReadBlock(b, &block)) {
+            std::cerr << "LsmStore: cannot read " << run->path << "\n";
+            return std::nullopt;
+        }
+        for (size_t pos = 0; pos + 8 <= block.size();) {
+            uint32_t k, len;
+            std::memcpy(&k, &block[pos], 4);
+            std::memcpy(&len, &block[pos + 4], 4);
+            if (k == key) {
+                if (len == kTombstone) return std::nullopt;
+                return block.substr(pos + 8, len);
+            }
+            if (k > key) break;
+            pos += 8 + (len == kTombstone ? 0 : len);
+        }
+    }
+    return std::nullopt;
+}
+
+void LsmStore::Scan(const std::function<void(uint32_t key, std::string_view value)>& fn) const {
+    std::shared_lock<std::shared_mutex> l(s_->mu);
+    std::vector<std::unique_ptr<Source>> sources;
+    sources.push_back(std::make_unique<MemSource<Memtable::Node>>(s_->mem->First()));
+    for (const auto& r : s_->runs) sources.push_back(std::make_unique<RunSource<Run>>(r));
+    merge(sources, [&](const Item& it) {
+        if (!it.tomb) fn(it.key, it.value);
+    });
+}
+
+bool LsmStore::Ingest(const std::vector<std::pair<uint32_t, std::string>>& sorted) {
+    std::lock_guard<std::mutex> c(s_->compact_mu);
+    std::unique_lock<std::shared_mutex> l(s_->mu);
+    const std::string path = s_->RunPath(s_->next_run++);
+    RunBuilder b(path);
+    for (const auto& [key, value] : sorted) b.Add(key, false, value);
+    if (!b.Finish()) return false;
+    std::shared_ptr<Run> run = Run::Load(path);
+    if (!run) return false;
+    s_->runs.push_back(std::move(run));
+    return s_->WriteManifest();
+}
+
+bool LsmStore::Flush() {
+    std::unique_lock<std::shared_mutex> l(s_->mu);
+    return s_->Flush();
+}
+
+bool LsmStore::CompactAll() {
+    std::lock_guard<std::mutex> c(s_->compact_mu);
+    if (!Flush()) return false;
+    const std::vector<std::shared_ptr<Run>> all = s_->Runs();
+    return all.size() < 2 || s_->Merge(all, true);
+}
+
+void LsmStore::WaitForCompaction() {
+    std::unique_lock<std::mutex> l(s_->wake_mu);
+    s_->idle.wait(l, [&] { return !s_->pending && !s_->busy; });
+}
+
+uint64_t LsmStore::catalog_bytes() const {
+    std::shared_lock<std::shared_mutex> l(s_->mu);
+    return s_->catalog_bytes;
+}
+
+bool LsmStore::SetCatalogBytes(uint64_t bytes) {
+    std::unique_lock<std::shared_mutex> l(s_->mu);
+    // Logged in order with the writes it covers; the next flush moves it
+    // to the manifest.
+    std::string rec;
+    put_record(&rec, kCatalogBytesKey, false, std::string_view(reinterpret_cast<const char*>(&bytes), sizeof bytes));
+    if (!write_all(s_->log_fd, rec.data(), rec.size())) {
+        std::cerr << "LsmStore: cannot append to " << s_->dir << "/log\n";
+        return false;
+    }
+    s_->catalog_bytes = bytes;
+    return true;
+}
+
+size_t LsmStore::run_count() const {
+    std::shared_lock<std::shared_mutex> l(s_->mu);
+    return s_->runs.size();
+}
+
+uint64_t LsmStore::disk_reads() const { return s_->disk_reads.load(std::memory_order_relaxed); }
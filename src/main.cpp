@@ -1,11 +1,47 @@
 #include<string>
 #include<algorithm>
+#include<stdexcept>
 #include <db.h>
+#include <api.h>
+#include <http.h>
+#include <image.h>
+#include <csignal>
+#include <filesystem>
+#include <cstdio>
+#include <iostream>
+#include <sstream>
 
 struct ParsedArgs {
     std::string cmd;
     std::string db_path;
     std::string img;
+    int radius = 8;
+    std::string file;
+    std::string id;
+    std::string vec;
+    std::string dtype = "f32";
+    int k = 10;
+    KnnOptions knn;
+    int pq_m = 64;
+    size_t sample = 100000;
+    bool drop_float = false;
+    std::string rgb;
+    std::string hue;
+    float min_score = 0.f;
+    ClusterFeature feature = ClusterFeature::PHash;
+    size_t batch = 1024;
+    int iters = 100;
+    uint32_t cluster = 0;
+    size_t offset = 0;
+    size_t limit = 50;
+    std::vector<std::string> add_tags;
+    std::vector<std::string> remove_tags;
+    std::string query;
+    std::string mime;
+    HttpServerOptions http;
+    ApiOptions api;
+    int threads = 0;
+    size_t in_flight = 256;
 };
 
 char* getCmdOption(char** begin, char** end, const std::string& option){
@@ -21,6 +57,21 @@ bool cmdOptionExists(char** begin, char** end, const std::string& option)
     return std::find(begin, end, option) != end;
 }
 
+std::string requireCmdOption(char** begin, char** end, const std::string& option){
+    char* value = getCmdOption(begin, end, option);
+    if(!value) throw std::runtime_error("Usage: " + option + " is needed");
+    return value;
+}
+
+std::vector<std::string> splitList(const std::string& s){
+    std::vector<std::string> out;
+    std::stringstream ss(s);
+    for(std::string tok; std::getline(ss, tok, ',');){
+        if(!tok.empty()) out.push_back(tok);
+    }
+    return out;
+}
+
 ParsedArgs parse_args(int argc, char** argv){
     ParsedArgs args;
 
@@ -48,18 +99,323 @@ ParsedArgs parse_args(int argc, char** argv){
         } else {
             throw std::runtime_error("Usage: -root is needed");
         }
+    } else if(args.cmd == "import-dir") {
+        args.db_path = requireCmdOption(argv, argv+argc, "-root");
+        args.img = requireCmdOption(argv, argv+argc, "-dir");
+        if(char* f = getCmdOption(argv, argv+argc, "-inflight")){
+            args.in_flight = std::stoull(f);
+        }
+    } else if(args.cmd == "similar") {
+        args.img = requireCmdOption(argv, argv+argc, "-img");
+        args.db_path = requireCmdOption(argv, argv+argc, "-root");
+
+        if(char* r = getCmdOption(argv, argv+argc, "-radius")){
+            args.radius = std::stoi(r);
+        }
+    } else if(args.cmd == "embed-import") {
+        args.db_path = requireCmdOption(argv, argv+argc, "-root");
+        args.file = requireCmdOption(argv, argv+argc, "-file");
+
+        if(char* d = getCmdOption(argv, argv+argc, "-dtype")){
+            args.dtype = d;
+        }
+        if(args.dtype != "f32" && args.dtype != "f16"){
+            throw std::runtime_error("Usage: -dtype must be f32 or f16");
+        }
+    } else if(args.cmd == "knn") {
+        args.db_path = requireCmdOption(argv, argv+argc, "-root");
+
+        if(char* id = getCmdOption(argv, argv+argc, "-id")){
+            args.id = id;
+        } else {
+            args.vec = requireCmdOption(argv, argv+argc, "-vec");
+        }
+        if(char* k = getCmdOption(argv, argv+argc, "-k")){
+            args.k = std::stoi(k);
+        }
+        if(char* ef = getCmdOption(argv, argv+argc, "-ef")){
+            args.knn.ef = std::stoi(ef);
+        }
+        args.knn.use_pq = cmdOptionExists(argv, argv+argc, "-pq");
+        if(char* r = getCmdOption(argv, argv+argc, "-rerank")){
+            args.knn.rerank = std::stoi(r);
+        }
+    } else if(args.cmd == "pq-train") {
+        args.db_path = requireCmdOption(argv, argv+argc, "-root");
+
+        if(char* m = getCmdOption(argv, argv+argc, "-m")){
+            args.pq_m = std::stoi(m);
+        }
+        if(char* n = getCmdOption(argv, argv+argc, "-sample")){
+            args.sample = std::stoull(n);
+        }
+        args.drop_float = cmdOptionExists(argv, argv+argc, "-drop-float");
+    } else if(args.cmd == "color") {
+        args.db_path = requireCmdOption(argv, argv+argc, "-root");
+
+        if(char* img = getCmdOption(argv, argv+argc, "-img")){
+            args.img = img;
+        } else if(char* rgb = getCmdOption(argv, argv+argc, "-rgb")){
+            args.rgb = rgb;
+        } else {
+            args.hue = requireCmdOption(argv, argv+argc, "-hue");
+        }
+        if(char* k = getCmdOption(argv, argv+argc, "-k")){
+            args.k = std::stoi(k);
+        }
+        if(char* m = getCmdOption(argv, argv+argc, "-min")){
+            args.min_score = std::stof(m);
+        }
+    } else if(args.cmd == "cluster-train") {
+        args.db_path = requireCmdOption(argv, argv+argc, "-root");
+        args.k = std::stoi(requireCmdOption(argv, argv+argc, "-k"));
+
+        if(char* f = getCmdOption(argv, argv+argc, "-feature")){
+            if(!parse_cluster_feature(f, &args.feature)){
+                throw std::runtime_error("Usage: -feature must be phash, color or embed");
+            }
+        }
+        if(char* b = getCmdOption(argv, argv+argc, "-batch")){
+            args.batch = std::stoull(b);
+        }
+        if(char* it = getCmdOption(argv, argv+argc, "-iters")){
+            args.iters = std::stoi(it);
+        }
+    } else if(args.cmd == "clusters") {
+        args.db_path = requireCmdOption(argv, argv+argc, "-root");
+    } else if(args.cmd == "cluster") {
+        args.db_path = requireCmdOption(argv, argv+argc, "-root");
+        args.cluster = static_cast<uint32_t>(std::stoul(requireCmdOption(argv, argv+argc, "-id")));
+
+        if(char* o = getCmdOption(argv, argv+argc, "-offset")){
+            args.offset = std::stoull(o);
+        }
+        if(char* l = getCmdOption(argv, argv+argc, "-limit")){
+            args.limit = std::stoull(l);
+        }
+    } else if(args.cmd == "tag") {
+        args.db_path = requireCmdOption(argv, argv+argc, "-root");
+        args.id = requireCmdOption(argv, argv+argc, "-id");
+
+        if(char* a = getCmdOption(argv, argv+argc, "-add")){
+            args.add_tags = splitList(a);
+        }
+        if(char* r = getCmdOption(argv, argv+argc, "-remove")){
+            args.remove_tags = splitList(r);
+        }
+        if(args.add_tags.empty() && args.remove_tags.empty()){
+            throw std::runtime_error("Usage: -add or -remove is needed");
+        }
+    } else if(args.cmd == "tags") {
+        args.db_path = requireCmdOption(argv, argv+argc, "-root");
+    } else if(args.cmd == "query") {
+        args.db_path = requireCmdOption(argv, argv+argc, "-root");
+        args.query = requireCmdOption(argv, argv+argc, "-q");
+    } else if(args.cmd == "index-build" || args.cmd == "checkpoint" || args.cmd == "gc") {
+        args.db_path = requireCmdOption(argv, argv+argc, "-root");
+    } else if(args.cmd == "show" || args.cmd == "delete") {
+        args.db_path = requireCmdOption(argv, argv+argc, "-root");
+        args.id = requireCmdOption(argv, argv+argc, "-id");
+    } else if(args.cmd == "edit") {
+        args.db_path = requireCmdOption(argv, argv+argc, "-root");
+        args.id = requireCmdOption(argv, argv+argc, "-id");
+        args.mime = requireCmdOption(argv, argv+argc, "-mime");
+    } else if(args.cmd == "find") {
+        args.db_path = requireCmdOption(argv, argv+argc, "-root");
+        args.query = requireCmdOption(argv, argv+argc, "-q");
+
+        if(char* o = getCmdOption(argv, argv+argc, "-offset")){
+            args.offset = std::stoull(o);
+        }
+        if(char* l = getCmdOption(argv, argv+argc, "-limit")){
+            args.limit = std::stoull(l);
+        }
+    } else if(args.cmd == "serve") {
+        args.db_path = requireCmdOption(argv, argv+argc, "-root");
+        if(char* h = getCmdOption(argv, argv+argc, "-host")){
+            args.http.host = h;
+        }
+        if(char* p = getCmdOption(argv, argv+argc, "-port")){
+            args.http.port = static_cast<uint16_t>(std::stoul(p));
+        }
+        if(char* w = getCmdOption(argv, argv+argc, "-workers")){
+            args.http.workers = std::stoi(w);
+        }
+        if(char* c = getCmdOption(argv, argv+argc, "-thumb-cache-mb")){
+            args.api.thumb_cache_bytes = std::stoull(c) << 20;
+        }
+        if(char* c = getCmdOption(argv, argv+argc, "-variant-cache-mb")){
+            args.api.variant_cache_bytes = std::stoull(c) << 20;
+        }
+        if(char* q = getCmdOption(argv, argv+argc, "-import-queue")){
+            args.api.import_queue = std::stoull(q);
+        }
+    }
+    // Worker threads of the DB's task pool, for any command.
+    if(char* t = getCmdOption(argv, argv+argc, "-threads")){
+        args.threads = std::stoi(t);
     }
 
     return args;
 }
 
+HttpServer* g_server = nullptr;
+
+void stop_server(int) {
+    if(g_server) g_server->Stop();
+}
+
 int main(int argc, char **argv){
     ParsedArgs args = parse_args(argc, argv);
 
     if(args.cmd == "init") {
-        return ImageDB::Open(args.db_path).Init() ? 0 : 1;
+        return ImageDB::Open(args.db_path, args.threads).Init() ? 0 : 1;
     } else if(args.cmd == "import") {
-        ImageDB db = ImageDB::Open(args.db_path);
+        ImageDB db = ImageDB::Open(args.db_path, args.threads);
         return db.ImportFile(args.img);
+    } else if(args.cmd == "import-dir") {
+        std::vector<std::string> files;
+        for (const auto& e : std::filesystem::directory_iterator(args.img)) {
+            if (e.is_regular_file()) files.push_back(e.path().string());
+        }
+        std::sort(files.begin(), files.end());
+        ImageDB db = ImageDB::Open(args.db_path, args.threads);
+        const size_t imported = db.ImportFiles(files, args.in_flight);
+        std::cout << "Imported " << imported << " of " << files.size() << " files\n";
+        return 0;
+    } else if(args.cmd == "similar") {
+        ImageDB db = ImageDB::Open(args.db_path, args.threads);
+        for (const SimilarHit& hit : db.FindSimilar(args.img, args.radius)) {
+            std::cout << hit.image_id << " " << hit.distance << "\n";
+        }
+        return 0;
+    } else if(args.cmd == "embed-import") {
+        ImageDB db = ImageDB::Open(args.db_path, args.threads);
+        return db.ImportEmbeddings(args.file, args.dtype == "f16" ? EmbedDType::F16 : EmbedDType::F32) ? 0 : 1;
+    } else if(args.cmd == "knn") {
+        ImageDB db = ImageDB::Open(args.db_path, args.threads);
+        std::vector<KnnHit> hits;
+        if(!args.id.empty()) {
+            hits = db.NearestByEmbedding(args.id, args.k, args.knn);
+        } else {
+            std::vector<float> q;
+            std::stringstream ss(args.vec);
+            for(std::string tok; std::getline(ss, tok, ',');) q.push_back(std::stof(tok));
+            hits = db.NearestByVector(q, args.k, args.knn);
+        }
+        for (const KnnHit& hit : hits) {
+            std::cout << hit.image_id << " " << hit.distance << "\n";
+        }
+        return 0;
+    } else if(args.cmd == "pq-train") {
+        ImageDB db = ImageDB::Open(args.db_path, args.threads);
+        return db.TrainPq(args.pq_m, args.sample, args.drop_float) ? 0 : 1;
+    } else if(args.cmd == "color") {
+        ImageDB db = ImageDB::Open(args.db_path, args.threads);
+        uint16_t query[kColorBins];
+        if(!args.img.empty()) {
+            ImgSignature sig;
+            if(!compute_signature(args.img, &sig)) return 1;
+            std::copy(sig.color.hist, sig.color.hist + kColorBins, query);
+        } else if(!args.rgb.empty()) {
+            const unsigned long v = std::stoul(args.rgb, nullptr, 16);
+            single_color_hist((v >> 16) & 0xFF, (v >> 8) & 0xFF, v & 0xFF, query);
+        } else {
+            const size_t dash = args.hue.find('-');
+            if(dash == std::string::npos) throw std::runtime_error("Usage: -hue LO-HI (degrees)");
+            hue_range_mask(std::stof(args.hue.substr(0, dash)), std::stof(args.hue.substr(dash + 1)), query);
+        }
+        for (const ColorHit& hit : db.SearchColor(query, args.k, args.min_score)) {
+            std::cout << hit.image_id << " " << hit.score;
+            for (const DominantColor& d : hit.dominant) {
+                char hex[16];
+                std::snprintf(hex, sizeof hex, " #%02x%02x%02x:%d", d.r, d.g, d.b, d.share * 100 / 255);
+                std::cout << hex;
+            }
+            std::cout << "\n";
+        }
+        return 0;
+    } else if(args.cmd == "cluster-train") {
+        ImageDB db = ImageDB::Open(args.db_path, args.threads);
+        return db.TrainClusters(args.feature, args.k, args.batch, args.iters) ? 0 : 1;
+    } else if(args.cmd == "clusters") {
+        ImageDB db = ImageDB::Open(args.db_path, args.threads);
+        ClusterFeature feature;
+        const std::vector<size_t> sizes = db.ClusterSizes(&feature);
+        std::cout << "# feature=" << cluster_feature_name(feature) << " k=" << sizes.size() << "\n";
+        for (size_t c = 0; c < sizes.size(); ++c) {
+            std::cout << c << " " << sizes[c] << "\n";
+        }
+        return 0;
+    } else if(args.cmd == "cluster") {
+        ImageDB db = ImageDB::Open(args.db_path, args.threads);
+        for (const std::string& id : db.ClusterMembers(args.cluster, args.offset, args.limit)) {
+            std::cout << id << "\n";
+        }
+        return 0;
+    } else if(args.cmd == "tag") {
+        ImageDB db = ImageDB::Open(args.db_path, args.threads);
+        return db.TagImage(args.id, args.add_tags, args.remove_tags) ? 0 : 1;
+    } else if(args.cmd == "tags") {
+        ImageDB db = ImageDB::Open(args.db_path, args.threads);
+        for (const auto& [tag, count] : db.ListTags()) {
+            std::cout << tag << " " << count << "\n";
+        }
+        return 0;
+    } else if(args.cmd == "find") {
+        ImageDB db = ImageDB::Open(args.db_path, args.threads);
+        uint64_t total = 0;
+        for (const std::string& id : db.FindByTags(args.query, args.offset, args.limit, &total)) {
+            std::cout << id << "\n";
+        }
+        std::cout << "# " << total << " matching\n";
+        return 0;
+    } else if(args.cmd == "query") {
+        ImageDB db = ImageDB::Open(args.db_path, args.threads);
+        db.RunQuery(args.query, std::cout);
+        return 0;
+    } else if(args.cmd == "index-build") {
+        ImageDB db = ImageDB::Open(args.db_path, args.threads);
+        return db.BuildRangeIndexes() ? 0 : 1;
+    } else if(args.cmd == "checkpoint") {
+        ImageDB db = ImageDB::Open(args.db_path, args.threads);
+        return db.Checkpoint() ? 0 : 1;
+    } else if(args.cmd == "show") {
+        ImageDB db = ImageDB::Open(args.db_path, args.threads);
+        std::optional<ImageMeta> m = db.GetImage(args.id);
+        if(!m) {
+            std::cerr << "No image " << args.id << "\n";
+            return 1;
+        }
+        std::cout << meta_to_json(*m) << "\n";
+        return 0;
+    } else if(args.cmd == "edit") {
+        ImageDB db = ImageDB::Open(args.db_path, args.threads);
+        std::optional<ImageMeta> m = db.GetImage(args.id);
+        if(!m) {
+            std::cerr << "No image " << args.id << "\n";
+            return 1;
+        }
+        m->mime = args.mime;
+        return db.UpdateImage(*m) ? 0 : 1;
+    } else if(args.cmd == "delete") {
+        ImageDB db = ImageDB::Open(args.db_path, args.threads);
+        return db.Delete(args.id) ? 0 : 1;
+    } else if(args.cmd == "gc") {
+        ImageDB db = ImageDB::Open(args.db_path, args.threads);
+        return db.CollectGarbage() ? 0 : 1;
+    } else if(args.cmd == "serve") {
+        ImageDB db = ImageDB::Open(args.db_path, args.threads);
+        ImageApi api(db, args.api);
+        HttpServer server = HttpServer::Listen(
+            args.http, [&api](const HttpRequest& req) { return api.Handle(req); },
+            [&api](const HttpRequest& req, std::shared_ptr<HttpBodySink>* sink) { return api.Admit(req, sink); });
+        g_server = &server;
+        std::signal(SIGINT, stop_server);
+        std::signal(SIGTERM, stop_server);
+        std::cout << "Serving " << db.db_root << " on " << args.http.host << ":" << server.port() << std::endl;
+        server.Run();
+        g_server = nullptr;
+        return 0;
     }
-}
\ No newline at end of file
+}
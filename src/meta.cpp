@@ -1,5 +1,15 @@
 #include <meta.h>
 #include "json.hpp"
+#include <phash.h>
+#include <fstream>
+#include <iostream>
+#include <istream>
+#include <streambuf>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 using json = nlohmann::json;
 
@@ -10,8 +20,115 @@ std::string meta_to_json(const ImageMeta& m) {
     obj["sha256"] = m.sha256;
     obj["width"] = m.width;
     obj["height"] = m.height;
+    obj["bytes"] = m.bytes;
     obj["created_at"] = m.created_unix;
+    obj["dhash"] = hash64_to_hex(m.dhash);
+    obj["phash"] = hash64_to_hex(m.phash);
+    obj["ordinal"] = m.ordinal;
 
     return obj.dump(4);
 
-}
\ No newline at end of file
+}
+
+namespace {
+
+bool meta_from_obj(const json& obj, uint32_t row, ImageMeta* out) {
+    if (!obj.is_object() || !obj.contains("image_id")) return false;
+    ImageMeta m;
+    m.image_id = obj.value("image_id", "");
+    m.mime = obj.value("mime", "");
+    m.sha256 = obj.value("sha256", "");
+    m.width = obj.value("width", 0u);
+    m.height = obj.value("height", 0u);
+    m.bytes = obj.value("bytes", uint64_t{0});
+    m.created_unix = obj.value("created_at", uint64_t{0});
+    // Records written before perceptual hashing simply have no signature.
+    if (!hex_to_hash64(obj.value("dhash", ""), &m.dhash)) m.dhash = 0;
+    if (!hex_to_hash64(obj.value("phash", ""), &m.phash)) m.phash = 0;
+    m.ordinal = obj.value("ordinal", row);
+    *out = std::move(m);
+    return true;
+}
+
+} // namespace
+
+bool meta_from_json(const std::string& text, ImageMeta* out) {
+    json obj = json::parse(text, nullptr, false);
+    if (obj.is_discarded()) return false;
+    return meta_from_obj(obj, 0, out);
+}
+
+namespace {
+
+// An istream's view of bytes in memory, e.g. a mapped file.
+struct MemoryBuf : std::streambuf {
+    MemoryBuf(const char* begin, const char* end) {
+        char* b = const_cast<char*>(begin);
+        setg(b, b, const_cast<char*>(end));
+    }
+};
+
+bool read_records(std::istream& in, const std::string& path, std::vector<ImageMeta>* out, uint32_t first_row) {
+    // The stream operator consumes exactly one JSON value, so both compact
+    // and pretty-printed records parse the same way.
+    for (uint32_t row = first_row;; ++row) {
+        in >> std::ws;
+        if (in.peek() == std::char_traits<char>::eof()) break;
+        json obj;
+        try {
+            in >> obj;
+        } catch (const json::exception& ex) {
+            std::cerr << "load_catalog: malformed record in " << path << ": " << ex.what() << "\n";
+            return false;
+        }
+        ImageMeta m;
+        if (!meta_from_obj(obj, row, &m)) {
+            std::cerr << "load_catalog: record without image_id in " << path << "\n";
+            return false;
+        }
+        out->push_back(std::move(m));
+    }
+    return true;
+}
+
+} // namespace
+
+bool load_catalog(const std::string& path, std::vector<ImageMeta>* out, uint64_t offset, uint32_t first_row) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in) {
+        std::cerr << "load_catalog: cannot open " << path << "\n";
+        return false;
+    }
+    in.seekg(static_cast<std::streamoff>(offset));
+    return read_records(in, path, out, first_row);
+}
+
+bool map_catalog(const std::string& path, uint64_t offset, uint64_t end, std::vector<ImageMeta>* out) {
+    if (end <= offset) return true;
+    const int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        std::cerr << "map_catalog: cannot open " << path << "\n";
+        return false;
+    }
+    // Mappings start on a page boundary. A file shorter than `end` (one
+    // replaced since the length was read) would fault past its last page.
+    struct stat st;
+    const uint64_t page = static_cast<uint64_t>(::sysconf(_SC_PAGESIZE));
+    const uint64_t base = offset / page * page;
+    const size_t len = static_cast<size_t>(end - base);
+    void* map = MAP_FAILED;
+    if (::fstat(fd, &st) == 0 && static_cast<uint64_t>(st.st_size) >= end) {
+        map = ::mmap(nullptr, len, PROT_READ, MAP_SHARED, fd, static_cast<off_t>(base));
+    }
+    ::close(fd);
+    if (map == MAP_FAILED) {
+        std::cerr << "map_catalog: mmap failed for " << path << "\n";
+        return false;
+    }
+    const char* bytes = static_cast<const char*>(map);
+    MemoryBuf buf(bytes + (offset - base), bytes + len);
+    std::istream in(&buf);
+    const bool ok = read_records(in, path, out, 0);
+    ::munmap(map, len);
+    return ok;
+}
@@ -0,0 +1,90 @@
+#include "mih.h"
+#include <algorithm>
+
+namespace {
+
+// All 16-bit masks with popcount <= s, ordered by popcount.
+const std::vector<uint16_t>& masks_upto(int s) {
+    static const std::array<std::vector<uint16_t>, 17> by_radius = [] {
+        std::array<std::vector<uint16_t>, 17> out;
+        std::array<std::vector<uint16_t>, 17> exact;
+        for (uint32_t m = 0; m <= 0xFFFF; ++m)
+            exact[__builtin_popcount(m)].push_back(static_cast<uint16_t>(m));
+        for (int r = 0; r <= 16; ++r) {
+            if (r > 0) out[r] = out[r - 1];
+            out[r].insert(out[r].end(), exact[r].begin(), exact[r].end());
+        }
+        return out;
+    }();
+    return by_radius[std::clamp(s, 0, 16)];
+}
+
+} // namespace
+
+MultiIndexHash::MultiIndexHash(std::vector<uint64_t> hashes) : hashes_(std::move(hashes)) {
+    const size_t n = hashes_.size();
+    for (int t = 0; t < kChunks; ++t) {
+        auto& off = offsets_[t];
+        auto& ids = ids_[t];
+        auto& bh = bucket_hashes_[t];
+        off.assign((1u << kChunkBits) + 1, 0);
+        ids.resize(n);
+        bh.resize(n);
+
+        // Counting sort by substring value.
+        for (uint64_t h : hashes_) ++off[chunk(h, t) + 1];
+        for (size_t b = 1; b < off.size(); ++b) off[b] += off[b - 1];
+        std::vector<uint32_t> cursor(off.begin(), off.end() - 1);
+        for (size_t i = 0; i < n; ++i) {
+            const uint32_t pos = cursor[chunk(hashes_[i], t)]++;
+            ids[pos] = static_cast<uint32_t>(i);
+            bh[pos] = hashes_[i];
+        }
+    }
+}
+
+// Cloned for hardware POPCNT; the default clone keeps the binary portable.
+__attribute__((target_clones("popcnt", "default")))
+std::vector<uint32_t> MultiIndexHash::Query(uint64_t q, int radius) const {
+    std::vector<uint32_t> out;
+    if (radius < 0) return out;
+
+    // Past ~radius 24 the substring neighbourhoods cover most buckets and a
+    // sequential popcount sweep is cheaper than the random probes.
+    const int s = radius / kChunks;
+    if (s >= 6) return LinearScan(q, radius);
+
+    const auto& masks = masks_upto(s);
+    for (int t = 0; t < kChunks; ++t) {
+        const uint16_t qc = chunk(q, t);
+        const auto& off = offsets_[t];
+        const auto& ids = ids_[t];
+        const auto& bh = bucket_hashes_[t];
+        for (uint16_t m : masks) {
+            const uint32_t b = static_cast<uint16_t>(qc ^ m);
+            for (uint32_t i = off[b]; i < off[b + 1]; ++i) {
+                const uint64_t h = bh[i];
+                if (__builtin_popcountll(h ^ q) > radius) continue;
+
+                // Report each id once: only from the first table where its
+                // substring fell inside the probed neighbourhood.
+                bool seen_earlier = false;
+                for (int u = 0; u < t && !seen_earlier; ++u)
+                    seen_earlier = __builtin_popcount(chunk(h, u) ^ chunk(q, u)) <= s;
+                if (!seen_earlier) out.push_back(ids[i]);
+            }
+        }
+    }
+    std::sort(out.begin(), out.end());
+    return out;
+}
+
+__attribute__((target_clones("popcnt", "default")))
+std::vector<uint32_t> MultiIndexHash::LinearScan(uint64_t q, int radius) const {
+    std::vector<uint32_t> out;
+    if (radius < 0) return out;
+    const size_t n = hashes_.size();
+    for (size_t i = 0; i < n; ++i)
+        if (__builtin_popcountll(hashes_[i] ^ q) <= radius) out.push_back(static_cast<uint32_t>(i));
+    return out;
+}
@@ -0,0 +1,125 @@
+#include "ordinals.h"
+
+#include <algorithm>
+#include <bit>
+#include <filesystem>
+#include <functional>
+#include <iostream>
+#include <stdexcept>
+
+OrdinalMap OrdinalMap::Open(const std::string& dir) {
+    namespace fs = std::filesystem;
+    OrdinalMap m;
+    m.dir_ = dir;
+    const std::string path = dir + "/ordinals.ids";
+    if (!fs::exists(path)) std::ofstream(path, std::ios::binary);
+    m.slots_.assign(16, 0);
+    m.Refresh();
+    return m;
+}
+
+void OrdinalMap::Refresh() {
+    const std::string path = dir_ + "/ordinals.ids";
+    std::ifstream in(path);
+    if (!in || !in.seekg(static_cast<std::streamoff>(file_bytes_))) {
+        throw std::runtime_error("OrdinalMap: cannot read " + path);
+    }
+    for (std::string line; std::getline(in, line);) {
+        file_bytes_ += line.size() + (in.eof() ? 0 : 1);
+        chars_ += line;
+        offsets_.push_back(chars_.size());
+        if (size() * 2 > slots_.size()) Grow();
+        else Insert(static_cast<uint32_t>(size() - 1));
+    }
+}
+
+void OrdinalMap::Insert(uint32_t ordinal) {
+    const size_t mask = slots_.size() - 1;
+    size_t i = std::hash<std::string_view>{}(image_id(ordinal)) & mask;
+    while (slots_[i] != 0) i = (i + 1) & mask;
+    slots_[i] = ordinal + 1;
+}
+
+void OrdinalMap::Grow() {
+    slots_.assign(slots_.size() * 2, 0);
+    for (uint32_t ord = 0; ord < size(); ++ord) Insert(ord);
+}
+
+uint32_t OrdinalMap::Find(std::string_view image_id) const {
+    const size_t mask = slots_.size() - 1;
+    for (size_t i = std::hash<std::string_view>{}(image_id) & mask; slots_[i] != 0; i = (i + 1) & mask) {
+        if (this->image_id(slots_[i] - 1) == image_id) return slots_[i] - 1;
+    }
+    return kNone;
+}
+
+uint32_t OrdinalMap::Append(const std::string& image_id) {
+    if (image_id.empty() || image_id.find('\n') != std::string::npos || Find(image_id) != kNone) {
+        std::cerr << "OrdinalMap: invalid or duplicate image_id '" << image_id << "'\n";
+        return kNone;
+    }
+    if (size() >= kNone - 1) {
+        std::cerr << "OrdinalMap: ordinal space exhausted\n";
+        return kNone;
+    }
+    if (!out_.is_open()) out_.open(dir_ + "/ordinals.ids", std::ios::app);
+    out_ << image_id << '\n';
+    if (!out_.flush()) {
+        std::cerr << "OrdinalMap: cannot append to " << dir_ << "/ordinals.ids\n";
+        return kNone;
+    }
+
+    const uint32_t ord = static_cast<uint32_t>(size());
+    file_bytes_ += image_id.size() + 1;
+    chars_ += image_id;
+    offsets_.push_back(chars_.size());
+    // Load factor stays at or below 1/2.
+    if ((size() * 2) > slots_.size()) Grow();
+    else Insert(ord);
+    return ord;
+}
+
+size_t OrdinalMap::SizeInBytes() const {
+    return chars_.capacity() + offsets_.capacity() * sizeof(uint64_t) + slots_.capacity() * sizeof(uint32_t);
+}
+
+std::vector<uint32_t> read_ordinal_column(const std::string& path) {
+    std::vector<uint32_t> ords;
+    std::error_code ec;
+    const uintmax_t bytes = std::filesystem::file_size(path, ec);
+    if (ec) return ords;
+    ords.resize(bytes / sizeof(uint32_t));
+    std::ifstream in(path, std::ios::binary);
+    if (!in.read(reinterpret_cast<char*>(ords.data()), static_cast<std::streamsize>(ords.size() * sizeof(uint32_t)))) {
+        throw std::runtime_error("read_ordinal_column: cannot read " + path);
+    }
+    return ords;
+}
+
+bool write_ordinal_column(const std::string& path, const std::vector<uint32_t>& ords) {
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    out.write(reinterpret_cast<const char*>(ords.data()), static_cast<std::streamsize>(ords.size() * sizeof(uint32_t)));
+    if (!out.flush()) {
+        std::cerr << "write_ordinal_column: cannot write " << path << "\n";
+        return false;
+    }
+    return true;
+}
+
+bool put_ordinal(std::fstream& out, const std::string& path, size_t row, uint32_t ord) {
+    return put_ordinals(out, path, row, &ord, 1);
+}
+
+bool put_ordinals(std::fstream& out, const std::string& path, size_t row, const uint32_t* ords, size_t n) {
+    if (!out.is_open()) {
+        if (!std::filesystem::exists(path)) std::ofstream(path, std::ios::binary);
+        out.open(path, std::ios::binary | std::ios::in | std::ios::out);
+    }
+    out.seekp(static_cast<std::streamoff>(row * sizeof(uint32_t)));
+    out.write(reinterpret_cast<const char*>(ords), static_cast<std::streamsize>(n * sizeof(uint32_t)));
+    if (!out.flush()) {
+        std::cerr << "put_ordinal: cannot write " << path << "\n";
+        return false;
+    }
+    return true;
+}
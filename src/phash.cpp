@@ -0,0 +1,139 @@
+#include "phash.h"
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <vector>
+
+namespace {
+
+// Area-weighted (box) resample of a single-channel image. Every destination
+// cell averages exactly the source region it covers, which is the classic
+// reduction for perceptual hashes and needs no filter kernels.
+void area_resize(const float* src, int sw, int sh, float* dst, int dw, int dh) {
+    const double sx = static_cast<double>(sw) / dw;
+    const double sy = static_cast<double>(sh) / dh;
+    for (int dy = 0; dy < dh; ++dy) {
+        const double y0 = dy * sy, y1 = y0 + sy;
+        for (int dx = 0; dx < dw; ++dx) {
+            const double x0 = dx * sx, x1 = x0 + sx;
+            double sum = 0.0, area = 0.0;
+            for (int y = static_cast<int>(y0); y < sh && y < y1; ++y) {
+                const double wy = std::min<double>(y + 1, y1) - std::max<double>(y, y0);
+                for (int x = static_cast<int>(x0); x < sw && x < x1; ++x) {
+                    const double wx = std::min<double>(x + 1, x1) - std::max<double>(x, x0);
+                    sum += src[static_cast<size_t>(y) * sw + x] * wx * wy;
+                    area += wx * wy;
+                }
+            }
+            dst[dy * dw + dx] = area > 0.0 ? static_cast<float>(sum / area) : 0.f;
+        }
+    }
+}
+
+// cos((2x+1) * u * pi / 2N) for the 8 lowest frequencies, built once.
+const std::array<float, 8 * kHashSide>& dct_table() {
+    static const std::array<float, 8 * kHashSide> table = [] {
+        std::array<float, 8 * kHashSide> t{};
+        const double pi = 3.14159265358979323846;
+        for (int u = 0; u < 8; ++u)
+            for (int x = 0; x < kHashSide; ++x)
+                t[u * kHashSide + x] = static_cast<float>(
+                    std::cos((2.0 * x + 1.0) * u * pi / (2.0 * kHashSide)));
+        return t;
+    }();
+    return table;
+}
+
+} // namespace
+
+bool gray_reduce(const unsigned char* pixels, int w, int h, int channels,
+                 float out[kHashSide * kHashSide]) {
+    if (!pixels || w <= 0 || h <= 0 || channels < 1 || channels > 4) return false;
+
+    // Rec. 601 luma; alpha is ignored, gray+alpha uses the gray channel.
+    std::vector<float> luma(static_cast<size_t>(w) * h);
+    for (size_t i = 0; i < luma.size(); ++i) {
+        const unsigned char* p = pixels + i * channels;
+        luma[i] = (channels >= 3) ? 0.299f * p[0] + 0.587f * p[1] + 0.114f * p[2]
+                                  : static_cast<float>(p[0]);
+    }
+
+    area_resize(luma.data(), w, h, out, kHashSide, kHashSide);
+    return true;
+}
+
+uint64_t dhash64(const float gray[kHashSide * kHashSide]) {
+    float small[8 * 9];
+    area_resize(gray, kHashSide, kHashSide, small, 9, 8);
+
+    uint64_t h = 0;
+    for (int y = 0; y < 8; ++y) {
+        for (int x = 0; x < 8; ++x) {
+            h <<= 1;
+            h |= small[y * 9 + x] < small[y * 9 + x + 1] ? 1u : 0u;
+        }
+    }
+    return h;
+}
+
+uint64_t phash64(const float gray[kHashSide * kHashSide]) {
+    const auto& c = dct_table();
+
+    // Separable DCT restricted to the 8x8 low-frequency block:
+    // rows first (32 rows x 8 freqs), then columns (8 x 8).
+    float rows[kHashSide * 8];
+    for (int y = 0; y < kHashSide; ++y) {
+        for (int u = 0; u < 8; ++u) {
+            float s = 0.f;
+            for (int x = 0; x < kHashSide; ++x) s += gray[y * kHashSide + x] * c[u * kHashSide + x];
+            rows[y * 8 + u] = s;
+        }
+    }
+
+    float coeff[64];
+    for (int v = 0; v < 8; ++v) {
+        for (int u = 0; u < 8; ++u) {
+            float s = 0.f;
+            for (int y = 0; y < kHashSide; ++y) s += rows[y * 8 + u] * c[v * kHashSide + y];
+            coeff[v * 8 + u] = s;
+        }
+    }
+
+    // Median of the 63 AC terms; the DC term only encodes mean brightness.
+    float ac[63];
+    std::copy(coeff + 1, coeff + 64, ac);
+    std::nth_element(ac, ac + 31, ac + 63);
+    const float median = ac[31];
+
+    uint64_t h = 0;
+    for (int i = 0; i < 64; ++i) {
+        h <<= 1;
+        h |= coeff[i] > median ? 1u : 0u;
+    }
+    return h;
+}
+
+std::string hash64_to_hex(uint64_t h) {
+    static const char* kHex = "0123456789abcdef";
+    std::string s(16, '0');
+    for (int i = 15; i >= 0; --i) {
+        s[i] = kHex[h & 0xF];
+        h >>= 4;
+    }
+    return s;
+}
+
+bool hex_to_hash64(const std::string& hex, uint64_t* out) {
+    if (hex.empty() || hex.size() > 16) return false;
+    uint64_t h = 0;
+    for (char ch : hex) {
+        int v;
+        if (ch >= '0' && ch <= '9') v = ch - '0';
+        else if (ch >= 'a' && ch <= 'f') v = ch - 'a' + 10;
+        else if (ch >= 'A' && ch <= 'F') v = ch - 'A' + 10;
+        else return false;
+        h = (h << 4) | static_cast<uint64_t>(v);
+    }
+    *out = h;
+    return true;
+}
@@ -0,0 +1,238 @@
+#include "pq.h"
+#include "distance.h"
+#include "kmeans.h"
+#include "ordinals.h"
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <queue>
+#include <stdexcept>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define IMGDB_X86 1
+#include <immintrin.h>
+#endif
+
+namespace {
+
+constexpr char kMagic[8] = {'I', 'M', 'G', 'P', 'Q', '0', '0', '1'};
+
+void scan_scalar(const float* lut, const uint8_t* codes, size_t n, int m, float* out) {
+    for (size_t i = 0; i < n; ++i) {
+        const uint8_t* c = codes + i * m;
+        float s = 0.f;
+        for (int j = 0; j < m; ++j) s += lut[j * ProductQuantizer::kCentroids + c[j]];
+        out[i] = s;
+    }
+}
+
+#ifdef IMGDB_X86
+// One gather fetches the table entries of eight consecutive subspaces of a
+// single code: index = (j + lane) * 256 + code[j + lane]. Codes are read
+// contiguously, so the only random access is into the L1-resident table.
+__attribute__((target("avx2,fma")))
+void scan_avx2(const float* lut, const uint8_t* codes, size_t n, int m, float* out) {
+    const __m256i lane_base = _mm256_setr_epi32(0, 256, 512, 768, 1024, 1280, 1536, 1792);
+    const int m8 = m & ~7;
+    for (size_t i = 0; i < n; ++i) {
+        const uint8_t* c = codes + i * m;
+        __m256 acc = _mm256_setzero_ps();
+        int j = 0;
+        for (; j < m8; j += 8) {
+            const __m128i bytes = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(c + j));
+            const __m256i idx = _mm256_add_epi32(_mm256_cvtepu8_epi32(bytes), lane_base);
+            acc = _mm256_add_ps(acc, _mm256_i32gather_ps(lut + j * 256, idx, 4));
+        }
+        __m128 lo = _mm_add_ps(_mm256_castps256_ps128(acc), _mm256_extractf128_ps(acc, 1));
+        lo = _mm_add_ps(lo, _mm_movehl_ps(lo, lo));
+        lo = _mm_add_ss(lo, _mm_movehdup_ps(lo));
+        float s = _mm_cvtss_f32(lo);
+        for (; j < m; ++j) s += lut[j * 256 + c[j]];
+        out[i] = s;
+    }
+}
+#endif
+
+using ScanFn = void (*)(const float*, const uint8_t*, size_t, int, float*);
+
+ScanFn pick_scan() {
+#ifdef IMGDB_X86
+    if (simd_distance_available()) return scan_avx2;
+#endif
+    return scan_scalar;
+}
+
+} // namespace
+
+ProductQuantizer ProductQuantizer::Train(const float* sample, size_t n, uint32_t dim, int m,
+                                         int iters, uint64_t seed) {
+    if (m <= 0 || dim % static_cast<uint32_t>(m) != 0) {
+        throw std::invalid_argument("ProductQuantizer: dim " + std::to_string(dim) +
+                                    " is not divisible by M=" + std::to_string(m));
+    }
+    ProductQuantizer pq;
+    pq.dim_ = dim;
+    pq.m_ = m;
+    const int ds = pq.dsub();
+    pq.centroids_.resize(static_cast<size_t>(m) * kCentroids * ds);
+
+    std::vector<float> sub(n * ds);
+    for (int j = 0; j < m; ++j) {
+        for (size_t i = 0; i < n; ++i)
+            std::memcpy(&sub[i * ds], sample + i * dim + static_cast<size_t>(j) * ds, ds * sizeof(float));
+        const std::vector<float> c = kmeans_train(sub.data(), n, ds, kCentroids, iters, seed + j);
+        std::copy(c.begin(), c.end(), pq.centroids_.begin() + static_cast<size_t>(j) * kCentroids * ds);
+    }
+    return pq;
+}
+
+void ProductQuantizer::Encode(const float* v, uint8_t* code) const {
+    const int ds = dsub();
+    for (int j = 0; j < m_; ++j) {
+        const float* cb = &centroids_[static_cast<size_t>(j) * kCentroids * ds];
+        code[j] = static_cast<uint8_t>(nearest_centroid(cb, kCentroids, ds, v + static_cast<size_t>(j) * ds));
+    }
+}
+
+void ProductQuantizer::Decode(const uint8_t* code, float* out) const {
+    const int ds = dsub();
+    for (int j = 0; j < m_; ++j) {
+        const float* c = &centroids_[(static_cast<size_t>(j) * kCentroids + code[j]) * ds];
+        std::memcpy(out + static_cast<size_t>(j) * ds, c, ds * sizeof(float));
+    }
+}
+
+void ProductQuantizer::ComputeTable(const float* q, float* lut) const {
+    const int ds = dsub();
+    for (int j = 0; j < m_; ++j) {
+        const float* qs = q + static_cast<size_t>(j) * ds;
+        const float* cb = &centroids_[static_cast<size_t>(j) * kCentroids * ds];
+        for (int c = 0; c < kCentroids; ++c) lut[j * kCentroids + c] = l2sq_f32(qs, cb + c * ds, ds);
+    }
+}
+
+void ProductQuantizer::ScanCodes(const float* lut, const uint8_t* codes, size_t n, float* out) const {
+    static const ScanFn fn = pick_scan();
+    fn(lut, codes, n, m_, out);
+}
+
+void ProductQuantizer::Write(std::ostream& out) const {
+    const int32_t m = m_;
+    out.write(reinterpret_cast<const char*>(&dim_), sizeof dim_);
+    out.write(reinterpret_cast<const char*>(&m), sizeof m);
+    out.write(reinterpret_cast<const char*>(centroids_.data()),
+              static_cast<std::streamsize>(centroids_.size() * sizeof(float)));
+}
+
+bool ProductQuantizer::Read(std::istream& in) {
+    int32_t m = 0;
+    if (!in.read(reinterpret_cast<char*>(&dim_), sizeof dim_) ||
+        !in.read(reinterpret_cast<char*>(&m), sizeof m)) {
+        return false;
+    }
+    if (m <= 0 || dim_ == 0 || dim_ % static_cast<uint32_t>(m) != 0) return false;
+    m_ = m;
+    centroids_.resize(static_cast<size_t>(m_) * kCentroids * dsub());
+    return static_cast<bool>(in.read(reinterpret_cast<char*>(centroids_.data()),
+                                     static_cast<std::streamsize>(centroids_.size() * sizeof(float))));
+}
+
+PqStore PqStore::Create(const std::string& path, ProductQuantizer pq) {
+    {
+        std::ofstream out(path, std::ios::binary | std::ios::trunc);
+        if (!out) throw std::runtime_error("PqStore: cannot create " + path);
+        const uint64_t count = 0;
+        out.write(kMagic, sizeof kMagic);
+        out.write(reinterpret_cast<const char*>(&count), sizeof count);
+        pq.Write(out);
+        if (!out.flush()) throw std::runtime_error("PqStore: cannot write " + path);
+    }
+    if (!write_ordinal_column(path + ".ords", {})) throw std::runtime_error("PqStore: cannot create " + path + ".ords");
+    return Open(path);
+}
+
+PqStore PqStore::Open(const std::string& path) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in) throw std::runtime_error("PqStore: cannot open " + path);
+
+    char magic[8];
+    uint64_t count = 0;
+    PqStore s;
+    s.path_ = path;
+    if (!in.read(magic, sizeof magic) || std::memcmp(magic, kMagic, sizeof kMagic) != 0 ||
+        !in.read(reinterpret_cast<char*>(&count), sizeof count) || !s.pq_.Read(in)) {
+        throw std::runtime_error("PqStore: bad header in " + path);
+    }
+    s.codes_offset_ = in.tellg();
+    s.codes_.resize(count * s.pq_.m());
+    if (!in.read(reinterpret_cast<char*>(s.codes_.data()), static_cast<std::streamsize>(s.codes_.size()))) {
+        throw std::runtime_error("PqStore: truncated codes in " + path);
+    }
+
+    // Ordinals past the committed count are left by an interrupted append
+    // and get overwritten by the next one.
+    s.ords_ = read_ordinal_column(path + ".ords");
+    if (s.ords_.size() < count) throw std::runtime_error("PqStore: ordinal column shorter than header count in " + path);
+    s.ords_.resize(count);
+    return s;
+}
+
+bool PqStore::Append(uint32_t ordinal, const float* v) {
+    std::vector<uint8_t> code(pq_.m());
+    pq_.Encode(v, code.data());
+
+    // Code and ordinal first, header count last: the count is the commit point.
+    if (!file_.is_open()) file_.open(path_, std::ios::binary | std::ios::in | std::ios::out);
+    if (!file_) {
+        std::cerr << "PqStore: cannot open " << path_ << " for append\n";
+        return false;
+    }
+    file_.seekp(codes_offset_ + static_cast<std::streamoff>(codes_.size()));
+    file_.write(reinterpret_cast<const char*>(code.data()), static_cast<std::streamsize>(code.size()));
+    if (!file_.flush() || !put_ordinal(ords_out_, path_ + ".ords", ords_.size(), ordinal)) {
+        std::cerr << "PqStore: append failed for " << path_ << "\n";
+        return false;
+    }
+
+    const uint64_t count = ords_.size() + 1;
+    file_.seekp(sizeof kMagic);
+    file_.write(reinterpret_cast<const char*>(&count), sizeof count);
+    if (!file_.flush()) {
+        std::cerr << "PqStore: append failed for " << path_ << "\n";
+        return false;
+    }
+
+    codes_.insert(codes_.end(), code.begin(), code.end());
+    ords_.push_back(ordinal);
+    return true;
+}
+
+std::vector<std::pair<float, uint32_t>> PqStore::Search(const float* q, size_t k) const {
+    std::vector<float> lut(static_cast<size_t>(pq_.m()) * ProductQuantizer::kCentroids);
+    pq_.ComputeTable(q, lut.data());
+
+    constexpr size_t kBlock = 4096;
+    std::vector<float> dist(kBlock);
+    std::priority_queue<std::pair<float, uint32_t>> top;
+    const size_t n = size();
+    for (size_t base = 0; base < n; base += kBlock) {
+        const size_t len = std::min(kBlock, n - base);
+        pq_.ScanCodes(lut.data(), code(base), len, dist.data());
+        for (size_t i = 0; i < len; ++i) {
+            if (top.size() < k) {
+                top.emplace(dist[i], static_cast<uint32_t>(base + i));
+            } else if (dist[i] < top.top().first) {
+                top.pop();
+                top.emplace(dist[i], static_cast<uint32_t>(base + i));
+            }
+        }
+    }
+
+    std::vector<std::pair<float, uint32_t>> out(top.size());
+    for (size_t i = out.size(); i-- > 0;) {
+        out[i] = top.top();
+        top.pop();
+    }
+    return out;
+}
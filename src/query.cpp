@@ -0,0 +1,889 @@
+#include "query.h"
+
+#include <algorithm>
+#include <cctype>
+#include <numeric>
+#include <ostream>
+#include <stdexcept>
+#include <unordered_map>
+
+#include "taskpool.h"
+
+namespace {
+
+constexpr SqlColumn kAllColumns[] = {
+    SqlColumn::ImageId, SqlColumn::Sha256, SqlColumn::Mime, SqlColumn::Width, SqlColumn::Height,
+    SqlColumn::Bytes, SqlColumn::CreatedAt, SqlColumn::Ordinal, SqlColumn::Cluster,
+};
+
+bool iequals(const std::string& a, const char* b) {
+    size_t i = 0;
+    for (; i < a.size() && b[i]; ++i) {
+        if (std::toupper(static_cast<unsigned char>(a[i])) != std::toupper(static_cast<unsigned char>(b[i]))) {
+            return false;
+        }
+    }
+    return i == a.size() && !b[i];
+}
+
+std::string quote(const std::string& s) {
+    std::string out = "'";
+    for (char ch : s) {
+        out += ch;
+        if (ch == '\'') out += '\'';
+    }
+    return out + "'";
+}
+
+const char* op_text(SqlExpr::Op op) {
+    switch (op) {
+    case SqlExpr::Eq: return "=";
+    case SqlExpr::Ne: return "!=";
+    case SqlExpr::Lt: return "<";
+    case SqlExpr::Le: return "<=";
+    case SqlExpr::Gt: return ">";
+    case SqlExpr::Ge: return ">=";
+    case SqlExpr::Between: return "BETWEEN";
+    }
+    return "?";
+}
+
+struct Token {
+    enum Type { Word, Number, String, Symbol } type;
+    std::string text;
+    uint64_t number = 0;
+};
+
+// Recursive descent over the grammar in query.h; NOT binds tighter than
+// AND, which binds tighter than OR.
+class SqlParser {
+public:
+    explicit SqlParser(const std::string& sql) { Tokenize(sql); }
+
+    SqlQuery Parse() {
+        SqlQuery q;
+        q.explain = AcceptWord("EXPLAIN");
+        ExpectWord("SELECT");
+        if (AcceptSymbol("*")) {
+            q.select.assign(std::begin(kAllColumns), std::end(kAllColumns) - 1);   // cluster on request only
+        } else if (AcceptWord("COUNT")) {
+            ExpectSymbol("(");
+            ExpectSymbol("*");
+            ExpectSymbol(")");
+            q.count = true;
+        } else {
+            do q.select.push_back(Column());
+            while (AcceptSymbol(","));
+        }
+        ExpectWord("FROM");
+        ExpectWord("images");
+        if (AcceptWord("WHERE")) q.where = Expr();
+        if (AcceptWord("ORDER")) {
+            ExpectWord("BY");
+            q.ordered = true;
+            q.order_by = Column();
+            if (AcceptWord("DESC")) q.descending = true;
+            else AcceptWord("ASC");
+        }
+        if (AcceptWord("LIMIT")) {
+            q.limit = Number();
+            if (AcceptWord("OFFSET")) q.offset = Number();
+        }
+        if (pos_ != toks_.size()) Fail();
+        return q;
+    }
+
+private:
+    void Tokenize(const std::string& s) {
+        for (size_t i = 0; i < s.size();) {
+            const unsigned char ch = static_cast<unsigned char>(s[i]);
+            if (std::isspace(ch)) {
+                ++i;
+            } else if (std::isalpha(ch) || ch == '_') {
+                size_t j = i;
+                while (j < s.size() && (std::isalnum(static_cast<unsigned char>(s[j])) || s[j] == '_')) ++j;
+                toks_.push_back({Token::Word, s.substr(i, j - i)});
+                i = j;
+            } else if (std::isdigit(ch)) {
+                Token t{Token::Number, ""};
+                for (; i < s.size() && std::isdigit(static_cast<unsigned char>(s[i])); ++i) {
+                    const uint64_t d = static_cast<uint64_t>(s[i] - '0');
+                    if (t.number > (UINT64_MAX - d) / 10) throw std::invalid_argument("number out of range in query");
+                    t.number = t.number * 10 + d;
+                    t.text += s[i];
+                }
+                toks_.push_back(std::move(t));
+            } else if (ch == '\'') {
+                Token t{Token::String, ""};
+                for (++i;; ++i) {
+                    if (i == s.size()) throw std::invalid_argument("unterminated string in query");
+                    if (s[i] == '\'') {
+                        if (i + 1 < s.size() && s[i + 1] == '\'') ++i;
+                        else break;
+                    }
+                    t.text += s[i];
+                }
+                ++i;
+                toks_.push_back(std::move(t));
+            } else {
+                static const char* const kSymbols[] = {"<=", ">=", "<>", "!=", "=", "<", ">", "(", ")", ",", "*"};
+                const char* sym = nullptr;
+                for (const char* k : kSymbols) {
+                    if (s.compare(i, std::char_traits<char>::length(k), k) == 0) {
+                        sym = k;
+                        break;
+                    }
+                }
+                if (!sym) throw std::invalid_argument(std::string("unexpected '") + s[i] + "' in query");
+                toks_.push_back({Token::Symbol, sym});
+                i += std::char_traits<char>::length(sym);
+            }
+        }
+    }
+
+    [[noreturn]] void Fail() const {
+        if (pos_ == toks_.size()) throw std::invalid_argument("query ends unexpectedly");
+        throw std::invalid_argument("unexpected '" + toks_[pos_].text + "' in query");
+    }
+
+    bool AcceptWord(const char* word) {
+        if (pos_ < toks_.size() && toks_[pos_].type == Token::Word && iequals(toks_[pos_].text, word)) {
+            ++pos_;
+            return true;
+        }
+        return false;
+    }
+
+    bool AcceptSymbol(const char* sym) {
+        if (pos_ < toks_.size() && toks_[pos_].type == Token::Symbol && toks_[pos_].text == sym) {
+            ++pos_;
+            return true;
+        }
+        return false;
+    }
+
+    void ExpectWord(const char* word) {
+        if (!AcceptWord(word)) Fail();
+    }
+
+    void ExpectSymbol(const char* sym) {
+        if (!AcceptSymbol(sym)) Fail();
+    }
+
+    SqlColumn Column() {
+        if (pos_ < toks_.size() && toks_[pos_].type == Token::Word) {
+            for (SqlColumn c : kAllColumns) {
+                if (iequals(toks_[pos_].text, sql_column_name(c))) {
+                    ++pos_;
+                    return c;
+                }
+            }
+        }
+        Fail();
+    }
+
+    uint64_t Number() {
+        if (pos_ == toks_.size() || toks_[pos_].type != Token::Number) Fail();
+        return toks_[pos_++].number;
+    }
+
+    std::string String() {
+        if (pos_ == toks_.size() || toks_[pos_].type != Token::String) Fail();
+        return toks_[pos_++].text;
+    }
+
+    std::unique_ptr<SqlExpr> Node(SqlExpr::Kind kind, std::unique_ptr<SqlExpr> l, std::unique_ptr<SqlExpr> r) {
+        auto e = std::make_unique<SqlExpr>();
+        e->kind = kind;
+        e->left = std::move(l);
+        e->right = std::move(r);
+        return e;
+    }
+
+    std::unique_ptr<SqlExpr> Expr() {
+        std::unique_ptr<SqlExpr> e = Term();
+        while (AcceptWord("OR")) e = Node(SqlExpr::Or, std::move(e), Term());
+        return e;
+    }
+
+    std::unique_ptr<SqlExpr> Term() {
+        std::unique_ptr<SqlExpr> e = Factor();
+        while (AcceptWord("AND")) e = Node(SqlExpr::And, std::move(e), Factor());
+        return e;
+    }
+
+    std::unique_ptr<SqlExpr> Factor() {
+        if (AcceptWord("NOT")) return Node(SqlExpr::Not, Factor(), nullptr);
+        if (AcceptSymbol("(")) {
+            std::unique_ptr<SqlExpr> e = Expr();
+            ExpectSymbol(")");
+            return e;
+        }
+        auto e = std::make_unique<SqlExpr>();
+        if (AcceptWord("tags")) {
+            ExpectWord("MATCH");
+            e->kind = SqlExpr::Match;
+            e->text = String();
+            return e;
+        }
+        e->column = Column();
+        const bool is_string = sql_column_is_string(e->column);
+        if (AcceptWord("BETWEEN")) {
+            if (is_string) Fail();
+            e->op = SqlExpr::Between;
+            e->lo = Number();
+            ExpectWord("AND");
+            e->hi = Number();
+            return e;
+        }
+        static const std::pair<const char*, SqlExpr::Op> kOps[] = {
+            {"=", SqlExpr::Eq}, {"!=", SqlExpr::Ne}, {"<>", SqlExpr::Ne}, {"<", SqlExpr::Lt},
+            {"<=", SqlExpr::Le}, {">", SqlExpr::Gt}, {">=", SqlExpr::Ge},
+        };
+        bool have_op = false;
+        for (const auto& [sym, op] : kOps) {
+            if (AcceptSymbol(sym)) {
+                e->op = op;
+                have_op = true;
+                break;
+            }
+        }
+        if (!have_op) Fail();
+        if (is_string) e->text = String();
+        else e->lo = e->hi = Number();
+        return e;
+    }
+
+    std::vector<Token> toks_;
+    size_t pos_ = 0;
+};
+
+// Selection-vector kernels: each compacts the row ids in sel[0, n) to the
+// ones that pass and returns how many did. Branch-free, so their cost does
+// not depend on selectivity.
+template <typename T>
+size_t keep_range(const T* col, uint32_t* sel, size_t n, uint64_t lo, uint64_t hi) {
+    if (lo > hi) return 0;
+    const uint64_t span = hi - lo;
+    size_t k = 0;
+    for (size_t i = 0; i < n; ++i) {
+        const uint32_t r = sel[i];
+        sel[k] = r;
+        k += static_cast<uint64_t>(col[r]) - lo <= span;
+    }
+    return k;
+}
+
+template <typename T>
+size_t keep_not_equal(const T* col, uint32_t* sel, size_t n, uint64_t v) {
+    size_t k = 0;
+    for (size_t i = 0; i < n; ++i) {
+        const uint32_t r = sel[i];
+        sel[k] = r;
+        k += static_cast<uint64_t>(col[r]) != v;
+    }
+    return k;
+}
+
+template <typename Pred>
+size_t keep_if(uint32_t* sel, size_t n, Pred pred) {
+    size_t k = 0;
+    for (size_t i = 0; i < n; ++i) {
+        const uint32_t r = sel[i];
+        sel[k] = r;
+        k += pred(r) ? 1 : 0;
+    }
+    return k;
+}
+
+bool compare_holds(int c, SqlExpr::Op op) {
+    switch (op) {
+    case SqlExpr::Eq: return c == 0;
+    case SqlExpr::Ne: return c != 0;
+    case SqlExpr::Lt: return c < 0;
+    case SqlExpr::Le: return c <= 0;
+    case SqlExpr::Gt: return c > 0;
+    case SqlExpr::Ge: return c >= 0;
+    case SqlExpr::Between: break;
+    }
+    return false;
+}
+
+// Every numeric comparison but != as a closed range [lo, hi]; false when
+// nothing can match.
+bool compare_range(const SqlExpr& e, uint64_t* lo, uint64_t* hi) {
+    *lo = 0;
+    *hi = UINT64_MAX;
+    switch (e.op) {
+    case SqlExpr::Eq: *lo = *hi = e.lo; break;
+    case SqlExpr::Lt:
+        if (e.lo == 0) return false;
+        *hi = e.lo - 1;
+        break;
+    case SqlExpr::Le: *hi = e.lo; break;
+    case SqlExpr::Gt:
+        if (e.lo == UINT64_MAX) return false;
+        *lo = e.lo + 1;
+        break;
+    case SqlExpr::Ge: *lo = e.lo; break;
+    case SqlExpr::Between: *lo = e.lo, *hi = e.hi; break;
+    case SqlExpr::Ne: break;
+    }
+    return *lo <= *hi;
+}
+
+bool projected(SqlColumn c, NumColumn* out) {
+    switch (c) {
+    case SqlColumn::Width: *out = NumColumn::Width; return true;
+    case SqlColumn::Height: *out = NumColumn::Height; return true;
+    case SqlColumn::Bytes: *out = NumColumn::Bytes; return true;
+    case SqlColumn::CreatedAt: *out = NumColumn::CreatedAt; return true;
+    default: return false;
+    }
+}
+
+bool expr_uses(const SqlExpr* e, SqlColumn c) {
+    if (!e) return false;
+    if (e->kind == SqlExpr::Compare) return e->column == c;
+    return expr_uses(e->left.get(), c) || expr_uses(e->right.get(), c);
+}
+
+void collect_terms(const SqlExpr* e, std::vector<const SqlExpr*>* out) {
+    if (e->kind == SqlExpr::And) {
+        collect_terms(e->left.get(), out);
+        collect_terms(e->right.get(), out);
+    } else {
+        out->push_back(e);
+    }
+}
+
+size_t saturating_add(size_t a, size_t b) { return a > SIZE_MAX - b ? SIZE_MAX : a + b; }
+
+} // namespace
+
+const char* sql_column_name(SqlColumn c) {
+    switch (c) {
+    case SqlColumn::ImageId: return "image_id";
+    case SqlColumn::Sha256: return "sha256";
+    case SqlColumn::Mime: return "mime";
+    case SqlColumn::Width: return "width";
+    case SqlColumn::Height: return "height";
+    case SqlColumn::Bytes: return "bytes";
+    case SqlColumn::CreatedAt: return "created_at";
+    case SqlColumn::Ordinal: return "ordinal";
+    case SqlColumn::Cluster: return "cluster";
+    }
+    return "?";
+}
+
+bool sql_column_is_string(SqlColumn c) {
+    return c == SqlColumn::ImageId || c == SqlColumn::Sha256 || c == SqlColumn::Mime;
+}
+
+SqlQuery parse_sql(const std::string& sql) {
+    return SqlParser(sql).Parse();
+}
+
+bool sql_query_uses(const SqlQuery& q, SqlColumn c) {
+    return std::find(q.select.begin(), q.select.end(), c) != q.select.end() || (q.ordered && q.order_by == c) ||
+           expr_uses(q.where.get(), c);
+}
+
+std::string sql_expr_string(const SqlExpr& e) {
+    switch (e.kind) {
+    case SqlExpr::And: return "(" + sql_expr_string(*e.left) + " AND " + sql_expr_string(*e.right) + ")";
+    case SqlExpr::Or: return "(" + sql_expr_string(*e.left) + " OR " + sql_expr_string(*e.right) + ")";
+    case SqlExpr::Not: return "NOT " + sql_expr_string(*e.left);
+    case SqlExpr::Match: return "tags MATCH " + quote(e.text);
+    case SqlExpr::Compare: break;
+    }
+    std::string s = std::string(sql_column_name(e.column)) + " " + op_text(e.op) + " ";
+    if (e.op == SqlExpr::Between) return s + std::to_string(e.lo) + " AND " + std::to_string(e.hi);
+    return s + (sql_column_is_string(e.column) ? quote(e.text) : std::to_string(e.lo));
+}
+
+CatalogColumns CatalogColumns::Build(const std::vector<ImageMeta>& records) {
+    CatalogColumns c;
+    const size_t n = records.size();
+    for (auto* col : {&c.image_id, &c.sha256}) col->reserve(n);
+    for (auto* col : {&c.width, &c.height, &c.ordinal, &c.cluster}) col->reserve(n);
+    for (auto* col : {&c.bytes, &c.created_at}) col->reserve(n);
+    c.mime.reserve(n);
+    c.row_of.reserve(n ? static_cast<size_t>(records.back().ordinal) + 1 : 0);
+    for (const ImageMeta& m : records) c.Append(m);
+    return c;
+}
+
+CatalogColumns CatalogColumns::FromProjection(const ColumnStore& store) {
+    CatalogColumns c;
+    const size_t n = store.size();
+    c.width.assign(store.width(), store.width() + n);
+    c.height.assign(store.height(), store.height() + n);
+    c.bytes.assign(store.bytes(), store.bytes() + n);
+    c.created_at.assign(store.created_at(), store.created_at() + n);
+    c.cluster.assign(n, kNoCluster);
+    c.ordinal.reserve(n);
+    for (size_t row = 0; row < n; ++row) {
+        const uint32_t o = store.ordinal(row);
+        while (c.row_of.size() < o) c.row_of.push_back(OrdinalMap::kNone);
+        c.row_of.push_back(static_cast<uint32_t>(row));
+        c.ordinal.push_back(o);
+    }
+    return c;
+}
+
+uint16_t CatalogColumns::MimeCode(const std::string& mime) {
+    const auto it = std::find(mime_dict.begin(), mime_dict.end(), mime);
+    if (it != mime_dict.end()) return static_cast<uint16_t>(it - mime_dict.begin());
+    if (mime_dict.size() > UINT16_MAX) throw std::runtime_error("CatalogColumns: too many distinct mime types");
+    mime_dict.push_back(mime);
+    return static_cast<uint16_t>(mime_dict.size() - 1);
+}
+
+void CatalogColumns::Append(const ImageMeta& m, uint32_t cluster_id) {
+    const uint32_t row = static_cast<uint32_t>(size());
+    while (row_of.size() < m.ordinal) row_of.push_back(OrdinalMap::kNone);
+    row_of.push_back(row);
+    image_id.push_back(m.image_id);
+    sha256.push_back(m.sha256);
+    mime.push_back(MimeCode(m.mime));
+    width.push_back(m.width);
+    height.push_back(m.height);
+    ordinal.push_back(m.ordinal);
+    bytes.push_back(m.bytes);
+    created_at.push_back(m.created_unix);
+    cluster.push_back(cluster_id);
+}
+
+void CatalogColumns::Set(const ImageMeta& m) {
+    // Only the fields that changed: each set() may copy a shared column.
+    const uint32_t r = row(m.ordinal);
+    auto update = [r](auto& col, const auto& v) {
+        if (col[r] != v) col.set(r, v);
+    };
+    update(image_id, m.image_id);
+    update(sha256, m.sha256);
+    update(mime, MimeCode(m.mime));
+    update(width, m.width);
+    update(height, m.height);
+    update(bytes, m.bytes);
+    update(created_at, m.created_unix);
+}
+
+void CatalogColumns::SetClusters(const std::vector<uint32_t>& ordinals, const std::vector<uint32_t>& clusters) {
+    for (size_t i = 0; i < ordinals.size(); ++i) {
+        const uint32_t r = row(ordinals[i]);
+        if (r != OrdinalMap::kNone) cluster.set(r, clusters[i]);
+    }
+}
+
+namespace {
+
+// EXPLAIN's note on rows an on-disk index did not cover yet.
+std::string unindexed_note(size_t rows) {
+    return rows ? ", " + std::to_string(rows) + " newer rows checked directly" : "";
+}
+
+} // namespace
+
+struct QueryEngine::Plan {
+    bool indexed = false;
+    std::vector<uint32_t> candidates;               // sorted rows, when indexed
+    std::vector<std::string> index_scans;           // EXPLAIN lines
+    std::vector<const SqlExpr*> residual;           // AND terms left to filter
+    std::unordered_map<const SqlExpr*, RoaringBitmap> probes;   // Match terms inside residual
+    bool natural = true;                            // output order is row order
+    size_t keep = SIZE_MAX;                         // rows needed before OFFSET/LIMIT trimming
+};
+
+QueryEngine::Plan QueryEngine::MakePlan(const SqlQuery& q) const {
+    Plan plan;
+    std::vector<const SqlExpr*> terms;
+    if (q.where) collect_terms(q.where.get(), &terms);
+
+    const uint32_t universe = static_cast<uint32_t>(cols_.row_of.size());
+    auto rows_of = [&](const RoaringBitmap& ords) {
+        std::vector<uint32_t> rows;
+        for (uint32_t o : ords.ToVector()) {
+            if (cols_.row(o) != OrdinalMap::kNone) rows.push_back(cols_.row(o));
+        }
+        return rows;
+    };
+
+    // On-disk indexes end at some ordinal; rows from the first one past it
+    // on are checked against the term directly.
+    auto first_row_from = [&](uint32_t end) {
+        return static_cast<size_t>(std::lower_bound(cols_.ordinal.begin(), cols_.ordinal.end(), end) -
+                                   cols_.ordinal.begin());
+    };
+    // `rows` (ascending) that pass term t, filtered a batch at a time.
+    auto filter_rows = [&](const SqlExpr& t, std::vector<uint32_t> rows) {
+        size_t kept = 0;
+        for (size_t base = 0; base < rows.size(); base += kBatch) {
+            const size_t n = Filter(plan, t, &rows[base], std::min(kBatch, rows.size() - base));
+            std::copy_n(&rows[base], n, &rows[kept]);
+            kept += n;
+        }
+        rows.resize(kept);
+        return rows;
+    };
+    auto unindexed = [&](const SqlExpr& t, size_t first) {
+        std::vector<uint32_t> rows(cols_.size() - first);
+        std::iota(rows.begin(), rows.end(), static_cast<uint32_t>(first));
+        return filter_rows(t, std::move(rows));
+    };
+    const ColumnStore* projection = idx_.columns && idx_.columns->size() ? idx_.columns : nullptr;
+    const uint32_t projection_end = projection ? projection->ordinal(projection->size() - 1) + 1 : 0;
+
+    // Every term an index answers exactly is taken off the filter.
+    std::vector<const SqlExpr*> ranged;
+    auto intersect = [&](std::vector<uint32_t> rows) {
+        if (!plan.indexed) {
+            plan.candidates = std::move(rows);
+        } else {
+            std::vector<uint32_t> both;
+            std::set_intersection(plan.candidates.begin(), plan.candidates.end(), rows.begin(), rows.end(),
+                                  std::back_inserter(both));
+            plan.candidates = std::move(both);
+        }
+        plan.indexed = true;
+    };
+    for (const SqlExpr* t : terms) {
+        std::vector<uint32_t> rows;
+        const char* index = nullptr;
+        NumColumn nc;
+        if (projection && t->kind == SqlExpr::Compare && t->op != SqlExpr::Ne && projected(t->column, &nc)) {
+            ranged.push_back(t);
+            continue;
+        } else if (t->kind == SqlExpr::Compare && t->column == SqlColumn::ImageId && t->op == SqlExpr::Eq &&
+                   (idx_.find_id || idx_.ordinals)) {
+            const uint32_t o = idx_.find_id ? idx_.find_id(t->text) : idx_.ordinals->Find(t->text);
+            if (cols_.row(o) != OrdinalMap::kNone) rows.push_back(cols_.row(o));
+            index = idx_.find_id ? "id index" : "ordinals";
+        } else if (t->kind == SqlExpr::Match && idx_.tags) {
+            rows = rows_of(idx_.tags->Query(t->text, universe));
+            index = "tag postings";
+        } else {
+            plan.residual.push_back(t);
+            continue;
+        }
+        plan.index_scans.push_back("IndexScan " + std::string(index) + ": " + sql_expr_string(*t) + " (" +
+                                   std::to_string(rows.size()) + " rows)");
+        intersect(std::move(rows));
+    }
+
+    // The most selective created_at or bytes range, if its tree expects few
+    // rows, is read from the tree: a descent plus the matching leaves
+    // instead of a pass over the column. A tree covers the projection rows
+    // it was synced to, so its end is found through the projection.
+    const BTree* best_tree = nullptr;
+    size_t best = SIZE_MAX;
+    uint64_t best_est = UINT64_MAX;
+    uint32_t best_end = 0;
+    for (size_t i = 0; i < ranged.size(); ++i) {
+        const SqlExpr* t = ranged[i];
+        const BTree* tree = t->column == SqlColumn::CreatedAt ? idx_.created_at
+                            : t->column == SqlColumn::Bytes   ? idx_.bytes
+                                                              : nullptr;
+        uint64_t lo, hi;
+        if (!tree || !compare_range(*t, &lo, &hi)) continue;
+        const size_t synced = std::min<size_t>(tree->synced_rows(), projection->size());
+        const uint32_t end = synced ? projection->ordinal(synced - 1) + 1 : 0;
+        const uint64_t est = tree->Estimate(lo, hi) + (cols_.size() - first_row_from(end));
+        if (est < best_est) best_tree = tree, best = i, best_est = est, best_end = end;
+    }
+    if (best_tree && best_est * 32 < cols_.size()) {
+        const SqlExpr* t = ranged[best];
+        ranged.erase(ranged.begin() + static_cast<std::ptrdiff_t>(best));
+        uint64_t lo, hi;
+        compare_range(*t, &lo, &hi);
+        size_t pages = 0;
+        std::vector<uint32_t> rows;
+        for (uint32_t o : best_tree->Range(lo, hi, &pages)) {
+            if (o < best_end && cols_.row(o) != OrdinalMap::kNone) rows.push_back(cols_.row(o));
+        }
+        std::sort(rows.begin(), rows.end());
+        const size_t first = first_row_from(best_end);
+        const std::vector<uint32_t> tail = unindexed(*t, first);
+        rows.insert(rows.end(), tail.begin(), tail.end());
+        plan.index_scans.push_back(std::string("IndexScan ") + sql_column_name(t->column) + " btree: " + sql_expr_string(*t) +
+                                   " (" + std::to_string(rows.size()) + " rows, " + std::to_string(pages) +
+                                   " pages" + unindexed_note(cols_.size() - first) + ")");
+        intersect(std::move(rows));
+    }
+
+    // Numeric ranges go to the projection together, unless the indexes
+    // above already left so few rows that filtering them is cheaper.
+    if (!ranged.empty() && plan.indexed && plan.candidates.size() * 16 < cols_.size()) {
+        plan.residual.insert(plan.residual.end(), ranged.begin(), ranged.end());
+    } else if (!ranged.empty()) {
+        std::vector<ColumnRange> ranges;
+        std::string text;
+        for (const SqlExpr* t : ranged) {
+            ColumnRange r{NumColumn::Width, 1, 0};
+            projected(t->column, &r.column);
+            if (!compare_range(*t, &r.lo, &r.hi)) r.lo = 1, r.hi = 0;
+            ranges.push_back(r);
+            text += (text.empty() ? "" : " AND ") + sql_expr_string(*t);
+        }
+        ScanStats stats;
+        std::vector<uint32_t> rows;
+        for (uint32_t r : projection->Select(ranges, &stats)) {
+            const uint32_t row = cols_.row(projection->ordinal(r));
+            if (row != OrdinalMap::kNone) rows.push_back(row);
+        }
+        // Rows past the projection pass every range or are dropped.
+        const size_t first = first_row_from(projection_end);
+        std::vector<uint32_t> tail = unindexed(*ranged[0], first);
+        for (size_t i = 1; i < ranged.size(); ++i) tail = filter_rows(*ranged[i], std::move(tail));
+        rows.insert(rows.end(), tail.begin(), tail.end());
+        plan.index_scans.push_back("ColumnScan zone maps: " + text + " (" + std::to_string(rows.size()) +
+                                   " rows; skipped " + std::to_string(stats.skipped) + " of " +
+                                   std::to_string(stats.blocks) + " blocks, " + std::to_string(stats.whole) +
+                                   " matched whole" + unindexed_note(cols_.size() - first) + ")");
+        intersect(std::move(rows));
+    }
+
+    // Tag matches under OR/NOT are resolved to one bitmap up front and
+    // probed per row.
+    std::vector<const SqlExpr*> stack(plan.residual.begin(), plan.residual.end());
+    while (!stack.empty()) {
+        const SqlExpr* e = stack.back();
+        stack.pop_back();
+        if (e->kind == SqlExpr::Match) {
+            if (!idx_.tags) throw std::invalid_argument("tags MATCH needs a tag store");
+            plan.probes.emplace(e, idx_.tags->Query(e->text, universe));
+        }
+        if (e->left) stack.push_back(e->left.get());
+        if (e->right) stack.push_back(e->right.get());
+    }
+
+    // Rows are stored in ordinal order, so that order needs no sort and a
+    // LIMIT can end the scan early.
+    plan.natural = !q.ordered || (q.order_by == SqlColumn::Ordinal && !q.descending);
+    plan.keep = saturating_add(q.offset, q.limit);
+    return plan;
+}
+
+size_t QueryEngine::Filter(const Plan& plan, const SqlExpr& e, uint32_t* sel, size_t n) const {
+    switch (e.kind) {
+    case SqlExpr::And:
+        n = Filter(plan, *e.left, sel, n);
+        return Filter(plan, *e.right, sel, n);
+    case SqlExpr::Or: {
+        uint32_t a[kBatch], b[kBatch];
+        std::copy_n(sel, n, a);
+        std::copy_n(sel, n, b);
+        const size_t na = Filter(plan, *e.left, a, n);
+        const size_t nb = Filter(plan, *e.right, b, n);
+        return static_cast<size_t>(std::set_union(a, a + na, b, b + nb, sel) - sel);
+    }
+    case SqlExpr::Not: {
+        uint32_t in[kBatch], hit[kBatch];
+        std::copy_n(sel, n, in);
+        std::copy_n(sel, n, hit);
+        const size_t nh = Filter(plan, *e.left, hit, n);
+        return static_cast<size_t>(std::set_difference(in, in + n, hit, hit + nh, sel) - sel);
+    }
+    case SqlExpr::Match: {
+        const RoaringBitmap& bits = plan.probes.at(&e);
+        return keep_if(sel, n, [&](uint32_t r) { return bits.Contains(cols_.ordinal[r]); });
+    }
+    case SqlExpr::Compare: break;
+    }
+
+    if (sql_column_is_string(e.column)) {
+        if (e.column == SqlColumn::Mime && (e.op == SqlExpr::Eq || e.op == SqlExpr::Ne)) {
+            const auto it = std::find(cols_.mime_dict.begin(), cols_.mime_dict.end(), e.text);
+            if (it == cols_.mime_dict.end()) return e.op == SqlExpr::Eq ? 0 : n;
+            const uint64_t code = static_cast<uint64_t>(it - cols_.mime_dict.begin());
+            return e.op == SqlExpr::Eq ? keep_range(cols_.mime.data(), sel, n, code, code)
+                                       : keep_not_equal(cols_.mime.data(), sel, n, code);
+        }
+        return keep_if(sel, n, [&](uint32_t r) { return compare_holds(StringValue(e.column, r).compare(e.text), e.op); });
+    }
+
+    uint64_t lo, hi;
+    if (e.op != SqlExpr::Ne && !compare_range(e, &lo, &hi)) return 0;
+    auto run = [&](const auto* col) {
+        return e.op == SqlExpr::Ne ? keep_not_equal(col, sel, n, e.lo) : keep_range(col, sel, n, lo, hi);
+    };
+    switch (e.column) {
+    case SqlColumn::Width: return run(cols_.width.data());
+    case SqlColumn::Height: return run(cols_.height.data());
+    case SqlColumn::Bytes: return run(cols_.bytes.data());
+    case SqlColumn::CreatedAt: return run(cols_.created_at.data());
+    case SqlColumn::Ordinal: return run(cols_.ordinal.data());
+    case SqlColumn::Cluster: return run(cols_.cluster.data());
+    default: return 0;
+    }
+}
+
+std::string_view QueryEngine::StringValue(SqlColumn c, uint32_t row) const {
+    switch (c) {
+    case SqlColumn::ImageId:
+        if (!cols_.image_id.empty()) return cols_.image_id[row];
+        return idx_.ordinals->image_id(cols_.ordinal[row]);
+    case SqlColumn::Sha256: return cols_.sha256[row];
+    case SqlColumn::Mime: return cols_.mime_dict[cols_.mime[row]];
+    default: return {};
+    }
+}
+
+QueryResult QueryEngine::Run(const SqlQuery& q) const {
+    const Plan plan = MakePlan(q);
+    QueryResult r;
+    const size_t total = plan.indexed ? plan.candidates.size() : cols_.size();
+    const bool live_only = idx_.deleted && !idx_.deleted->empty();
+    if (q.count && plan.residual.empty() && !live_only) {
+        r.count = total;
+        return r;
+    }
+
+    const size_t stop = plan.natural && !q.count ? plan.keep : SIZE_MAX;
+    // Rows of the batch at `base` that pass every residual term.
+    auto filter_batch = [&](size_t base, uint32_t* sel) {
+        size_t n = std::min(kBatch, total - base);
+        if (plan.indexed) std::copy_n(&plan.candidates[base], n, sel);
+        else std::iota(sel, sel + n, static_cast<uint32_t>(base));
+        for (const SqlExpr* t : plan.residual) n = Filter(plan, *t, sel, n);
+        if (live_only) n = keep_if(sel, n, [&](uint32_t r) { return !idx_.deleted->Contains(cols_.ordinal[r]); });
+        return n;
+    };
+    if (idx_.pool && stop == SIZE_MAX && total >= kParallelRows) {
+        // Nothing stops the scan early, so every batch can be filtered at
+        // once; results are concatenated in batch order.
+        const size_t batches = (total + kBatch - 1) / kBatch;
+        std::vector<std::vector<uint32_t>> kept(q.count ? 0 : batches);
+        std::vector<uint64_t> counts(batches);
+        idx_.pool->ParallelFor(batches, kParallelRows / kBatch, [&](size_t first, size_t last) {
+            uint32_t sel[kBatch];
+            for (size_t b = first; b < last; ++b) {
+                const size_t n = filter_batch(b * kBatch, sel);
+                counts[b] = n;
+                if (!q.count) kept[b].assign(sel, sel + n);
+            }
+        }, TaskPriority::High);
+        for (size_t b = 0; b < batches; ++b) {
+            if (q.count) r.count += counts[b];
+            else r.rows.insert(r.rows.end(), kept[b].begin(), kept[b].end());
+        }
+    } else {
+        uint32_t sel[kBatch];
+        for (size_t base = 0; base < total && r.rows.size() < stop; base += kBatch) {
+            const size_t n = filter_batch(base, sel);
+            if (q.count) r.count += n;
+            else r.rows.insert(r.rows.end(), sel, sel + n);
+        }
+    }
+    if (q.count) return r;
+
+    if (!plan.natural) {
+        const SqlColumn c = q.order_by;
+        auto before = [&](uint32_t a, uint32_t b) {
+            int cmp;
+            if (sql_column_is_string(c)) {
+                cmp = StringValue(c, a).compare(StringValue(c, b));
+            } else {
+                uint64_t x = 0, y = 0;
+                switch (c) {
+                case SqlColumn::Width: x = cols_.width[a], y = cols_.width[b]; break;
+                case SqlColumn::Height: x = cols_.height[a], y = cols_.height[b]; break;
+                case SqlColumn::Bytes: x = cols_.bytes[a], y = cols_.bytes[b]; break;
+                case SqlColumn::CreatedAt: x = cols_.created_at[a], y = cols_.created_at[b]; break;
+                case SqlColumn::Ordinal: x = cols_.ordinal[a], y = cols_.ordinal[b]; break;
+                case SqlColumn::Cluster: x = cols_.cluster[a], y = cols_.cluster[b]; break;
+                default: break;
+                }
+                cmp = x < y ? -1 : x > y;
+            }
+            if (cmp != 0) return q.descending ? cmp > 0 : cmp < 0;
+            return a < b;
+        };
+        if (plan.keep < r.rows.size()) {
+            std::nth_element(r.rows.begin(), r.rows.begin() + static_cast<std::ptrdiff_t>(plan.keep), r.rows.end(), before);
+            r.rows.resize(plan.keep);
+        }
+        std::sort(r.rows.begin(), r.rows.end(), before);
+    }
+
+    r.rows.erase(r.rows.begin(), r.rows.begin() + static_cast<std::ptrdiff_t>(std::min(q.offset, r.rows.size())));
+    if (r.rows.size() > q.limit) r.rows.resize(q.limit);
+    return r;
+}
+
+std::string QueryEngine::Explain(const SqlQuery& q) const {
+    const Plan plan = MakePlan(q);
+    const uint64_t deleted = idx_.deleted ? idx_.deleted->Cardinality() : 0;
+    std::vector<std::string> ops;
+    if (q.count) {
+        ops.push_back(plan.residual.empty() && !deleted ? "Count (from the row set, no scan)" : "Count");
+    } else {
+        std::string cols;
+        for (SqlColumn c : q.select) cols += (cols.empty() ? "" : ", ") + std::string(sql_column_name(c));
+        ops.push_back("Project " + cols);
+        if (q.limit != SIZE_MAX || q.offset) {
+            std::string limit = "Limit " + (q.limit == SIZE_MAX ? std::string("all") : std::to_string(q.limit)) +
+                                " offset " + std::to_string(q.offset);
+            if (plan.natural && plan.keep != SIZE_MAX) limit += " (stops the scan at " + std::to_string(plan.keep) + " rows)";
+            ops.push_back(limit);
+        }
+        if (!plan.natural) {
+            const std::string key = std::string(sql_column_name(q.order_by)) + (q.descending ? " DESC" : " ASC");
+            ops.push_back(plan.keep != SIZE_MAX ? "TopN " + key + " (keeps " + std::to_string(plan.keep) + " rows)"
+                                                : "Sort " + key);
+        }
+    }
+    if (deleted) ops.push_back("Skip deleted (" + std::to_string(deleted) + " ordinals)");
+    if (!plan.residual.empty()) {
+        std::string terms;
+        for (const SqlExpr* t : plan.residual) terms += (terms.empty() ? "" : " AND ") + sql_expr_string(*t);
+        ops.push_back("Filter " + terms + " (" + std::to_string(kBatch) + "-row batches" +
+                      (plan.probes.empty() ? ")" : ", tag bitmap probes)"));
+    }
+    if (plan.index_scans.size() > 1) {
+        ops.push_back("Intersect (" + std::to_string(plan.candidates.size()) + " rows)");
+    }
+    if (plan.indexed) ops.insert(ops.end(), plan.index_scans.begin(), plan.index_scans.end());
+    else ops.push_back("FullScan images (" + std::to_string(cols_.size()) + " rows)");
+
+    // Each operator feeds the one above it; intersected scans are siblings.
+    const size_t scans = plan.indexed ? plan.index_scans.size() : 1;
+    const size_t first_scan = ops.size() - scans;
+    std::string out;
+    for (size_t i = 0; i < ops.size(); ++i) {
+        out += std::string(2 * std::min(i, first_scan), ' ') + ops[i] + "\n";
+    }
+    return out;
+}
+
+void QueryEngine::Write(const SqlQuery& q, const QueryResult& r, std::ostream& out) const {
+    if (q.count) {
+        out << r.count << "\n";
+        return;
+    }
+    out << "#";
+    for (size_t i = 0; i < q.select.size(); ++i) out << (i ? "\t" : " ") << sql_column_name(q.select[i]);
+    out << "\n";
+    for (uint32_t row : r.rows) {
+        for (size_t i = 0; i < q.select.size(); ++i) {
+            if (i) out << "\t";
+            switch (q.select[i]) {
+            case SqlColumn::ImageId:
+            case SqlColumn::Sha256:
+            case SqlColumn::Mime: out << StringValue(q.select[i], row); break;
+            case SqlColumn::Width: out << cols_.width[row]; break;
+            case SqlColumn::Height: out << cols_.height[row]; break;
+            case SqlColumn::Bytes: out << cols_.bytes[row]; break;
+            case SqlColumn::CreatedAt: out << cols_.created_at[row]; break;
+            case SqlColumn::Ordinal: out << cols_.ordinal[row]; break;
+            case SqlColumn::Cluster:
+                if (cols_.cluster[row] == CatalogColumns::kNoCluster) out << "NULL";
+                else out << cols_.cluster[row];
+                break;
+            }
+        }
+        out << "\n";
+    }
+    out << "# " << r.rows.size() << " rows\n";
+}
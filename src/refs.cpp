@@ -0,0 +1,171 @@
+#include "refs.h"
+
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+// Holds an flock on a descriptor for the scope.
+class FileLock {
+public:
+    FileLock(int fd, int op) : fd_(fd) { ok_ = ::flock(fd_, op) == 0; }
+    ~FileLock() {
+        if (ok_) ::flock(fd_, LOCK_UN);
+    }
+    bool ok() const { return ok_; }
+
+private:
+    int fd_;
+    bool ok_;
+};
+
+void apply_line(const std::string& line, std::unordered_map<std::string, int64_t>* counts) {
+    if (line.size() < 2) return;
+    if (line[0] == '=') {
+        const size_t sp = line.find(' ');
+        if (sp == std::string::npos) return;
+        (*counts)[line.substr(1, sp - 1)] += std::stoll(line.substr(sp + 1));
+    } else if (line[0] == '+') {
+        ++(*counts)[line.substr(1)];
+    } else if (line[0] == '-') {
+        --(*counts)[line.substr(1)];
+    }
+}
+
+} // namespace
+
+BlobRefs BlobRefs::Open(const std::string& dir) {
+    std::error_code ec;
+    std::filesystem::create_directories(dir, ec);
+    if (ec) throw std::runtime_error("BlobRefs: cannot create " + dir);
+    BlobRefs r;
+    r.path_ = dir + "/refs.log";
+    return r;
+}
+
+bool BlobRefs::exists() const { return std::filesystem::exists(path_); }
+
+bool BlobRefs::Append(char op, const std::string& sha256) {
+    const std::string line = op + sha256 + "\n";
+    // Reopen if Compact() replaced the file between our open and lock.
+    for (;;) {
+        const int fd = ::open(path_.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+        if (fd < 0) break;
+        bool done = false, ok = false;
+        {
+            FileLock lock(fd, LOCK_SH);
+            struct stat a, b;
+            if (lock.ok() && ::fstat(fd, &a) == 0 && ::stat(path_.c_str(), &b) == 0) {
+                if (a.st_ino == b.st_ino) {
+                    done = true;
+                    ok = ::write(fd, line.data(), line.size()) == static_cast<ssize_t>(line.size());
+                    // Right behind what the counts cover: take it in
+                    // now. Otherwise someone appended in between, and
+                    // the next Count() reads both.
+                    const off_t pos = ok ? ::lseek(fd, 0, SEEK_CUR) : -1;
+                    if (pos > 0 && static_cast<uint64_t>(a.st_ino) == ino_ &&
+                        static_cast<uint64_t>(pos) == end_ + line.size()) {
+                        apply_line(line.substr(0, line.size() - 1), &counts_);
+                        end_ = static_cast<uint64_t>(pos);
+                    }
+                }
+            } else {
+                done = true;
+            }
+        }
+        ::close(fd);
+        if (done) {
+            if (ok) return true;
+            break;
+        }
+    }
+    std::cerr << "BlobRefs: cannot append to " << path_ << "\n";
+    return false;
+}
+
+std::unordered_map<std::string, int64_t> BlobRefs::Counts(uint64_t from, uint64_t* end) const {
+    std::unordered_map<std::string, int64_t> counts;
+    std::ifstream in(path_, std::ios::binary);
+    uint64_t pos = from;
+    if (in) {
+        in.seekg(static_cast<std::streamoff>(from));
+        // Only whole lines count; a torn last line is left for later.
+        for (std::string line; std::getline(in, line);) {
+            if (in.eof()) break;
+            apply_line(line, &counts);
+            pos += line.size() + 1;
+        }
+    }
+    if (end) *end = pos;
+    return counts;
+}
+
+void BlobRefs::CatchUp() const {
+    // Read through one descriptor, so a Compact() renaming a new log in
+    // meanwhile cannot mix two files.
+    const int fd = ::open(path_.c_str(), O_RDONLY);
+    struct stat st;
+    if (fd < 0 || ::fstat(fd, &st) != 0) {
+        if (fd >= 0) ::close(fd);
+        counts_.clear();
+        ino_ = end_ = 0;
+        return;
+    }
+    const uint64_t ino = static_cast<uint64_t>(st.st_ino), size = static_cast<uint64_t>(st.st_size);
+    if (ino != ino_ || size < end_) {
+        counts_.clear();
+        ino_ = ino;
+        end_ = 0;
+    }
+    std::string tail(size - end_, '\0');
+    const ssize_t got = tail.empty() ? 0 : ::pread(fd, tail.data(), tail.size(), static_cast<off_t>(end_));
+    ::close(fd);
+    if (got <= 0) return;
+    tail.resize(static_cast<size_t>(got));
+    // Only whole lines count; a torn last line is left for later.
+    size_t at = 0;
+    for (size_t nl; (nl = tail.find('\n', at)) != std::string::npos; at = nl + 1) {
+        apply_line(tail.substr(at, nl - at), &counts_);
+    }
+    end_ += at;
+}
+
+int64_t BlobRefs::Count(const std::string& sha256) const {
+    CatchUp();
+    const auto it = counts_.find(sha256);
+    return it == counts_.end() ? 0 : it->second;
+}
+
+bool BlobRefs::Compact(const std::unordered_map<std::string, int64_t>* seed) {
+    const int fd = ::open(path_.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+    if (fd < 0) {
+        std::cerr << "BlobRefs: cannot open " << path_ << "\n";
+        return false;
+    }
+    bool ok;
+    {
+        FileLock lock(fd, LOCK_EX);
+        const std::unordered_map<std::string, int64_t> counts = seed ? *seed : Counts();
+        const std::string tmp = path_ + ".tmp";
+        {
+            std::ofstream out(tmp, std::ios::trunc);
+            for (const auto& [sha, n] : counts) {
+                if (n > 0) out << '=' << sha << ' ' << n << '\n';
+            }
+            ok = lock.ok() && static_cast<bool>(out.flush());
+        }
+        std::error_code ec;
+        if (ok) std::filesystem::rename(tmp, path_, ec);
+        ok = ok && !ec;
+    }
+    ::close(fd);
+    if (!ok) std::cerr << "BlobRefs: cannot rewrite " << path_ << "\n";
+    return ok;
+}
@@ -0,0 +1,425 @@
+#include "roaring.h"
+
+#include <algorithm>
+#include <istream>
+#include <iterator>
+#include <ostream>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define IMGDB_X86 1
+#include <immintrin.h>
+#endif
+
+namespace {
+
+// Bitmap/bitmap results only become arrays when they are this sparse:
+// extracting a few thousand set bits costs more than the SIMD op itself,
+// and a result is usually consumed by another bitmap op or paged through.
+constexpr uint32_t kResultArrayMax = 512;
+
+enum class WordOp { And, Or, AndNot };
+
+template <WordOp op>
+uint64_t apply(uint64_t a, uint64_t b) {
+    if constexpr (op == WordOp::And) return a & b;
+    else if constexpr (op == WordOp::Or) return a | b;
+    else return a & ~b;
+}
+
+// out = a op b over kWords words; returns the popcount of out.
+template <WordOp op>
+uint32_t words_scalar(const uint64_t* a, const uint64_t* b, uint64_t* out) {
+    uint32_t card = 0;
+    for (uint32_t i = 0; i < RoaringBitmap::kWords; ++i) {
+        out[i] = apply<op>(a[i], b[i]);
+        card += static_cast<uint32_t>(__builtin_popcountll(out[i]));
+    }
+    return card;
+}
+
+#ifdef IMGDB_X86
+template <WordOp op>
+__attribute__((target("avx2,popcnt")))
+uint32_t words_avx2(const uint64_t* a, const uint64_t* b, uint64_t* out) {
+    uint64_t card = 0;
+    for (uint32_t i = 0; i < RoaringBitmap::kWords; i += 4) {
+        const __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + i));
+        const __m256i y = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + i));
+        __m256i r;
+        if constexpr (op == WordOp::And) r = _mm256_and_si256(x, y);
+        else if constexpr (op == WordOp::Or) r = _mm256_or_si256(x, y);
+        else r = _mm256_andnot_si256(y, x);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), r);
+        card += _mm_popcnt_u64(out[i]) + _mm_popcnt_u64(out[i + 1]) +
+                _mm_popcnt_u64(out[i + 2]) + _mm_popcnt_u64(out[i + 3]);
+    }
+    return static_cast<uint32_t>(card);
+}
+#endif
+
+using WordsFn = uint32_t (*)(const uint64_t*, const uint64_t*, uint64_t*);
+
+template <WordOp op>
+WordsFn pick_words() {
+#ifdef IMGDB_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("popcnt")) return words_avx2<op>;
+#endif
+    return words_scalar<op>;
+}
+
+template <WordOp op>
+uint32_t words(const uint64_t* a, const uint64_t* b, uint64_t* out) {
+    static const WordsFn fn = pick_words<op>();
+    return fn(a, b, out);
+}
+
+bool test_bit(const std::vector<uint64_t>& bits, uint16_t v) {
+    return (bits[v >> 6] >> (v & 63)) & 1;
+}
+
+} // namespace
+
+bool RoaringBitmap::Container::Contains(uint16_t lo) const {
+    if (is_bitmap()) return test_bit(bits, lo);
+    return std::binary_search(array.begin(), array.end(), lo);
+}
+
+void RoaringBitmap::Container::ToBitmap() {
+    bits.assign(kWords, 0);
+    for (uint16_t v : array) bits[v >> 6] |= uint64_t{1} << (v & 63);
+    array.clear();
+    array.shrink_to_fit();
+}
+
+void RoaringBitmap::Container::Normalize() {
+    if (!is_bitmap() || card > kArrayMax) return;
+    array.resize(card);
+    uint16_t* out = array.data();
+    for (uint32_t w = 0; w < kWords; ++w) {
+        for (uint64_t word = bits[w]; word; word &= word - 1) {
+            *out++ = static_cast<uint16_t>(w * 64 + __builtin_ctzll(word));
+        }
+    }
+    bits.clear();
+    bits.shrink_to_fit();
+}
+
+RoaringBitmap RoaringBitmap::Range(uint32_t lo, uint32_t hi) {
+    RoaringBitmap r;
+    if (lo >= hi) return r;
+    const uint64_t end = hi;
+    for (uint64_t base = lo & ~0xFFFFull; base < end; base += 0x10000) {
+        const uint32_t from = static_cast<uint32_t>(std::max<uint64_t>(base, lo) - base);
+        const uint32_t to = static_cast<uint32_t>(std::min<uint64_t>(base + 0x10000, end) - base);
+        Container c;
+        c.card = to - from;
+        if (c.card > kArrayMax) {
+            c.bits.assign(kWords, 0);
+            for (uint32_t v = from; v < to; ++v) c.bits[v >> 6] |= uint64_t{1} << (v & 63);
+        } else {
+            for (uint32_t v = from; v < to; ++v) c.array.push_back(static_cast<uint16_t>(v));
+        }
+        r.keys_.push_back(static_cast<uint16_t>(base >> 16));
+        r.containers_.push_back(std::move(c));
+    }
+    return r;
+}
+
+void RoaringBitmap::Add(uint32_t v) {
+    const uint16_t key = static_cast<uint16_t>(v >> 16);
+    const uint16_t lo = static_cast<uint16_t>(v);
+    auto kit = std::lower_bound(keys_.begin(), keys_.end(), key);
+    const size_t i = static_cast<size_t>(kit - keys_.begin());
+    if (kit == keys_.end() || *kit != key) {
+        keys_.insert(kit, key);
+        containers_.insert(containers_.begin() + static_cast<std::ptrdiff_t>(i), Container{});
+    }
+    Container& c = containers_[i];
+    if (c.is_bitmap()) {
+        uint64_t& w = c.bits[lo >> 6];
+        const uint64_t bit = uint64_t{1} << (lo & 63);
+        if (!(w & bit)) {
+            w |= bit;
+            ++c.card;
+        }
+        return;
+    }
+    auto it = std::lower_bound(c.array.begin(), c.array.end(), lo);
+    if (it != c.array.end() && *it == lo) return;
+    c.array.insert(it, lo);
+    if (++c.card > kArrayMax) c.ToBitmap();
+}
+
+void RoaringBitmap::Remove(uint32_t v) {
+    const uint16_t key = static_cast<uint16_t>(v >> 16);
+    const uint16_t lo = static_cast<uint16_t>(v);
+    auto kit = std::lower_bound(keys_.begin(), keys_.end(), key);
+    if (kit == keys_.end() || *kit != key) return;
+    const size_t i = static_cast<size_t>(kit - keys_.begin());
+    Container& c = containers_[i];
+    if (c.is_bitmap()) {
+        uint64_t& w = c.bits[lo >> 6];
+        const uint64_t bit = uint64_t{1} << (lo & 63);
+        if (!(w & bit)) return;
+        w &= ~bit;
+        --c.card;
+        c.Normalize();
+    } else {
+        auto it = std::lower_bound(c.array.begin(), c.array.end(), lo);
+        if (it == c.array.end() || *it != lo) return;
+        c.array.erase(it);
+        --c.card;
+    }
+    if (c.card == 0) {
+        keys_.erase(kit);
+        containers_.erase(containers_.begin() + static_cast<std::ptrdiff_t>(i));
+    }
+}
+
+bool RoaringBitmap::Contains(uint32_t v) const {
+    const uint16_t key = static_cast<uint16_t>(v >> 16);
+    auto kit = std::lower_bound(keys_.begin(), keys_.end(), key);
+    if (kit == keys_.end() || *kit != key) return false;
+    return containers_[static_cast<size_t>(kit - keys_.begin())].Contains(static_cast<uint16_t>(v));
+}
+
+uint64_t RoaringBitmap::Cardinality() const {
+    uint64_t n = 0;
+    for (const Container& c : containers_) n += c.card;
+    return n;
+}
+
+RoaringBitmap::Container RoaringBitmap::AndC(const Container& a, const Container& b) {
+    Container r;
+    if (a.is_bitmap() && b.is_bitmap()) {
+        r.bits.resize(kWords);
+        r.card = words<WordOp::And>(a.bits.data(), b.bits.data(), r.bits.data());
+        if (r.card <= kResultArrayMax) r.Normalize();
+    } else if (a.is_bitmap() || b.is_bitmap()) {
+        const Container& arr = a.is_bitmap() ? b : a;
+        const Container& bmp = a.is_bitmap() ? a : b;
+        for (uint16_t v : arr.array) {
+            if (test_bit(bmp.bits, v)) r.array.push_back(v);
+        }
+    } else {
+        std::set_intersection(a.array.begin(), a.array.end(), b.array.begin(), b.array.end(),
+                              std::back_inserter(r.array));
+    }
+    if (!r.is_bitmap()) r.card = static_cast<uint32_t>(r.array.size());
+    return r;
+}
+
+RoaringBitmap::Container RoaringBitmap::OrC(const Container& a, const Container& b) {
+    Container r;
+    if (a.is_bitmap() && b.is_bitmap()) {
+        r.bits.resize(kWords);
+        r.card = words<WordOp::Or>(a.bits.data(), b.bits.data(), r.bits.data());
+        return r;
+    }
+    if (a.is_bitmap() || b.is_bitmap()) {
+        const Container& arr = a.is_bitmap() ? b : a;
+        r = a.is_bitmap() ? a : b;
+        for (uint16_t v : arr.array) {
+            uint64_t& w = r.bits[v >> 6];
+            const uint64_t bit = uint64_t{1} << (v & 63);
+            r.card += (w & bit) ? 0 : 1;
+            w |= bit;
+        }
+        return r;
+    }
+    std::set_union(a.array.begin(), a.array.end(), b.array.begin(), b.array.end(),
+                   std::back_inserter(r.array));
+    r.card = static_cast<uint32_t>(r.array.size());
+    if (r.card > kArrayMax) r.ToBitmap();
+    return r;
+}
+
+RoaringBitmap::Container RoaringBitmap::AndNotC(const Container& a, const Container& b) {
+    Container r;
+    if (a.is_bitmap() && b.is_bitmap()) {
+        r.bits.resize(kWords);
+        r.card = words<WordOp::AndNot>(a.bits.data(), b.bits.data(), r.bits.data());
+        if (r.card <= kResultArrayMax) r.Normalize();
+        return r;
+    }
+    if (a.is_bitmap()) {
+        r = a;
+        for (uint16_t v : b.array) {
+            uint64_t& w = r.bits[v >> 6];
+            const uint64_t bit = uint64_t{1} << (v & 63);
+            r.card -= (w & bit) ? 1 : 0;
+            w &= ~bit;
+        }
+        if (r.card <= kResultArrayMax) r.Normalize();
+        return r;
+    }
+    if (b.is_bitmap()) {
+        for (uint16_t v : a.array) {
+            if (!test_bit(b.bits, v)) r.array.push_back(v);
+        }
+    } else {
+        std::set_difference(a.array.begin(), a.array.end(), b.array.begin(), b.array.end(),
+                            std::back_inserter(r.array));
+    }
+    r.card = static_cast<uint32_t>(r.array.size());
+    return r;
+}
+
+RoaringBitmap RoaringBitmap::And(const RoaringBitmap& a, const RoaringBitmap& b) {
+    RoaringBitmap r;
+    size_t i = 0, j = 0;
+    while (i < a.keys_.size() && j < b.keys_.size()) {
+        if (a.keys_[i] < b.keys_[j]) {
+            ++i;
+        } else if (a.keys_[i] > b.keys_[j]) {
+            ++j;
+        } else {
+            Container c = AndC(a.containers_[i], b.containers_[j]);
+            if (c.card > 0) {
+                r.keys_.push_back(a.keys_[i]);
+                r.containers_.push_back(std::move(c));
+            }
+            ++i;
+            ++j;
+        }
+    }
+    return r;
+}
+
+RoaringBitmap RoaringBitmap::Or(const RoaringBitmap& a, const RoaringBitmap& b) {
+    RoaringBitmap r;
+    size_t i = 0, j = 0;
+    while (i < a.keys_.size() || j < b.keys_.size()) {
+        if (j == b.keys_.size() || (i < a.keys_.size() && a.keys_[i] < b.keys_[j])) {
+            r.keys_.push_back(a.keys_[i]);
+            r.containers_.push_back(a.containers_[i++]);
+        } else if (i == a.keys_.size() || b.keys_[j] < a.keys_[i]) {
+            r.keys_.push_back(b.keys_[j]);
+            r.containers_.push_back(b.containers_[j++]);
+        } else {
+            r.keys_.push_back(a.keys_[i]);
+            r.containers_.push_back(OrC(a.containers_[i++], b.containers_[j++]));
+        }
+    }
+    return r;
+}
+
+RoaringBitmap RoaringBitmap::AndNot(const RoaringBitmap& a, const RoaringBitmap& b) {
+    RoaringBitmap r;
+    size_t j = 0;
+    for (size_t i = 0; i < a.keys_.size(); ++i) {
+        while (j < b.keys_.size() && b.keys_[j] < a.keys_[i]) ++j;
+        if (j == b.keys_.size() || b.keys_[j] != a.keys_[i]) {
+            r.keys_.push_back(a.keys_[i]);
+            r.containers_.push_back(a.containers_[i]);
+            continue;
+        }
+        Container c = AndNotC(a.containers_[i], b.containers_[j]);
+        if (c.card > 0) {
+            r.keys_.push_back(a.keys_[i]);
+            r.containers_.push_back(std::move(c));
+        }
+    }
+    return r;
+}
+
+std::vector<uint32_t> RoaringBitmap::ToVector(size_t offset, size_t limit) const {
+    std::vector<uint32_t> out;
+    for (size_t i = 0; i < keys_.size() && out.size() < limit; ++i) {
+        const Container& c = containers_[i];
+        if (offset >= c.card) {
+            offset -= c.card;
+            continue;
+        }
+        const uint32_t base = static_cast<uint32_t>(keys_[i]) << 16;
+        if (!c.is_bitmap()) {
+            for (size_t k = offset; k < c.array.size() && out.size() < limit; ++k) out.push_back(base | c.array[k]);
+        } else {
+            size_t skip = offset;
+            for (uint32_t w = 0; w < kWords && out.size() < limit; ++w) {
+                for (uint64_t word = c.bits[w]; word && out.size() < limit; word &= word - 1) {
+                    if (skip > 0) {
+                        --skip;
+                        continue;
+                    }
+                    out.push_back(base | (w * 64 + __builtin_ctzll(word)));
+                }
+            }
+        }
+        offset = 0;
+    }
+    return out;
+}
+
+size_t RoaringBitmap::SizeInBytes() const {
+    size_t n = keys_.size() * sizeof(uint16_t) + containers_.size() * sizeof(Container);
+    for (const Container& c : containers_) n += c.array.size() * 2 + c.bits.size() * 8;
+    return n;
+}
+
+void RoaringBitmap::Write(std::ostream& out) const {
+    const uint32_t n = static_cast<uint32_t>(keys_.size());
+    out.write(reinterpret_cast<const char*>(&n), sizeof n);
+    for (size_t i = 0; i < keys_.size(); ++i) {
+        const Container& c = containers_[i];
+        const uint16_t type = c.is_bitmap() ? 1 : 0;
+        out.write(reinterpret_cast<const char*>(&keys_[i]), sizeof keys_[i]);
+        out.write(reinterpret_cast<const char*>(&type), sizeof type);
+        out.write(reinterpret_cast<const char*>(&c.card), sizeof c.card);
+        if (type) {
+            out.write(reinterpret_cast<const char*>(c.bits.data()), kWords * sizeof(uint64_t));
+        } else {
+            out.write(reinterpret_cast<const char*>(c.array.data()),
+                      static_cast<std::streamsize>(c.array.size() * sizeof(uint16_t)));
+        }
+    }
+}
+
+bool RoaringBitmap::Read(std::istream& in) {
+    keys_.clear();
+    containers_.clear();
+    uint32_t n = 0;
+    if (!in.read(reinterpret_cast<char*>(&n), sizeof n) || n > 0x10000) return false;
+    keys_.resize(n);
+    containers_.resize(n);
+    for (uint32_t i = 0; i < n; ++i) {
+        Container& c = containers_[i];
+        uint16_t type = 0;
+        if (!in.read(reinterpret_cast<char*>(&keys_[i]), sizeof keys_[i]) ||
+            !in.read(reinterpret_cast<char*>(&type), sizeof type) ||
+            !in.read(reinterpret_cast<char*>(&c.card), sizeof c.card) || c.card == 0 || c.card > 0x10000 ||
+            (type == 0 && c.card > kArrayMax)) {
+            return false;
+        }
+        if (type) {
+            c.bits.resize(kWords);
+            if (!in.read(reinterpret_cast<char*>(c.bits.data()), kWords * sizeof(uint64_t))) return false;
+        } else {
+            c.array.resize(c.card);
+            if (!in.read(reinterpret_cast<char*>(c.array.data()),
+                         static_cast<std::streamsize>(c.card * sizeof(uint16_t)))) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+bool RoaringBitmap::operator==(const RoaringBitmap& o) const {
+    if (keys_ != o.keys_) return false;
+    for (size_t i = 0; i < keys_.size(); ++i) {
+        const Container& a = containers_[i];
+        const Container& b = o.containers_[i];
+        if (a.card != b.card) return false;
+        if (a.is_bitmap() == b.is_bitmap()) {
+            if (a.array != b.array || a.bits != b.bits) return false;
+            continue;
+        }
+        // A sparse bitmap left by a set operation against an array.
+        Container x = a.is_bitmap() ? a : b;
+        x.Normalize();
+        if (x.array != (a.is_bitmap() ? b.array : a.array)) return false;
+    }
+    return true;
+}
@@ -1,16 +1,7 @@
 #include "sha256.h"
 #include<iostream>
 #include<array>
-
-/***
- * SHA-256 digest are eight 32-bit words.
- */
-struct Sha256Ctx {
-    std::array<uint32_t, 8> h;
-    std::array<uint8_t, 64>  data; 
-    uint64_t bitlen;
-    uint32_t datalen; 
-};
+#include<cstring>
 
 // --- helpers ---
 static inline uint32_t ROTR(uint32_t x, unsigned n) { return (x >> n) | (x << (32 - n)); }
@@ -50,7 +41,7 @@ void sha256_init(Sha256Ctx& ctx) {
     ctx.bitlen = 0;     // total number of bits processed so far
 }
 
-void sha256_transform(Sha256Ctx& ctx, const std::array<uint8_t, 64> block) {
+static void sha256_transform(Sha256Ctx& ctx, const uint8_t* block) {
     uint32_t m[64];
 
     // 1) Prepare message schedule 'm'
@@ -104,16 +95,23 @@ void sha256_transform(Sha256Ctx& ctx, const std::array<uint8_t, 64> block) {
 }
 
 void sha256_update(Sha256Ctx& ctx, const uint8_t* data, size_t len) {
-    for (size_t i = 0; i < len; ++i) {
-        ctx.data[ctx.datalen++] = data[i];
-
-        // Process a full 512-bit block
+    // Top up a partial block first.
+    while (ctx.datalen != 0 && len != 0) {
+        ctx.data[ctx.datalen++] = *data++;
+        --len;
         if (ctx.datalen == 64) {
-            sha256_transform(ctx, ctx.data);
-            ctx.bitlen += 512;   // count processed bits
+            sha256_transform(ctx, ctx.data.data());
+            ctx.bitlen += 512;
             ctx.datalen = 0;
         }
     }
+    // Whole blocks straight from the input, without the copy.
+    for (; len >= 64; data += 64, len -= 64) {
+        sha256_transform(ctx, data);
+        ctx.bitlen += 512;
+    }
+    std::memcpy(ctx.data.data(), data, len);
+    ctx.datalen += static_cast<uint32_t>(len);
 }
 
 void sha256_final(Sha256Ctx& ctx, uint8_t out[32]){
@@ -126,7 +124,7 @@ void sha256_final(Sha256Ctx& ctx, uint8_t out[32]){
     // Pad with zeros until we have 56 bytes (so we can append 8-byte length)
     if (ctx.datalen > 56) {
         std::memset(ctx.data.data() + ctx.datalen, 0, 64 - ctx.datalen);
-        sha256_transform(ctx, ctx.data);
+        sha256_transform(ctx, ctx.data.data());
         ctx.bitlen += 512;
         ctx.datalen = 0;
     }
@@ -140,7 +138,7 @@ void sha256_final(Sha256Ctx& ctx, uint8_t out[32]){
     }
 
     // Final block
-    sha256_transform(ctx, ctx.data);
+    sha256_transform(ctx, ctx.data.data());
     // ctx.bitlen += 512; // not needed anymore, hashing is complete
 
     // Output digest as big-endian bytes from h[0..7]
@@ -0,0 +1,230 @@
+#include "snapshot.h"
+
+#include <algorithm>
+#include <utility>
+
+#include "phash.h"
+
+CatalogSnapshot::Ptr CatalogSnapshot::Build(std::vector<ImageMeta> records, RoaringBitmap deleted, TagStore tags,
+                                            const std::vector<uint32_t>& cluster_ords,
+                                            const std::vector<uint32_t>& clusters, uint64_t seq) {
+    std::unique_ptr<CatalogSnapshot> s(new CatalogSnapshot());
+    s->seq_ = seq;
+    // Chunks are filled in place here, before anyone can see them.
+    std::vector<std::shared_ptr<Chunk>> chunks;
+    auto slot = [&](uint32_t ordinal) -> Chunk& {
+        const size_t i = ordinal / kChunkRows;
+        if (i >= chunks.size()) chunks.resize(i + 1);
+        if (!chunks[i]) {
+            chunks[i] = std::make_shared<Chunk>();
+            chunks[i]->rows.resize(kChunkRows);
+            chunks[i]->cluster.assign(kChunkRows, CatalogColumns::kNoCluster);
+        }
+        return *chunks[i];
+    };
+    auto ids = std::make_shared<IdMap>();
+    ids->reserve(records.size());
+    for (ImageMeta& m : records) {
+        if (deleted.Contains(m.ordinal)) continue;
+        ids->emplace(m.image_id, m.ordinal);
+        ImageMeta& row = slot(m.ordinal).rows[m.ordinal % kChunkRows];
+        if (row.image_id.empty()) ++s->live_;
+        s->end_ = std::max(s->end_, m.ordinal + 1);
+        row = std::move(m);
+    }
+    for (size_t i = 0; i < cluster_ords.size(); ++i) {
+        const uint32_t o = cluster_ords[i];
+        if (o < s->end_) slot(o).cluster[o % kChunkRows] = clusters[i];
+    }
+    s->chunks_.assign(chunks.begin(), chunks.end());
+    s->ids_ = {std::move(ids)};
+    s->BuildColumns();
+    s->BuildPhash();
+    s->deleted_ = std::make_shared<RoaringBitmap>(std::move(deleted));
+    s->tags_ = std::make_shared<TagStore>(std::move(tags));
+    return s;
+}
+
+std::unique_ptr<CatalogSnapshot> CatalogSnapshot::Copy() const {
+    std::unique_ptr<CatalogSnapshot> s(new CatalogSnapshot());
+    s->chunks_ = chunks_;
+    s->ids_ = ids_;
+    s->columns_ = columns_;
+    s->phash_ = phash_;
+    s->phash_tail_ords_ = phash_tail_ords_;
+    s->phash_tail_ = phash_tail_;
+    s->deleted_ = deleted_;
+    s->tags_ = tags_;
+    s->end_ = end_;
+    s->live_ = live_;
+    s->seq_ = seq_ + 1;
+    return s;
+}
+
+CatalogSnapshot::Chunk& CatalogSnapshot::Own(uint32_t ordinal) {
+    const size_t i = ordinal / kChunkRows;
+    if (i >= chunks_.size()) chunks_.resize(i + 1);
+    auto c = chunks_[i] ? std::make_shared<Chunk>(*chunks_[i]) : std::make_shared<Chunk>();
+    if (!chunks_[i]) {
+        c->rows.resize(kChunkRows);
+        c->cluster.assign(kChunkRows, CatalogColumns::kNoCluster);
+    }
+    chunks_[i] = c;
+    if (ordinal >= end_) end_ = ordinal + 1;
+    return *c;
+}
+
+void CatalogSnapshot::Index(const std::string& image_id, uint32_t ordinal) {
+    std::shared_ptr<const IdMap> last = std::make_shared<const IdMap>(IdMap{{image_id, ordinal}});
+    while (!ids_.empty() && ids_.back()->size() <= last->size()) {
+        auto merged = std::make_shared<IdMap>(*ids_.back());
+        merged->insert(last->begin(), last->end());
+        last = std::move(merged);
+        ids_.pop_back();
+    }
+    ids_.push_back(std::move(last));
+}
+
+void CatalogSnapshot::BuildColumns() {
+    auto cols = std::make_shared<CatalogColumns>(CatalogColumns::Build(Live()));
+    std::vector<uint32_t> ords, clusters;
+    for (const std::shared_ptr<const Chunk>& c : chunks_) {
+        if (!c) continue;
+        for (size_t r = 0; r < kChunkRows; ++r) {
+            if (c->rows[r].image_id.empty() || c->cluster[r] == CatalogColumns::kNoCluster) continue;
+            ords.push_back(c->rows[r].ordinal);
+            clusters.push_back(c->cluster[r]);
+        }
+    }
+    cols->SetClusters(ords, clusters);
+    columns_ = std::move(cols);
+}
+
+void CatalogSnapshot::BuildPhash() {
+    std::vector<uint64_t> hashes;
+    std::vector<uint32_t> ords;
+    hashes.reserve(live_);
+    ords.reserve(live_);
+    for (const std::shared_ptr<const Chunk>& c : chunks_) {
+        if (!c) continue;
+        for (const ImageMeta& m : c->rows) {
+            if (m.image_id.empty() || m.phash == 0) continue;
+            hashes.push_back(m.phash);
+            ords.push_back(m.ordinal);
+        }
+    }
+    phash_ = std::make_shared<const PhashIndex>(PhashIndex{MultiIndexHash(std::move(hashes)), std::move(ords)});
+    phash_tail_ords_ = {};
+    phash_tail_ = {};
+}
+
+CatalogSnapshot::Ptr CatalogSnapshot::WithRecord(const ImageMeta& m, uint32_t cluster) const {
+    return WithRecords({m}, cluster);
+}
+
+CatalogSnapshot::Ptr CatalogSnapshot::WithRecords(const std::vector<ImageMeta>& records, uint32_t cluster) const {
+    std::unique_ptr<CatalogSnapshot> s = Copy();
+    auto cols = std::make_shared<CatalogColumns>(*columns_);
+    bool rebuild = false;
+    // Consecutive rows usually share a chunk: copy it once per run.
+    Chunk* c = nullptr;
+    size_t owned = SIZE_MAX;
+    for (const ImageMeta& m : records) {
+        const ImageMeta* before = s->Get(m.ordinal);
+        if (m.phash != 0 && (!before || before->phash != m.phash)) {
+            s->phash_tail_ords_.push_back(m.ordinal);
+            s->phash_tail_.push_back(m.phash);
+        }
+        if (!s->Find(m.image_id)) {
+            s->Index(m.image_id, m.ordinal);
+            ++s->live_;
+        }
+        if (m.ordinal / kChunkRows != owned) {
+            c = &s->Own(m.ordinal);
+            owned = m.ordinal / kChunkRows;
+        }
+        c->rows[m.ordinal % kChunkRows] = m;
+        if (cluster != CatalogColumns::kNoCluster) c->cluster[m.ordinal % kChunkRows] = cluster;
+
+        // New ordinals are past every row; an edit rewrites its row. An
+        // ordinal below the end that has no row cannot be placed.
+        const uint32_t row = cols->row(m.ordinal);
+        if (m.ordinal >= cols->row_of.size()) {
+            cols->Append(m, cluster);
+        } else if (row == OrdinalMap::kNone) {
+            rebuild = true;
+        } else {
+            cols->Set(m);
+            if (cluster != CatalogColumns::kNoCluster) cols->cluster.set(row, cluster);
+        }
+    }
+    if (rebuild) s->BuildColumns();
+    else s->columns_ = std::move(cols);
+    if (s->phash_tail_.size() > std::max<size_t>(4096, s->phash_->ordinals.size() / 8)) s->BuildPhash();
+    return s;
+}
+
+CatalogSnapshot::Ptr CatalogSnapshot::WithDeleted(uint32_t ordinal, TagStore tags) const {
+    std::unique_ptr<CatalogSnapshot> s = Copy();
+    if (Get(ordinal)) {
+        s->Own(ordinal).rows[ordinal % kChunkRows] = ImageMeta{};
+        --s->live_;
+    }
+    auto deleted = std::make_shared<RoaringBitmap>(*deleted_);
+    deleted->Add(ordinal);
+    s->deleted_ = std::move(deleted);
+    s->tags_ = std::make_shared<TagStore>(std::move(tags));
+    return s;
+}
+
+CatalogSnapshot::Ptr CatalogSnapshot::WithTags(TagStore tags) const {
+    std::unique_ptr<CatalogSnapshot> s = Copy();
+    s->tags_ = std::make_shared<TagStore>(std::move(tags));
+    return s;
+}
+
+const ImageMeta* CatalogSnapshot::Get(uint32_t ordinal) const {
+    const size_t i = ordinal / kChunkRows;
+    if (i >= chunks_.size() || !chunks_[i]) return nullptr;
+    const ImageMeta& m = chunks_[i]->rows[ordinal % kChunkRows];
+    return m.image_id.empty() ? nullptr : &m;
+}
+
+std::optional<uint32_t> CatalogSnapshot::Find(std::string_view image_id) const {
+    const std::string key(image_id);
+    for (auto it = ids_.rbegin(); it != ids_.rend(); ++it) {
+        const auto hit = (*it)->find(key);
+        if (hit == (*it)->end()) continue;
+        if (!Get(hit->second)) return std::nullopt;
+        return hit->second;
+    }
+    return std::nullopt;
+}
+
+std::vector<std::pair<uint32_t, int>> CatalogSnapshot::Similar(uint64_t phash, int radius) const {
+    std::vector<std::pair<uint32_t, int>> hits;
+    auto check = [&](uint32_t ordinal, uint64_t h) {
+        const ImageMeta* m = Get(ordinal);
+        if (m && m->phash == h) hits.emplace_back(ordinal, hamming64(h, phash));
+    };
+    for (uint32_t id : phash_->mih.Query(phash, radius)) check(phash_->ordinals[id], phash_->mih.hash(id));
+    for (size_t i = 0; i < phash_tail_.size(); ++i) {
+        if (hamming64(phash_tail_[i], phash) <= radius) check(phash_tail_ords_[i], phash_tail_[i]);
+    }
+    // A record re-hashed back to an indexed pHash is in both.
+    std::sort(hits.begin(), hits.end());
+    hits.erase(std::unique(hits.begin(), hits.end()), hits.end());
+    return hits;
+}
+
+std::vector<ImageMeta> CatalogSnapshot::Live() const {
+    std::vector<ImageMeta> out;
+    out.reserve(live_);
+    for (const std::shared_ptr<const Chunk>& c : chunks_) {
+        if (!c) continue;
+        for (const ImageMeta& m : c->rows) {
+            if (!m.image_id.empty()) out.push_back(m);
+        }
+    }
+    return out;
+}
@@ -0,0 +1,257 @@
+#include "tags.h"
+
+#include <cctype>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <stdexcept>
+
+namespace {
+
+constexpr char kMagic[8] = {'I', 'M', 'G', 'T', 'A', 'G', '0', '1'};
+
+bool valid_tag(const std::string& tag) {
+    if (tag.empty() || tag.size() > 64 || tag == "AND" || tag == "OR" || tag == "NOT") return false;
+    for (unsigned char ch : tag) {
+        if (!std::isalnum(ch) && ch != '_' && ch != ':' && ch != '.' && ch != '-') return false;
+    }
+    return true;
+}
+
+// Recursive-descent evaluator over the token stream:
+//   expr   := term ( OR term )*
+//   term   := factor ( [AND] [NOT] factor )*
+//   factor := NOT factor | '(' expr ')' | TAG
+// "a AND NOT b" is evaluated as AndNot(a, b); only a NOT with nothing to
+// subtract from needs the universe.
+class QueryParser {
+public:
+    QueryParser(const TagStore& store, const std::string& expr, uint32_t universe)
+        : store_(store), universe_(universe) {
+        Tokenize(expr);
+    }
+
+    RoaringBitmap Parse() {
+        if (toks_.empty()) throw std::invalid_argument("tag query is empty");
+        RoaringBitmap r = Expr();
+        if (pos_ != toks_.size()) throw std::invalid_argument("unexpected '" + toks_[pos_] + "' in tag query");
+        return r;
+    }
+
+private:
+    void Tokenize(const std::string& s) {
+        for (size_t i = 0; i < s.size();) {
+            const char ch = s[i];
+            if (std::isspace(static_cast<unsigned char>(ch))) {
+                ++i;
+            } else if (ch == '(' || ch == ')' || ch == '&' || ch == '|' || ch == '!') {
+                toks_.push_back(std::string(1, ch));
+                ++i;
+            } else {
+                size_t j = i;
+                while (j < s.size() && !std::isspace(static_cast<unsigned char>(s[j])) &&
+                       !std::strchr("()&|!", s[j])) {
+                    ++j;
+                }
+                toks_.push_back(s.substr(i, j - i));
+                i = j;
+            }
+        }
+    }
+
+    bool Accept(const char* word, const char* sym) {
+        if (pos_ < toks_.size() && (toks_[pos_] == word || toks_[pos_] == sym)) {
+            ++pos_;
+            return true;
+        }
+        return false;
+    }
+
+    bool AtFactor() const {
+        return pos_ < toks_.size() && toks_[pos_] != ")" && toks_[pos_] != "OR" && toks_[pos_] != "|";
+    }
+
+    RoaringBitmap Expr() {
+        RoaringBitmap r = Term();
+        while (Accept("OR", "|")) r = RoaringBitmap::Or(r, Term());
+        return r;
+    }
+
+    RoaringBitmap Term() {
+        RoaringBitmap r = Factor();
+        while (true) {
+            const bool explicit_and = Accept("AND", "&");
+            if (!explicit_and && !AtFactor()) return r;
+            if (Accept("NOT", "!")) r = RoaringBitmap::AndNot(r, Factor());
+            else r = RoaringBitmap::And(r, Factor());
+        }
+    }
+
+    RoaringBitmap Factor() {
+        if (pos_ == toks_.size()) throw std::invalid_argument("tag query ends unexpectedly");
+        if (Accept("NOT", "!")) return RoaringBitmap::AndNot(RoaringBitmap::Range(0, universe_), Factor());
+        if (Accept("(", "(")) {
+            RoaringBitmap r = Expr();
+            if (!Accept(")", ")")) throw std::invalid_argument("missing ')' in tag query");
+            return r;
+        }
+        const std::string& tok = toks_[pos_++];
+        if (!valid_tag(tok)) {
+            throw std::invalid_argument("unexpected '" + tok + "' in tag query");
+        }
+        const RoaringBitmap* p = store_.Find(tok);
+        return p ? *p : RoaringBitmap();
+    }
+
+    const TagStore& store_;
+    uint32_t universe_;
+    std::vector<std::string> toks_;
+    size_t pos_ = 0;
+};
+
+} // namespace
+
+TagStore TagStore::Open(const std::string& dir) {
+    namespace fs = std::filesystem;
+    TagStore s;
+    s.dir_ = dir;
+    const std::string dict_path = dir + "/tags.dict";
+    const std::string postings_path = dir + "/tags.postings";
+    const std::string log_path = dir + "/tags.log";
+
+    for (const auto& p : {dict_path, log_path}) {
+        if (!fs::exists(p)) std::ofstream(p, std::ios::binary);
+    }
+
+    std::ifstream dict(dict_path);
+    for (std::string line; std::getline(dict, line);) {
+        s.ids_.emplace(line, static_cast<uint32_t>(s.names_.size()));
+        s.names_.push_back(line);
+    }
+    s.postings_.resize(s.names_.size());
+
+    if (fs::exists(postings_path)) {
+        std::ifstream in(postings_path, std::ios::binary);
+        char magic[8];
+        uint32_t n = 0;
+        if (!in.read(magic, sizeof magic) || std::memcmp(magic, kMagic, sizeof kMagic) != 0 ||
+            !in.read(reinterpret_cast<char*>(&n), sizeof n) || n > s.names_.size()) {
+            throw std::runtime_error("TagStore: bad header in " + postings_path);
+        }
+        for (uint32_t t = 0; t < n; ++t) {
+            if (!s.postings_[t].Read(in)) throw std::runtime_error("TagStore: truncated " + postings_path);
+        }
+    }
+
+    // A torn trailing record (crash mid-append) is ignored.
+    std::ifstream log(log_path, std::ios::binary);
+    uint32_t rec[2];
+    while (log.read(reinterpret_cast<char*>(rec), sizeof rec)) {
+        if ((rec[1] & ~kRemoveBit) >= s.names_.size()) {
+            throw std::runtime_error("TagStore: log references unknown tag in " + log_path);
+        }
+        s.Apply(rec[0], rec[1]);
+        ++s.log_records_;
+    }
+    if (log.gcount() != 0) fs::resize_file(log_path, s.log_records_ * sizeof rec);
+    return s;
+}
+
+void TagStore::Apply(uint32_t ordinal, uint32_t tag_word) {
+    RoaringBitmap& p = postings_[tag_word & ~kRemoveBit];
+    if (tag_word & kRemoveBit) p.Remove(ordinal);
+    else p.Add(ordinal);
+}
+
+bool TagStore::TagId(const std::string& tag, bool create, uint32_t* id) {
+    if (!valid_tag(tag)) {
+        std::cerr << "TagStore: invalid tag name '" << tag << "'\n";
+        return false;
+    }
+    auto it = ids_.find(tag);
+    if (it != ids_.end()) {
+        *id = it->second;
+        return true;
+    }
+    if (!create) return false;
+
+    // Dictionary line first: a tag id only becomes referenced once a log
+    // record naming it is written.
+    if (!dict_out_.is_open()) dict_out_.open(dir_ + "/tags.dict", std::ios::app);
+    dict_out_ << tag << '\n';
+    if (!dict_out_.flush()) {
+        std::cerr << "TagStore: cannot append to " << dir_ << "/tags.dict\n";
+        return false;
+    }
+    *id = static_cast<uint32_t>(names_.size());
+    ids_.emplace(tag, *id);
+    names_.push_back(tag);
+    postings_.emplace_back();
+    return true;
+}
+
+bool TagStore::Log(uint32_t ordinal, uint32_t tag_word) {
+    if (!log_out_.is_open()) log_out_.open(dir_ + "/tags.log", std::ios::binary | std::ios::app);
+    const uint32_t rec[2] = {ordinal, tag_word};
+    log_out_.write(reinterpret_cast<const char*>(rec), sizeof rec);
+    if (!log_out_.flush()) {
+        std::cerr << "TagStore: cannot append to " << dir_ << "/tags.log\n";
+        return false;
+    }
+    Apply(ordinal, tag_word);
+    if (++log_records_ >= kCompactAfter) return Compact();
+    return true;
+}
+
+bool TagStore::Add(uint32_t ordinal, const std::string& tag) {
+    uint32_t id;
+    if (!TagId(tag, true, &id)) return false;
+    if (postings_[id].Contains(ordinal)) return true;
+    return Log(ordinal, id);
+}
+
+bool TagStore::Remove(uint32_t ordinal, const std::string& tag) {
+    uint32_t id;
+    if (!TagId(tag, false, &id) || !postings_[id].Contains(ordinal)) return valid_tag(tag);
+    return Log(ordinal, id | kRemoveBit);
+}
+
+bool TagStore::Compact() {
+    namespace fs = std::filesystem;
+    const std::string postings_path = dir_ + "/tags.postings";
+    const std::string tmp = postings_path + ".tmp";
+    {
+        std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+        const uint32_t n = static_cast<uint32_t>(postings_.size());
+        out.write(kMagic, sizeof kMagic);
+        out.write(reinterpret_cast<const char*>(&n), sizeof n);
+        for (const RoaringBitmap& p : postings_) p.Write(out);
+        if (!out.flush()) {
+            std::cerr << "TagStore: cannot write " << tmp << "\n";
+            return false;
+        }
+    }
+    std::error_code ec;
+    fs::rename(tmp, postings_path, ec);
+    if (ec) {
+        std::cerr << "TagStore: cannot publish " << postings_path << ": " << ec.message() << "\n";
+        return false;
+    }
+    log_out_.close();
+    fs::resize_file(dir_ + "/tags.log", 0, ec);
+    if (ec) {
+        std::cerr << "TagStore: cannot truncate tags.log: " << ec.message() << "\n";
+        return false;
+    }
+    log_records_ = 0;
+    return true;
+}
+
+const RoaringBitmap* TagStore::Find(const std::string& tag) const {
+    auto it = ids_.find(tag);
+    return it == ids_.end() ? nullptr : &postings_[it->second];
+}
+
+RoaringBitmap TagStore::Query(const std::string& expr, uint32_t universe) const {
+    return QueryParser(*this, expr, universe).Parse();
+}
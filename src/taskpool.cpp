@@ -0,0 +1,447 @@
+#include "taskpool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <utility>
+
+#include <pthread.h>
+#include <sched.h>
+
+namespace {
+
+using Job = std::function<void()>;
+
+constexpr int kSpins = 16;   // search rounds before a worker parks
+
+// Chase-Lev work-stealing deque (in the C11 formulation of Lê et al.,
+// "Correct and Efficient Work-Stealing for Weak Memory Models"). The owner
+// pushes and pops the bottom without locks; thieves take the top with one
+// CAS, which only contends with the owner when a single job is left. The
+// ring is allocated by the owner's first push, so it is first touched on
+// the owner's node. Outgrown rings are kept until the deque dies because a
+// thief may still be reading one.
+class ChaseLevDeque {
+public:
+    ChaseLevDeque() = default;
+    ~ChaseLevDeque() {
+        while (Job* j = Pop()) delete j;
+    }
+    ChaseLevDeque(const ChaseLevDeque&) = delete;
+    ChaseLevDeque& operator=(const ChaseLevDeque&) = delete;
+
+    // Owner only.
+    void Push(Job* j) {
+        const int64_t b = bottom_.load(std::memory_order_relaxed);
+        const int64_t t = top_.load(std::memory_order_acquire);
+        Ring* r = ring_.load(std::memory_order_relaxed);
+        if (!r || b - t >= r->cap) r = Grow(r, t, b);
+        r->at(b).store(j, std::memory_order_release);
+        std::atomic_thread_fence(std::memory_order_release);
+        bottom_.store(b + 1, std::memory_order_relaxed);
+    }
+
+    // Owner only. nullptr when empty.
+    Job* Pop() {
+        const int64_t b = bottom_.load(std::memory_order_relaxed) - 1;
+        Ring* r = ring_.load(std::memory_order_relaxed);
+        bottom_.store(b, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t t = top_.load(std::memory_order_relaxed);
+        if (t > b) {
+            bottom_.store(b + 1, std::memory_order_relaxed);
+            return nullptr;
+        }
+        Job* j = r->at(b).load(std::memory_order_acquire);
+        if (t == b) {
+            // The last job: race the thieves for it.
+            if (!top_.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+                j = nullptr;
+            }
+            bottom_.store(b + 1, std::memory_order_relaxed);
+        }
+        return j;
+    }
+
+    // Any thread. nullptr when empty or when another thread won the job.
+    Job* Steal() {
+        int64_t t = top_.load(std::memory_order_acquire);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        const int64_t b = bottom_.load(std::memory_order_acquire);
+        if (t >= b) return nullptr;
+        Ring* r = ring_.load(std::memory_order_acquire);
+        Job* j = r->at(t).load(std::memory_order_acquire);
+        if (!top_.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+            return nullptr;
+        }
+        return j;
+    }
+
+    size_t size() const {
+        const int64_t n = bottom_.load(std::memory_order_relaxed) - top_.load(std::memory_order_relaxed);
+        return n > 0 ? static_cast<size_t>(n) : 0;
+    }
+
+private:
+    struct Ring {
+        int64_t cap;
+        std::unique_ptr<std::atomic<Job*>[]> slots;
+        explicit Ring(int64_t c) : cap(c), slots(new std::atomic<Job*>[static_cast<size_t>(c)]) {}
+        std::atomic<Job*>& at(int64_t i) { return slots[static_cast<size_t>(i & (cap - 1))]; }
+    };
+
+    Ring* Grow(Ring* old, int64_t top, int64_t bottom) {
+        auto r = std::make_unique<Ring>(old ? old->cap * 2 : 64);
+        for (int64_t i = top; i < bottom; ++i) r->at(i).store(old->at(i).load(std::memory_order_relaxed), std::memory_order_relaxed);
+        Ring* raw = r.get();
+        rings_.push_back(std::move(r));
+        ring_.store(raw, std::memory_order_release);
+        return raw;
+    }
+
+    alignas(64) std::atomic<int64_t> top_{0};
+    alignas(64) std::atomic<int64_t> bottom_{0};
+    std::atomic<Ring*> ring_{nullptr};
+    std::vector<std::unique_ptr<Ring>> rings_;   // owner only
+};
+
+// "0-3,8,10-11" -> {0, 1, 2, 3, 8, 10, 11}
+std::vector<int> parse_cpulist(const std::string& list) {
+    std::vector<int> cpus;
+    std::stringstream ss(list);
+    for (std::string range; std::getline(ss, range, ',');) {
+        if (range.empty() || range == "\n") continue;
+        try {
+            const size_t dash = range.find('-');
+            const int lo = std::stoi(range.substr(0, dash));
+            const int hi = dash == std::string::npos ? lo : std::stoi(range.substr(dash + 1));
+            for (int c = lo; c <= hi; ++c) cpus.push_back(c);
+        } catch (const std::exception&) {
+            return {};
+        }
+    }
+    return cpus;
+}
+
+void run_job(Job* j) {
+    try {
+        (*j)();
+    } catch (const std::exception& e) {
+        std::cerr << "WorkStealingPool: task failed: " << e.what() << "\n";
+    } catch (...) {
+        std::cerr << "WorkStealingPool: task failed\n";
+    }
+    delete j;
+}
+
+} // namespace
+
+std::vector<std::vector<int>> numa_cpus() {
+    namespace fs = std::filesystem;
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    const bool have_mask = sched_getaffinity(0, sizeof(allowed), &allowed) == 0;
+    auto is_allowed = [&](int c) { return !have_mask || (c < CPU_SETSIZE && CPU_ISSET(c, &allowed)); };
+
+    std::map<int, std::vector<int>> nodes;
+    std::error_code ec;
+    for (const fs::directory_entry& e : fs::directory_iterator("/sys/devices/system/node", ec)) {
+        const std::string name = e.path().filename().string();
+        if (name.rfind("node", 0) != 0 || name.size() == 4 ||
+            name.find_first_not_of("0123456789", 4) != std::string::npos) {
+            continue;
+        }
+        std::ifstream in(e.path() / "cpulist");
+        std::string list;
+        std::getline(in, list);
+        std::vector<int> cpus;
+        for (int c : parse_cpulist(list)) {
+            if (is_allowed(c)) cpus.push_back(c);
+        }
+        if (!cpus.empty()) nodes[std::stoi(name.substr(4))] = std::move(cpus);
+    }
+
+    std::vector<std::vector<int>> out;
+    for (auto& [id, cpus] : nodes) out.push_back(std::move(cpus));
+    if (out.empty()) {
+        std::vector<int> all;
+        const int n = have_mask ? CPU_SETSIZE : static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+        for (int c = 0; c < n; ++c) {
+            if (is_allowed(c)) all.push_back(c);
+        }
+        out.push_back(std::move(all));
+    }
+    return out;
+}
+
+struct WorkStealingPool::Worker {
+    State* pool = nullptr;
+    ChaseLevDeque deques[kPriorities];
+    int node = 0;
+    std::vector<size_t> victims;   // same node first, then the rest
+    std::atomic<uint64_t> executed{0};
+    std::atomic<uint64_t> stolen{0};
+    std::atomic<uint64_t> stolen_from{0};
+    std::atomic<uint64_t> parked{0};
+    std::thread thread;
+};
+
+struct WorkStealingPool::State {
+    static thread_local Worker* current;
+
+    std::vector<std::unique_ptr<Worker>> workers;
+    int nodes = 1;
+
+    // Jobs submitted from outside the pool.
+    std::mutex inject_mu;
+    std::deque<Job*> inject[kPriorities];
+    std::atomic<size_t> injected{0};
+
+    // Parking. Every submit bumps `epoch`; a worker parks only if it has
+    // not moved since before its last fruitless search.
+    std::mutex park_mu;
+    std::condition_variable park_cv;
+    std::atomic<uint64_t> epoch{0};
+    std::atomic<int> sleepers{0};
+    std::atomic<bool> stopping{false};
+
+    void Wake(bool all) {
+        epoch.fetch_add(1);
+        if (sleepers.load() == 0 && !all) return;
+        { std::lock_guard<std::mutex> lock(park_mu); }
+        if (all) park_cv.notify_all();
+        else park_cv.notify_one();
+    }
+
+    Job* Find(Worker& w) {
+        for (int p = 0; p < kPriorities; ++p) {
+            if (Job* j = w.deques[p].Pop()) return j;
+            if (injected.load(std::memory_order_acquire) > 0) {
+                std::lock_guard<std::mutex> lock(inject_mu);
+                if (!inject[p].empty()) {
+                    Job* j = inject[p].front();
+                    inject[p].pop_front();
+                    injected.fetch_sub(1);
+                    return j;
+                }
+            }
+            for (size_t v : w.victims) {
+                Worker& victim = *workers[v];
+                if (Job* j = victim.deques[p].Steal()) {
+                    w.stolen.fetch_add(1, std::memory_order_relaxed);
+                    victim.stolen_from.fetch_add(1, std::memory_order_relaxed);
+                    return j;
+                }
+            }
+        }
+        return nullptr;
+    }
+
+    void Loop(Worker& w) {
+        current = &w;
+        for (;;) {
+            Job* j = Find(w);
+            for (int i = 0; !j && i < kSpins; ++i) {
+                std::this_thread::yield();
+                j = Find(w);
+            }
+            if (!j) {
+                const uint64_t seen = epoch.load();
+                if (!(j = Find(w))) {
+                    if (stopping.load()) return;
+                    std::unique_lock<std::mutex> lock(park_mu);
+                    sleepers.fetch_add(1);
+                    w.parked.fetch_add(1, std::memory_order_relaxed);
+                    park_cv.wait(lock, [&] { return epoch.load() != seen || stopping.load(); });
+                    sleepers.fetch_sub(1);
+                    continue;
+                }
+            }
+            run_job(j);
+            w.executed.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    void Stop() {
+        stopping.store(true);
+        Wake(true);
+        for (std::unique_ptr<Worker>& w : workers) {
+            if (w->thread.joinable()) w->thread.join();
+        }
+    }
+};
+
+thread_local WorkStealingPool::Worker* WorkStealingPool::State::current = nullptr;
+
+WorkStealingPool::WorkStealingPool(int workers) : s_(std::make_unique<State>()) {
+    State& s = *s_;
+    const std::vector<std::vector<int>> topology = numa_cpus();
+    std::vector<std::pair<int, int>> cpus;   // (node index, cpu), node order
+    for (size_t n = 0; n < topology.size(); ++n) {
+        for (int c : topology[n]) cpus.emplace_back(static_cast<int>(n), c);
+    }
+    if (cpus.empty()) cpus.emplace_back(0, 0);
+    if (workers <= 0) workers = static_cast<int>(cpus.size());
+    s.nodes = static_cast<int>(topology.size());
+
+    // Spread the workers over the CPU list, so each node gets a share in
+    // proportion to its CPUs.
+    for (int i = 0; i < workers; ++i) {
+        auto w = std::make_unique<Worker>();
+        w->pool = &s;
+        w->node = cpus[static_cast<size_t>(i) * cpus.size() / static_cast<size_t>(workers)].first;
+        s.workers.push_back(std::move(w));
+    }
+    for (size_t i = 0; i < s.workers.size(); ++i) {
+        Worker& w = *s.workers[i];
+        for (int remote = 0; remote < 2; ++remote) {
+            for (size_t k = 1; k < s.workers.size(); ++k) {
+                const size_t v = (i + k) % s.workers.size();
+                if ((s.workers[v]->node != w.node) == static_cast<bool>(remote)) w.victims.push_back(v);
+            }
+        }
+    }
+
+    try {
+        for (std::unique_ptr<Worker>& w : s.workers) {
+            Worker* raw = w.get();
+            w->thread = std::thread([&s, raw] { s.Loop(*raw); });
+            if (s.nodes > 1) {
+                cpu_set_t set;
+                CPU_ZERO(&set);
+                for (int c : topology[static_cast<size_t>(w->node)]) CPU_SET(c, &set);
+                pthread_setaffinity_np(w->thread.native_handle(), sizeof(set), &set);
+            }
+        }
+    } catch (const std::system_error& e) {
+        s.Stop();
+        throw std::runtime_error(std::string("WorkStealingPool: cannot start workers: ") + e.what());
+    }
+}
+
+WorkStealingPool::~WorkStealingPool() {
+    s_->Stop();
+    for (std::deque<Job*>& q : s_->inject) {
+        for (Job* j : q) run_job(j);
+    }
+}
+
+void WorkStealingPool::Submit(std::function<void()> fn, TaskPriority priority) {
+    State& s = *s_;
+    Job* j = new Job(std::move(fn));
+    const int p = static_cast<int>(priority);
+    Worker* w = State::current;
+    if (w && w->pool == &s) {
+        w->deques[p].Push(j);
+    } else {
+        std::lock_guard<std::mutex> lock(s.inject_mu);
+        s.inject[p].push_back(j);
+        s.injected.fetch_add(1, std::memory_order_release);
+    }
+    s.Wake(false);
+}
+
+void WorkStealingPool::ParallelFor(size_t n, size_t grain, const std::function<void(size_t, size_t)>& fn,
+                                   TaskPriority priority) {
+    if (n == 0) return;
+    grain = std::max<size_t>(1, grain);
+    const size_t chunks = (n + grain - 1) / grain;
+    if (chunks == 1) {
+        fn(0, n);
+        return;
+    }
+
+    // Helpers that start after every chunk is claimed touch only `next`,
+    // so the state is shared with them rather than living on this stack.
+    struct Loop {
+        std::atomic<size_t> next{0};
+        std::atomic<size_t> done{0};
+        std::mutex mu;
+        std::condition_variable cv;
+        std::exception_ptr error;
+    };
+    auto loop = std::make_shared<Loop>();
+    auto body = [loop, &fn, n, grain, chunks] {
+        for (size_t c; (c = loop->next.fetch_add(1)) < chunks;) {
+            try {
+                fn(c * grain, std::min(n, (c + 1) * grain));
+            } catch (...) {
+                std::lock_guard<std::mutex> lock(loop->mu);
+                if (!loop->error) loop->error = std::current_exception();
+            }
+            if (loop->done.fetch_add(1) + 1 == chunks) {
+                std::lock_guard<std::mutex> lock(loop->mu);
+                loop->cv.notify_all();
+            }
+        }
+    };
+    const size_t helpers = std::min(chunks - 1, s_->workers.size());
+    for (size_t i = 0; i < helpers; ++i) Submit(body, priority);
+    body();
+
+    std::unique_lock<std::mutex> lock(loop->mu);
+    loop->cv.wait(lock, [&] { return loop->done.load() == chunks; });
+    if (loop->error) std::rethrow_exception(loop->error);
+}
+
+void WorkStealingPool::Run(const std::function<void()>& fn, TaskPriority priority) {
+    if (on_worker()) {
+        fn();
+        return;
+    }
+    std::mutex mu;
+    std::condition_variable cv;
+    bool done = false;
+    std::exception_ptr error;
+    Submit([&] {
+        try {
+            fn();
+        } catch (...) {
+            error = std::current_exception();
+        }
+        // Notify under the lock: the caller's stack is gone once it sees done.
+        std::lock_guard<std::mutex> lock(mu);
+        done = true;
+        cv.notify_one();
+    }, priority);
+    std::unique_lock<std::mutex> lock(mu);
+    cv.wait(lock, [&] { return done; });
+    if (error) std::rethrow_exception(error);
+}
+
+int WorkStealingPool::workers() const {
+    return static_cast<int>(s_->workers.size());
+}
+
+bool WorkStealingPool::on_worker() const {
+    return State::current && State::current->pool == s_.get();
+}
+
+WorkStealingPool::Stats WorkStealingPool::stats() const {
+    Stats st;
+    st.nodes = s_->nodes;
+    st.injected_queued = s_->injected.load();
+    for (const std::unique_ptr<Worker>& w : s_->workers) {
+        WorkerStats ws;
+        ws.node = w->node;
+        for (const ChaseLevDeque& d : w->deques) ws.queued += d.size();
+        ws.executed = w->executed.load(std::memory_order_relaxed);
+        ws.stolen = w->stolen.load(std::memory_order_relaxed);
+        ws.stolen_from = w->stolen_from.load(std::memory_order_relaxed);
+        ws.parked = w->parked.load(std::memory_order_relaxed);
+        st.workers.push_back(ws);
+    }
+    return st;
+}
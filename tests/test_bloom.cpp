@@ -0,0 +1,70 @@
+// test_bloom.cpp
+#include <cstdlib>
+#include <filesystem>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "bloom.h"
+
+static void expect(bool cond, const char* label) {
+    if (!cond) {
+        std::cerr << "[FAIL] " << label << "\n";
+        std::exit(1);
+    }
+    std::cout << "[PASS] " << label << "\n";
+}
+
+int main() {
+    const std::string dir = "tmp_test_bloom";
+    std::filesystem::remove_all(dir);
+    std::filesystem::create_directories(dir);
+    const std::string path = dir + "/digests.bloom";
+
+    // 1) Keys
+    expect(BlockedBloom::KeyOfSha256("00000000000000ff" + std::string(48, '0')) == 0xff, "KeyOfSha256 low bits");
+    expect(BlockedBloom::KeyOfSha256("Deadbeef00000000") == 0xdeadbeef00000000ULL, "KeyOfSha256 mixed case");
+
+    // 2) No false negatives, few false positives at capacity
+    const uint64_t n = 200000;
+    std::mt19937_64 rng(11);
+    std::vector<uint64_t> keys(n);
+    for (uint64_t& k : keys) k = rng();
+    {
+        BlockedBloom f = BlockedBloom::Create(path, n);
+        for (uint64_t k : keys) f.Add(k);
+        bool all = true;
+        for (uint64_t k : keys) all &= f.MayContain(k);
+        expect(all && f.count() == n, "every added key is found");
+
+        size_t fp = 0;
+        const size_t probes = 1000000;
+        for (size_t i = 0; i < probes; ++i) fp += f.MayContain(rng());
+        const double rate = static_cast<double>(fp) / probes;
+        std::cout << "false positive rate: " << rate << "\n";
+        expect(rate < 0.005, "false positive rate");
+        f.set_catalog_bytes(4242);
+        expect(f.Sync(), "Sync");
+    }
+
+    // 3) Reopen from the file
+    {
+        std::optional<BlockedBloom> f = BlockedBloom::Open(path);
+        expect(f && f->count() == n && f->capacity() == n && f->catalog_bytes() == 4242, "reopen header");
+        bool all = true;
+        for (uint64_t k : keys) all &= f->MayContain(k);
+        expect(all, "reopened filter finds every key");
+        f->Add(12345);
+    }
+    expect(BlockedBloom::Open(path)->MayContain(12345), "adds write through the mapping");
+
+    // 4) Bad files
+    expect(!BlockedBloom::Open(dir + "/missing"), "missing file");
+    std::filesystem::resize_file(path, 100);
+    expect(!BlockedBloom::Open(path), "truncated file");
+
+    std::filesystem::remove_all(dir);
+    std::cout << "All tests passed ✅\n";
+    return 0;
+}
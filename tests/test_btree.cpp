@@ -0,0 +1,179 @@
+// test_btree.cpp
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "btree.h"
+
+static void expect(bool cond, const char* label) {
+    if (!cond) {
+        std::cerr << "[FAIL] " << label << "\n";
+        std::exit(1);
+    }
+    std::cout << "[PASS] " << label << "\n";
+}
+
+// Ordinals with lo <= key <= hi, in (key, ordinal) order.
+static std::vector<uint32_t> brute(const std::vector<BTree::Entry>& sorted, uint64_t lo, uint64_t hi) {
+    std::vector<uint32_t> out;
+    for (const BTree::Entry& e : sorted) {
+        if (e.first >= lo && e.first <= hi) out.push_back(e.second);
+    }
+    return out;
+}
+
+static bool ranges_match(const BTree& t, const std::vector<BTree::Entry>& sorted, std::mt19937_64& rng,
+                         uint64_t key_span) {
+    for (int q = 0; q < 200; ++q) {
+        uint64_t lo = rng() % key_span, hi = lo + rng() % (key_span / 50 + 1);
+        if (t.Range(lo, hi) != brute(sorted, lo, hi)) return false;
+    }
+    return t.Range(0, UINT64_MAX).size() == sorted.size();
+}
+
+int main() {
+    const std::string dir = "tmp_test_btree";
+    std::filesystem::remove_all(dir);
+    std::filesystem::create_directories(dir);
+    const std::string path = dir + "/t.bt";
+    std::mt19937_64 rng(5);
+
+    // 1) Random inserts split leaves and internal nodes
+    const size_t n = 200000;   // > kLeafCap * kInnerCap, so the tree reaches height 3
+    std::vector<BTree::Entry> entries;
+    expect(BTree::BulkLoad(path, {}, 0), "BulkLoad of an empty tree");
+    {
+        std::optional<BTree> t = BTree::Open(path);
+        expect(t && t->size() == 0 && t->Range(0, UINT64_MAX).empty(), "empty tree");
+        bool ok = true;
+        for (size_t i = 0; i < n; ++i) {
+            const BTree::Entry e{rng() % 50000, static_cast<uint32_t>(i)};   // many equal keys
+            ok &= t->Insert(e.first, e.second);
+            entries.push_back(e);
+        }
+        expect(ok && t->size() == n && t->height() == 3, "Insert with splits");
+        std::sort(entries.begin(), entries.end());
+        expect(ranges_match(*t, entries, rng, 50000), "Range matches brute force");
+
+        expect(t->Insert(entries[10].first, entries[10].second) && t->size() == n, "duplicate insert is a no-op");
+        t->set_synced_rows(n);
+        expect(t->Flush(), "Flush");
+    }
+
+    // 2) Reopen
+    {
+        std::optional<BTree> t = BTree::Open(path);
+        expect(t && t->size() == n && t->synced_rows() == n, "reopen keeps entries and synced rows");
+        expect(ranges_match(*t, entries, rng, 50000), "reopened Range matches");
+    }
+
+    // 3) Bulk load builds the same index
+    const std::string bulk = dir + "/bulk.bt";
+    expect(BTree::BulkLoad(bulk, entries, n), "BulkLoad");
+    {
+        std::optional<BTree> t = BTree::Open(bulk);
+        expect(t && t->size() == n && t->height() == 3, "bulk-loaded shape");
+        expect(ranges_match(*t, entries, rng, 50000), "bulk-loaded Range matches");
+
+        // O(log n + k) pages: one per level, then the leaves holding matches.
+        size_t pages = 0;
+        const std::vector<uint32_t> hits = t->Range(20000, 20099, &pages);
+        const size_t per_leaf = static_cast<size_t>(BTree::kLeafCap * BTree::kBulkFill);
+        expect(!hits.empty() && pages <= t->height() + hits.size() / per_leaf + 2, "Range touches few pages");
+        const uint64_t est = t->Estimate(20000, 20099);
+        expect(est < n / 20, "Estimate of a narrow range is small");
+        expect(t->Estimate(0, UINT64_MAX) == n, "Estimate of everything");
+
+        // Inserts into a packed tree still land in order.
+        bool ok = true;
+        for (uint32_t i = 0; i < 5000; ++i) {
+            const uint64_t key = rng() % 60000;
+            ok &= t->Insert(key, static_cast<uint32_t>(n + i));
+            entries.push_back({key, static_cast<uint32_t>(n + i)});
+        }
+        std::sort(entries.begin(), entries.end());
+        expect(ok && ranges_match(*t, entries, rng, 60000), "inserts after bulk load");
+    }
+
+    // 4) Ascending keys (import order) fill pages fully
+    const std::string seq = dir + "/seq.bt";
+    expect(BTree::BulkLoad(seq, {}, 0), "BulkLoad of a second tree");
+    {
+        std::optional<BTree> t = BTree::Open(seq);
+        for (uint32_t i = 0; i < 100000; ++i) t->Insert(1700000000 + i / 4, i);
+        expect(t->page_count() < 100000 / BTree::kLeafCap + 10, "ascending inserts pack leaves");
+        expect(t->Range(1700000000 + 100, 1700000000 + 101).size() == 8, "ascending Range");
+    }
+
+    // 5) A tree left dirty by a crash does not open
+    {
+        std::optional<BTree> t = BTree::Open(seq);
+        expect(t->Insert(1, 1), "Insert marks dirty");
+        const int fd = ::open(seq.c_str(), O_RDWR);
+        char copy[BufferPool::kPageSize];
+        expect(::pread(fd, copy, sizeof copy, 0) == static_cast<ssize_t>(sizeof copy), "read header");
+        t.reset();   // clean shutdown clears the flag ...
+        expect(BTree::Open(seq).has_value(), "clean close reopens");
+        // ... restore the header as it was mid-update
+        expect(::pwrite(fd, copy, sizeof copy, 0) == static_cast<ssize_t>(sizeof copy), "write header");
+        ::close(fd);
+        expect(!BTree::Open(seq).has_value(), "dirty tree is rejected");
+    }
+
+    // 6) Buffer pool: clock eviction, write-back, pin exhaustion
+    {
+        const std::string pf = dir + "/pool";
+        const int fd = ::open(pf.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+        BufferPool pool(fd, 4, 0);
+        for (uint32_t i = 0; i < 10; ++i) {
+            uint32_t id;
+            unsigned char* p = pool.PinNew(&id);
+            std::memset(p, static_cast<int>(i + 1), BufferPool::kPageSize);
+            pool.Unpin(id, true);
+        }
+        bool ok = true;
+        for (uint32_t i = 0; i < 10; ++i) {
+            const unsigned char* p = pool.Pin(i);
+            ok &= p && p[0] == i + 1 && p[BufferPool::kPageSize - 1] == i + 1;
+            pool.Unpin(i, false);
+        }
+        expect(ok && pool.page_count() == 10, "evicted pages are written back and reread");
+        const uint64_t misses = pool.misses();
+        pool.Pin(9);
+        pool.Unpin(9, false);
+        expect(pool.misses() == misses && pool.hits() > 0, "resident page is a hit");
+        for (uint32_t i = 0; i < 4; ++i) pool.Pin(i);
+        std::cout << "(expect a pinned-frames message)\n";
+        expect(pool.Pin(5) == nullptr, "all frames pinned");
+        ::close(fd);
+    }
+
+    // 7) Readers and updates exclude each other without waiting
+    {
+        const std::string shared = dir + "/shared.bt";
+        expect(BTree::BulkLoad(shared, {{1, 1}, {3, 3}}, 2), "BulkLoad");
+        std::optional<BTree> writer = BTree::Open(shared);
+        std::optional<BTree> reader = BTree::OpenReadOnly(shared);
+        expect(reader && !reader->Insert(2, 2), "read-only tree takes no inserts");
+        expect(!writer->Insert(2, 2), "no update while a reader has the tree open");
+        const uint64_t before = reader->size();
+        reader.reset();
+        expect(writer->Insert(2, 2) && !BTree::OpenReadOnly(shared), "no reader during an update");
+        expect(writer->Flush(), "Flush ends the update");
+        reader = BTree::OpenReadOnly(shared);
+        expect(reader && reader->size() == before + 1 && reader->Range(2, 2) == std::vector<uint32_t>{2},
+               "reader sees the update");
+    }
+
+    std::filesystem::remove_all(dir);
+    std::cout << "All tests passed ✅\n";
+    return 0;
+}
@@ -0,0 +1,110 @@
+// test_cache.cpp
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "cache.h"
+
+static void expect(bool cond, const char* label) {
+    if (!cond) {
+        std::cerr << "[FAIL] " << label << "\n";
+        std::exit(1);
+    }
+    std::cout << "[PASS] " << label << "\n";
+}
+
+static std::string key_of(const char* prefix, int i) {
+    std::string key(prefix);
+    key += std::to_string(i);
+    return key;
+}
+
+static TinyLfuCache::Value value_of(size_t bytes, char fill) {
+    return std::make_shared<const std::string>(bytes, fill);
+}
+
+int main() {
+    // 1) Get, Put, replace, Erase
+    {
+        TinyLfuCache cache(1 << 20, 4);
+        expect(!cache.Get("a"), "miss");
+        cache.Put("a", value_of(100, 'x'));
+        const TinyLfuCache::Value v = cache.Get("a");
+        expect(v && *v == std::string(100, 'x'), "hit");
+        cache.Put("a", value_of(50, 'y'));
+        expect(*cache.Get("a") == std::string(50, 'y') && cache.stats().entries == 1, "replace");
+        cache.Erase("a");
+        expect(!cache.Get("a") && cache.stats().entries == 0 && cache.stats().bytes == 0, "Erase");
+        const TinyLfuCache::Stats st = cache.stats();
+        expect(st.hits == 2 && st.misses == 2, "hit and miss counters");
+        cache.Put("huge", value_of(1 << 19, 'z'));
+        expect(!cache.Get("huge"), "oversized values are not cached");
+    }
+
+    // 2) The byte budget holds
+    {
+        const size_t budget = 4 << 20;
+        TinyLfuCache cache(budget, 8);
+        for (int i = 0; i < 5000; ++i) cache.Put(key_of("k", i), value_of(4000, 'v'));
+        const TinyLfuCache::Stats st = cache.stats();
+        expect(st.bytes <= budget && st.entries > 500, "within budget");
+        expect(st.evictions + st.rejections + st.entries == 5000, "every insert accounted for");
+    }
+
+    // 3) A scan does not flush frequently used entries
+    {
+        TinyLfuCache cache(2 << 20, 4);
+        const int hot = 200;
+        for (int round = 0; round < 5; ++round) {
+            for (int i = 0; i < hot; ++i) {
+                const std::string key = key_of("hot", i);
+                if (!cache.Get(key)) cache.Put(key, value_of(4000, 'h'));
+            }
+        }
+        for (int i = 0; i < 20000; ++i) {
+            const std::string key = key_of("scan", i);
+            if (!cache.Get(key)) cache.Put(key, value_of(4000, 's'));
+        }
+        int kept = 0;
+        for (int i = 0; i < hot; ++i) kept += cache.Get(key_of("hot", i)) != nullptr;
+        std::cout << "hot entries kept after scan: " << kept << "/" << hot << "\n";
+        expect(kept >= hot * 9 / 10, "scan resistance");
+        expect(cache.stats().rejections > 0, "scan candidates rejected");
+    }
+
+    // 4) Zipf-skewed traffic from several threads
+    {
+        TinyLfuCache cache(8 << 20, 16);
+        const int keys = 20000, threads = 4, per_thread = 100000;
+        std::vector<double> cdf(keys);
+        double sum = 0;
+        for (int i = 0; i < keys; ++i) cdf[i] = sum += 1.0 / (i + 1);
+        std::vector<std::thread> workers;
+        for (int t = 0; t < threads; ++t) {
+            workers.emplace_back([&, t] {
+                std::mt19937 rng(t);
+                std::uniform_real_distribution<double> u(0, sum);
+                for (int i = 0; i < per_thread; ++i) {
+                    const int k = static_cast<int>(std::lower_bound(cdf.begin(), cdf.end(), u(rng)) - cdf.begin());
+                    const std::string key = key_of("img", k);
+                    if (!cache.Get(key)) cache.Put(key, value_of(8000, 'z'));
+                }
+            });
+        }
+        for (std::thread& w : workers) w.join();
+        const TinyLfuCache::Stats st = cache.stats();
+        const double hit_ratio = static_cast<double>(st.hits) / (st.hits + st.misses);
+        std::cout << "zipf hit ratio with ~5% of keys cached: " << hit_ratio << "\n";
+        expect(st.hits + st.misses == static_cast<uint64_t>(threads) * per_thread && st.bytes <= (8 << 20),
+               "concurrent counters and budget");
+        expect(hit_ratio > 0.5, "skewed traffic mostly hits");
+    }
+
+    std::cout << "All tests passed ✅\n";
+    return 0;
+}
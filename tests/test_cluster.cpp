@@ -0,0 +1,99 @@
+// test_cluster.cpp
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "cluster.h"
+#include "kmeans.h"
+
+static void expect(bool cond, const char* label) {
+    if (!cond) {
+        std::cerr << "[FAIL] " << label << "\n";
+        std::exit(1);
+    }
+    std::cout << "[PASS] " << label << "\n";
+}
+
+int main() {
+    // Four well-separated blobs in 8 dimensions.
+    const uint32_t dim = 8;
+    const int k = 4;
+    const size_t per = 500, n = per * k;
+    std::mt19937_64 rng(5);
+    std::normal_distribution<float> g(0.f, 0.1f);
+    std::vector<float> data(n * dim);
+    for (size_t i = 0; i < n; ++i) {
+        for (uint32_t d = 0; d < dim; ++d) data[i * dim + d] = (d == i % k ? 10.f : 0.f) + g(rng);
+    }
+
+    // 1) Mini-batch k-means separates the blobs
+    ClusterModel model = ClusterModel::Train(ClusterFeature::Embedding, data.data(), n, dim, k, 64, 50);
+    {
+        bool pure = true;
+        std::vector<uint32_t> of_blob(k);
+        for (int b = 0; b < k; ++b) of_blob[b] = model.Assign(&data[b * dim]);
+        for (size_t i = 0; i < n; ++i) pure &= model.Assign(&data[i * dim]) == of_blob[i % k];
+        expect(pure, "every point joins its blob's cluster");
+        bool distinct = true;
+        for (int a = 0; a < k; ++a)
+            for (int b = a + 1; b < k; ++b) distinct &= of_blob[a] != of_blob[b];
+        expect(distinct, "one cluster per blob");
+
+        uint64_t total = 0;
+        for (int c = 0; c < k; ++c) total += model.count(c);
+        expect(total == 64 * 50, "counts cover every mini-batch row");
+    }
+
+    // 2) Save, then Update persists the moved centroid in place
+    const std::string path = "tmp_test_cluster.model";
+    {
+        expect(model.Save(path), "Save");
+        std::optional<ClusterModel> loaded = ClusterModel::Load(path);
+        expect(loaded && loaded->k() == k && loaded->dim() == dim &&
+                   loaded->feature() == ClusterFeature::Embedding, "Load header");
+
+        std::vector<float> v(dim, 0.f);
+        v[0] = 12.f;
+        const uint32_t c = loaded->Update(v.data());
+        const uint64_t count = loaded->count(c);
+        const float moved = loaded->centroid(c)[0];
+
+        std::optional<ClusterModel> again = ClusterModel::Load(path);
+        expect(again && again->count(c) == count && again->centroid(c)[0] == moved,
+               "Update is written back");
+        expect(again->Assign(v.data()) == c, "updated point stays in its cluster");
+    }
+    std::remove(path.c_str());
+
+    // 3) Assignments: rewrite, append, reopen
+    const std::string dir = "tmp_test_cluster_dir";
+    std::filesystem::create_directories(dir);
+    {
+        expect(ClusterAssignments::Rewrite(dir, {7, 8, 9}, {2, 0, 2}), "Rewrite");
+        ClusterAssignments a = ClusterAssignments::Open(dir);
+        expect(a.size() == 3 && a.cluster(2) == 2 && a.ordinal(1) == 8, "rewritten rows");
+        expect(a.Append(10, 1), "Append");
+    }
+    {
+        ClusterAssignments a = ClusterAssignments::Open(dir);
+        expect(a.size() == 4 && a.ordinal(3) == 10 && a.cluster(3) == 1, "appended row survives reopen");
+    }
+    std::filesystem::remove_all(dir);
+
+    // 4) pHash feature vectors: squared L2 equals hamming distance
+    {
+        float a[64], b[64];
+        phash_vector(0xF0F0ULL, a);
+        phash_vector(0x0FF0ULL, b);
+        float d = 0.f;
+        for (int i = 0; i < 64; ++i) d += (a[i] - b[i]) * (a[i] - b[i]);
+        expect(d == 8.f, "phash_vector distance is hamming");
+    }
+
+    std::cout << "All tests passed ✅\n";
+    return 0;
+}
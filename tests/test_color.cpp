@@ -0,0 +1,105 @@
+// test_color.cpp
+#include <algorithm>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "color.h"
+
+static void expect(bool cond, const char* label) {
+    if (!cond) {
+        std::cerr << "[FAIL] " << label << "\n";
+        std::exit(1);
+    }
+    std::cout << "[PASS] " << label << "\n";
+}
+
+int main() {
+    // 1) Histogram of a two-colour image: normalized, dominant colours found
+    {
+        const int w = 40, h = 10;
+        std::vector<unsigned char> px(w * h * 3);
+        for (int i = 0; i < w * h; ++i) {
+            const bool blue = (i % w) < 30;   // 75% blue, 25% red
+            px[i * 3 + 0] = blue ? 20 : 230;
+            px[i * 3 + 1] = blue ? 40 : 20;
+            px[i * 3 + 2] = blue ? 220 : 30;
+        }
+        ColorFeatures f;
+        expect(color_features(px.data(), w, h, 3, &f), "color_features");
+
+        uint32_t sum = 0;
+        for (uint16_t v : f.hist) sum += v;
+        expect(sum == kHistTotal, "histogram sums to kHistTotal");
+        expect(f.dominant[0].b > 200 && f.dominant[0].share > 180, "blue is dominant");
+        expect(f.dominant[1].r > 200, "red is second");
+
+        uint16_t blue_mask[kColorBins];
+        hue_range_mask(200.f, 260.f, blue_mask);
+        const uint32_t blue_mass = hist_intersection(f.hist, blue_mask);
+        expect(blue_mass > kHistTotal * 0.7 && blue_mass < kHistTotal * 0.8, "hue range mass ~75%");
+
+        uint16_t red_mask[kColorBins];
+        hue_range_mask(340.f, 20.f, red_mask);   // wraps through 0
+        const uint32_t red_mass = hist_intersection(f.hist, red_mask);
+        expect(red_mass > kHistTotal * 0.2 && red_mass < kHistTotal * 0.3, "wrapping hue range");
+    }
+
+    // 2) Batch kernel matches a scalar reference
+    {
+        std::mt19937 rng(9);
+        const size_t n = 37;
+        std::vector<uint16_t> rows(n * kColorBins), q(kColorBins);
+        for (auto& v : rows) v = static_cast<uint16_t>(rng() % (kHistTotal + 1));
+        for (auto& v : q) v = static_cast<uint16_t>(rng() % (kHistTotal + 1));
+        std::vector<uint32_t> got(n);
+        hist_intersection_batch(q.data(), rows.data(), n, got.data());
+        bool ok = true;
+        for (size_t r = 0; r < n; ++r) {
+            uint32_t want = 0;
+            for (int i = 0; i < kColorBins; ++i) want += std::min(q[i], rows[r * kColorBins + i]);
+            ok &= (got[r] == want);
+        }
+        expect(ok, "batch intersection matches scalar");
+    }
+
+    // 3) Identical histograms score kHistTotal; grays have their own bins
+    {
+        uint16_t a[kColorBins];
+        single_color_hist(10, 200, 30, a);
+        expect(hist_intersection(a, a) == kHistTotal, "self intersection is total");
+        expect(color_bin(128, 128, 128) >= 48 && color_bin(0, 255, 0) < 48, "gray vs chromatic bins");
+    }
+
+    // 4) The sidecar: appends show after Refresh, survive a reopen, and a
+    //    torn ordinal is not a row
+    {
+        const std::string dir = "tmp_test_color";
+        std::filesystem::remove_all(dir);
+        std::filesystem::create_directories(dir);
+        ColorFeatures f;
+        single_color_hist(200, 10, 10, f.hist);
+        f.dominant[0] = {200, 10, 10, 255};
+        {
+            ColorStore s = ColorStore::Open(dir);
+            expect(s.size() == 0 && s.Append(7, f) && s.Append(9, ColorFeatures{}), "append");
+            expect(s.size() == 0 && s.Refresh() && s.size() == 2, "rows visible after Refresh");
+            expect(s.ordinal(1) == 9 && s.dominant(0)[0].r == 200 && hist_intersection(s.hist(0), f.hist) == kHistTotal,
+                   "rows read back");
+        }
+        std::ofstream(dir + "/color.ords", std::ios::app | std::ios::binary) << "xy";
+        {
+            ColorStore s = ColorStore::Open(dir);
+            expect(s.size() == 2 && s.ordinal(0) == 7, "reopen ignores the torn ordinal");
+            expect(s.Append(11, f) && s.Refresh() && s.size() == 3 && s.ordinal(2) == 11, "append overwrites it");
+        }
+        std::filesystem::remove_all(dir);
+    }
+
+    std::cout << "\nAll tests passed ✅\n";
+    return 0;
+}
@@ -0,0 +1,95 @@
+// test_columns.cpp
+#include <cstdlib>
+#include <filesystem>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "columns.h"
+
+static void expect(bool cond, const char* label) {
+    if (!cond) {
+        std::cerr << "[FAIL] " << label << "\n";
+        std::exit(1);
+    }
+    std::cout << "[PASS] " << label << "\n";
+}
+
+int main() {
+    const std::string dir = "tmp_test_columns";
+    std::filesystem::remove_all(dir);
+    std::filesystem::create_directories(dir);
+
+    // Three full blocks plus a partial one that ends mid mask word.
+    const size_t n = 3 * ColumnStore::kBlockRows + 1000 + 7;
+    std::vector<ImageMeta> rows(n);
+    std::mt19937_64 rng(3);
+    for (size_t i = 0; i < n; ++i) {
+        rows[i].width = static_cast<uint32_t>(rng() % 5000);
+        rows[i].height = i < ColumnStore::kBlockRows ? 100 : static_cast<uint32_t>(rng() % 3000);
+        rows[i].bytes = rng() % 2 ? rng() : rng() % 1000000;   // uses the top bit
+        rows[i].created_unix = 1700000000 + i;                  // sorted, as imports are
+        rows[i].ordinal = static_cast<uint32_t>(i);
+    }
+    {
+        ColumnStore cs = ColumnStore::Open(dir);
+        bool ok = true;
+        for (const ImageMeta& m : rows) ok &= cs.Append(m);
+        expect(ok && cs.SetCatalogBytes(12345) && cs.Refresh(), "Append");
+    }
+
+    ColumnStore cs = ColumnStore::Open(dir);
+    expect(cs.size() == n && cs.catalog_bytes() == 12345 && cs.ordinal(n - 1) == n - 1, "reopen");
+
+    auto brute = [&](const std::vector<ColumnRange>& ranges) {
+        std::vector<uint32_t> out;
+        for (size_t i = 0; i < n; ++i) {
+            bool ok = true;
+            for (const ColumnRange& r : ranges) {
+                const uint64_t v = cs.value(r.column, i);
+                ok &= r.lo <= v && v <= r.hi;
+            }
+            if (ok) out.push_back(static_cast<uint32_t>(i));
+        }
+        return out;
+    };
+
+    // 1) Select and Count agree with a row-by-row check
+    const std::vector<std::vector<ColumnRange>> cases = {
+        {{NumColumn::Width, 2001, UINT64_MAX}},
+        {{NumColumn::Width, 0, 0}},
+        {{NumColumn::Height, 100, 2000}, {NumColumn::Width, 10, 4000}},
+        {{NumColumn::Bytes, 1ULL << 63, UINT64_MAX}},
+        {{NumColumn::Bytes, 0, 999999}, {NumColumn::Height, 0, 500}},
+        {{NumColumn::CreatedAt, 1700000000 + 70000, 1700000000 + 70100}},
+        {{NumColumn::Width, 1ULL << 40, UINT64_MAX}},
+    };
+    bool same = true;
+    for (const auto& c : cases) {
+        const std::vector<uint32_t> want = brute(c);
+        same &= cs.Select(c) == want && cs.Count(c) == want.size();
+    }
+    expect(same, "scan matches brute force");
+
+    // 2) Zone maps
+    ScanStats st;
+    const std::vector<ColumnRange> day = {{NumColumn::CreatedAt, 1700000000 + 70000, 1700000000 + 70100}};
+    expect(cs.Count(day, &st) == 101 && st.blocks == 4 && st.skipped == 3, "sorted column skips blocks");
+    cs.Count({{NumColumn::Height, 100, 100}}, &st);
+    expect(st.whole == 1, "constant block matches whole");
+    expect(cs.Count({{NumColumn::Width, 5, 4}}, &st) == 0 && st.skipped == st.blocks, "empty range");
+
+    // 3) Appends become visible after Refresh
+    ImageMeta extra;
+    extra.width = 123456;
+    extra.ordinal = static_cast<uint32_t>(n);
+    expect(cs.Append(extra), "Append to an open store");
+    const std::vector<ColumnRange> wide = {{NumColumn::Width, 100000, UINT64_MAX}};
+    expect(cs.Count(wide) == 0 && cs.Refresh() && cs.Select(wide) == std::vector<uint32_t>({static_cast<uint32_t>(n)}),
+           "Refresh");
+    std::filesystem::remove_all(dir);
+
+    std::cout << "All tests passed ✅\n";
+    return 0;
+}
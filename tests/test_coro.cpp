@@ -0,0 +1,117 @@
+// test_coro.cpp
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "coro.h"
+
+static void expect(bool cond, const char* label) {
+    if (!cond) {
+        std::cerr << "[FAIL] " << label << "\n";
+        std::exit(1);
+    }
+    std::cout << "[PASS] " << label << "\n";
+}
+
+static Task<int> add(IoExecutor& io, int a, int b) {
+    co_await io.Schedule();
+    co_return a + b;
+}
+
+static Task<int> sum_to(IoExecutor& io, int n) {
+    int total = 0;
+    for (int i = 1; i <= n; ++i) total = co_await add(io, total, i);
+    co_return total;
+}
+
+static Task<int> fails(IoExecutor& io) {
+    co_await io.Schedule();
+    throw std::runtime_error("boom");
+}
+
+static Task<bool> round_trip(IoExecutor& io, std::string path, std::string bytes) {
+    if (!co_await WriteFileAtomic(io, path, bytes)) co_return false;
+    std::string back;
+    if (!co_await ReadFile(io, path, &back)) co_return false;
+    co_return back == bytes;
+}
+
+static std::string pattern(size_t n, int seed) {
+    std::string s(n, '\0');
+    for (size_t i = 0; i < n; ++i) s[i] = static_cast<char>((i * 131 + seed) & 0xFF);
+    return s;
+}
+
+int main() {
+    namespace fs = std::filesystem;
+    const std::string dir = "tmp_test_coro";
+    fs::remove_all(dir);
+
+    for (const bool uring : {true, false}) {
+        IoExecutor io(2, 64, uring);
+        std::cout << (io.uses_io_uring() ? "io_uring" : "blocking I/O threads") << "\n";
+        if (!uring) expect(!io.uses_io_uring(), "fallback when io_uring is off");
+
+        // 1) Tasks chain and propagate results and exceptions
+        expect(io.Run(sum_to(io, 100)) == 5050, "chained tasks");
+        bool threw = false;
+        try {
+            io.Run(fails(io));
+        } catch (const std::runtime_error& e) {
+            threw = std::string(e.what()) == "boom";
+        }
+        expect(threw, "exception reaches the caller");
+
+        // 2) Whole-file helpers, across several reads and writes
+        expect(io.Run(round_trip(io, dir + "/a/big.bin", pattern(3 << 20, 1))), "3 MiB round trip");
+        expect(io.Run(round_trip(io, dir + "/a/empty.bin", "")), "empty file");
+        std::string missing;
+        expect(!io.Run(ReadFile(io, dir + "/nope", &missing)), "missing file");
+
+        // 3) Many operations in flight on two threads, more than the ring
+        //    holds at once
+        const int n = 300;
+        std::vector<char> ok(n, 0);
+        for (int i = 0; i < n; ++i) {
+            io.Spawn([](IoExecutor& ex, std::string path, int seed, char* out) -> Task<void> {
+                *out = co_await round_trip(ex, path, pattern(20000 + seed, seed));
+            }(io, dir + "/many/" + std::to_string(i), i, &ok[i]));
+        }
+        io.Wait();
+        int good = 0;
+        for (char c : ok) good += c;
+        expect(good == n, "concurrent round trips");
+        std::ifstream in(dir + "/many/7", std::ios::binary);
+        expect(std::string(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>()) ==
+                   pattern(20007, 7), "file contents");
+
+        // 4) SerialWorker runs calls one at a time and rethrows
+        SerialWorker serial;
+        long counter = 0;   // not atomic: only the serial thread touches it
+        for (int i = 0; i < 200; ++i) {
+            io.Spawn([](IoExecutor& ex, SerialWorker& s, long* c) -> Task<void> {
+                for (int k = 0; k < 10; ++k) co_await s.Call(ex, [c] { ++*c; });
+            }(io, serial, &counter));
+        }
+        io.Wait();
+        expect(counter == 2000, "serialized calls");
+        threw = false;
+        try {
+            io.Run([](IoExecutor& ex, SerialWorker& s) -> Task<void> {
+                co_await s.Call(ex, [] { throw std::runtime_error("catalog"); });
+            }(io, serial));
+        } catch (const std::runtime_error&) {
+            threw = true;
+        }
+        expect(threw, "serial call exception");
+        fs::remove_all(dir);
+    }
+
+    std::cout << "All tests passed ✅\n";
+    return 0;
+}
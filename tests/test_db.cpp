@@ -0,0 +1,360 @@
+// test_db.cpp
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <future>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+
+#include "btree.h"
+#include "color.h"
+#include "db.h"
+#include "idgen.h"
+#include "lease.h"
+#include "phash.h"
+#include "sha256.h"
+#include "stb_image_write.h"
+
+static void expect(bool cond, const char* label) {
+    if (!cond) {
+        std::cerr << "[FAIL] " << label << "\n";
+        std::exit(1);
+    }
+    std::cout << "[PASS] " << label << "\n";
+}
+
+// A small JPEG whose pixels (and so digest) depend on `seed`.
+static std::string make_image(const std::string& dir, int seed) {
+    const int w = 64, h = 48;
+    std::vector<unsigned char> px(static_cast<size_t>(w) * h * 3);
+    for (int y = 0; y < h; ++y) {
+        for (int x = 0; x < w; ++x) {
+            unsigned char* p = &px[(static_cast<size_t>(y) * w + x) * 3];
+            p[0] = static_cast<unsigned char>(x * 4 + seed * 11);
+            p[1] = static_cast<unsigned char>(y * 5 + seed * 7);
+            p[2] = static_cast<unsigned char>((x ^ y) + seed * 29);
+        }
+    }
+    const std::string path = dir + "/" + std::to_string(seed) + ".jpg";
+    stbi_write_jpg(path.c_str(), w, h, 3, px.data(), 95);
+    return path;
+}
+
+static uint64_t count_rows(const ImageDB& db, const CatalogSnapshot* at = nullptr, const std::string& where = "") {
+    std::ostringstream out;
+    db.RunQuery("SELECT COUNT(*) FROM images " + where, out, at);
+    return std::stoull(out.str());
+}
+
+int main() {
+    namespace fs = std::filesystem;
+    const std::string dir = "tmp_test_db";
+    fs::remove_all(dir);
+    fs::create_directories(dir + "/src");
+    const int kFiles = 48, kLater = 16;
+    std::vector<std::string> files;
+    for (int i = 0; i < kFiles + kLater; ++i) files.push_back(make_image(dir + "/src", i));
+
+    ImageDB db = ImageDB::Open(dir + "/db", 2);
+    expect(db.Init(), "init");
+
+    // 1) Published snapshots are immutable: a reader's copy keeps its view
+    //    across imports, tags and deletes
+    std::vector<std::string> ids;
+    for (int i = 0; i < 2; ++i) {
+        ImportResult r;
+        expect(db.ImportFile(files[static_cast<size_t>(i)], &r), "import");
+        ids.push_back(r.image_id);
+    }
+    expect(IdGenerator::Timestamp(ids[1].c_str()) - IdGenerator::Timestamp(ids[0].c_str()) < IdGenerator::kLeaseMs,
+           "ids follow the clock, not the reserved mark");
+    const PinnedSnapshot s0 = db.Snapshot();
+    expect(s0->size() == 2 && s0->Find(ids[0]) && db.GetImage(ids[1]), "snapshot after imports");
+    ImportResult dup;
+    expect(!db.ImportFile(files[0], &dup) && dup.duplicate, "duplicate");
+    expect(db.TagImage(ids[0], {"red"}, {}), "tag");
+    expect(db.Delete(ids[1]), "delete");
+
+    const PinnedSnapshot s1 = db.Snapshot();
+    expect(s1.seq() > s0.seq(), "sequence advances");
+    expect(s0->size() == 2 && s0->Find(ids[1]) && s0->tags().Find("red") == nullptr, "old snapshot unchanged");
+    expect(s1->size() == 1 && !s1->Find(ids[1]) && s1->deleted().Contains(*s0->Find(ids[1])), "delete published");
+    expect(!db.GetImage(ids[1]) && db.FindByTags("red", 0, 10) == std::vector<std::string>{ids[0]}, "tag published");
+    expect(db.FindByTags("NOT red", 0, 10).empty(), "deleted images stay out of NOT");
+    expect(count_rows(db) == 1, "query sees the snapshot");
+    const std::vector<SimilarHit> near0 = db.FindSimilar(files[0], 0), near1 = db.FindSimilar(files[1], 0);
+    expect(!near0.empty() && near0[0].image_id == ids[0] && near0[0].distance == 0 &&
+               std::none_of(near1.begin(), near1.end(), [&](const SimilarHit& h) { return h.image_id == ids[1]; }),
+           "similar search skips deleted images");
+
+    // 2) Readers run against concurrent importers: counts only grow, and
+    //    an image once visible stays visible
+    const int kImporters = 4, kReaders = 6;
+    std::atomic<int> importers_left{kImporters};
+    std::atomic<int> imported{0};
+    std::atomic<bool> failed{false};
+    std::atomic<uint64_t> reads{0};
+    std::vector<std::thread> threads;
+    for (int t = 0; t < kImporters; ++t) {
+        threads.emplace_back([&, t] {
+            for (size_t i = 2 + static_cast<size_t>(t); i < static_cast<size_t>(kFiles); i += kImporters) {
+                if (db.ImportFile(files[i])) imported.fetch_add(1);
+                else failed = true;
+            }
+            importers_left.fetch_sub(1);
+        });
+    }
+    // One reader pins a single snapshot throughout: it must not move, not
+    // even for queries answered from the projection and range trees, which
+    // the importers keep extending.
+    threads.emplace_back([&] {
+        const PinnedSnapshot pinned = db.Snapshot();
+        const uint64_t seq = pinned.seq();
+        const uint64_t n = count_rows(db, pinned.get());
+        const std::string ranged = "WHERE bytes > 0 AND created_at > 0";
+        const std::string by_id = "WHERE image_id = '" + ids[0] + "'";
+        while (importers_left.load() > 0) {
+            if (count_rows(db, pinned.get()) != n || pinned->size() != n || pinned.seq() != seq) failed = true;
+            if (count_rows(db, pinned.get(), ranged) != n || count_rows(db, pinned.get(), by_id) != 1) failed = true;
+            if (db.FindByTags("red", 0, 10, nullptr, pinned.get()).size() != 1) failed = true;
+        }
+    });
+    for (int t = 0; t < kReaders; ++t) {
+        threads.emplace_back([&, t] {
+            std::unordered_set<std::string> seen;
+            uint64_t last_count = 0;
+            size_t last_size = 0;
+            bool more = true;
+            while (more) {
+                more = importers_left.load() > 0;   // one full pass after the last import
+                const PinnedSnapshot snap = db.Snapshot();
+                const std::vector<ImageMeta> live = snap->Live();
+                if (live.size() != snap->size() || live.size() < last_size) failed = true;
+                last_size = live.size();
+                for (const ImageMeta& m : live) seen.insert(m.image_id);
+                for (const std::string& id : seen) {
+                    if (!db.GetImage(id)) failed = true;
+                }
+                if (t % 2 == 0) {
+                    const uint64_t n = count_rows(db);
+                    if (n < last_count) failed = true;
+                    last_count = n;
+                } else if (db.LoadCatalog().size() < last_size) {
+                    failed = true;
+                }
+                reads.fetch_add(1);
+            }
+            if (seen.size() != static_cast<size_t>(kFiles - 1)) failed = true;
+        });
+    }
+    for (std::thread& th : threads) th.join();
+    std::cout << "imported " << imported.load() << " with " << reads.load() << " concurrent reads\n";
+    expect(!failed.load(), "readers saw consistent, growing snapshots");
+    expect(imported.load() == kFiles - 2 && db.Snapshot()->size() == static_cast<size_t>(kFiles - 1),
+           "every import committed");
+    expect(count_rows(db) == static_cast<uint64_t>(kFiles - 1), "count after imports");
+
+    // 3) The published snapshot matches what a fresh handle reads from disk
+    {
+        const ImageDB fresh = ImageDB::Open(dir + "/db", 1);
+        std::unordered_set<std::string> a, b;
+        for (const ImageMeta& m : db.LoadCatalog()) a.insert(m.image_id + m.sha256 + std::to_string(m.ordinal));
+        for (const ImageMeta& m : fresh.LoadCatalog()) b.insert(m.image_id + m.sha256 + std::to_string(m.ordinal));
+        expect(a == b && a.size() == static_cast<size_t>(kFiles - 1), "snapshot matches disk");
+        expect(fresh.FindByTags("red", 0, 10) == std::vector<std::string>{ids[0]}, "tags match disk");
+        // The fresh handle's pHash index is built from disk; db's has
+        // every import since in its tail.
+        auto similar = [&](const ImageDB& h, int file) {
+            std::vector<std::string> out;
+            for (const SimilarHit& hit : h.FindSimilar(files[static_cast<size_t>(file)], 10)) out.push_back(hit.image_id);
+            return out;
+        };
+        bool same = true;
+        for (int i : {0, 1, 5, 20}) same &= similar(db, i) == similar(fresh, i);
+        expect(same && !similar(db, 5).empty(), "similar images match disk");
+    }
+
+    // 4) A second handle has its own writer lease, as another process
+    //    would: writes through either are seen by the other
+    {
+        ImageDB other = ImageDB::Open(dir + "/db", 1);
+        const size_t before = db.Snapshot()->size();
+        expect(other.Snapshot()->size() == before, "second handle loads the catalog");
+
+        std::vector<std::string> theirs;
+        std::thread mine([&] {
+            for (int i = 0; i < 4; ++i) {
+                if (!db.ImportFile(make_image(dir + "/src", 100 + i))) failed = true;
+            }
+        });
+        for (int i = 0; i < 4; ++i) {
+            ImportResult r;
+            if (other.ImportFile(make_image(dir + "/src", 110 + i), &r)) theirs.push_back(r.image_id);
+            else failed = true;
+        }
+        mine.join();
+        expect(!failed.load() && theirs.size() == 4, "imports through both handles");
+        const PinnedSnapshot a = db.Snapshot(), b = other.Snapshot();
+        expect(a->size() == before + 8 && b->size() == before + 8, "each sees the other's imports");
+        expect(db.GetImage(theirs[0]) && db.GetImage(theirs[0])->ordinal == other.GetImage(theirs[0])->ordinal,
+               "same ordinals");
+
+        const std::string gone = db.BlobPath(db.GetImage(theirs[1])->sha256);
+        expect(other.Delete(theirs[1]) && other.TagImage(theirs[2], {"blue"}, {}), "delete and tag elsewhere");
+        expect(!db.GetImage(theirs[1]) && db.FindByTags("blue", 0, 10) == std::vector<std::string>{theirs[2]},
+               "rewrites seen");
+        expect(count_rows(db) == before + 7 && count_rows(other) == before + 7, "queries agree");
+
+        // Appends are picked up while another writer holds the lease
+        expect(other.ImportFile(make_image(dir + "/src", 120)), "import before the lease is taken");
+        WriterLease writer = WriterLease::Open(dir + "/db");
+        expect(writer.Acquire(), "lease held elsewhere");
+        std::future<size_t> seen = std::async(std::launch::async, [&] { return db.Snapshot()->size(); });
+        const bool ready = seen.wait_for(std::chrono::seconds(5)) == std::future_status::ready;
+
+        // So does the garbage collector, until it compacts the reference log
+        std::future<bool> gc = std::async(std::launch::async, [&] { return db.CollectGarbage(); });
+        for (int i = 0; i < 500 && std::filesystem::exists(gone); ++i) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+        const bool unlinked = !std::filesystem::exists(gone);
+        const bool waiting = gc.wait_for(std::chrono::milliseconds(50)) == std::future_status::timeout;
+        writer.Release();
+        expect(ready && seen.get() == before + 8, "reader catches up without the lease");
+        expect(unlinked && waiting && gc.get(), "garbage collected outside the lease, compacted under it");
+    }
+
+    // 5) Clustering trains on a snapshot while imports go on; images
+    //    committed meanwhile are still assigned
+    {
+        std::thread importer([&] {
+            for (int i = kFiles; i < kFiles + kLater; ++i) {
+                if (!db.ImportFile(files[static_cast<size_t>(i)])) failed = true;
+            }
+        });
+        const bool trained = db.TrainClusters(ClusterFeature::Color, 4, 16, 5);
+        importer.join();
+        size_t assigned = 0;
+        for (size_t n : db.ClusterSizes()) assigned += n;
+        expect(trained && !failed.load(), "clustering during imports");
+        expect(assigned == db.Snapshot()->size(), "every image assigned");
+        std::ostringstream out;
+        db.RunQuery("SELECT COUNT(*) FROM images WHERE cluster < 4", out);
+        expect(std::stoull(out.str()) == assigned, "query sees the clusters");
+
+        // Imports keep the model open; retraining replaces it
+        expect(db.ImportFile(make_image(dir + "/src", 130)) && db.TrainClusters(ClusterFeature::Color, 3, 16, 5) &&
+                   db.ImportFile(make_image(dir + "/src", 131)),
+               "import, retrain, import");
+        const std::vector<size_t> sizes = db.ClusterSizes();
+        assigned = 0;
+        for (size_t n : sizes) assigned += n;
+        expect(sizes.size() == 3 && assigned == db.Snapshot()->size(), "imports join the retrained model");
+
+        // Cluster and colour queries answer while another writer holds the lease
+        WriterLease writer = WriterLease::Open(dir + "/db");
+        expect(writer.Acquire(), "lease held elsewhere");
+        const std::vector<uint16_t> flat(kColorBins, kHistTotal / kColorBins);
+        std::future<size_t> clustered = std::async(std::launch::async, [&] {
+            size_t n = 0;
+            for (size_t s : db.ClusterSizes()) n += s;
+            return n;
+        });
+        std::future<size_t> matched =
+            std::async(std::launch::async, [&] { return db.SearchColor(flat.data(), 1000, 0.0f).size(); });
+        const bool answered = clustered.wait_for(std::chrono::seconds(5)) == std::future_status::ready &&
+                              matched.wait_for(std::chrono::seconds(5)) == std::future_status::ready;
+        writer.Release();
+        expect(answered && clustered.get() == assigned && matched.get() > 0, "queries run without the lease");
+    }
+
+    // 6) The MIME type comes from the content, whichever path imports it
+    {
+        const unsigned char px[4 * 4 * 3] = {200, 10, 10};
+        const std::string png = dir + "/src/mime.png", named_jpg = dir + "/src/mime.jpg";
+        stbi_write_png(png.c_str(), 4, 4, 3, px, 4 * 3);
+        stbi_write_png(named_jpg.c_str(), 4, 3, 3, px, 4 * 3);
+        ImportResult r;
+        expect(db.ImportFile(png, &r) && db.GetImage(r.image_id)->mime == "image/png", "ImportFile sniffs PNG");
+        expect(db.ImportFiles({named_jpg}) == 1, "ImportFiles");
+        bool batch_png = false;
+        for (const ImageMeta& m : db.LoadCatalog()) batch_png |= m.mime == "image/png" && m.height == 3;
+        expect(batch_png && db.GetImage(ids[0])->mime == "image/jpeg", "ImportFiles sniffs PNG despite the name");
+    }
+
+    // 7) A failed import gives its blob reference back: the content is not
+    //    taken for a duplicate afterwards and no blob is left behind
+    {
+        const std::string bad = dir + "/src/bad.jpg";
+        std::ofstream(bad, std::ios::binary) << "\xFF\xD8\xFF not really a JPEG";
+        const std::string sha = sha256_file(bad);
+        ImportResult r;
+        expect(!db.ImportFile(bad, &r) && !r.duplicate, "undecodable file fails");
+        expect(!fs::exists(db.BlobPath(sha)), "blob removed");
+        expect(!db.ImportFile(bad, &r) && !r.duplicate, "retry is not a duplicate");
+        expect(db.ImportFiles({bad}) == 0 && !fs::exists(db.BlobPath(sha)), "batch import cleans up too");
+
+        // Likewise when a catalog step throws before the record: here the
+        // colour sidecar cannot be opened
+        const std::string hist = dir + "/db/catalog/color.hist";
+        fs::rename(hist, hist + ".saved");
+        fs::create_directory(hist);
+        const std::string good = make_image(dir + "/src", 140);
+        const std::string good_sha = sha256_file(good);
+        const size_t before = db.Snapshot()->size();
+        const bool refused = !db.ImportFile(good) && !fs::exists(db.BlobPath(good_sha));
+        const bool batch_refused = db.ImportFiles({good}) == 0 && !fs::exists(db.BlobPath(good_sha));
+        fs::remove(hist);
+        fs::rename(hist + ".saved", hist);
+        expect(refused && batch_refused && db.Snapshot()->size() == before, "failing sidecar abandons the claim");
+        expect(db.ImportFile(good), "import once the sidecar is back");
+
+        // Each import goes into the range trees as it commits
+        expect(db.ImportFile(make_image(dir + "/src", 141), &r), "import");
+        const std::optional<ImageMeta> m = db.GetImage(r.image_id);
+        const std::optional<BTree> tree = BTree::OpenReadOnly(dir + "/db/catalog/bytes.bt");
+        const std::vector<uint32_t> hits = tree ? tree->Range(m->bytes, m->bytes) : std::vector<uint32_t>{};
+        expect(std::find(hits.begin(), hits.end(), m->ordinal) != hits.end(), "range tree updated in place");
+    }
+
+    // 8) The snapshot's pHash index across its tail and rebuilds
+    {
+        CatalogSnapshot::Ptr snap = CatalogSnapshot::Build({}, {}, TagStore(), {}, {});
+        std::vector<uint64_t> hashes;
+        uint64_t x = 0x9e3779b97f4a7c15ULL;
+        for (uint32_t o = 0; o < 6000; ++o) {
+            x ^= x << 13, x ^= x >> 7, x ^= x << 17;
+            ImageMeta m;
+            m.image_id = "img" + std::to_string(o);
+            m.ordinal = o;
+            m.phash = o % 3 == 0 ? hashes.empty() ? x : hashes[o / 2] ^ (uint64_t{1} << (o % 64)) : x;
+            hashes.push_back(m.phash);
+            snap = snap->WithRecord(m);
+        }
+        ImageMeta rehashed = *snap->Get(7);
+        rehashed.phash = hashes[0];
+        hashes[7] = hashes[0];
+        snap = snap->WithRecord(rehashed)->WithDeleted(3, TagStore());
+        bool same = true;
+        for (uint32_t q : {0u, 7u, 300u, 4500u, 5999u}) {
+            std::vector<std::pair<uint32_t, int>> want;
+            for (uint32_t o = 0; o < hashes.size(); ++o) {
+                const int d = hamming64(hashes[o], hashes[q]);
+                if (o != 3 && d <= 6) want.emplace_back(o, d);
+            }
+            same &= snap->Similar(hashes[q], 6) == want;
+        }
+        expect(same, "pHash index matches a scan after rebuilds, edits and deletes");
+    }
+
+    fs::remove_all(dir);
+    std::cout << "All tests passed ✅\n";
+    return 0;
+}
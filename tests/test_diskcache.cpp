@@ -0,0 +1,106 @@
+// test_diskcache.cpp
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "diskcache.h"
+
+static void expect(bool cond, const char* label) {
+    if (!cond) {
+        std::cerr << "[FAIL] " << label << "\n";
+        std::exit(1);
+    }
+    std::cout << "[PASS] " << label << "\n";
+}
+
+static std::string read_all(const std::string& path) {
+    std::ifstream in(path, std::ios::binary);
+    return std::string(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+}
+
+static std::string key_of(const char* prefix, int i) {
+    std::string key(prefix);
+    key += std::to_string(i);
+    key += ".jpg";
+    return key;
+}
+
+int main() {
+    namespace fs = std::filesystem;
+    const std::string dir = "tmp_test_diskcache";
+    fs::remove_all(dir);
+
+    // 1) Insert, Lookup, replace, Erase
+    {
+        DiskCache cache = DiskCache::Open(dir, 1 << 20);
+        expect(cache.Lookup("ab12_300x200_cover.jpg").empty(), "miss");
+        expect(cache.Insert("ab12_300x200_cover.jpg", std::string(1000, 'x')), "insert");
+        const std::string path = cache.Lookup("ab12_300x200_cover.jpg");
+        expect(path == dir + "/ab/ab12_300x200_cover.jpg" && read_all(path) == std::string(1000, 'x'), "hit");
+        expect(cache.Insert("ab12_300x200_cover.jpg", "short") && cache.stats().bytes == 5 &&
+                   cache.stats().entries == 1, "replace");
+        cache.Erase("ab12_300x200_cover.jpg");
+        expect(!fs::exists(path) && cache.stats().entries == 0 && cache.stats().bytes == 0, "Erase");
+        expect(!cache.Insert("../escape", "x") && !cache.Insert("a/b", "x"), "keys cannot leave the directory");
+        const DiskCache::Stats st = cache.stats();
+        expect(st.hits == 1 && st.misses == 1, "hit and miss counters");
+    }
+
+    // 2) The byte budget holds, dropping the least recently used
+    {
+        fs::remove_all(dir);
+        DiskCache cache = DiskCache::Open(dir, 10000);
+        for (int i = 0; i < 10; ++i) cache.Insert(key_of("k", i), std::string(1000, 'a' + i));
+        expect(!cache.Lookup(key_of("k", 0)).empty(), "touch k0");
+        cache.Insert(key_of("k", 10), std::string(1000, 'z'));
+        const DiskCache::Stats st = cache.stats();
+        expect(st.bytes <= 10000 && st.evictions == 1, "within budget");
+        expect(!cache.Lookup(key_of("k", 0)).empty() && cache.Lookup(key_of("k", 1)).empty(), "LRU victim");
+        expect(!fs::exists(dir + "/k1/" + key_of("k", 1)), "victim unlinked");
+        expect(cache.Insert("big.png", std::string(20000, 'b')) && cache.Lookup("big.png").empty(),
+               "files over the budget are not kept");
+    }
+
+    // 3) Reopening indexes what is on disk and clears temp files
+    {
+        std::ofstream(dir + "/k2/~tmp-1-1") << "partial";
+        DiskCache cache = DiskCache::Open(dir, 10000);
+        const DiskCache::Stats st = cache.stats();
+        expect(st.entries == 10 && st.bytes == 10000, "index rebuilt");
+        expect(read_all(cache.Lookup(key_of("k", 5))) == std::string(1000, 'f'), "contents survive");
+        expect(!fs::exists(dir + "/k2/~tmp-1-1"), "temp file removed");
+        DiskCache smaller = DiskCache::Open(dir, 5000);
+        expect(smaller.stats().bytes <= 5000 && smaller.stats().entries == 5, "smaller budget trims on open");
+    }
+
+    // 4) Concurrent inserts and lookups
+    {
+        fs::remove_all(dir);
+        DiskCache cache = DiskCache::Open(dir, 200000);
+        std::vector<std::thread> workers;
+        for (int t = 0; t < 4; ++t) {
+            workers.emplace_back([&cache, t] {
+                for (int i = 0; i < 300; ++i) {
+                    const std::string key = key_of("c", (i * 7 + t) % 400);
+                    if (cache.Lookup(key).empty()) cache.Insert(key, std::string(1000, 'c'));
+                }
+            });
+        }
+        for (std::thread& w : workers) w.join();
+        const DiskCache::Stats st = cache.stats();
+        uint64_t on_disk = 0;
+        for (const auto& e : fs::recursive_directory_iterator(dir)) {
+            if (e.is_regular_file()) on_disk += e.file_size();
+        }
+        expect(st.bytes <= 200000 && on_disk == st.bytes, "index matches the directory");
+    }
+
+    fs::remove_all(dir);
+    std::cout << "All tests passed ✅\n";
+    return 0;
+}
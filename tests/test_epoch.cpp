@@ -0,0 +1,103 @@
+// test_epoch.cpp
+#include <atomic>
+#include <cstdlib>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#include "epoch.h"
+
+static void expect(bool cond, const char* label) {
+    if (!cond) {
+        std::cerr << "[FAIL] " << label << "\n";
+        std::exit(1);
+    }
+    std::cout << "[PASS] " << label << "\n";
+}
+
+static std::atomic<int> live{0};
+
+// Poisons itself when freed, so a reader touching a freed node sees it.
+struct Node {
+    static constexpr uint64_t kAlive = 0x600DF00D;
+    uint64_t canary = kAlive;
+    uint64_t value;
+    explicit Node(uint64_t v) : value(v) { live.fetch_add(1); }
+    ~Node() {
+        canary = 0;
+        live.fetch_sub(1);
+    }
+};
+
+int main() {
+    // 1) A retired object waits for the pins taken before it
+    {
+        EpochDomain d;
+        bool freed = false;
+        EpochDomain::Guard g = d.Pin();
+        expect(g && d.pinned() == 1, "pin");
+        d.Retire([&] { freed = true; });
+        expect(d.Collect() == 0 && !freed && d.pending() == 1, "held while pinned");
+
+        EpochDomain::Guard later = d.Pin();
+        expect(later.epoch() > g.epoch(), "epoch advances on retire");
+        g.Release();
+        expect(!g && d.Collect() == 1 && freed, "freed once unpinned");
+        expect(d.pending() == 0 && d.pinned() == 1, "later pin does not hold it");
+
+        EpochDomain::Guard moved = std::move(later);
+        expect(!later && moved && d.pinned() == 1, "guard moves");
+    }
+
+    // 2) The destructor frees what is still retired
+    {
+        int freed = 0;
+        {
+            EpochDomain d;
+            for (int i = 0; i < 10; ++i) d.Retire([&] { ++freed; });
+            expect(d.pending() == 10, "pending");
+        }
+        expect(freed == 10, "drained on destruction");
+    }
+
+    // 3) Readers never see a freed node while a writer keeps replacing it
+    {
+        EpochDomain d;
+        std::atomic<const Node*> head{new Node(0)};
+        std::atomic<bool> stop{false};
+        std::atomic<bool> bad{false};
+        std::atomic<uint64_t> reads{0};
+        std::vector<std::thread> readers;
+        for (int t = 0; t < 4; ++t) {
+            readers.emplace_back([&] {
+                uint64_t last = 0;
+                while (!stop.load()) {
+                    EpochDomain::Guard g = d.Pin();
+                    const Node* n = head.load();
+                    if (n->canary != Node::kAlive || n->value < last) bad = true;
+                    last = n->value;
+                    reads.fetch_add(1);
+                }
+            });
+        }
+        const uint64_t kSwaps = 20000;
+        size_t collected = 0;
+        for (uint64_t i = 1; i <= kSwaps; ++i) {
+            const Node* old = head.exchange(new Node(i));
+            d.Retire(old);
+            if (i % 16 == 0) collected += d.Collect();
+            if (i % 1024 == 0) std::this_thread::yield();
+        }
+        stop = true;
+        for (std::thread& r : readers) r.join();
+        collected += d.Collect();
+        std::cout << reads.load() << " reads, " << collected << " of " << kSwaps << " freed while running\n";
+        expect(!bad.load(), "no reader saw a freed node");
+        expect(collected == kSwaps && live.load() == 1 && d.pinned() == 0, "every retired node freed");
+        delete head.load();
+    }
+    expect(live.load() == 0, "no leaks");
+
+    std::cout << "All tests passed ✅\n";
+    return 0;
+}
@@ -0,0 +1,111 @@
+// test_hnsw.cpp
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "distance.h"
+#include "embed.h"
+#include "hnsw.h"
+
+static void expect(bool cond, const char* label) {
+    if (!cond) {
+        std::cerr << "[FAIL] " << label << "\n";
+        std::exit(1);
+    }
+    std::cout << "[PASS] " << label << "\n";
+}
+
+static void cleanup(const std::string& path) {
+    std::remove(path.c_str());
+    std::remove((path + ".ords").c_str());
+    std::remove((path + ".hnsw").c_str());
+}
+
+int main() {
+    // 1) Kernels agree with a plain loop and half conversion round-trips
+    {
+        std::mt19937 rng(3);
+        std::uniform_real_distribution<float> u(-2.f, 2.f);
+        std::vector<float> a(37), b(37);
+        for (auto& x : a) x = u(rng);
+        for (auto& x : b) x = u(rng);
+        float ref = 0.f, dref = 0.f;
+        for (size_t i = 0; i < a.size(); ++i) {
+            ref += (a[i] - b[i]) * (a[i] - b[i]);
+            dref += a[i] * b[i];
+        }
+        expect(std::fabs(l2sq_f32(a.data(), b.data(), a.size()) - ref) < 1e-3f, "l2sq_f32 matches scalar");
+        expect(std::fabs(dot_f32(a.data(), b.data(), a.size()) - dref) < 1e-3f, "dot_f32 matches scalar");
+
+        bool ok = true;
+        for (float x : {0.f, 1.f, -1.5f, 65504.f, 1e-5f, 0.333f})
+            ok &= std::fabs(half_to_float(float_to_half(x)) - x) <= std::fabs(x) * 1e-3f + 1e-7f;
+        expect(ok, "float16 round-trip");
+    }
+
+    const std::string path = "tmp_test_hnsw.bin";
+    cleanup(path);
+    const uint32_t dim = 24;
+    const size_t n = 2000;
+
+    std::mt19937_64 rng(5);
+    std::normal_distribution<float> g(0.f, 1.f);
+    {
+        EmbeddingStore w = EmbeddingStore::Create(path, dim, EmbedDType::F32);
+        std::vector<float> v(dim);
+        for (size_t i = 0; i < n; ++i) {
+            for (auto& x : v) x = g(rng);
+            w.Append(static_cast<uint32_t>(1000 + i), v.data());
+        }
+    }
+    EmbeddingStore store = EmbeddingStore::Open(path);
+
+    // 2) Store layout
+    expect(store.size() == n && store.dim() == dim, "store size and dim");
+    expect(reinterpret_cast<uintptr_t>(store.Row(7)) % EmbeddingStore::kAlign == 0, "rows are 64-byte aligned");
+    expect(store.ordinal(42) == 1042, "row ordinals");
+
+    // 3) Recall against brute force
+    Hnsw index(&store);
+    for (size_t i = 0; i < n; ++i) index.Add(static_cast<uint32_t>(i));
+
+    size_t found = 0;
+    const int k = 10, nq = 50;
+    std::vector<float> q(dim);
+    for (int qi = 0; qi < nq; ++qi) {
+        for (auto& x : q) x = g(rng);
+        std::vector<std::pair<float, uint32_t>> all;
+        for (size_t i = 0; i < n; ++i) all.emplace_back(store.Distance(q.data(), i), static_cast<uint32_t>(i));
+        std::partial_sort(all.begin(), all.begin() + k, all.end());
+        for (const auto& hit : index.Search(q.data(), k, 100)) {
+            for (int j = 0; j < k; ++j) found += (all[j].second == hit.second);
+        }
+    }
+    expect(static_cast<double>(found) / (nq * k) > 0.9, "recall@10 > 0.9 at ef=100");
+
+    // 4) Self-query finds itself
+    {
+        std::vector<float> v(dim);
+        store.Decode(123, v.data());
+        const auto hits = index.Search(v.data(), 1, 32);
+        expect(!hits.empty() && hits[0].second == 123, "self-query returns own row");
+    }
+
+    // 5) Save/Load round-trip gives identical answers
+    {
+        expect(index.Save(path + ".hnsw"), "save index");
+        auto loaded = Hnsw::Load(path + ".hnsw", &store);
+        expect(loaded.has_value() && loaded->size() == n, "load index");
+        for (auto& x : q) x = g(rng);
+        expect(loaded->Search(q.data(), k, 64) == index.Search(q.data(), k, 64), "loaded index answers identically");
+    }
+
+    cleanup(path);
+    std::cout << "\nAll tests passed ✅\n";
+    return 0;
+}
@@ -0,0 +1,228 @@
+// test_http.cpp
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "http.h"
+
+static void expect(bool cond, const char* label) {
+    if (!cond) {
+        std::cerr << "[FAIL] " << label << "\n";
+        std::exit(1);
+    }
+    std::cout << "[PASS] " << label << "\n";
+}
+
+static int connect_to(uint16_t port) {
+    const int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    ::inet_pton(AF_INET, "127.0.0.1", &addr.sin_addr);
+    if (::connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof addr) != 0) {
+        ::close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static bool send_all(int fd, const std::string& s) {
+    return ::send(fd, s.data(), s.size(), 0) == static_cast<ssize_t>(s.size());
+}
+
+// Everything the server sends until it closes the connection.
+static std::string read_until_close(int fd) {
+    std::string out;
+    char buf[4096];
+    for (ssize_t n; (n = ::recv(fd, buf, sizeof buf, 0)) > 0;) out.append(buf, static_cast<size_t>(n));
+    return out;
+}
+
+int main() {
+    // 1) Parser
+    {
+        HttpRequest req;
+        size_t used = 0;
+        const std::string get = "GET /query?q=SELECT%20*+FROM%20images&x=1 HTTP/1.1\r\nHost: a\r\n\r\n";
+        expect(parse_http_request(get, 1024, &req, &used) == 0 && used == get.size(), "GET parses");
+        expect(req.method == "GET" && req.path == "/query" && req.keep_alive, "request line");
+        expect(req.param("q") == std::string("SELECT * FROM images") && req.param("x") == std::string("1") &&
+                   !req.param("y"),
+               "query parameters");
+        expect(req.header("host") && *req.header("host") == "a", "headers");
+
+        const std::string post = "POST /images HTTP/1.1\r\nContent-Length: 5\r\nConnection: close\r\n\r\nhello";
+        expect(parse_http_request(post.substr(0, post.size() - 2), 1024, &req, &used) == -1, "partial body");
+        expect(parse_http_request(post + post, 1024, &req, &used) == 0 && used == post.size() && req.body == "hello" &&
+                   !req.keep_alive,
+               "body and pipelined remainder");
+        expect(parse_http_request("GET / HTTP/1.0\r\n\r\n", 1024, &req, &used) == 0 && !req.keep_alive,
+               "HTTP/1.0 closes by default");
+        expect(parse_http_request(post, 4, &req, &used) == 413, "body too large");
+        expect(parse_http_request("POST / HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n", 1024, &req, &used) == 501,
+               "chunked rejected");
+        expect(parse_http_request("GARBAGE\r\n\r\n", 1024, &req, &used) == 400, "bad request line");
+        expect(parse_http_request(std::string(20000, 'a'), 1024, &req, &used) == 431, "header too large");
+        expect(parse_http_request("GET / HTT", 1024, &req, &used) == -1, "partial head");
+
+        uint64_t first = 0, last = 0;
+        expect(parse_http_range("bytes=10-19", 100, &first, &last) == 1 && first == 10 && last == 19, "range");
+        expect(parse_http_range("bytes=90-", 100, &first, &last) == 1 && first == 90 && last == 99, "open range");
+        expect(parse_http_range("bytes=-30", 100, &first, &last) == 1 && first == 70 && last == 99, "suffix range");
+        expect(parse_http_range("bytes=50-500", 100, &first, &last) == 1 && last == 99, "range clamped to size");
+        expect(parse_http_range("bytes=100-", 100, &first, &last) == -1 &&
+                   parse_http_range("bytes=-0", 100, &first, &last) == -1,
+               "unsatisfiable ranges");
+        expect(parse_http_range("bytes=0-1,5-6", 100, &first, &last) == 0 &&
+                   parse_http_range("items=0-1", 100, &first, &last) == 0 &&
+                   parse_http_range("bytes=9-3", 100, &first, &last) == 0,
+               "ignored ranges");
+    }
+
+    // 2) Server: pipelined requests are handled in parallel, answered in order
+    HttpServerOptions opts;
+    opts.port = 0;
+    opts.workers = 4;
+    // Larger than the socket buffers, so sendfile has to resume after EAGAIN.
+    const std::string file = "tmp_test_http.bin";
+    std::string content(6 << 20, '\0');
+    std::mt19937 rng(3);
+    for (char& ch : content) ch = static_cast<char>(rng());
+    std::ofstream(file, std::ios::binary).write(content.data(), static_cast<std::streamsize>(content.size()));
+
+    HttpServer server = HttpServer::Listen(opts, [&](const HttpRequest& req) {
+        if (req.path == "/file") return HttpResponse::File(req, file, "application/octet-stream");
+        if (req.path == "/slow") std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        if (req.path == "/boom") throw std::runtime_error("boom");
+        return HttpResponse::Text(200, req.method + " " + req.path + " " + req.body);
+    });
+    std::thread loop([&] { server.Run(); });
+    {
+        const int fd = connect_to(server.port());
+        expect(fd >= 0, "connect");
+        const auto start = std::chrono::steady_clock::now();
+        expect(send_all(fd, "GET /slow HTTP/1.1\r\n\r\n"
+                            "GET /slow HTTP/1.1\r\n\r\n"
+                            "POST /echo HTTP/1.1\r\nContent-Length: 3\r\n\r\nabc"
+                            "GET /boom HTTP/1.1\r\nConnection: close\r\n\r\n"),
+               "send pipelined");
+        const std::string got = read_until_close(fd);
+        const double ms =
+            std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        ::close(fd);
+        const size_t a = got.find("GET /slow"), b = got.find("GET /slow", a + 1), c = got.find("POST /echo abc"),
+                     d = got.find("HTTP/1.1 500");
+        expect(a != std::string::npos && b != std::string::npos && c != std::string::npos &&
+                   d != std::string::npos && a < b && b < c && c < d,
+               "responses in request order");
+        expect(got.find("Connection: close") != std::string::npos, "Connection: close honoured");
+        expect(ms < 190, "slow requests ran in parallel");
+    }
+    {
+        // Keep-alive: two round trips on one connection.
+        const int fd = connect_to(server.port());
+        std::string got;
+        char buf[4096];
+        for (int i = 0; i < 2; ++i) {
+            send_all(fd, "GET /ping HTTP/1.1\r\n\r\n");
+            const ssize_t n = ::recv(fd, buf, sizeof buf, 0);
+            if (n > 0) got.append(buf, static_cast<size_t>(n));
+        }
+        ::close(fd);
+        expect(got.find("GET /ping") != got.rfind("GET /ping"), "keep-alive");
+    }
+    {
+        const int fd = connect_to(server.port());
+        send_all(fd, "POST / HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n");
+        const std::string got = read_until_close(fd);
+        ::close(fd);
+        expect(got.rfind("HTTP/1.1 501", 0) == 0, "parse errors answered then closed");
+    }
+    {
+        // 3) File bodies, whole and ranged, pipelined behind each other
+        const int fd = connect_to(server.port());
+        send_all(fd, "GET /file HTTP/1.1\r\n\r\n"
+                     "GET /file HTTP/1.1\r\nRange: bytes=1000-1999\r\n\r\n"
+                     "GET /file HTTP/1.1\r\nRange: bytes=-10\r\n\r\n"
+                     "GET /file HTTP/1.1\r\nRange: bytes=99999999-\r\nConnection: close\r\n\r\n");
+        const std::string got = read_until_close(fd);
+        ::close(fd);
+        const size_t body1 = got.find("\r\n\r\n") + 4;
+        const size_t head2 = body1 + content.size();
+        expect(got.rfind("HTTP/1.1 200", 0) == 0 && got.find("Accept-Ranges: bytes") < body1 &&
+                   got.compare(body1, content.size(), content) == 0,
+               "whole file");
+        const size_t body2 = got.find("\r\n\r\n", head2) + 4;
+        expect(got.compare(head2, 12, "HTTP/1.1 206") == 0 &&
+                   got.find("Content-Range: bytes 1000-1999/" + std::to_string(content.size()), head2) < body2 &&
+                   got.compare(body2, 1000, content, 1000, 1000) == 0,
+               "byte range");
+        const size_t head3 = body2 + 1000;
+        const size_t body3 = got.find("\r\n\r\n", head3) + 4;
+        expect(got.compare(body3, 10, content, content.size() - 10, 10) == 0, "suffix range");
+        expect(got.compare(body3 + 10, 12, "HTTP/1.1 416") == 0 &&
+                   got.find("Content-Range: bytes */" + std::to_string(content.size()), body3) != std::string::npos,
+               "unsatisfiable range");
+    }
+    server.Stop();
+    loop.join();
+    std::filesystem::remove(file);
+
+    // 4) Head handler: answers before the body is sent, or streams it to a sink
+    {
+        struct Collect : HttpBodySink {
+            std::string got;
+            size_t pieces = 0;
+            bool Write(std::string_view piece) override {
+                got += piece;
+                ++pieces;
+                return true;
+            }
+        };
+        HttpServer streaming = HttpServer::Listen(
+            opts,
+            [](const HttpRequest& req) {
+                const auto* sink = dynamic_cast<const Collect*>(req.body_sink.get());
+                const size_t n = sink ? sink->got.size() : req.body.size();
+                return HttpResponse::Text(200, req.path + " " + std::to_string(n) + (sink && sink->pieces > 1 ? " pieces" : ""));
+            },
+            [](const HttpRequest& req, std::shared_ptr<HttpBodySink>* sink) -> std::optional<HttpResponse> {
+                if (req.path == "/full") return HttpResponse::Text(429, "full\n");
+                if (req.path == "/upload") *sink = std::make_shared<Collect>();
+                return std::nullopt;
+            });
+        std::thread serve([&] { streaming.Run(); });
+        const int fd = connect_to(streaming.port());
+        const std::string body(3 << 20, 'x');
+        send_all(fd, "POST /full HTTP/1.1\r\nContent-Length: " + std::to_string(body.size()) + "\r\n\r\n");
+        char buf[4096];
+        const ssize_t n = ::recv(fd, buf, sizeof buf, 0);
+        expect(n > 0 && std::string(buf, static_cast<size_t>(n)).rfind("HTTP/1.1 429", 0) == 0,
+               "answered from the head, before the body is sent");
+        send_all(fd, body);
+        send_all(fd, "POST /upload HTTP/1.1\r\nContent-Length: " + std::to_string(body.size()) + "\r\n\r\n" + body +
+                         "POST /echo HTTP/1.1\r\nContent-Length: 2\r\nConnection: close\r\n\r\nhi");
+        const std::string got = read_until_close(fd);
+        ::close(fd);
+        expect(got.find("/upload " + std::to_string(body.size()) + " pieces") != std::string::npos,
+               "body streamed to the sink in pieces");
+        expect(got.find("/echo 2") != std::string::npos, "dropped body does not derail the connection");
+        streaming.Stop();
+        serve.join();
+    }
+
+    std::cout << "All tests passed ✅\n";
+    return 0;
+}
@@ -0,0 +1,79 @@
+// test_idgen.cpp
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <string>
+
+#include "idgen.h"
+
+static void expect(bool cond, const char* label) {
+    if (!cond) {
+        std::cerr << "[FAIL] " << label << "\n";
+        std::exit(1);
+    }
+    std::cout << "[PASS] " << label << "\n";
+}
+
+int main() {
+    const std::string path = "tmp_test_idgen.hwm";
+    std::filesystem::remove(path);
+    const uint64_t t0 = 1760700000000ULL;   // 2025-10-17
+
+    char prev[IdGenerator::kLen + 1] = "";
+    char id[IdGenerator::kLen + 1];
+
+    // 1) Format and timestamp roundtrip
+    {
+        IdGenerator g = IdGenerator::Open(path);
+        expect(g.Next(t0, id), "Next");
+        expect(std::strlen(id) == IdGenerator::kLen, "26 characters");
+        expect(std::strspn(id, "0123456789ABCDEFGHJKMNPQRSTVWXYZ") == IdGenerator::kLen, "Crockford alphabet");
+        expect(IdGenerator::Timestamp(id) == t0, "timestamp roundtrip");
+        std::memcpy(prev, id, sizeof id);
+
+        // 2) Strictly increasing within a millisecond and when the clock steps back
+        bool increasing = true;
+        for (int i = 0; i < 100000; ++i) {
+            const uint64_t now = i < 50000 ? t0 + i / 1000 : t0 - 5000;
+            increasing &= g.Next(now, id) && std::strcmp(prev, id) < 0;
+            std::memcpy(prev, id, sizeof id);
+        }
+        expect(increasing, "ids increase lexicographically");
+        expect(IdGenerator::Timestamp(prev) == t0 + 49, "stepped-back clock keeps the last timestamp");
+    }
+
+    // 3) Restart with the clock far behind resumes above every issued id
+    {
+        IdGenerator g = IdGenerator::Open(path);
+        expect(g.Next(t0 - 3600 * 1000, id) && std::strcmp(prev, id) < 0, "monotonic across restart");
+        expect(IdGenerator::Timestamp(id) >= t0 + 49 && IdGenerator::Timestamp(id) <= t0 + 49 + IdGenerator::kLeaseMs,
+               "resumes at the high-water mark");
+    }
+
+    // 4) Two generators in the same millisecond do not collide
+    {
+        IdGenerator a = IdGenerator::Open(path), b = IdGenerator::Open(path);
+        char ida[IdGenerator::kLen + 1], idb[IdGenerator::kLen + 1];
+        expect(a.Next(t0 + 100000, ida) && b.Next(t0 + 100000, idb) && std::strcmp(ida, idb) != 0,
+               "random bits separate concurrent generators");
+    }
+
+    // 5) A generator reserving behind another does not lower the mark
+    {
+        IdGenerator a = IdGenerator::Open(path), b = IdGenerator::Open(path);
+        expect(a.Next(t0 + 500000, id) && b.Next(t0 + 200000, id), "both reserve");
+        IdGenerator c = IdGenerator::Open(path);
+        expect(c.Next(t0, id) && IdGenerator::Timestamp(id) >= t0 + 500000, "mark only moves up");
+
+        // 6) One open generator reserves once per lease, not once per id
+        const uint64_t first = IdGenerator::Timestamp(id);
+        bool close = true;
+        for (int i = 1; i <= 1000; ++i) close &= c.Next(first + i, id) && IdGenerator::Timestamp(id) == first + i;
+        expect(close, "ids follow the clock once past the mark");
+    }
+    std::filesystem::remove(path);
+
+    std::cout << "All tests passed ✅\n";
+    return 0;
+}
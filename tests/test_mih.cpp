@@ -0,0 +1,61 @@
+// test_mih.cpp
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include "mih.h"
+
+static void expect(bool cond, const char* label) {
+    if (!cond) {
+        std::cerr << "[FAIL] " << label << "\n";
+        std::exit(1);
+    }
+    std::cout << "[PASS] " << label << "\n";
+}
+
+int main() {
+    std::mt19937_64 rng(7);
+
+    // Clustered data so every radius has non-trivial answers.
+    std::vector<uint64_t> hashes;
+    for (int c = 0; c < 200; ++c) {
+        const uint64_t center = rng();
+        for (int k = 0; k < 50; ++k) {
+            uint64_t h = center;
+            const int flips = static_cast<int>(rng() % 20);
+            for (int b = 0; b < flips; ++b) h ^= 1ULL << (rng() % 64);
+            hashes.push_back(h);
+        }
+    }
+    MultiIndexHash index(hashes);
+
+    // 1) Query agrees with the linear scan for every radius band
+    bool all_equal = true;
+    for (int radius = 0; radius <= 30 && all_equal; radius += 3) {
+        for (int i = 0; i < 50; ++i) {
+            const uint64_t q = hashes[rng() % hashes.size()] ^ (1ULL << (rng() % 64));
+            if (index.Query(q, radius) != index.LinearScan(q, radius)) {
+                all_equal = false;
+                break;
+            }
+        }
+    }
+    expect(all_equal, "Query matches LinearScan for radius 0..30");
+
+    // 2) Exact match at radius 0
+    {
+        const auto hits = index.Query(hashes[123], 0);
+        bool found = false;
+        for (uint32_t id : hits) found |= (id == 123);
+        expect(found, "radius 0 finds the stored hash");
+    }
+
+    // 3) Negative radius and empty index
+    expect(index.Query(hashes[0], -1).empty(), "negative radius is empty");
+    expect(MultiIndexHash({}).Query(42, 8).empty(), "empty index");
+
+    std::cout << "\nAll tests passed ✅\n";
+    return 0;
+}
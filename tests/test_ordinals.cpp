@@ -0,0 +1,77 @@
+// test_ordinals.cpp
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "ordinals.h"
+
+static void expect(bool cond, const char* label) {
+    if (!cond) {
+        std::cerr << "[FAIL] " << label << "\n";
+        std::exit(1);
+    }
+    std::cout << "[PASS] " << label << "\n";
+}
+
+static std::string id_of(int i) { return "20261017-121500-4242-" + std::to_string(100000 + i); }
+
+int main() {
+    const std::string dir = "tmp_test_ordinals";
+    std::filesystem::remove_all(dir);
+    std::filesystem::create_directories(dir);
+
+    // 1) Dense allocation and both lookup directions across table growth
+    const int n = 5000;
+    {
+        OrdinalMap m = OrdinalMap::Open(dir);
+        bool dense = true;
+        for (int i = 0; i < n; ++i) dense &= m.Append(id_of(i)) == static_cast<uint32_t>(i);
+        expect(dense && m.size() == n, "ordinals are dense and in import order");
+
+        bool ok = true;
+        for (int i = 0; i < n; ++i) ok &= m.Find(id_of(i)) == static_cast<uint32_t>(i) && m.image_id(i) == id_of(i);
+        expect(ok, "id -> ordinal -> id roundtrip");
+        expect(m.Find("missing") == OrdinalMap::kNone, "unknown id");
+        expect(m.Append(id_of(3)) == OrdinalMap::kNone, "duplicate id rejected");
+        expect(m.SizeInBytes() < static_cast<size_t>(n) * 96, "compact in memory");
+    }
+
+    // 2) Reopen
+    {
+        const OrdinalMap m = OrdinalMap::Open(dir);
+        expect(m.size() == n && m.Find(id_of(4321)) == 4321, "map survives reopen");
+    }
+
+    // 3) Refresh takes in ids another map appended
+    {
+        const uint32_t u = n;
+        OrdinalMap a = OrdinalMap::Open(dir);
+        OrdinalMap b = OrdinalMap::Open(dir);
+        expect(b.Append(id_of(u)) == u && b.Append(id_of(u + 1)) == u + 1, "second map appends");
+        expect(a.size() == u && a.Find(id_of(u)) == OrdinalMap::kNone, "first map has not seen them yet");
+        a.Refresh();
+        expect(a.size() == u + 2 && a.Find(id_of(u + 1)) == u + 1 && a.Find(id_of(7)) == 7,
+               "refresh reads only the appended ids");
+        expect(a.Append(id_of(u + 2)) == u + 2 && a.file_bytes() == OrdinalMap::Open(dir).file_bytes(),
+               "append after refresh takes the next ordinal");
+    }
+
+    // 4) Ordinal columns: positioned writes overwrite a torn tail
+    {
+        const std::string col = dir + "/col.ords";
+        expect(write_ordinal_column(col, {5, 6, 7}), "write_ordinal_column");
+        std::ofstream(col, std::ios::app | std::ios::binary) << "xy";   // torn append
+        expect(read_ordinal_column(col) == std::vector<uint32_t>({5, 6, 7}), "torn tail ignored");
+        std::fstream out;
+        expect(put_ordinal(out, col, 3, 8), "put_ordinal");
+        out.close();
+        expect(read_ordinal_column(col) == std::vector<uint32_t>({5, 6, 7, 8}), "tail overwritten");
+    }
+    std::filesystem::remove_all(dir);
+
+    std::cout << "All tests passed ✅\n";
+    return 0;
+}
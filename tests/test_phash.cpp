@@ -0,0 +1,92 @@
+// test_phash.cpp
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "phash.h"
+
+// Synthetic RGB test image: a soft diagonal gradient with a bright disc.
+static std::vector<unsigned char> make_image(int w, int h, float cx, float cy, int bias) {
+    std::vector<unsigned char> px(static_cast<size_t>(w) * h * 3);
+    for (int y = 0; y < h; ++y) {
+        for (int x = 0; x < w; ++x) {
+            float v = 255.f * (x + y) / (w + h);
+            float dx = x - cx * w, dy = y - cy * h;
+            if (dx * dx + dy * dy < 0.04f * w * h) v = 255.f - v * 0.5f;
+            int iv = static_cast<int>(v) + bias;
+            iv = iv < 0 ? 0 : (iv > 255 ? 255 : iv);
+            unsigned char* p = &px[(static_cast<size_t>(y) * w + x) * 3];
+            p[0] = static_cast<unsigned char>(iv);
+            p[1] = static_cast<unsigned char>(iv * 3 / 4);
+            p[2] = static_cast<unsigned char>(255 - iv);
+        }
+    }
+    return px;
+}
+
+struct Hashes { uint64_t d, p; };
+
+static Hashes hash_image(const std::vector<unsigned char>& px, int w, int h) {
+    float gray[kHashSide * kHashSide];
+    if (!gray_reduce(px.data(), w, h, 3, gray)) {
+        std::cerr << "[FAIL] gray_reduce\n";
+        std::exit(1);
+    }
+    return {dhash64(gray), phash64(gray)};
+}
+
+static void expect(bool cond, const char* label) {
+    if (!cond) {
+        std::cerr << "[FAIL] " << label << "\n";
+        std::exit(1);
+    }
+    std::cout << "[PASS] " << label << "\n";
+}
+
+int main() {
+    const auto base = make_image(256, 192, 0.3f, 0.4f, 0);
+    const Hashes hb = hash_image(base, 256, 192);
+
+    // 1) Deterministic
+    {
+        const Hashes again = hash_image(base, 256, 192);
+        expect(again.d == hb.d && again.p == hb.p, "hashes are deterministic");
+    }
+
+    // 2) Robust to rescaling (same content at a different thumbnail size)
+    {
+        const auto small = make_image(128, 96, 0.3f, 0.4f, 0);
+        const Hashes hs = hash_image(small, 128, 96);
+        expect(hamming64(hb.d, hs.d) <= 6, "dhash stable under rescale");
+        expect(hamming64(hb.p, hs.p) <= 6, "phash stable under rescale");
+    }
+
+    // 3) Robust to a global brightness shift
+    {
+        const auto bright = make_image(256, 192, 0.3f, 0.4f, 12);
+        const Hashes hx = hash_image(bright, 256, 192);
+        expect(hamming64(hb.d, hx.d) <= 6, "dhash stable under brightness shift");
+        expect(hamming64(hb.p, hx.p) <= 6, "phash stable under brightness shift");
+    }
+
+    // 4) Different content is far away
+    {
+        const auto other = make_image(256, 192, 0.75f, 0.7f, 0);
+        const Hashes ho = hash_image(other, 256, 192);
+        expect(hamming64(hb.p, ho.p) >= 10, "phash separates different content");
+    }
+
+    // 5) Hex round-trip
+    {
+        uint64_t back = 0;
+        expect(hash64_to_hex(0x0123456789abcdefULL) == "0123456789abcdef", "hash64_to_hex");
+        expect(hex_to_hash64(hash64_to_hex(hb.p), &back) && back == hb.p, "hex round-trip");
+        expect(!hex_to_hash64("xyz", &back), "hex rejects garbage");
+    }
+
+    std::cout << "\nAll tests passed ✅\n";
+    return 0;
+}
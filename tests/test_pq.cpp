@@ -0,0 +1,94 @@
+// test_pq.cpp
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "distance.h"
+#include "pq.h"
+
+static void expect(bool cond, const char* label) {
+    if (!cond) {
+        std::cerr << "[FAIL] " << label << "\n";
+        std::exit(1);
+    }
+    std::cout << "[PASS] " << label << "\n";
+}
+
+int main() {
+    const uint32_t dim = 32;
+    const int m = 8;
+    const size_t n = 3000;
+
+    std::mt19937_64 rng(11);
+    std::normal_distribution<float> g(0.f, 1.f);
+    std::vector<float> data(n * dim);
+    for (auto& x : data) x = g(rng);
+
+    ProductQuantizer pq = ProductQuantizer::Train(data.data(), n, dim, m, 10);
+
+    // 1) Reconstruction error is well below the data variance
+    {
+        double err = 0.0, var = 0.0;
+        std::vector<uint8_t> code(m);
+        std::vector<float> rec(dim);
+        for (size_t i = 0; i < n; ++i) {
+            pq.Encode(&data[i * dim], code.data());
+            pq.Decode(code.data(), rec.data());
+            err += l2sq_f32(&data[i * dim], rec.data(), dim);
+            for (uint32_t d = 0; d < dim; ++d) var += data[i * dim + d] * data[i * dim + d];
+        }
+        expect(err < 0.5 * var, "reconstruction error < 50% of energy");
+    }
+
+    // 2) ADC scan equals the distance to the reconstruction
+    {
+        std::vector<float> q(dim), lut(m * ProductQuantizer::kCentroids), rec(dim);
+        for (auto& x : q) x = g(rng);
+        pq.ComputeTable(q.data(), lut.data());
+
+        std::vector<uint8_t> codes(100 * m);
+        for (size_t i = 0; i < 100; ++i) pq.Encode(&data[i * dim], &codes[i * m]);
+        std::vector<float> dist(100);
+        pq.ScanCodes(lut.data(), codes.data(), 100, dist.data());
+
+        bool ok = true;
+        for (size_t i = 0; i < 100; ++i) {
+            pq.Decode(&codes[i * m], rec.data());
+            ok &= std::fabs(dist[i] - l2sq_f32(q.data(), rec.data(), dim)) < 1e-3f * (1.f + dist[i]);
+        }
+        expect(ok, "ADC scan matches decoded distance");
+    }
+
+    // 3) Store round-trip and search returns the query's own row first
+    {
+        const std::string path = "tmp_test_pq.bin";
+        {
+            PqStore s = PqStore::Create(path, pq);
+            for (size_t i = 0; i < 200; ++i) s.Append(static_cast<uint32_t>(i * 3), &data[i * dim]);
+        }
+        PqStore s = PqStore::Open(path);
+        expect(s.size() == 200 && s.ordinal(17) == 51, "store reopens with ordinals");
+        const auto hits = s.Search(&data[17 * dim], 5);
+        expect(hits.size() == 5 && hits[0].second == 17, "search finds own row first");
+        std::remove(path.c_str());
+        std::remove((path + ".ords").c_str());
+    }
+
+    // 4) Bad subspace count is rejected
+    {
+        bool threw = false;
+        try {
+            ProductQuantizer::Train(data.data(), 10, dim, 5);
+        } catch (const std::invalid_argument&) {
+            threw = true;
+        }
+        expect(threw, "dim not divisible by M throws");
+    }
+
+    std::cout << "\nAll tests passed ✅\n";
+    return 0;
+}
@@ -0,0 +1,305 @@
+// test_query.cpp
+#include <cstdlib>
+#include <filesystem>
+#include <functional>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "query.h"
+#include "taskpool.h"
+
+static void expect(bool cond, const char* label) {
+    if (!cond) {
+        std::cerr << "[FAIL] " << label << "\n";
+        std::exit(1);
+    }
+    std::cout << "[PASS] " << label << "\n";
+}
+
+static bool rejects(const std::string& sql) {
+    try {
+        parse_sql(sql);
+    } catch (const std::invalid_argument&) {
+        return true;
+    }
+    return false;
+}
+
+int main() {
+    const std::string dir = "tmp_test_query";
+    std::filesystem::remove_all(dir);
+    std::filesystem::create_directories(dir);
+
+    // 5000 rows, so scans cross several batches.
+    const uint32_t n = 5000;
+    std::vector<ImageMeta> records(n);
+    OrdinalMap ords = OrdinalMap::Open(dir);
+    TagStore tags = TagStore::Open(dir);
+    for (uint32_t i = 0; i < n; ++i) {
+        ImageMeta& m = records[i];
+        m.image_id = "id" + std::to_string(i);
+        m.sha256 = std::string(64, 'a');
+        m.mime = i % 3 == 0 ? "image/png" : "image/jpeg";
+        m.width = (i * 37) % 4000;
+        m.height = i % 1000;
+        m.bytes = uint64_t{i} * 100;
+        m.created_unix = 1000 + i;
+        m.ordinal = i;
+        ords.Append(m.image_id);
+        if (i % 2 == 0) tags.Add(i, "even");
+        if (m.width > 3000) tags.Add(i, "big");
+    }
+    CatalogColumns cols = CatalogColumns::Build(records);
+    cols.SetClusters({1, 2, 3}, {7, 7, 8});
+    QueryIndexes indexes;
+    indexes.ordinals = &ords;
+    indexes.tags = &tags;
+    const QueryEngine engine(cols, indexes);
+
+    auto run = [&](const std::string& sql) { return engine.Run(parse_sql(sql)).rows; };
+    auto brute = [&](const std::function<bool(const ImageMeta&)>& pred) {
+        std::vector<uint32_t> rows;
+        for (uint32_t i = 0; i < n; ++i) {
+            if (pred(records[i])) rows.push_back(i);
+        }
+        return rows;
+    };
+
+    // 1) Parser
+    expect(rejects("SELECT FROM images"), "missing select list");
+    expect(rejects("SELECT width FROM images WHERE width > 'x'"), "string literal on numeric column");
+    expect(rejects("SELECT * FROM images WHERE mime = 3"), "number on string column");
+    expect(rejects("SELECT * FROM images LIMIT"), "LIMIT without count");
+    expect(rejects("SELECT * FROM images WHERE mime = 'x"), "unterminated string");
+    expect(rejects("SELECT * FROM photos"), "unknown table");
+    {
+        const SqlQuery q = parse_sql("explain select Image_ID, width from IMAGES order by created_at desc limit 5 offset 2");
+        expect(q.explain && q.select.size() == 2 && q.ordered && q.descending && q.limit == 5 && q.offset == 2,
+               "keywords are case-insensitive");
+    }
+
+    // 2) Filters match a row-by-row evaluation
+    expect(run("SELECT image_id FROM images WHERE width > 2000 AND mime = 'image/png'") ==
+               brute([](const ImageMeta& m) { return m.width > 2000 && m.mime == "image/png"; }),
+           "AND of numeric and dictionary-coded predicates");
+    expect(run("SELECT * FROM images WHERE (height < 10 OR height BETWEEN 500 AND 505) AND NOT mime = 'image/png'") ==
+               brute([](const ImageMeta& m) {
+                   return (m.height < 10 || (m.height >= 500 && m.height <= 505)) && m.mime != "image/png";
+               }),
+           "OR, BETWEEN and NOT");
+    expect(run("SELECT * FROM images WHERE bytes <> 300 AND bytes <= 500") ==
+               std::vector<uint32_t>({0, 1, 2, 4, 5}), "<> and <=");
+    expect(run("SELECT * FROM images WHERE width < 0").empty(), "empty range");
+    expect(run("SELECT * FROM images WHERE image_id >= 'id4998' AND image_id < 'id5'") == std::vector<uint32_t>({4998, 4999}),
+           "string range");
+
+    // 3) Index access paths agree with probes and full scans
+    expect(run("SELECT * FROM images WHERE tags MATCH 'big' AND height < 100") ==
+               brute([](const ImageMeta& m) { return m.width > 3000 && m.height < 100; }),
+           "tag index plus residual filter");
+    expect(run("SELECT * FROM images WHERE tags MATCH 'even' OR width = 5") ==
+               brute([](const ImageMeta& m) { return m.ordinal % 2 == 0 || m.width == 5; }),
+           "tag probe under OR");
+    expect(run("SELECT * FROM images WHERE image_id = 'id42' AND tags MATCH 'even'") == std::vector<uint32_t>({42}),
+           "intersected index scans");
+    expect(run("SELECT * FROM images WHERE image_id = 'nope'").empty(), "unknown id");
+    expect(engine.Run(parse_sql("SELECT COUNT(*) FROM images WHERE tags MATCH 'even'")).count == n / 2,
+           "COUNT from an index");
+    expect(engine.Run(parse_sql("SELECT COUNT(*) FROM images WHERE tags MATCH 'even' AND mime = 'image/png'")).count ==
+               brute([](const ImageMeta& m) { return m.ordinal % 6 == 0; }).size(),
+           "COUNT with a residual filter");
+    expect(run("SELECT * FROM images WHERE cluster = 7") == std::vector<uint32_t>({1, 2}), "cluster column");
+
+    // 4) ORDER BY, LIMIT, OFFSET
+    expect(run("SELECT * FROM images ORDER BY created_at DESC LIMIT 3 OFFSET 5") ==
+               std::vector<uint32_t>({4994, 4993, 4992}), "TopN descending");
+    {
+        const std::vector<uint32_t> rows = run("SELECT * FROM images WHERE height < 50 ORDER BY width");
+        bool sorted = rows.size() == brute([](const ImageMeta& m) { return m.height < 50; }).size();
+        for (size_t i = 1; i < rows.size(); ++i) {
+            sorted &= records[rows[i - 1]].width < records[rows[i]].width ||
+                      (records[rows[i - 1]].width == records[rows[i]].width && rows[i - 1] < rows[i]);
+        }
+        expect(sorted, "full sort with row tie-break");
+    }
+    expect(run("SELECT * FROM images WHERE mime = 'image/png' LIMIT 3 OFFSET 2") == std::vector<uint32_t>({6, 9, 12}),
+           "LIMIT in natural order");
+
+    // 5) EXPLAIN and output
+    {
+        const std::string plan = engine.Explain(parse_sql(
+            "EXPLAIN SELECT image_id, width FROM images WHERE width > 2000 AND mime = 'image/png' "
+            "ORDER BY created_at DESC LIMIT 100"));
+        expect(plan.find("TopN created_at DESC (keeps 100 rows)") != std::string::npos &&
+                   plan.find("FullScan images (5000 rows)") != std::string::npos, "EXPLAIN full scan");
+        const std::string indexed = engine.Explain(parse_sql("SELECT * FROM images WHERE image_id = 'id7' AND tags MATCH 'even'"));
+        expect(indexed.find("Intersect") != std::string::npos &&
+                   indexed.find("IndexScan ordinals") != std::string::npos &&
+                   indexed.find("IndexScan tag postings") != std::string::npos, "EXPLAIN index scans");
+
+        const SqlQuery q = parse_sql("SELECT image_id, cluster FROM images WHERE ordinal < 2");
+        std::ostringstream out;
+        engine.Write(q, engine.Run(q), out);
+        expect(out.str() == "# image_id\tcluster\nid0\tNULL\nid1\t7\n# 2 rows\n", "Write");
+    }
+
+    // 6) The columnar projection answers numeric ranges and can stand in
+    // for the decoded catalog when no string column besides image_id is used
+    {
+        ColumnStore store = ColumnStore::Open(dir);
+        expect(store.Append(records.data(), records.size()) && store.Refresh(), "projection");
+        QueryIndexes with_columns = indexes;
+        with_columns.columns = &store;
+        const QueryEngine projected(cols, with_columns);
+        const CatalogColumns slim = CatalogColumns::FromProjection(store);
+        const QueryEngine slim_engine(slim, with_columns);
+
+        bool same = true;
+        for (const char* sql : {"SELECT * FROM images WHERE width > 2000 AND height BETWEEN 10 AND 700",
+                                "SELECT * FROM images WHERE created_at < 1100 AND (mime = 'image/png' OR width = 7)",
+                                "SELECT * FROM images WHERE tags MATCH 'big' AND bytes >= 250000"}) {
+            same &= projected.Run(parse_sql(sql)).rows == engine.Run(parse_sql(sql)).rows;
+        }
+        expect(same, "projection scans agree with the filter");
+        expect(projected.Explain(parse_sql("SELECT * FROM images WHERE width > 2000 AND created_at < 1100"))
+                       .find("ColumnScan zone maps: width > 2000 AND created_at < 1100") != std::string::npos,
+               "EXPLAIN column scan");
+
+        const SqlQuery q = parse_sql("SELECT image_id, width FROM images WHERE created_at BETWEEN 1010 AND 1011");
+        std::ostringstream out;
+        slim_engine.Write(q, slim_engine.Run(q), out);
+        expect(!sql_query_uses(q, SqlColumn::Mime) && out.str() == "# image_id\twidth\nid10\t370\nid11\t407\n# 2 rows\n",
+               "image ids through the ordinal map");
+
+        // 7) A selective created_at or bytes range is read from its B+tree
+        std::vector<BTree::Entry> by_time, by_size;
+        for (const ImageMeta& m : records) {
+            by_time.push_back({m.created_unix, m.ordinal});
+            by_size.push_back({m.bytes, m.ordinal});
+        }
+        expect(BTree::BulkLoad(dir + "/created_at.bt", by_time, n) && BTree::BulkLoad(dir + "/bytes.bt", by_size, n),
+               "range trees");
+        const std::optional<BTree> created_at = BTree::Open(dir + "/created_at.bt");
+        const std::optional<BTree> bytes = BTree::Open(dir + "/bytes.bt");
+        QueryIndexes with_trees = with_columns;
+        with_trees.created_at = &*created_at;
+        with_trees.bytes = &*bytes;
+        const QueryEngine treed(cols, with_trees);
+        const char* narrow = "SELECT * FROM images WHERE created_at BETWEEN 3000 AND 3040 AND width > 100";
+        expect(treed.Run(parse_sql(narrow)).rows == engine.Run(parse_sql(narrow)).rows, "tree scan agrees");
+        const std::string plan = treed.Explain(parse_sql(narrow));
+        expect(plan.find("IndexScan created_at btree: created_at BETWEEN 3000 AND 3040 (41 rows") !=
+                       std::string::npos &&
+                   plan.find("ColumnScan") == std::string::npos,
+               "EXPLAIN tree scan");
+        const char* wide = "SELECT * FROM images WHERE bytes > 1000";
+        expect(treed.Explain(parse_sql(wide)).find("ColumnScan zone maps: bytes > 1000") != std::string::npos,
+               "wide range stays a column scan");
+
+        // 8) Deleted ordinals drop out of every access path and of COUNT(*)
+        RoaringBitmap deleted;
+        for (uint32_t ord = 0; ord < n; ord += 3) deleted.Add(ord);
+        QueryIndexes with_deleted = with_trees;
+        with_deleted.deleted = &deleted;
+        const QueryEngine live(cols, with_deleted);
+        bool live_only = true;
+        for (const char* sql : {"SELECT * FROM images", narrow, "SELECT * FROM images WHERE tags MATCH 'big'",
+                                "SELECT * FROM images WHERE image_id = 'id9' OR image_id = 'id10'"}) {
+            std::vector<uint32_t> want;
+            for (uint32_t row : engine.Run(parse_sql(sql)).rows) {
+                if (!deleted.Contains(cols.ordinal[row])) want.push_back(row);
+            }
+            live_only &= live.Run(parse_sql(sql)).rows == want;
+        }
+        expect(live_only, "deleted rows are skipped");
+        expect(live.Run(parse_sql("SELECT COUNT(*) FROM images")).count == n - deleted.Cardinality(), "live count");
+        expect(live.Explain(parse_sql("SELECT COUNT(*) FROM images")).find("Skip deleted (" +
+                                                                         std::to_string(deleted.Cardinality()) +
+                                                                         " ordinals)") != std::string::npos,
+               "EXPLAIN skip deleted");
+
+        // 9) Indexes that trail the columns (a commit they have not caught
+        // up with) cover a prefix; the rows past it are checked directly.
+        // Ids come from whatever id index the caller has.
+        const uint32_t covered = 4950;
+        const std::string behind = dir + "/behind";
+        std::filesystem::create_directories(behind);
+        ColumnStore prefix = ColumnStore::Open(behind);
+        expect(prefix.Append(records.data(), covered) && prefix.Refresh(), "prefix projection");
+        expect(BTree::BulkLoad(behind + "/created_at.bt",
+                               std::vector<BTree::Entry>(by_time.begin(), by_time.begin() + covered), covered),
+               "prefix tree");
+        const std::optional<BTree> prefix_tree = BTree::Open(behind + "/created_at.bt");
+        QueryIndexes trailing;
+        trailing.columns = &prefix;
+        trailing.created_at = &*prefix_tree;
+        trailing.find_id = [](std::string_view id) {
+            return id.substr(0, 2) == "id" ? static_cast<uint32_t>(std::stoul(std::string(id.substr(2))))
+                                           : OrdinalMap::kNone;
+        };
+        const QueryEngine lagging(cols, trailing);
+        bool agree = true;
+        for (const char* sql : {"SELECT * FROM images WHERE width > 2000 AND height BETWEEN 10 AND 700",
+                                "SELECT * FROM images WHERE created_at BETWEEN 5930 AND 5960",
+                                "SELECT * FROM images WHERE created_at >= 5900 AND width < 2000",
+                                "SELECT * FROM images WHERE image_id = 'id4990'"}) {
+            agree &= lagging.Run(parse_sql(sql)).rows == engine.Run(parse_sql(sql)).rows;
+        }
+        expect(agree, "trailing indexes agree with the filter");
+        const std::string late = lagging.Explain(parse_sql("SELECT * FROM images WHERE created_at BETWEEN 5930 AND 5960"));
+        expect(late.find("created_at btree") != std::string::npos && late.find("50 newer rows checked directly") !=
+                                                                        std::string::npos,
+               "EXPLAIN trailing tree");
+        expect(lagging.Explain(parse_sql("SELECT * FROM images WHERE image_id = 'id3'")).find("IndexScan id index") !=
+                   std::string::npos,
+               "EXPLAIN id index");
+    }
+    std::filesystem::remove_all(dir);
+
+    // 10) Scans spread over a pool return what a serial scan does
+    {
+        const uint32_t big = 200000;
+        std::vector<ImageMeta> many(big);
+        for (uint32_t i = 0; i < big; ++i) {
+            many[i].image_id = std::to_string(i);
+            many[i].mime = i % 5 == 0 ? "image/png" : "image/jpeg";
+            many[i].width = (i * 7919) % 5000;
+            many[i].height = i % 777;
+            many[i].bytes = (uint64_t{i} * 2654435761u) % 1000000;
+            many[i].created_unix = 5000 + i;
+            many[i].ordinal = i;
+        }
+        const CatalogColumns wide = CatalogColumns::Build(many);
+        RoaringBitmap gone;
+        for (uint32_t ord = 0; ord < big; ord += 7) gone.Add(ord);
+        WorkStealingPool pool(3);
+        QueryIndexes serial_idx, pooled_idx;
+        serial_idx.deleted = pooled_idx.deleted = &gone;
+        pooled_idx.pool = &pool;
+        const QueryEngine serial(wide, serial_idx), pooled(wide, pooled_idx);
+        bool same = true;
+        for (const char* sql : {"SELECT * FROM images WHERE width > 2500 AND NOT height < 100",
+                                "SELECT COUNT(*) FROM images WHERE mime = 'image/png' OR bytes < 5000",
+                                "SELECT * FROM images WHERE height BETWEEN 10 AND 20 ORDER BY bytes DESC LIMIT 50",
+                                "SELECT * FROM images WHERE width != 3 LIMIT 10"}) {
+            const QueryResult a = serial.Run(parse_sql(sql)), b = pooled.Run(parse_sql(sql));
+            same &= a.rows == b.rows && a.count == b.count;
+        }
+        expect(same, "parallel scan matches serial");
+        // The calling thread takes chunks too and may finish a scan before
+        // a worker wakes; over a few scans the workers get some.
+        uint64_t executed = 0;
+        for (int i = 0; i < 100 && executed == 0; ++i) {
+            pooled.Run(parse_sql("SELECT COUNT(*) FROM images WHERE width > 10"));
+            executed = 0;
+            for (const WorkStealingPool::WorkerStats& w : pool.stats().workers) executed += w.executed;
+        }
+        expect(executed > 0, "scan ran on the pool");
+    }
+
+    std::cout << "All tests passed ✅\n";
+    return 0;
+}
@@ -0,0 +1,90 @@
+// test_refs.cpp
+#include <cstdlib>
+#include <filesystem>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "refs.h"
+
+static void expect(bool cond, const char* label) {
+    if (!cond) {
+        std::cerr << "[FAIL] " << label << "\n";
+        std::exit(1);
+    }
+    std::cout << "[PASS] " << label << "\n";
+}
+
+int main() {
+    const std::string dir = "tmp_test_refs";
+    std::filesystem::remove_all(dir);
+    const std::string a(64, 'a'), b(64, 'b'), c(64, 'c');
+
+    // 1) Counts replay the log
+    {
+        BlobRefs refs = BlobRefs::Open(dir);
+        expect(!refs.exists() && refs.Count(a) == 0, "empty log");
+        expect(refs.Increment(a) && refs.Increment(a) && refs.Increment(b) && refs.Decrement(a), "appends");
+        expect(refs.exists() && refs.Count(a) == 1 && refs.Count(b) == 1, "net counts");
+    }
+
+    // 2) A later replay picks up only what was appended since
+    {
+        BlobRefs refs = BlobRefs::Open(dir);
+        uint64_t end = 0;
+        const auto all = refs.Counts(0, &end);
+        expect(all.size() == 2 && end == std::filesystem::file_size(dir + "/refs.log"), "replay end");
+        expect(refs.Increment(c) && refs.Decrement(b), "more appends");
+        const auto since = refs.Counts(end);
+        expect(since.size() == 2 && since.at(c) == 1 && since.at(b) == -1, "tail replay");
+    }
+
+    // 3) Compact keeps positive counts only, as snapshot lines
+    {
+        BlobRefs refs = BlobRefs::Open(dir);
+        expect(refs.Compact(), "Compact");
+        const auto counts = refs.Counts();
+        expect(counts.size() == 2 && counts.at(a) == 1 && counts.at(c) == 1, "zero counts dropped");
+        expect(refs.Increment(a) && refs.Count(a) == 2, "appends after Compact");
+    }
+
+    // 4) Seeding replaces the log
+    {
+        BlobRefs refs = BlobRefs::Open(dir);
+        const std::unordered_map<std::string, int64_t> seed = {{b, 3}, {c, 0}};
+        expect(refs.Compact(&seed) && refs.Count(b) == 3 && refs.Count(a) == 0 && refs.Counts().size() == 1, "seed");
+    }
+
+    // 5) In-memory counts follow other writers and a replaced log
+    {
+        BlobRefs mine = BlobRefs::Open(dir), other = BlobRefs::Open(dir);
+        expect(mine.Count(b) == 3 && mine.Increment(b) && mine.Count(b) == 4, "own appends");
+        expect(other.Increment(c) && other.Decrement(b) && mine.Count(c) == 1 && mine.Count(b) == 3,
+               "appends by another writer");
+        expect(other.Compact() && other.Increment(c) && mine.Count(c) == 2 && mine.Count(b) == 3,
+               "log compacted elsewhere");
+    }
+    std::filesystem::remove_all(dir);
+
+    // 6) Appends racing compactions are never lost
+    {
+        BlobRefs refs = BlobRefs::Open(dir);
+        const int threads = 4, per_thread = 500;
+        std::vector<std::thread> writers;
+        for (int t = 0; t < threads; ++t) {
+            writers.emplace_back([&] {
+                BlobRefs own = BlobRefs::Open(dir);
+                for (int i = 0; i < per_thread; ++i) own.Increment(a);
+            });
+        }
+        bool ok = true;
+        for (int i = 0; i < 50; ++i) ok &= refs.Compact();
+        for (std::thread& w : writers) w.join();
+        expect(ok && refs.Count(a) == threads * per_thread, "concurrent appends and compactions");
+    }
+    std::filesystem::remove_all(dir);
+
+    std::cout << "All tests passed ✅\n";
+    return 0;
+}
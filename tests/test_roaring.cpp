@@ -0,0 +1,134 @@
+// test_roaring.cpp
+#include <algorithm>
+#include <cstdlib>
+#include <filesystem>
+#include <iostream>
+#include <iterator>
+#include <random>
+#include <set>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "roaring.h"
+#include "tags.h"
+
+static void expect(bool cond, const char* label) {
+    if (!cond) {
+        std::cerr << "[FAIL] " << label << "\n";
+        std::exit(1);
+    }
+    std::cout << "[PASS] " << label << "\n";
+}
+
+static std::vector<uint32_t> to_vec(const std::set<uint32_t>& s) { return {s.begin(), s.end()}; }
+
+// Mixes sparse (array) and dense (bitmap) containers across a few keys.
+static void fill(RoaringBitmap* b, std::set<uint32_t>* ref, std::mt19937_64& rng, double density) {
+    for (uint32_t key = 0; key < 4; ++key) {
+        const double d = key % 2 ? density : density / 40;
+        for (uint32_t lo = 0; lo < 65536; ++lo) {
+            if (std::uniform_real_distribution<double>(0, 1)(rng) < d) {
+                b->Add(key << 16 | lo);
+                ref->insert(key << 16 | lo);
+            }
+        }
+    }
+}
+
+int main() {
+    std::mt19937_64 rng(3);
+    RoaringBitmap a, b;
+    std::set<uint32_t> ra, rb;
+    fill(&a, &ra, rng, 0.3);
+    fill(&b, &rb, rng, 0.2);
+
+    // 1) Add / Contains / Cardinality agree with std::set
+    {
+        bool ok = a.Cardinality() == ra.size() && a.ToVector() == to_vec(ra);
+        for (uint32_t v = 0; v < 4 << 16; v += 97) ok &= a.Contains(v) == (ra.count(v) > 0);
+        expect(ok, "Add/Contains/ToVector match reference");
+    }
+
+    // 2) Set operations across array and bitmap containers
+    {
+        std::set<uint32_t> x;
+        std::set_intersection(ra.begin(), ra.end(), rb.begin(), rb.end(), std::inserter(x, x.end()));
+        expect(RoaringBitmap::And(a, b).ToVector() == to_vec(x), "And");
+        x.clear();
+        std::set_union(ra.begin(), ra.end(), rb.begin(), rb.end(), std::inserter(x, x.end()));
+        expect(RoaringBitmap::Or(a, b).ToVector() == to_vec(x), "Or");
+        x.clear();
+        std::set_difference(ra.begin(), ra.end(), rb.begin(), rb.end(), std::inserter(x, x.end()));
+        expect(RoaringBitmap::AndNot(a, b).ToVector() == to_vec(x), "AndNot");
+
+        const RoaringBitmap r = RoaringBitmap::Range(70000, 200001);
+        expect(r.Cardinality() == 130001 && r.Contains(70000) && r.Contains(200000) &&
+                   !r.Contains(200001), "Range bounds");
+    }
+
+    // 3) Remove shrinks bitmaps back to arrays; paging; serialization
+    {
+        RoaringBitmap c = RoaringBitmap::Range(0, 10000);
+        for (uint32_t v = 0; v < 9000; ++v) c.Remove(v);
+        expect(c.Cardinality() == 1000 && c.SizeInBytes() < 4000, "Remove converts to array");
+
+        const std::vector<uint32_t> page = a.ToVector(100, 5);
+        const std::vector<uint32_t> all = a.ToVector();
+        expect(page == std::vector<uint32_t>(all.begin() + 100, all.begin() + 105), "ToVector paging");
+
+        std::stringstream ss;
+        a.Write(ss);
+        RoaringBitmap back;
+        expect(back.Read(ss) && back == a, "Write/Read roundtrip");
+    }
+
+    // 4) TagStore: log replay, compaction, boolean queries
+    const std::string dir = "tmp_test_tags";
+    std::filesystem::remove_all(dir);
+    std::filesystem::create_directories(dir);
+    {
+        TagStore t = TagStore::Open(dir);
+        for (uint32_t i = 0; i < 100; ++i) {
+            if (i % 2 == 0) t.Add(i, "even");
+            if (i % 3 == 0) t.Add(i, "three");
+            if (i >= 90) t.Add(i, "top");
+        }
+        t.Remove(96, "top");
+        expect(!t.Add(1, "bad tag") && !t.Add(1, "AND"), "invalid tag names rejected");
+    }
+    {
+        TagStore t = TagStore::Open(dir);
+        expect(t.size() == 3 && t.Find("even")->Cardinality() == 50, "log replays on open");
+
+        auto q = [&](const char* expr) { return t.Query(expr, 100).ToVector(); };
+        expect(q("even AND three").size() == 17, "AND");
+        expect(q("even & !three") == RoaringBitmap::AndNot(*t.Find("even"), *t.Find("three")).ToVector(),
+               "AND NOT");
+        expect(q("top | three").size() == 9 + 34 - 3, "OR");
+        expect(q("NOT even").size() == 50 && q("NOT even")[0] == 1, "leading NOT uses universe");
+        expect(q("top (even OR three)") == std::vector<uint32_t>({90, 92, 93, 94, 98, 99}),
+               "precedence and implicit AND");
+        expect(q("missing").empty(), "unknown tag matches nothing");
+
+        bool threw = false;
+        try {
+            q("even AND (three");
+        } catch (const std::invalid_argument&) {
+            threw = true;
+        }
+        expect(threw, "syntax error throws");
+
+        expect(t.Compact(), "Compact");
+    }
+    {
+        TagStore t = TagStore::Open(dir);
+        expect(std::filesystem::file_size(dir + "/tags.log") == 0 && t.Find("top")->Cardinality() == 9,
+               "postings survive compaction");
+    }
+    std::filesystem::remove_all(dir);
+
+    std::cout << "All tests passed ✅\n";
+    return 0;
+}
@@ -1,4 +1,5 @@
 // test_sha256.cpp
+#include <algorithm>
 #include <cassert>
 #include <cstdint>
 #include <cstring>
@@ -7,19 +8,7 @@
 #include <string>
 #include <vector>
 
-// ---- Your SHA-256 API (adjust the header include / declarations as needed)
-struct Sha256Ctx {
-    uint8_t  data[64];
-    uint32_t h[8];
-    uint32_t datalen;
-    uint64_t bitlen;
-};
-
-void sha256_init(Sha256Ctx& ctx);
-void sha256_update(Sha256Ctx& ctx, const uint8_t* data, size_t len);
-void sha256_final(Sha256Ctx& ctx, uint8_t out[32]);
-std::string sha256_hex(const uint8_t digest[32]);
-std::string sha256_file(const std::string& filepath);
+#include "sha256.h"
 
 // Convenience: hash an in-memory buffer and return hex string
 static std::string sha256_mem_hex(const void* data, size_t len) {
@@ -104,9 +93,26 @@ int main() {
             expect_eq(sha256_mem_hex(million_a.data(), million_a.size()), tv_million_a, "1,000,000 x 'a'");
         }
 
+        // 5) Chunked updates match a single update, whatever the split
+        {
+            std::vector<uint8_t> bytes(10000);
+            for (size_t i = 0; i < bytes.size(); ++i) bytes[i] = static_cast<uint8_t>((i * 31) & 0xFF);
+            const std::string want = sha256_mem_hex(bytes.data(), bytes.size());
+            for (size_t step : {1, 7, 63, 64, 65, 1000, 4096}) {
+                Sha256Ctx ctx;
+                sha256_init(ctx);
+                for (size_t off = 0; off < bytes.size(); off += step) {
+                    sha256_update(ctx, bytes.data() + off, std::min(step, bytes.size() - off));
+                }
+                uint8_t dig[32];
+                sha256_final(ctx, dig);
+                expect_eq(sha256_hex(dig), want, ("incremental, step " + std::to_string(step)).c_str());
+            }
+        }
+
         // --- File-based tests ---
 
-        // 5) Empty file
+        // 6) Empty file
         {
             std::vector<uint8_t> bytes; // empty
             std::string path = write_temp_file("tmp_empty.bin", bytes);
@@ -116,7 +122,7 @@ int main() {
             remove_file(path);
         }
 
-        // 6) Small file "abc"
+        // 7) Small file "abc"
         {
             std::vector<uint8_t> bytes = {'a','b','c'};
             std::string path = write_temp_file("tmp_abc.bin", bytes);
@@ -126,7 +132,7 @@ int main() {
             remove_file(path);
         }
 
-        // 7) File with non-aligned size (e.g., 100 KiB + 13 bytes)
+        // 8) File with non-aligned size (e.g., 100 KiB + 13 bytes)
         {
             std::vector<uint8_t> bytes((100 << 10) + 13);
             for (size_t i = 0; i < bytes.size(); ++i) {
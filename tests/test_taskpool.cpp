@@ -0,0 +1,187 @@
+// test_taskpool.cpp
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "taskpool.h"
+
+static void expect(bool cond, const char* label) {
+    if (!cond) {
+        std::cerr << "[FAIL] " << label << "\n";
+        std::exit(1);
+    }
+    std::cout << "[PASS] " << label << "\n";
+}
+
+static void wait_for(const std::atomic<int>& counter, int target) {
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(30);
+    while (counter.load() < target && std::chrono::steady_clock::now() < deadline) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+}
+
+// Splits [lo, hi) until it is small, submitting the halves from the worker
+// running it, so the work spreads only by stealing. Leaves sleep briefly
+// so idle workers get a chance to steal even on a single CPU.
+static void spread(WorkStealingPool& pool, int lo, int hi, std::vector<std::atomic<int>>* hits,
+                   std::atomic<int>* done) {
+    if (hi - lo <= 4) {
+        std::this_thread::sleep_for(std::chrono::microseconds(10));
+        for (int i = lo; i < hi; ++i) (*hits)[static_cast<size_t>(i)].fetch_add(1);
+        done->fetch_add(hi - lo);
+        return;
+    }
+    const int mid = lo + (hi - lo) / 2;
+    pool.Submit([&pool, lo, mid, hits, done] { spread(pool, lo, mid, hits, done); });
+    pool.Submit([&pool, mid, hi, hits, done] { spread(pool, mid, hi, hits, done); });
+}
+
+int main() {
+    const std::vector<std::vector<int>> nodes = numa_cpus();
+    size_t cpus = 0;
+    for (const std::vector<int>& n : nodes) cpus += n.size();
+    expect(!nodes.empty() && cpus > 0, "topology");
+
+    // 1) ParallelFor covers every index once, and chunks sum correctly
+    {
+        WorkStealingPool pool(4);
+        expect(pool.workers() == 4 && !pool.on_worker(), "pool size");
+        const size_t n = 100000;
+        std::vector<int> seen(n, 0);
+        pool.ParallelFor(n, 1000, [&](size_t b, size_t e) {
+            for (size_t i = b; i < e; ++i) seen[i] += 1;
+        });
+        expect(std::all_of(seen.begin(), seen.end(), [](int v) { return v == 1; }), "parallel for coverage");
+
+        std::atomic<uint64_t> sum{0};
+        pool.ParallelFor(n, 37, [&](size_t b, size_t e) {
+            uint64_t s = 0;
+            for (size_t i = b; i < e; ++i) s += i;
+            sum.fetch_add(s);
+        });
+        expect(sum.load() == static_cast<uint64_t>(n) * (n - 1) / 2, "parallel for sum");
+
+        bool ran = false;
+        pool.ParallelFor(0, 10, [&](size_t, size_t) { ran = true; });
+        expect(!ran, "empty range");
+    }
+
+    // 2) Nested ParallelFor on the workers does not deadlock, and Run on a
+    //    worker runs inline
+    {
+        WorkStealingPool pool(2);
+        std::atomic<uint64_t> total{0};
+        pool.ParallelFor(8, 1, [&](size_t, size_t) {
+            pool.ParallelFor(1000, 10, [&](size_t b, size_t e) { total.fetch_add(e - b); });
+        });
+        expect(total.load() == 8000, "nested parallel for");
+
+        bool inline_run = false;
+        pool.Run([&] {
+            const std::thread::id self = std::this_thread::get_id();
+            pool.Run([&] { inline_run = pool.on_worker() && std::this_thread::get_id() == self; });
+        });
+        expect(inline_run, "run on a worker is inline");
+    }
+
+    // 3) Exceptions reach the caller
+    {
+        WorkStealingPool pool(2);
+        bool threw = false;
+        try {
+            pool.ParallelFor(100, 1, [](size_t b, size_t) {
+                if (b == 42) throw std::runtime_error("chunk");
+            });
+        } catch (const std::runtime_error& e) {
+            threw = std::string(e.what()) == "chunk";
+        }
+        expect(threw, "parallel for rethrows");
+        threw = false;
+        try {
+            pool.Run([] { throw std::runtime_error("run"); });
+        } catch (const std::runtime_error& e) {
+            threw = std::string(e.what()) == "run";
+        }
+        expect(threw, "run rethrows");
+    }
+
+    // 4) Work submitted by one worker spreads by stealing; every task runs
+    //    exactly once
+    {
+        WorkStealingPool pool(4);
+        const int n = 8000;
+        std::vector<std::atomic<int>> hits(n);
+        std::atomic<int> done{0};
+        pool.Submit([&] { spread(pool, 0, n, &hits, &done); });
+        wait_for(done, n);
+        bool once = true;
+        for (const std::atomic<int>& h : hits) once = once && h.load() == 1;
+        expect(done.load() == n && once, "each task once");
+
+        const WorkStealingPool::Stats st = pool.stats();
+        uint64_t executed = 0, stolen = 0, stolen_from = 0;
+        for (const WorkStealingPool::WorkerStats& w : st.workers) {
+            executed += w.executed;
+            stolen += w.stolen;
+            stolen_from += w.stolen_from;
+        }
+        std::cout << "executed " << executed << ", stolen " << stolen << "\n";
+        expect(st.workers.size() == 4 && st.nodes >= 1, "stats per worker");
+        expect(stolen == stolen_from, "steals balance");
+        expect(stolen > 0, "work was stolen");
+    }
+
+    // 5) A worker takes high-priority work before low, wherever it is
+    {
+        WorkStealingPool pool(1);
+        std::mutex gate;
+        gate.lock();
+        std::atomic<int> started{0};
+        pool.Submit([&] {
+            started.fetch_add(1);
+            std::lock_guard<std::mutex> hold(gate);
+        });
+        wait_for(started, 1);
+
+        std::mutex order_mu;
+        std::vector<char> order;
+        std::atomic<int> done{0};
+        for (int i = 0; i < 5; ++i) {
+            pool.Submit([&] {
+                std::lock_guard<std::mutex> lock(order_mu);
+                order.push_back('L');
+                done.fetch_add(1);
+            }, TaskPriority::Low);
+        }
+        for (int i = 0; i < 5; ++i) {
+            pool.Submit([&] {
+                std::lock_guard<std::mutex> lock(order_mu);
+                order.push_back('H');
+                done.fetch_add(1);
+            }, TaskPriority::High);
+        }
+        gate.unlock();
+        wait_for(done, 10);
+        expect(std::string(order.begin(), order.end()) == "HHHHHLLLLL", "priority order");
+    }
+
+    // 6) The destructor runs what was already submitted
+    {
+        std::atomic<int> ran{0};
+        {
+            WorkStealingPool pool(2);
+            for (int i = 0; i < 1000; ++i) pool.Submit([&] { ran.fetch_add(1); }, TaskPriority::Low);
+        }
+        expect(ran.load() == 1000, "drained on destruction");
+    }
+
+    std::cout << "All tests passed ✅\n";
+    return 0;
+}